@@ -0,0 +1,147 @@
+/*
+ * Our concurrent bucketed priority structure for delta-stepping.
+ */
+
+#include <stdlib.h>
+
+#include "deltaqueue.h"
+
+#define INITIAL_BUCKET_CAPACITY 16
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Returns the bucket of 'queue' that holds priority 'priority'.
+ */
+DeltaBucket* bucketFor(DeltaQueue* queue, int priority) {
+	return &queue->buckets[(priority / queue->delta) % queue->numBuckets];
+}
+
+/* Appends 'id' to 'bucket', growing it if needed.
+ */
+void bucketPush(DeltaBucket* bucket, int id) {
+	pthread_mutex_lock(&bucket->lock);
+	if (bucket->size == bucket->capacity) {
+		bucket->capacity = bucket->capacity == 0 ? INITIAL_BUCKET_CAPACITY
+		                                         : 2 * bucket->capacity;
+		bucket->ids = realloc(bucket->ids, sizeof(int) * bucket->capacity);
+	}
+	bucket->ids[bucket->size++] = id;
+	pthread_mutex_unlock(&bucket->lock);
+}
+
+/* Lowers the priority of ID 'id' in 'queue' to 'newPriority' if that is
+ * smaller than its current priority, and files 'id' into the matching bucket.
+ * Returns True if the priority was lowered, False otherwise.
+ * Precondition: 0 <= 'id' < queue->capacity
+ *               0 <= 'newPriority'
+ */
+bool deltaDecreasePriority(DeltaQueue* queue, int id, int newPriority) {
+	int old = atomic_load_explicit(&queue->priorities[id], memory_order_relaxed);
+
+	// atomic min: retry until we win or someone else has gone lower
+	do {
+		if (old <= newPriority) return false;
+	} while (!atomic_compare_exchange_weak(&queue->priorities[id], &old,
+	                                       newPriority));
+
+	bucketPush(bucketFor(queue, newPriority), id);
+	return true;
+}
+
+/* Returns the current priority of ID 'id' in 'queue', or DELTA_UNREACHED.
+ */
+int deltaGetPriority(DeltaQueue* queue, int id) {
+	return atomic_load(&queue->priorities[id]);
+}
+
+/* Removes up to 'max' IDs from the current bucket of 'queue' into 'out', and
+ * returns how many were removed, dropping stale and duplicate entries.
+ */
+int deltaPopBucket(DeltaQueue* queue, int* out, int max) {
+	DeltaBucket* bucket = &queue->buckets[queue->current % queue->numBuckets];
+	int count = 0;
+
+	pthread_mutex_lock(&bucket->lock);
+	while (count < max && bucket->size > 0) {
+		int id = bucket->ids[--bucket->size];
+		int priority = atomic_load(&queue->priorities[id]);
+
+		// stale: id has since moved to a lower bucket (or wrapped around)
+		if (priority / queue->delta != queue->current) continue;
+
+		// duplicate: id was filed here twice at this same priority
+		if (atomic_exchange(&queue->popped[id], priority) == priority) continue;
+
+		out[count++] = id;
+	}
+	pthread_mutex_unlock(&bucket->lock);
+
+	return count;
+}
+
+/* Advances 'queue' to the first non-empty bucket at or after the current
+ * one, and returns its number, or -1 if all buckets are empty.
+ */
+int deltaNextBucket(DeltaQueue* queue) {
+	for (int i = 0; i < queue->numBuckets; i++) {
+		DeltaBucket* bucket = &queue->buckets[queue->current % queue->numBuckets];
+
+		// drop stale IDs left behind so an empty bucket really reads as empty
+		int kept = 0;
+		for (int j = 0; j < bucket->size; j++) {
+			int id = bucket->ids[j];
+			int priority = atomic_load(&queue->priorities[id]);
+			if (priority / queue->delta == queue->current &&
+			    atomic_load(&queue->popped[id]) != priority)
+				bucket->ids[kept++] = id;
+		}
+		bucket->size = kept;
+
+		if (bucket->size > 0) return queue->current;
+		queue->current++;
+	}
+	return -1;
+}
+
+/* Returns a newly created queue for IDs 0 <= id < 'capacity', with every ID
+ * unreached, bucket width 'delta' and 'numBuckets' cyclic buckets.
+ * Precondition: capacity >= 0, delta > 0, numBuckets > 0
+ */
+DeltaQueue* newDeltaQueue(int capacity, int delta, int numBuckets) {
+	DeltaQueue* new = malloc(sizeof(DeltaQueue));
+	new->capacity = capacity;
+	new->delta = delta;
+	new->numBuckets = numBuckets;
+	new->current = 0;
+	new->priorities = malloc(sizeof(_Atomic int) * capacity);
+	new->popped = malloc(sizeof(_Atomic int) * capacity);
+	for (int id = 0; id < capacity; id++) {
+		atomic_init(&new->priorities[id], DELTA_UNREACHED);
+		atomic_init(&new->popped[id], DELTA_UNREACHED);
+	}
+
+	new->buckets = malloc(sizeof(DeltaBucket) * numBuckets);
+	for (int b = 0; b < numBuckets; b++) {
+		new->buckets[b].ids = NULL;
+		new->buckets[b].size = 0;
+		new->buckets[b].capacity = 0;
+		pthread_mutex_init(&new->buckets[b].lock, NULL);
+	}
+
+	return new;
+}
+
+/* Frees all memory allocated for 'queue'.
+ */
+void deleteDeltaQueue(DeltaQueue* queue) {
+	for (int b = 0; b < queue->numBuckets; b++) {
+		free(queue->buckets[b].ids);
+		pthread_mutex_destroy(&queue->buckets[b].lock);
+	}
+	free(queue->buckets);
+	free(queue->priorities);
+	free(queue->popped);
+	free(queue);
+}
@@ -0,0 +1,76 @@
+/*
+ * Header file for our concurrent bucketed priority structure, used by
+ * parallel single-source shortest paths (delta-stepping).
+ *
+ * Like MinHeap, every node is identified by a unique ID 0 <= id < capacity,
+ * and the structure keeps an ID-indexed array (here: of priorities, rather
+ * than of heap indices). Priorities only ever decrease, via an atomic min,
+ * so any number of threads may call deltaDecreasePriority concurrently.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#ifndef __DeltaQueue_header
+#define __DeltaQueue_header
+
+#define DELTA_UNREACHED __INT_MAX__  // priority of an ID never decreased
+
+typedef struct delta_bucket {
+  int* ids;              // IDs appended to this bucket; may hold stale IDs
+  int size;              // number of IDs in 'ids'
+  int capacity;          // number of IDs 'ids' can hold before growing
+  pthread_mutex_t lock;  // guards 'ids', 'size' and 'capacity'
+} DeltaBucket;
+
+typedef struct delta_queue {
+  int capacity;               // number of IDs; 0 <= id < capacity
+  int delta;                  // width of the priority range of one bucket
+  int numBuckets;             // number of buckets, reused cyclically
+  int current;                // the (absolute) bucket currently being popped
+  _Atomic int* priorities;    // priorities[id] is the priority of ID id
+  _Atomic int* popped;        // popped[id] is the priority id was last popped at
+  DeltaBucket* buckets;       // buckets[b % numBuckets] holds bucket b
+} DeltaQueue;
+
+/* Lowers the priority of ID 'id' in 'queue' to 'newPriority' if that is
+ * smaller than its current priority, and files 'id' into the matching bucket.
+ * Returns True if the priority was lowered, False otherwise.
+ * Safe to call from many threads at once.
+ * Precondition: 0 <= 'id' < queue->capacity
+ *               0 <= 'newPriority'
+ *               newPriority / delta lies within numBuckets of 'current'
+ */
+bool deltaDecreasePriority(DeltaQueue* queue, int id, int newPriority);
+
+/* Returns the current priority of ID 'id' in 'queue', or DELTA_UNREACHED.
+ * Precondition: 0 <= 'id' < queue->capacity
+ */
+int deltaGetPriority(DeltaQueue* queue, int id);
+
+/* Removes up to 'max' IDs from the current bucket of 'queue' into 'out', and
+ * returns how many were removed. Stale and duplicate entries are dropped, so
+ * every ID returned is due to be processed at its current priority.
+ * Safe to call from many threads at once, also while other threads call
+ * deltaDecreasePriority.
+ */
+int deltaPopBucket(DeltaQueue* queue, int* out, int max);
+
+/* Advances 'queue' to the first non-empty bucket at or after the current
+ * one, and returns its (absolute) number, or -1 if all buckets are empty.
+ * Must not run concurrently with any other operation on 'queue'.
+ */
+int deltaNextBucket(DeltaQueue* queue);
+
+/* Returns a newly created queue for IDs 0 <= id < 'capacity', with every ID
+ * unreached, bucket width 'delta' and 'numBuckets' cyclic buckets.
+ * Precondition: capacity >= 0, delta > 0, numBuckets > 0
+ */
+DeltaQueue* newDeltaQueue(int capacity, int delta, int numBuckets);
+
+/* Frees all memory allocated for 'queue'.
+ */
+void deleteDeltaQueue(DeltaQueue* queue);
+
+#endif
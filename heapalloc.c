@@ -0,0 +1,310 @@
+/*
+ * Our memory allocation backends for arr and indexMap.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "heapalloc.h"
+#include "minheap_internal.h"
+
+#define MPOL_BIND 2	// from <numaif.h>, which would pull in libnuma
+#define MAX_LINE 256
+#define MIN_SIZE_CLASS 6	// 64-byte blocks: one cache line
+#define MAX_BLOCK_ALIGNMENT 4096
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Returns 'bytes' rounded up to a whole number of huge pages.
+ */
+size_t roundToHugePages(size_t bytes) {
+	return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+/* Returns a fresh anonymous mapping of 'bytes' (a multiple of
+ * HUGE_PAGE_SIZE), from the hugetlbfs pool if 'hugetlb' and it has room,
+ * otherwise from ordinary pages advised to become transparent huge pages.
+ * Returns NULL on failure.
+ */
+void* mapHugePages(size_t bytes, bool hugetlb) {
+	void* ptr = MAP_FAILED;
+	if (hugetlb)
+		ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+		           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (ptr != MAP_FAILED) return ptr;
+	
+	// Over-map by one huge page, so the region can start on a huge page
+	// boundary; THP can only back fully aligned 2 MiB ranges
+	size_t padded = bytes + HUGE_PAGE_SIZE;
+	char* raw = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) return NULL;
+	
+	char* aligned = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+	if (aligned > raw) munmap(raw, aligned - raw);
+	munmap(aligned + bytes, raw + padded - (aligned + bytes));
+	madvise(aligned, bytes, MADV_HUGEPAGE);
+	return aligned;
+}
+
+/* Returns True if 'line' of /proc/self/smaps is the header of a mapping,
+ * and stores that mapping's address range in 'start' and 'end'.
+ */
+bool parseMappingHeader(const char* line, uintptr_t* start, uintptr_t* end) {
+	unsigned long first, last;
+	char dash;
+	if (sscanf(line, "%lx%c%lx ", &first, &dash, &last) != 3 || dash != '-') return false;
+	*start = first;
+	*end = last;
+	return true;
+}
+
+/* Returns how many of the bytes in the 'numRanges' disjoint ranges
+ * [firsts[r], lasts[r]) are backed by huge pages, according to
+ * /proc/self/smaps. smaps only gives each mapping's total, so a mapping
+ * counts once, for at most the bytes of it that the ranges cover. Returns 0
+ * if smaps cannot be read.
+ */
+size_t hugePageBytesIn(uintptr_t* firsts, uintptr_t* lasts, int numRanges) {
+	FILE* smaps = fopen("/proc/self/smaps", "r");
+	if (smaps == NULL) return 0;
+	
+	uintptr_t start = 0, end = 0;
+	size_t covered = 0, huge = 0, total = 0;
+	char line[MAX_LINE];
+	
+	while (fgets(line, MAX_LINE, smaps)) {
+		if (parseMappingHeader(line, &start, &end)) {
+			total += huge < covered ? huge : covered;	// the mapping before
+			covered = huge = 0;
+			for (int r = 0; r < numRanges; r++) {
+				uintptr_t from = firsts[r] > start ? firsts[r] : start;
+				uintptr_t to = lasts[r] < end ? lasts[r] : end;
+				if (from < to) covered += to - from;
+			}
+			continue;
+		}
+		if (covered == 0) continue;	// not one of ours
+		
+		size_t kiB;
+		if (sscanf(line, "AnonHugePages: %zu kB", &kiB) == 1 ||
+		    sscanf(line, "Private_Hugetlb: %zu kB", &kiB) == 1 ||
+		    sscanf(line, "Shared_Hugetlb: %zu kB", &kiB) == 1)
+			huge += kiB << 10;
+	}
+	total += huge < covered ? huge : covered;
+	
+	fclose(smaps);
+	return total;
+}
+
+/* Returns the size class of an arena block of 'bytes' bytes: the smallest c
+ * with 2^c >= bytes.
+ */
+int sizeClass(size_t bytes) {
+	int c = MIN_SIZE_CLASS;
+	while (((size_t)1 << c) < bytes) c++;
+	return c;
+}
+
+/* Returns the offset of arr within the arena block of minheap 'heap'; the
+ * header comes first, padded so arr keeps the alignment its layout needs.
+ */
+size_t arenaArrOffset(MinHeap* heap) {
+	size_t alignment = arrAlignment(heap) > CACHE_LINE_SIZE ? arrAlignment(heap) : CACHE_LINE_SIZE;
+	return (sizeof(MinHeap) + alignment - 1) / alignment * alignment;
+}
+
+/* Returns the offset of the payload within the arena block of minheap 'heap':
+ * after indexMap, at the next cache line.
+ */
+size_t arenaPayloadOffset(MinHeap* heap) {
+	size_t end = arenaArrOffset(heap) + sizeof(HeapNode) * heap->arrSlots +
+	             sizeof(int) * heap->capacity;
+	return (end + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+/* Returns 'bytes' of memory from 'allocator', aligned to at least
+ * 'alignment' bytes (0 for the allocator's default), bound to NUMA node
+ * 'numaNode' unless that is -1. Returns NULL on failure.
+ * Precondition: 'alignment' is 0 or a power of two
+ */
+void* heapAlloc(HeapAllocator allocator, size_t bytes, size_t alignment,
+                int numaNode) {
+	void* ptr = NULL;
+	
+	switch (allocator) {
+	case HEAP_ALLOC_MALLOC:
+		// Blocked layouts size arr in whole blocks, as aligned_alloc requires
+		ptr = alignment == 0 ? malloc(bytes) : aligned_alloc(alignment, bytes);
+		break;
+	case HEAP_ALLOC_ALIGNED:
+		if (alignment < CACHE_LINE_SIZE) alignment = CACHE_LINE_SIZE;
+		if (posix_memalign(&ptr, alignment, bytes) != 0) ptr = NULL;
+		break;
+	case HEAP_ALLOC_ARENA:
+		break;	// only through newHeapInArena, which knows the arena
+	case HEAP_ALLOC_MAPPED:
+		break;	// only through loadHeap, which maps a file
+	case HEAP_ALLOC_HUGEPAGES:
+	case HEAP_ALLOC_HUGETLB:
+		if (bytes == 0) return NULL;
+		ptr = mapHugePages(roundToHugePages(bytes), allocator == HEAP_ALLOC_HUGETLB);
+		if (ptr != NULL && numaNode >= 0) {
+			// A region left on the wrong node would fail the caller silently
+			unsigned long nodeMask = 1UL << numaNode;
+			if (syscall(SYS_mbind, ptr, roundToHugePages(bytes), MPOL_BIND, &nodeMask,
+			            sizeof(nodeMask) * 8, 0) != 0) {
+				munmap(ptr, roundToHugePages(bytes));
+				ptr = NULL;
+			}
+		}
+		break;
+	}
+	
+	return ptr;
+}
+
+/* Frees the 'bytes' of memory at 'ptr', which came from heapAlloc with the
+ * same 'allocator' and 'bytes'. Has no effect if 'ptr' is NULL.
+ */
+void heapFree(HeapAllocator allocator, void* ptr, size_t bytes) {
+	if (ptr == NULL) return;
+	
+	if (allocator == HEAP_ALLOC_HUGEPAGES || allocator == HEAP_ALLOC_HUGETLB)
+		munmap(ptr, roundToHugePages(bytes));
+	else if (allocator == HEAP_ALLOC_MAPPED)
+		munmap(ptr, bytes);
+	else if (allocator != HEAP_ALLOC_ARENA)
+		free(ptr);
+}
+
+/* Returns how many of the bytes in [ptr, ptr + bytes) are backed by huge
+ * pages according to /proc/self/smaps, or 0 if smaps cannot be read.
+ */
+size_t hugePageBytes(void* ptr, size_t bytes) {
+	uintptr_t first = (uintptr_t)ptr, last = first + bytes;
+	return hugePageBytesIn(&first, &last, 1);
+}
+
+/* Returns how many bytes of the arr, indexMap and payload of minheap 'heap'
+ * are backed by huge pages, counting a mapping shared by several once.
+ */
+size_t heapHugePageBytes(MinHeap* heap) {
+	// One pass, as arenas and loaded images hold all three in one mapping
+	uintptr_t firsts[] = {(uintptr_t)heap->arr, (uintptr_t)heap->indexMap,
+	                      (uintptr_t)heap->payload};
+	uintptr_t lasts[] = {firsts[0] + sizeof(HeapNode) * heap->arrSlots,
+	                     firsts[1] + sizeof(int) * heap->capacity,
+	                     firsts[2] + heap->payloadSize * heap->capacity};
+	return hugePageBytesIn(firsts, lasts, heap->payload == NULL ? 2 : 3);
+}
+
+/* Returns a new arena over a fresh region of (at least) 'bytes' bytes, or
+ * NULL if the region cannot be mapped or the arena allocated.
+ */
+HeapArena* newHeapArena(size_t bytes) {
+	void* region = mapHugePages(roundToHugePages(bytes), false);
+	if (region == NULL) return NULL;
+	
+	HeapArena* arena = newHeapArenaOver(region, roundToHugePages(bytes));
+	if (arena == NULL) {
+		munmap(region, roundToHugePages(bytes));
+		return NULL;
+	}
+	arena->ownsMemory = true;
+	return arena;
+}
+
+/* Returns a new arena over the caller's 'bytes' bytes at 'memory', or NULL if
+ * the arena cannot be allocated. The caller keeps ownership of 'memory'.
+ */
+HeapArena* newHeapArenaOver(void* memory, size_t bytes) {
+	HeapArena* arena = malloc(sizeof(HeapArena));
+	if (arena == NULL) return NULL;
+	arena->base = memory;
+	arena->bytes = bytes;
+	arena->ownsMemory = false;
+	resetHeapArena(arena);
+	return arena;
+}
+
+/* Returns a newly created empty minheap with capacity 'capacity', configured
+ * by 'options', whose header, arr and indexMap all lie in one block of
+ * 'arena'. Returns NULL if 'arena' is full.
+ * Precondition: capacity >= 0
+ */
+MinHeap* newHeapInArena(HeapArena* arena, int capacity, HeapOptions* options) {
+	MinHeap config;
+	initHeap(&config, capacity, options);
+	config.allocator = HEAP_ALLOC_ARENA;
+	config.arena = arena;
+	
+	char* block = arenaAlloc(arena, arenaBlockBytes(&config));
+	if (block == NULL) return NULL;
+	
+	MinHeap* new = (MinHeap*)block;
+	*new = config;
+	new->arr = (HeapNode*)(block + arenaArrOffset(new));
+	new->indexMap = (int*)(new->arr + new->arrSlots);
+	if (new->payloadSize > 0) new->payload = block + arenaPayloadOffset(new);
+	return new;
+}
+
+/* Returns a block of at least 'bytes' bytes from 'arena', aligned to its
+ * size class (up to 4 KiB), or NULL if 'arena' is full.
+ */
+void* arenaAlloc(HeapArena* arena, size_t bytes) {
+	int c = sizeClass(bytes);
+	if (c >= ARENA_SIZE_CLASSES) return NULL;
+	
+	// Recycle a freed block of this class if there is one
+	void* block = arena->freeLists[c];
+	if (block != NULL) {
+		arena->freeLists[c] = *(void**)block;
+		return block;
+	}
+	
+	size_t size = (size_t)1 << c;
+	size_t alignment = size < MAX_BLOCK_ALIGNMENT ? size : MAX_BLOCK_ALIGNMENT;
+	uintptr_t start = ((uintptr_t)arena->base + arena->used + alignment - 1) & ~(alignment - 1);
+	if (start + size > (uintptr_t)arena->base + arena->bytes) return NULL;
+	
+	arena->used = start + size - (uintptr_t)arena->base;
+	return (void*)start;
+}
+
+/* Returns the block 'block' of 'bytes' bytes, from arenaAlloc, to 'arena'.
+ */
+void arenaFree(HeapArena* arena, void* block, size_t bytes) {
+	int c = sizeClass(bytes);
+	*(void**)block = arena->freeLists[c];
+	arena->freeLists[c] = block;
+}
+
+/* Returns the size of the arena block holding minheap 'heap'.
+ * Precondition: heap->allocator == HEAP_ALLOC_ARENA
+ */
+size_t arenaBlockBytes(MinHeap* heap) {
+	return arenaPayloadOffset(heap) + heap->payloadSize * heap->capacity;
+}
+
+/* Frees every block of 'arena' at once, and with them every heap in it.
+ */
+void resetHeapArena(HeapArena* arena) {
+	arena->used = 0;
+	memset(arena->freeLists, 0, sizeof(arena->freeLists));
+}
+
+/* Frees 'arena', and its region if newHeapArena mapped it.
+ */
+void deleteHeapArena(HeapArena* arena) {
+	if (arena->ownsMemory) munmap(arena->base, arena->bytes);
+	free(arena);
+}
@@ -0,0 +1,102 @@
+/*
+ * Header file for the memory allocation backends of our Priority Queue.
+ * newHeapWithOptions allocates arr and indexMap through these, as chosen by
+ * HeapOptions.allocator; deleteHeap frees them the same way.
+ */
+
+#include <stddef.h>
+
+#include "minheap.h"
+
+#ifndef __HeapAlloc_header
+#define __HeapAlloc_header
+
+#define HUGE_PAGE_SIZE (2UL << 20)  // mmap-based regions are multiples of this
+#define ARENA_SIZE_CLASSES 48       // arena blocks are 2^6 .. 2^47 bytes
+
+/* An arena hands out blocks by bumping a pointer through one region, and
+ * recycles freed blocks through one free list per power-of-two size class.
+ * Both take O(1). An arena is not thread-safe: give each thread its own.
+ */
+typedef struct heap_arena {
+  char* base;    // start of the region blocks are carved from
+  size_t bytes;  // size of that region
+  size_t used;   // bytes of the region handed out so far (by bumping)
+  void* freeLists[ARENA_SIZE_CLASSES];  // freed blocks, linked through
+                                        // their first word, by size class
+  bool ownsMemory;  // whether deleteHeapArena should unmap the region
+} HeapArena;
+
+/* Returns 'bytes' of memory from 'allocator', aligned to at least
+ * 'alignment' bytes (0 for the allocator's default). If 'numaNode' is not -1,
+ * binds mmap-based regions to that NUMA node before they are first touched.
+ * Returns NULL on failure (including a failed binding), or if 'bytes' is 0
+ * for an mmap-based allocator.
+ * Precondition: 'alignment' is 0 or a power of two
+ */
+void* heapAlloc(HeapAllocator allocator, size_t bytes, size_t alignment,
+                int numaNode);
+
+/* Frees the 'bytes' of memory at 'ptr', which came from heapAlloc with
+ * the same 'allocator' and 'bytes' (or, for HEAP_ALLOC_MAPPED, is a whole
+ * mapping made by loadHeap). Has no effect if 'ptr' is NULL.
+ */
+void heapFree(HeapAllocator allocator, void* ptr, size_t bytes);
+
+/* Returns how many of the bytes in [ptr, ptr + bytes) are currently backed
+ * by huge pages (transparent or hugetlbfs), according to /proc/self/smaps.
+ * smaps counts whole mappings, so each mapping counts for at most the bytes
+ * of it in the range. Returns 0 if smaps cannot be read.
+ */
+size_t hugePageBytes(void* ptr, size_t bytes);
+
+/* Returns how many bytes of the arr, indexMap and payload of minheap 'heap'
+ * are currently backed by huge pages, counting a mapping that holds several
+ * of them once. See hugePageBytes.
+ */
+size_t heapHugePageBytes(MinHeap* heap);
+
+/* Returns a new arena over a fresh region of (at least) 'bytes' bytes.
+ * Returns NULL if the region cannot be mapped or the arena allocated.
+ */
+HeapArena* newHeapArena(size_t bytes);
+
+/* Returns a new arena over the caller's 'bytes' bytes at 'memory', which the
+ * caller keeps ownership of and must keep alive until deleteHeapArena.
+ * Returns NULL if the arena cannot be allocated.
+ */
+HeapArena* newHeapArenaOver(void* memory, size_t bytes);
+
+/* Returns a newly created empty minheap with capacity 'capacity', configured
+ * by 'options' (whose allocator is ignored), whose header, arr and indexMap
+ * all lie in one block of 'arena'. Returns NULL if 'arena' is full.
+ * deleteHeap returns the block to 'arena' in O(1).
+ * Precondition: capacity >= 0
+ */
+MinHeap* newHeapInArena(HeapArena* arena, int capacity, HeapOptions* options);
+
+/* Returns a block of at least 'bytes' bytes from 'arena', aligned to its
+ * size class (up to 4 KiB), or NULL if 'arena' is full.
+ */
+void* arenaAlloc(HeapArena* arena, size_t bytes);
+
+/* Returns the block 'block' of 'bytes' bytes, from arenaAlloc, to 'arena'.
+ */
+void arenaFree(HeapArena* arena, void* block, size_t bytes);
+
+/* Returns the size of the arena block holding minheap 'heap'.
+ * Precondition: heap->allocator == HEAP_ALLOC_ARENA
+ */
+size_t arenaBlockBytes(MinHeap* heap);
+
+/* Frees every block of 'arena' at once, so every heap in it is gone. Do not
+ * call deleteHeap on those heaps afterwards.
+ */
+void resetHeapArena(HeapArena* arena);
+
+/* Frees 'arena', and its region if newHeapArena mapped it. Every heap in it
+ * is gone.
+ */
+void deleteHeapArena(HeapArena* arena);
+
+#endif
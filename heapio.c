@@ -0,0 +1,457 @@
+/*
+ * Our input file loading: mapped files, a vectorised integer parser for the
+ * text format, and the binary format. Also our heap images.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "heapio.h"
+#include "minheap_internal.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Returns whether 'c' separates tokens of the text format.
+ */
+bool isSeparator(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/* Returns the value of the run of decimal digits at 'p', at most 'end', and
+ * stores the number of digits in '*length'.
+ */
+uint64_t parseDigitsScalar(const char* p, const char* end, int* length) {
+	uint64_t value = 0;
+	const char* start = p;
+	while (p < end && (unsigned)(*p - '0') < 10)
+		value = value * 10 + (*p++ - '0');
+	*length = p - start;
+	return value;
+}
+
+/* Stores the value of the last 'digits' bytes of the 8 in 'word' (as loaded
+ * from memory, so the last are the most significant) in '*value' and
+ * returns True, if they are all decimal digits; returns False otherwise.
+ * Checks and converts them all at once, within the 64-bit word.
+ * Precondition: 1 <= 'digits' <= 8
+ */
+bool wordValue(uint64_t word, int digits, uint64_t* value) {
+	// The bytes before the digits count as '0's
+	uint64_t keep = ~0ULL << (8 * (8 - digits));
+	word = (word & keep) | (0x3030303030303030 & ~keep);
+	if ((word & 0xf0f0f0f0f0f0f0f0) != 0x3030303030303030 ||
+	    ((word + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) != 0x3030303030303030)
+		return false;
+
+	// Most significant digit in the low byte: fold pairs of digits
+	word -= 0x3030303030303030;
+	word = (word * 10 + (word >> 8)) & 0x00ff00ff00ff00ff;
+	word = (word * 100 + (word >> 16)) & 0x0000ffff0000ffff;
+	*value = (uint32_t)(word * 10000 + (word >> 32));
+	return true;
+}
+
+/* Same as wordValue, but for the 'length' bytes ending just before 'end'.
+ * Precondition: 1 <= 'length' <= 16
+ *               the 16 bytes before 'end' are readable
+ */
+bool digitsValue(const char* end, int length, uint64_t* value) {
+	uint64_t high, low;
+	memcpy(&low, end - 8, 8);
+	if (length <= 8) return wordValue(low, length, value);
+
+	memcpy(&high, end - 16, 8);
+	if (!wordValue(high, length - 8, &high) || !wordValue(low, 8, &low))
+		return false;
+	*value = high * 100000000 + low;
+	return true;
+}
+
+#ifdef __SSE2__
+/* Returns a bitmask of which of the 64 bytes at 'p' are separators,
+ * classifying 16 at a time.
+ */
+uint64_t separatorMask(const char* p) {
+	uint64_t separators = 0;
+	for (int i = 0; i < 64; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i space = _mm_or_si128(
+			_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+			_mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('\t' - 1)),
+			              _mm_cmplt_epi8(bytes, _mm_set1_epi8('\r' + 1))));
+		separators |= (uint64_t)(uint16_t)_mm_movemask_epi8(space) << i;
+	}
+	return separators;
+}
+#endif
+
+/* Parses the token of 'length' bytes at 'p' (an optional sign, then decimal
+ * digits) into '*value', and returns True; returns False if it is not an
+ * integer or is out of the range of an int. Uses digitsValue if the 16 bytes
+ * before the token's end are within the text starting at 'text'.
+ */
+bool parseToken(const char* text, const char* p, int length, int* value) {
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+') {
+		p++;
+		length--;
+	}
+	if (length == 0) return false;
+
+	// Leading zeros aside, an int has at most 10 digits, so the magnitude
+	// below cannot wrap
+	while (length > 1 && *p == '0') {
+		p++;
+		length--;
+	}
+	if (length > 10) return false;
+
+	uint64_t magnitude;
+	if (length <= 16 && p + length - text >= 16) {
+		if (!digitsValue(p + length, length, &magnitude)) return false;
+	} else {
+		int digits;
+		magnitude = parseDigitsScalar(p, p + length, &digits);
+		if (digits != length) return false;
+	}
+	if (magnitude > (negative ? (uint64_t)INT_MAX + 1 : (uint64_t)INT_MAX)) return false;
+	*value = (int)(negative ? -magnitude : magnitude);
+	return true;
+}
+
+/* Maps the whole file at 'path' read-only, and stores its size in '*bytes'.
+ * Returns NULL if it cannot be opened or mapped, or is empty.
+ */
+void* mapInputFile(const char* path, size_t* bytes) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat status;
+	if (fstat(fd, &status) < 0 || status.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping outlives the descriptor
+	if (data == MAP_FAILED) return NULL;
+	madvise(data, status.st_size, MADV_SEQUENTIAL);
+	*bytes = status.st_size;
+	return data;
+}
+
+/* Returns a new minheap of capacity 'capacity', created with 'options' and
+ * holding the 'n' priorities 'priorities'. Returns NULL if 'n' exceeds
+ * 'capacity'.
+ */
+MinHeap* buildFromPriorities(int capacity, int* priorities, long n,
+                             HeapOptions* options) {
+	if (capacity < 0 || n > capacity) return NULL;
+	MinHeap* heap = newHeapWithOptions(capacity, options);
+	if (heap != NULL) buildHeap(heap, priorities, NULL, n);
+	return heap;
+}
+
+/* Returns a new minheap holding the text-format input at 'text' (of 'bytes'
+ * bytes), created with 'options'. Returns NULL if it is malformed.
+ */
+MinHeap* loadText(const char* text, size_t bytes, HeapOptions* options) {
+	int capacity;
+	const char* end = text + bytes;
+	const char* p = text;
+	while (p < end && isSeparator(*p)) p++;
+	const char* rest = p;
+	while (rest < end && !isSeparator(*rest)) rest++;
+	if (parseIntegers(p, rest - p, &capacity, 1) != 1 || capacity < 0) return NULL;
+
+	int* priorities = malloc(sizeof(int) * (capacity > 0 ? capacity : 1));
+	if (priorities == NULL) return NULL;
+	long n = parseIntegers(rest, end - rest, priorities, capacity);
+	MinHeap* heap = n < 0 ? NULL : buildFromPriorities(capacity, priorities, n, options);
+	free(priorities);
+	return heap;
+}
+
+/* Returns 'offset' rounded up to the next multiple of HEAP_IMAGE_ALIGNMENT.
+ */
+uint64_t alignImage(uint64_t offset) {
+	return (offset + HEAP_IMAGE_ALIGNMENT - 1) / HEAP_IMAGE_ALIGNMENT * HEAP_IMAGE_ALIGNMENT;
+}
+
+/* Returns the header of the heap image of minheap 'heap'.
+ */
+HeapImageHeader imageHeader(MinHeap* heap) {
+	HeapImageHeader header = {
+		.magic = HEAP_IMAGE_MAGIC,
+		.version = HEAP_IMAGE_VERSION,
+		.size = heap->size,
+		.capacity = heap->capacity,
+		.layout = heap->layout,
+		.prefetchDistance = heap->prefetchDistance,
+		.bufferSize = heap->bufferSize,
+		.bufferCapacity = heap->bufferCapacity,
+		.bufferMin = heap->bufferMin,
+		.nodeBytes = sizeof(HeapNode),
+		.arrSlots = heap->arrSlots,
+		.payloadSize = heap->payloadSize,
+	};
+	header.arrOffset = alignImage(sizeof(HeapImageHeader));
+	header.indexMapOffset = alignImage(header.arrOffset + sizeof(HeapNode) * heap->arrSlots);
+	header.payloadOffset = alignImage(header.indexMapOffset + sizeof(int) * (uint64_t)heap->capacity);
+	header.bytes = header.payloadOffset + heap->payloadSize * heap->capacity;
+	return header;
+}
+
+/* Returns whether 'header' describes a heap image of this version that is
+ * consistent with itself and with a file of 'bytes' bytes.
+ */
+bool isValidImage(HeapImageHeader* header, size_t bytes) {
+	if (header->magic != HEAP_IMAGE_MAGIC || header->version != HEAP_IMAGE_VERSION ||
+	    header->nodeBytes != sizeof(HeapNode) || header->bytes != bytes ||
+	    header->capacity < 0 || header->size < 0 || header->bufferSize < 0 ||
+	    (int64_t)header->size + header->bufferSize > header->capacity ||
+	    header->bufferSize > header->bufferCapacity ||
+	    (header->bufferSize > 0 && (header->bufferMin <= header->size ||
+	                                header->bufferMin > header->size + header->bufferSize)) ||
+	    (header->bufferSize == 0 && header->bufferMin != NOTHING) ||
+	    header->prefetchDistance < 0 || header->prefetchDistance > MAX_PREFETCH_DISTANCE ||
+	    header->layout < HEAP_LAYOUT_IMPLICIT || header->layout > HEAP_LAYOUT_PAGES)
+		return false;
+
+	// The payload section must not wrap the sizes computed from it below
+	size_t payloadBytes, totalBytes;
+	if (header->payloadSize > SIZE_MAX ||
+	    __builtin_mul_overflow((size_t)header->payloadSize, (size_t)header->capacity, &payloadBytes) ||
+	    __builtin_add_overflow((size_t)header->payloadOffset, payloadBytes, &totalBytes))
+		return false;
+
+	// The layout of the sections must be the one saveHeap would write
+	MinHeap shape;
+	HeapOptions options = {.layout = header->layout, .payloadSize = header->payloadSize};
+	initHeap(&shape, header->capacity, &options);
+	HeapImageHeader expected = imageHeader(&shape);
+	return header->arrSlots == expected.arrSlots &&
+	       header->arrOffset == expected.arrOffset &&
+	       header->indexMapOffset == expected.indexMapOffset &&
+	       header->payloadOffset == expected.payloadOffset &&
+	       header->bytes == expected.bytes;
+}
+
+/* Syncs the directory holding the file at 'path', and returns True. Returns
+ * False on error.
+ */
+bool syncParentDirectory(const char* path) {
+	char directory[strlen(path) + sizeof(".")];
+	strcpy(directory, path);
+	char* slash = strrchr(directory, '/');
+	if (slash == NULL) strcpy(directory, ".");
+	else if (slash == directory) slash[1] = '\0';	// the root
+	else *slash = '\0';
+
+	int fd = open(directory, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) return false;
+	bool synced = fsync(fd) == 0;
+	return close(fd) == 0 && synced;
+}
+
+/* Writes the 'bytes' bytes at 'data' to 'fd' at offset 'offset', retrying
+ * short writes, and returns True. Returns False on error.
+ */
+bool writeAllAt(int fd, const void* data, size_t bytes, uint64_t offset) {
+	const char* next = data;
+	while (bytes > 0) {
+		ssize_t written = pwrite(fd, next, bytes, offset);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		next += written;
+		offset += written;
+		bytes -= written;
+	}
+	return true;
+}
+
+/* Returns the FNV-1a hash of the 'bytes' bytes at 'data'.
+ */
+uint64_t fnv1a(const unsigned char* data, size_t bytes) {
+	uint64_t hash = FNV_OFFSET;
+	for (size_t i = 0; i < bytes; i++) hash = (hash ^ data[i]) * FNV_PRIME;
+	return hash;
+}
+
+/* Parses the whitespace-separated decimal integers among the 'bytes' bytes
+ * at 'text' into 'out', and returns how many there were. Returns -1 if a
+ * token is not an integer or there are more than 'maxCount'.
+ */
+long parseIntegers(const char* text, size_t bytes, int* out, long maxCount) {
+	const char* end = text + bytes;
+	const char* p = text;
+	long count = 0;
+
+#ifdef __SSE2__
+	// Whole 64-byte blocks, each starting at a token or a separator: find
+	// every token from the block's bitmasks, without scanning byte by byte
+	while (end - p >= 64) {
+		uint64_t separators = separatorMask(p);
+		uint64_t starts = ~separators & (separators << 1 | 1);
+		int next = 64;
+		while (starts != 0) {
+			int first = __builtin_ctzll(starts);
+			uint64_t after = separators >> first;
+			if (after == 0 && first > 0) {	// the token runs past the block
+				next = first;
+				break;
+			}
+			int length = after == 0 ? 64 : __builtin_ctzll(after);
+			if (after == 0) {	// a token of 64 bytes or more, surely malformed
+				while (first + length < end - p && !isSeparator(p[first + length]))
+					length++;
+				next = first + length;
+			}
+
+			if (count == maxCount || !parseToken(text, p + first, length, &out[count]))
+				return -1;
+			count++;
+			starts &= starts - 1;
+		}
+		p += next;
+	}
+#endif
+
+	while (true) {
+		while (p < end && isSeparator(*p)) p++;
+		if (p == end) return count;
+
+		const char* token = p;
+		while (p < end && !isSeparator(*p)) p++;
+		if (count == maxCount || !parseToken(text, token, p - token, &out[count]))
+			return -1;
+		count++;
+	}
+}
+
+/* Returns a new minheap, created with 'options' (may be NULL) and holding
+ * the priorities of the input file at 'path'. Returns NULL if the file cannot
+ * be read, is malformed, or holds more priorities than its capacity.
+ */
+MinHeap* loadHeapFromFile(const char* path, HeapOptions* options) {
+	size_t bytes;
+	const char* data = mapInputFile(path, &bytes);
+	if (data == NULL) return NULL;
+
+	MinHeap* heap;
+	HeapInputHeader header;
+	if (bytes >= sizeof(header)) memcpy(&header, data, sizeof(header));
+	if (bytes >= sizeof(header) && header.magic == HEAP_INPUT_MAGIC) {
+		// Binary: buildHeap reads the priorities straight from the mapping
+		bool valid = header.version == HEAP_INPUT_VERSION && header.count >= 0 &&
+		             (bytes - sizeof(header)) / sizeof(int) >= (size_t)header.count;
+		heap = valid ? buildFromPriorities(header.capacity,
+		                                   (int*)(data + sizeof(header)),
+		                                   header.count, options)
+		             : NULL;
+	} else {
+		heap = loadText(data, bytes, options);
+	}
+
+	munmap((void*)data, bytes);
+	return heap;
+}
+
+/* Writes minheap 'heap' as a heap image at 'path', and returns True. Returns
+ * False, leaving any image already at 'path' as it was, if it cannot be
+ * written.
+ */
+bool saveHeap(MinHeap* heap, const char* path) {
+	char temporary[strlen(path) + sizeof(".tmp")];
+	sprintf(temporary, "%s.tmp", path);
+	int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	// Sections go straight from the heap to the file; padding becomes holes
+	HeapImageHeader header = imageHeader(heap);
+	bool written =
+		writeAllAt(fd, &header, sizeof(header), 0) &&
+		writeAllAt(fd, heap->arr, sizeof(HeapNode) * heap->arrSlots, header.arrOffset) &&
+		writeAllAt(fd, heap->indexMap, sizeof(int) * (size_t)heap->capacity,
+		           header.indexMapOffset) &&
+		writeAllAt(fd, heap->payload, heap->payloadSize * heap->capacity,
+		           header.payloadOffset) &&
+		ftruncate(fd, header.bytes) == 0 && fsync(fd) == 0;
+	written = close(fd) == 0 && written;
+
+	if (!written || rename(temporary, path) != 0) {
+		unlink(temporary);
+		return false;
+	}
+	return syncParentDirectory(path);	// or the rename may not survive a crash
+}
+
+/* Returns a minheap restored from the heap image at 'path', mapped in 'mode',
+ * or NULL if it cannot be mapped or is not a valid image of this version.
+ */
+MinHeap* loadHeap(const char* path, HeapImageMode mode) {
+	int fd = open(path, O_RDONLY);	// enough even to map copy-on-write
+	if (fd < 0) return NULL;
+
+	struct stat status;
+	HeapImageHeader header;
+	if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(header) ||
+	    pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+	    !isValidImage(&header, status.st_size)) {
+		close(fd);
+		return NULL;
+	}
+	char* mapping = mmap(NULL, header.bytes,
+	                     mode == HEAP_IMAGE_READONLY ? PROT_READ : PROT_READ | PROT_WRITE,
+	                     mode == HEAP_IMAGE_READONLY ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping outlives the descriptor
+	if (mapping == MAP_FAILED) return NULL;
+
+	MinHeap* heap = malloc(sizeof(MinHeap));
+	HeapOptions options = {
+		.insertBufferCapacity = header.bufferCapacity,
+		.layout = header.layout,
+		.prefetchDistance = header.prefetchDistance,
+		.allocator = HEAP_ALLOC_MAPPED,
+		.payloadSize = header.payloadSize,
+	};
+	initHeap(heap, header.capacity, &options);
+	heap->size = header.size;
+	heap->bufferSize = header.bufferSize;
+	heap->bufferMin = header.bufferMin;
+	heap->mapping = mapping;
+	heap->mappingBytes = header.bytes;
+	heap->arr = (HeapNode*)(mapping + header.arrOffset);
+	heap->indexMap = (int*)(mapping + header.indexMapOffset);
+	if (header.payloadSize > 0) heap->payload = mapping + header.payloadOffset;
+	return heap;
+}
+
+/* Writes 'capacity' and the 'n' priorities 'priorities' as a binary input
+ * file at 'path', and returns True. Returns False if it cannot be written.
+ */
+bool writeHeapInput(const char* path, int capacity, const int* priorities,
+                    int n) {
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) return false;
+
+	HeapInputHeader header = {HEAP_INPUT_MAGIC, HEAP_INPUT_VERSION, capacity, n};
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+	               fwrite(priorities, sizeof(int), n, f) == (size_t)n;
+	return fclose(f) == 0 && written;
+}
@@ -0,0 +1,113 @@
+/*
+ * Header file for loading our Priority Queue from input files, and for
+ * saving it to and restoring it from heap images.
+ *
+ * Two input formats are read, told apart by their first four bytes:
+ *  - text: the capacity, then the priorities, as decimal integers separated
+ *    by whitespace (one per line in practice, like sample_input.txt);
+ *  - binary: a HeapInputHeader, then 'count' native int32 priorities.
+ * Either way, the file is mapped rather than read, and the priorities get
+ * IDs 0, 1, ... in file order and are heapified in one buildHeap.
+ *
+ * A heap image is a HeapImageHeader, then arr, indexMap and the payload (if
+ * any) exactly as they are in memory, each starting on a page boundary. So
+ * loadHeap maps an image and uses it in place, without rebuilding anything:
+ * pages are read in from the file as the heap first touches them.
+ */
+
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __HeapIO_header
+#define __HeapIO_header
+
+#define HEAP_INPUT_MAGIC 0x4e49484d  // "MHIN", little-endian
+#define HEAP_INPUT_VERSION 1
+#define HEAP_IMAGE_MAGIC 0x4d49484d  // "MHIM", little-endian
+#define HEAP_IMAGE_VERSION 1
+#define HEAP_IMAGE_ALIGNMENT 4096    // sections start on page boundaries
+
+typedef struct heap_input_header {
+  uint32_t magic;    // HEAP_INPUT_MAGIC
+  uint32_t version;  // HEAP_INPUT_VERSION
+  int32_t capacity;  // capacity of the heap to create
+  int32_t count;     // number of priorities that follow
+} HeapInputHeader;
+
+typedef struct heap_image_header {
+  uint32_t magic;            // HEAP_IMAGE_MAGIC
+  uint32_t version;          // HEAP_IMAGE_VERSION
+  int32_t size;              // the MinHeap fields of the same names
+  int32_t capacity;
+  int32_t layout;
+  int32_t prefetchDistance;
+  int32_t bufferSize;
+  int32_t bufferCapacity;
+  int32_t bufferMin;
+  int32_t nodeBytes;         // sizeof(HeapNode), to refuse foreign images
+  int64_t arrSlots;
+  uint64_t payloadSize;
+  uint64_t arrOffset;        // where each section starts in the file
+  uint64_t indexMapOffset;
+  uint64_t payloadOffset;
+  uint64_t bytes;            // size of the whole file
+} HeapImageHeader;
+
+typedef enum heap_image_mode {
+  HEAP_IMAGE_PRIVATE,  // copy-on-write: the heap works as usual, and its
+                       // changes are never written back to the image
+  HEAP_IMAGE_READONLY  // shared and read-only: only operations that do not
+                       // change the heap (getMin, getPriority, numNodes,
+                       // printHeap, ...) may be used
+} HeapImageMode;
+
+/* Returns a new minheap, created with 'options' (may be NULL) and holding
+ * the priorities of the input file at 'path', in either format. Returns NULL
+ * if the file cannot be read, is malformed, or holds more priorities than
+ * its capacity.
+ */
+MinHeap* loadHeapFromFile(const char* path, HeapOptions* options);
+
+/* Writes minheap 'heap' as a heap image at 'path', and returns True.
+ * Returns False, leaving any image already at 'path' as it was, if it cannot
+ * be written: the image is written beside it, synced, then renamed over it,
+ * and the directory is synced. (If only that last sync fails, the image may
+ * be in place, but not durably.)
+ */
+bool saveHeap(MinHeap* heap, const char* path);
+
+/* Returns a minheap restored from the heap image at 'path', mapped in 'mode'.
+ * Returns NULL if it cannot be mapped or is not a valid image of this
+ * version. deleteHeap unmaps it.
+ */
+MinHeap* loadHeap(const char* path, HeapImageMode mode);
+
+/* Writes 'capacity' and the 'n' priorities 'priorities' as a binary input
+ * file at 'path', and returns True. Returns False if it cannot be written.
+ */
+bool writeHeapInput(const char* path, int capacity, const int* priorities,
+                    int n);
+
+/* Parses the whitespace-separated decimal integers among the 'bytes' bytes
+ * at 'text' into 'out', and returns how many there were. Returns -1 if a
+ * token is not an integer or there are more than 'maxCount'.
+ */
+long parseIntegers(const char* text, size_t bytes, int* out, long maxCount);
+
+/* Syncs the directory holding the file at 'path', so that a file created or
+ * renamed there survives a crash, and returns True. Returns False on error.
+ */
+bool syncParentDirectory(const char* path);
+
+/* Writes the 'bytes' bytes at 'data' to file descriptor 'fd' at offset
+ * 'offset', retrying short writes, and returns True. Returns False on error.
+ */
+bool writeAllAt(int fd, const void* data, size_t bytes, uint64_t offset);
+
+/* Returns the FNV-1a hash of the 'bytes' bytes at 'data', which the log
+ * formats built on heap images use as their checksum.
+ */
+uint64_t fnv1a(const unsigned char* data, size_t bytes);
+
+#endif
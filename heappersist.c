@@ -0,0 +1,322 @@
+/*
+ * Our persistent heap: a copy-on-write mapping of a heap image, kept
+ * crash-consistent with a redo log of group commits.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "heappersist.h"
+#include "minheap_internal.h"
+
+#define INITIAL_RECORD_BYTES 4096
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Appends the 'bytes' bytes at 'data' to file descriptor 'fd', retrying
+ * short writes. Returns False on error.
+ */
+bool writeFully(int fd, const unsigned char* data, size_t bytes) {
+	while (bytes > 0) {
+		ssize_t written = write(fd, data, bytes);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		data += written;
+		bytes -= written;
+	}
+	return true;
+}
+
+/* Appends to the record of 'p' a write of the 'bytes' bytes at 'data' to
+ * offset 'offset' of the image.
+ */
+void appendWrite(PersistentHeap* p, size_t* length, uint64_t offset,
+                 const void* data, size_t bytes) {
+	size_t needed = *length + sizeof(HeapLogWrite) + bytes;
+	if (needed > p->recordCapacity) {
+		while (needed > p->recordCapacity) p->recordCapacity *= 2;
+		p->record = realloc(p->record, p->recordCapacity);
+	}
+
+	HeapLogWrite write = {offset, bytes};
+	memcpy(p->record + *length, &write, sizeof(write));
+	memcpy(p->record + *length + sizeof(write), data, bytes);
+	*length = needed;
+	((HeapLogRecord*)p->record)->numWrites++;
+}
+
+/* Appends to the record of 'p' the current contents of the elements in
+ * dirty set 'set' of the array at 'base' (of elements of 'size' bytes),
+ * which the image holds at offset 'offset'. Runs of adjacent elements become
+ * one write each, in file order.
+ */
+void appendDirty(PersistentHeap* p, size_t* length, HeapDirtySet* set,
+                 const char* base, size_t size, uint64_t offset) {
+	qsort(set->words, set->numWords, sizeof(long), compareWords);
+
+	long runStart = -1, runEnd = -1;	// the run being gathered: [start, end)
+	for (long w = 0; w < set->numWords; w++) {
+		uint64_t bits = set->bits[set->words[w]];
+		while (bits != 0) {
+			long i = set->words[w] * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			if (i == runEnd) {
+				runEnd++;
+				continue;
+			}
+			if (runStart >= 0)
+				appendWrite(p, length, offset + runStart * size, base + runStart * size,
+				            (runEnd - runStart) * size);
+			runStart = i;
+			runEnd = i + 1;
+		}
+	}
+	if (runStart >= 0)
+		appendWrite(p, length, offset + runStart * size, base + runStart * size,
+		            (runEnd - runStart) * size);
+}
+
+/* Copies the writes of the record at 'record' into the mapped 'image'.
+ */
+void applyRecord(unsigned char* image, const unsigned char* record) {
+	HeapLogRecord header;
+	memcpy(&header, record, sizeof(header));
+
+	size_t pos = sizeof(header);
+	for (uint32_t i = 0; i < header.numWrites; i++) {
+		HeapLogWrite write;
+		memcpy(&write, record + pos, sizeof(write));
+		pos += sizeof(write);
+		memcpy(image + write.offset, record + pos, write.bytes);
+		pos += write.bytes;
+	}
+}
+
+/* Returns whether the 'available' bytes at 'record' start with a complete,
+ * intact record that follows the one numbered 'sequence', for an image of
+ * 'imageBytes' bytes.
+ */
+bool isValidRecord(const unsigned char* record, size_t available, uint64_t sequence,
+                   size_t imageBytes) {
+	HeapLogRecord header;
+	if (available < sizeof(header)) return false;
+	memcpy(&header, record, sizeof(header));
+	if (header.magic != HEAP_LOG_MAGIC || header.bytes < sizeof(header) ||
+	    header.bytes > available || (sequence != 0 && header.sequence != sequence + 1))
+		return false;
+
+	// Writes must stay within the record and the image (checksums collide)
+	size_t pos = sizeof(header);
+	for (uint32_t i = 0; i < header.numWrites; i++) {
+		HeapLogWrite write;
+		if (header.bytes - pos < sizeof(write)) return false;
+		memcpy(&write, record + pos, sizeof(write));
+		pos += sizeof(write);
+		if (header.bytes - pos < write.bytes || write.offset > imageBytes ||
+		    imageBytes - write.offset < write.bytes)
+			return false;
+		pos += write.bytes;
+	}
+	return pos == header.bytes &&
+	       header.checksum == fnv1a(record + sizeof(header), header.bytes - sizeof(header));
+}
+
+/* Re-applies every intact record of the redo log 'logFd' to the mapped
+ * 'image' of 'imageBytes' bytes, syncs the image, and empties the log.
+ * Stores the sequence number of the last record in '*sequence'. Returns
+ * False on error.
+ */
+bool recover(unsigned char* image, size_t imageBytes, int logFd, uint64_t* sequence) {
+	struct stat status;
+	if (fstat(logFd, &status) < 0) return false;
+	*sequence = 0;
+	if (status.st_size == 0) return true;
+
+	const unsigned char* log = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, logFd, 0);
+	if (log == MAP_FAILED) return false;
+	size_t pos = 0;
+	while (isValidRecord(log + pos, status.st_size - pos, *sequence, imageBytes)) {
+		HeapLogRecord record;
+		memcpy(&record, log + pos, sizeof(record));	// records are not aligned
+		applyRecord(image, log + pos);
+		*sequence = record.sequence;
+		pos += record.bytes;
+	}
+	munmap((void*)log, status.st_size);
+
+	// Anything after the last intact record was never committed
+	return msync(image, imageBytes, MS_SYNC) == 0 && ftruncate(logFd, 0) == 0 &&
+	       fsync(logFd) == 0;
+}
+
+/* Counts one operation on the heap of 'p', and commits if that makes
+ * p->commitInterval of them. Returns False if that commit failed.
+ */
+bool countOperation(PersistentHeap* p) {
+	if (p->commitInterval > 0 && ++p->uncommitted >= p->commitInterval)
+		return commitPersistentHeap(p);
+	return true;
+}
+
+/* Opens the persistent heap whose image is at 'path', after recovering it
+ * from its redo log, or creates an empty one of capacity 'capacity' if there
+ * is no image. Returns NULL if the files cannot be created, read or mapped.
+ */
+PersistentHeap* openPersistentHeap(const char* path, int capacity,
+                                   HeapOptions* options, int commitInterval) {
+	// A new heap starts as the image of an empty heap
+	if (access(path, F_OK) != 0) {
+		HeapOptions creation = options == NULL ? (HeapOptions){0} : *options;
+		creation.allocator = HEAP_ALLOC_MALLOC;
+		MinHeap* empty = newHeapWithOptions(capacity, &creation);
+		bool saved = saveHeap(empty, path);
+		deleteHeap(empty);
+		if (!saved) return NULL;
+	}
+
+	char logPath[strlen(path) + sizeof(".log")];
+	strcpy(logPath, path);
+	strcat(logPath, ".log");
+	int imageFd = open(path, O_RDWR);
+	int logFd = open(logPath, O_RDWR | O_CREAT | O_APPEND, 0644);
+	struct stat status;
+	unsigned char* image = MAP_FAILED;
+	if (imageFd >= 0 && fstat(imageFd, &status) == 0 && status.st_size > 0)
+		image = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, imageFd, 0);
+	if (imageFd >= 0) close(imageFd);	// the mapping outlives the descriptor
+
+	uint64_t sequence;
+	MinHeap* heap = NULL;
+	if (image != MAP_FAILED && logFd >= 0 && recover(image, status.st_size, logFd, &sequence))
+		heap = loadHeap(path, HEAP_IMAGE_PRIVATE);
+	if (heap == NULL) {
+		if (image != MAP_FAILED) munmap(image, status.st_size);
+		if (logFd >= 0) close(logFd);
+		return NULL;
+	}
+
+	PersistentHeap* p = malloc(sizeof(PersistentHeap));
+	p->heap = heap;
+	memcpy(&p->header, (char*)heap->mapping, sizeof(HeapImageHeader));
+	p->image = image;
+	p->imageBytes = status.st_size;
+	p->logFd = logFd;
+	p->logBytes = 0;
+	p->sequence = sequence;
+	p->commitInterval = commitInterval;
+	p->uncommitted = 0;
+	p->recordCapacity = INITIAL_RECORD_BYTES;
+	p->record = malloc(p->recordCapacity);
+	p->commits = 0;
+	p->bytesLogged = 0;
+	startTrackingWrites(heap);
+	return p;
+}
+
+/* Makes every change to the heap of 'p' so far durable, and returns True.
+ * Returns False if the log cannot be written (the changes are then kept for
+ * the next commit) or, after a checkpoint, cannot be synced.
+ */
+bool commitPersistentHeap(PersistentHeap* p) {
+	MinHeap* heap = p->heap;
+	HeapDirty* dirty = heap->dirty;
+	p->uncommitted = 0;
+	if (dirty->slots.numWords == 0 && dirty->ids.numWords == 0 &&
+	    dirty->payloads.numWords == 0 && heap->size == p->header.size &&
+	    heap->bufferSize == p->header.bufferSize)
+		return true;	// nothing changed
+
+	// The header fields that change, from size to bufferMin, then the data
+	HeapLogRecord* record = (HeapLogRecord*)p->record;
+	record->numWrites = 0;
+	size_t length = sizeof(HeapLogRecord);
+	p->header.size = heap->size;
+	p->header.bufferSize = heap->bufferSize;
+	p->header.bufferMin = heap->bufferMin;
+	size_t first = offsetof(HeapImageHeader, size);
+	size_t last = offsetof(HeapImageHeader, bufferMin) + sizeof(int32_t);
+	appendWrite(p, &length, first, (char*)&p->header + first, last - first);
+	appendDirty(p, &length, &dirty->slots, (char*)heap->arr, sizeof(HeapNode),
+	            p->header.arrOffset);
+	appendDirty(p, &length, &dirty->ids, (char*)heap->indexMap, sizeof(int),
+	            p->header.indexMapOffset);
+	appendDirty(p, &length, &dirty->payloads, heap->payload, heap->payloadSize,
+	            p->header.payloadOffset);
+
+	record = (HeapLogRecord*)p->record;	// appendWrite may have moved it
+	record->magic = HEAP_LOG_MAGIC;
+	record->bytes = length;
+	record->sequence = p->sequence + 1;
+	record->checksum = fnv1a(p->record + sizeof(HeapLogRecord), length - sizeof(HeapLogRecord));
+
+	// The commit point: once the log is synced, recovery will redo the record
+	if (!writeFully(p->logFd, p->record, length) || fdatasync(p->logFd) != 0) {
+		// Drop whatever part made it; the writes stay dirty for the next try
+		ftruncate(p->logFd, p->logBytes);
+		return false;
+	}
+	clearDirtySet(&dirty->slots);
+	clearDirtySet(&dirty->ids);
+	clearDirtySet(&dirty->payloads);
+	p->sequence++;
+	p->logBytes += length;
+	p->bytesLogged += length;
+	p->commits++;
+
+	// The image catches up lazily; a crash before it does is redone from the log
+	applyRecord(p->image, p->record);
+	if (p->logBytes >= HEAP_LOG_CHECKPOINT_BYTES &&
+	    msync(p->image, p->imageBytes, MS_SYNC) == 0 && ftruncate(p->logFd, 0) == 0) {
+		p->logBytes = 0;
+		return fsync(p->logFd) == 0;	// or the emptied log may not survive a crash
+	}
+	return true;
+}
+
+/* Same as insert on the heap of 'p', counting towards its next automatic
+ * commit. Returns what that commit returned, if it made one, and True
+ * otherwise.
+ */
+bool persistentInsert(PersistentHeap* p, int priority, int id) {
+	insert(p->heap, priority, id);
+	return countOperation(p);
+}
+
+/* Same as extractMin on the heap of 'p', storing the node in '*min'.
+ * Returns as persistentInsert does.
+ */
+bool persistentExtractMin(PersistentHeap* p, HeapNode* min) {
+	*min = extractMin(p->heap);
+	return countOperation(p);
+}
+
+/* Same as decreasePriority on the heap of 'p', storing whether it took effect
+ * in '*decreased' unless NULL. Returns as persistentInsert does.
+ */
+bool persistentDecreasePriority(PersistentHeap* p, int id, int newPriority,
+                                bool* decreased) {
+	bool changed = decreasePriority(p->heap, id, newPriority);
+	if (decreased != NULL) *decreased = changed;
+	return countOperation(p);
+}
+
+/* Commits the heap of 'p', syncs its image, empties its log, and closes and
+ * frees it. Returns False if the final commit or sync failed.
+ */
+bool closePersistentHeap(PersistentHeap* p) {
+	bool closed = commitPersistentHeap(p) && msync(p->image, p->imageBytes, MS_SYNC) == 0 &&
+	              ftruncate(p->logFd, 0) == 0 && fsync(p->logFd) == 0;
+	deleteHeap(p->heap);
+	munmap(p->image, p->imageBytes);
+	close(p->logFd);
+	free(p->record);
+	free(p);
+	return closed;
+}
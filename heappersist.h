@@ -0,0 +1,99 @@
+/*
+ * Header file for our persistent Priority Queue: a heap that lives in a heap
+ * image file (see heapio.h) and survives crashes, for durable job queues.
+ *
+ * The heap runs on a copy-on-write mapping of its image, so nothing it
+ * writes reaches the file by itself. Instead, every write to arr, indexMap
+ * and payload (through setPayload) is tracked, and a group commit appends
+ * the new contents of everything written since the last commit to a redo
+ * log ('path' + ".log") as one checksummed record, syncs the log, and only
+ * then copies the same bytes into a shared mapping of the image. The sync of
+ * the log is the commit point. The image itself is only synced (msync) when
+ * the log grows past HEAP_LOG_CHECKPOINT_BYTES, after which the log starts
+ * over.
+ *
+ * After a crash, openPersistentHeap re-applies every complete record of the
+ * log to the image, so the heap is exactly as of the last commit. A record
+ * torn by the crash fails its checksum and is dropped, with everything done
+ * since the commit before it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "heapio.h"
+#include "minheap.h"
+
+#ifndef __HeapPersist_header
+#define __HeapPersist_header
+
+#define HEAP_LOG_MAGIC 0x4c52484d  // "MHRL", little-endian
+#define HEAP_LOG_CHECKPOINT_BYTES (64L << 20)
+
+typedef struct heap_log_record {
+  uint32_t magic;      // HEAP_LOG_MAGIC
+  uint32_t numWrites;  // the writes that follow, each a HeapLogWrite and
+                       // then the 'bytes' bytes to write
+  uint64_t bytes;      // size of this record, header included
+  uint64_t sequence;   // 1 for the first commit, then counting up
+  uint64_t checksum;   // FNV-1a of the rest of the record
+} HeapLogRecord;
+
+typedef struct heap_log_write {
+  uint64_t offset;  // where in the image file to write
+  uint64_t bytes;   // how many bytes
+} HeapLogWrite;
+
+typedef struct persistent_heap {
+  MinHeap* heap;            // the heap itself; read it freely, and change it
+                            // through the functions below or setPayload
+  HeapImageHeader header;   // the header of the image, kept up to date
+  unsigned char* image;     // the image file, mapped shared
+  size_t imageBytes;        // its size
+  int logFd;                // the redo log
+  size_t logBytes;          // size of the redo log
+  uint64_t sequence;        // of the last record committed
+  int commitInterval;       // operations per automatic commit; 0 for none
+  int uncommitted;          // operations since the last commit
+  unsigned char* record;    // the record being built by a commit
+  size_t recordCapacity;    // bytes allocated for it
+  long commits;             // group commits made since opening
+  long bytesLogged;         // bytes appended to the log since opening
+} PersistentHeap;
+
+/* Opens the persistent heap whose image is at 'path', after recovering it
+ * from its redo log. If there is no image at 'path', creates an empty heap
+ * of capacity 'capacity', configured by 'options' (may be NULL; its
+ * allocator is ignored). Commits automatically after every 'commitInterval'
+ * operations (0 for only when told to). Returns NULL if the files cannot be
+ * created, read or mapped.
+ */
+PersistentHeap* openPersistentHeap(const char* path, int capacity,
+                                   HeapOptions* options, int commitInterval);
+
+/* Makes every change to the heap of 'p' so far durable: after this returns
+ * True, a crash no longer loses them. Returns False if the log cannot be
+ * written; the changes are then kept for the next commit. Also returns
+ * False if the log, emptied by a checkpoint after the commit, cannot be
+ * synced; the changes are durable even so.
+ */
+bool commitPersistentHeap(PersistentHeap* p);
+
+/* Same as insert, extractMin (storing the node in '*min') and
+ * decreasePriority (storing whether it took effect in '*decreased', unless
+ * NULL) on the heap of 'p', with the same preconditions, counting towards
+ * its next automatic commit. Return what that commit returned, if the
+ * operation made one, and True otherwise: the operation takes effect
+ * either way, and a failed commit leaves it for the next.
+ */
+bool persistentInsert(PersistentHeap* p, int priority, int id);
+bool persistentExtractMin(PersistentHeap* p, HeapNode* min);
+bool persistentDecreasePriority(PersistentHeap* p, int id, int newPriority,
+                                bool* decreased);
+
+/* Commits the heap of 'p', syncs its image, empties its log, and closes and
+ * frees it. Returns False if the final commit or sync failed.
+ */
+bool closePersistentHeap(PersistentHeap* p);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Header file for the protocol of our Priority Queue server (see
+ * minheap_server.c and minheap_loadgen.c), which serves heaps to local
+ * processes over a Unix domain stream socket.
+ *
+ * A client sends request frames: a HeapRequest, then 'count' HeapNodes for
+ * the operations that take them. The server answers every request, in
+ * order, with a response frame: a HeapResponse, then 'count' HeapNodes for
+ * HEAP_OP_EXTRACT_MIN. A malformed request makes the server close the
+ * connection instead. Requests are pipelined: a client may send many before
+ * reading any answer, and the server handles every complete frame it has
+ * read before writing all of their answers at once; it holds frames back,
+ * without reading more, while a client leaves over a megabyte of answers
+ * unread. So a batch of 'count' nodes, 'depth' frames deep, costs the server
+ * about one read and one write per count * depth operations, where
+ * request/response costs two syscalls per operation.
+ *
+ * All fields are in native byte order: the socket is local.
+ */
+
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __HeapServer_header
+#define __HeapServer_header
+
+#define HEAP_SERVER_MAX_QUEUES 256
+#define HEAP_SERVER_MAX_CAPACITY (1 << 24)  // nodes per queue, at most
+#define HEAP_SERVER_MAX_BATCH 4096   // nodes per frame, at most
+
+typedef enum heap_server_op {
+  HEAP_OP_CREATE = 1,     // (re)create queue 'queue' of capacity 'arg'
+  HEAP_OP_INSERT,         // insert the 'count' nodes that follow
+  HEAP_OP_EXTRACT_MIN,    // extract up to 'arg' nodes
+  HEAP_OP_DECREASE,       // decreasePriority(id, priority) of each of the
+                          // 'count' nodes that follow
+  HEAP_OP_SIZE            // nothing, but answer with the size
+} HeapServerOp;
+
+typedef enum heap_server_status {
+  HEAP_STATUS_OK,
+  HEAP_STATUS_NO_QUEUE,   // 'queue' is out of range or was never created (or,
+                          // for HEAP_OP_CREATE, 'arg' is negative)
+  HEAP_STATUS_NO_MEMORY   // HEAP_OP_CREATE: 'arg' is above
+                          // HEAP_SERVER_MAX_CAPACITY, or the server is out
+                          // of memory; the queue is left as it was
+} HeapServerStatus;
+
+typedef struct heap_request {
+  uint32_t bytes;   // size of the frame, this header included
+  uint16_t op;      // a HeapServerOp
+  uint16_t count;   // nodes that follow (HEAP_OP_INSERT, HEAP_OP_DECREASE)
+  uint32_t queue;   // which queue, 0 <= queue < HEAP_SERVER_MAX_QUEUES
+  int32_t arg;      // see HeapServerOp
+  uint32_t tag;     // echoed in the response
+} HeapRequest;
+
+typedef struct heap_response {
+  uint32_t bytes;   // size of the frame, this header included
+  uint16_t status;  // a HeapServerStatus
+  uint16_t count;   // nodes inserted, extracted (and following) or decreased
+  int32_t size;     // nodes in the queue after the request
+  uint32_t tag;     // that of the request
+} HeapResponse;
+
+#endif
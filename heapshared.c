@@ -0,0 +1,314 @@
+/*
+ * Our shared heap: a heap in a POSIX shared-memory segment, locked with a
+ * robust process-shared mutex and used through per-process views.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "heapshared.h"
+#include "minheap_internal.h"
+
+#define SEGMENT_ALIGNMENT 4096	// arr and indexMap start on page boundaries
+#define OPEN_RETRY_US 1000	// how long openSharedHeap waits between checks
+#define OPEN_RETRIES 5000	// checks before it gives up, for each thing it waits for
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Returns 'offset' rounded up to the next multiple of SEGMENT_ALIGNMENT.
+ */
+uint64_t alignSegment(uint64_t offset) {
+	return (offset + SEGMENT_ALIGNMENT - 1) / SEGMENT_ALIGNMENT * SEGMENT_ALIGNMENT;
+}
+
+/* Returns a new view of the shared heap whose segment, of 'bytes' bytes, is
+ * mapped at 'mapping' and set up, or NULL if memory runs out.
+ */
+SharedHeap* newView(void* mapping, size_t bytes) {
+	SharedHeapHeader* header = mapping;
+	HeapOptions options = {
+		.insertBufferCapacity = header->bufferCapacity,
+		.layout = header->layout,
+		.prefetchDistance = header->prefetchDistance,
+		.allocator = HEAP_ALLOC_MAPPED,
+	};
+	MinHeap* heap = malloc(sizeof(MinHeap));
+	SharedHeap* s = malloc(sizeof(SharedHeap));
+	if (heap == NULL || s == NULL) {
+		free(heap);
+		free(s);
+		return NULL;
+	}
+	initHeap(heap, header->capacity, &options);
+	heap->mapping = mapping;
+	heap->mappingBytes = bytes;
+	heap->arr = (HeapNode*)((char*)mapping + header->arrOffset);
+	heap->indexMap = (int*)((char*)mapping + header->indexMapOffset);
+	heap->swapping = &header->swapping;
+
+	s->heap = heap;
+	s->header = header;
+	return s;
+}
+
+/* Rebuilds the shared heap of 's' after a process died in the middle of an
+ * operation on it: undoes the swap it was making, if any, then keeps the
+ * first node of each ID among every slot that operation could have used,
+ * and re-heapifies them.
+ * Precondition: the lock of 's' is held
+ */
+void repairHeap(SharedHeap* s) {
+	SharedHeapHeader* header = s->header;
+	MinHeap* heap = s->heap;
+	HeapSwap* swapping = &header->swapping;
+	if (swapping->active) {
+		*nodePtr(heap, swapping->index1) = swapping->node1;
+		*nodePtr(heap, swapping->index2) = swapping->node2;
+		swapping->active = 0;
+	}
+	long slots = (long)header->size + header->bufferSize + header->adding;
+	if (slots > header->capacity) slots = header->capacity;
+
+	int* priorities = malloc(sizeof(int) * (slots > 0 ? slots : 1));
+	int* ids = malloc(sizeof(int) * (slots > 0 ? slots : 1));
+	bool* seen = calloc(header->capacity > 0 ? header->capacity : 1, sizeof(bool));
+	int n = 0;
+	for (int i = ROOT_INDEX; i <= slots; i++) {
+		int id = idAt(heap, i);
+		if (id < 0 || id >= header->capacity || seen[id]) continue;
+		seen[id] = true;
+		priorities[n] = priorityAt(heap, i);
+		ids[n++] = id;
+	}
+	buildHeap(heap, priorities, ids, n);
+	free(priorities);
+	free(ids);
+	free(seen);
+
+	header->size = heap->size;
+	header->bufferSize = heap->bufferSize;
+	header->bufferMin = heap->bufferMin;
+	header->adding = 0;
+}
+
+/* Takes the lock of 's', repairing the heap if its last holder died, and
+ * brings the view up to date with the shared state. Records that the
+ * operation about to run may fill 'adding' slots past the nodes, and marks
+ * those slots empty, so a repair can tell whether it got to them. Returns
+ * False, without the lock, if the lock cannot be taken or made consistent.
+ */
+bool lockHeap(SharedHeap* s, int adding) {
+	SharedHeapHeader* header = s->header;
+	MinHeap* heap = s->heap;
+	int locked = pthread_mutex_lock(&header->lock);
+	if (locked != 0 && locked != EOWNERDEAD) return false;	// e.g. ENOTRECOVERABLE
+	heap->size = header->size;
+	heap->bufferSize = header->bufferSize;
+	heap->bufferMin = header->bufferMin;
+	if (locked == EOWNERDEAD) {
+		repairHeap(s);
+		if (pthread_mutex_consistent(&header->lock) != 0) {
+			pthread_mutex_unlock(&header->lock);
+			return false;
+		}
+	}
+	int total = heap->size + heap->bufferSize;
+	for (int i = 1; i <= adding && total + i <= heap->capacity; i++)
+		nodePtr(heap, total + i)->id = NOTHING;
+	header->adding = adding;
+	return true;
+}
+
+/* Publishes the state of the view of 's' and releases its lock.
+ */
+void unlockHeap(SharedHeap* s) {
+	SharedHeapHeader* header = s->header;
+	MinHeap* heap = s->heap;
+	header->size = heap->size;
+	header->bufferSize = heap->bufferSize;
+	header->bufferMin = heap->bufferMin;
+	header->adding = 0;
+	pthread_mutex_unlock(&header->lock);
+}
+
+/* Creates a shared-memory segment named 'name' holding an empty heap of
+ * capacity 'capacity', configured by 'options' (may be NULL), and returns a
+ * view of it. Returns NULL if the segment exists already or cannot be
+ * created.
+ */
+SharedHeap* createSharedHeap(const char* name, int capacity,
+                             HeapOptions* options) {
+	// The segment is laid out for the shape the views will have
+	MinHeap shape;
+	HeapOptions creation = {
+		.insertBufferCapacity = options == NULL ? 0 : options->insertBufferCapacity,
+		.layout = options == NULL ? HEAP_LAYOUT_IMPLICIT : options->layout,
+		.prefetchDistance = options == NULL ? 0 : options->prefetchDistance,
+	};
+	initHeap(&shape, capacity, &creation);
+	uint64_t arrOffset = alignSegment(sizeof(SharedHeapHeader));
+	uint64_t indexMapOffset = alignSegment(arrOffset + sizeof(HeapNode) * shape.arrSlots);
+	uint64_t bytes = indexMapOffset + sizeof(int) * (uint64_t)capacity;
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) return NULL;
+	void* mapping = MAP_FAILED;
+	if (ftruncate(fd, bytes) == 0)
+		mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);	// the mapping outlives the descriptor
+	if (mapping == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+
+	SharedHeapHeader* header = mapping;
+	pthread_mutexattr_t attributes;
+	pthread_mutexattr_init(&attributes);
+	pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&header->lock, &attributes);
+	pthread_mutexattr_destroy(&attributes);
+	header->version = SHARED_HEAP_VERSION;
+	header->size = 0;
+	header->capacity = capacity;
+	header->layout = shape.layout;
+	header->prefetchDistance = shape.prefetchDistance;
+	header->bufferSize = 0;
+	header->bufferCapacity = shape.bufferCapacity;
+	header->bufferMin = NOTHING;
+	header->adding = 0;
+	header->swapping.active = 0;
+	header->arrSlots = shape.arrSlots;
+	header->arrOffset = arrOffset;
+	header->indexMapOffset = indexMapOffset;
+	header->bytes = bytes;
+
+	// Openers wait for the magic, so it goes last
+	atomic_store_explicit(&header->magic, SHARED_HEAP_MAGIC, memory_order_release);
+	SharedHeap* s = newView(mapping, bytes);
+	if (s == NULL) {
+		munmap(mapping, bytes);
+		shm_unlink(name);
+	}
+	return s;
+}
+
+/* Returns a view of the shared heap in the segment named 'name', once its
+ * creator has set it up. Returns NULL if there is no such segment or it is
+ * not a shared heap of this version.
+ */
+SharedHeap* openSharedHeap(const char* name) {
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) return NULL;
+
+	// The creator sizes the segment, then fills in its header; each wait gets
+	// the whole budget
+	struct stat status;
+	int sizeRetries = 0;
+	while (fstat(fd, &status) == 0 && (size_t)status.st_size < sizeof(SharedHeapHeader) &&
+	       sizeRetries++ < OPEN_RETRIES)
+		usleep(OPEN_RETRY_US);
+	if ((size_t)status.st_size < sizeof(SharedHeapHeader)) {
+		close(fd);
+		return NULL;
+	}
+	void* mapping = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);	// the mapping outlives the descriptor
+	if (mapping == MAP_FAILED) return NULL;
+
+	SharedHeapHeader* header = mapping;
+	int magicRetries = 0;
+	while (atomic_load_explicit(&header->magic, memory_order_acquire) != SHARED_HEAP_MAGIC &&
+	       magicRetries++ < OPEN_RETRIES)
+		usleep(OPEN_RETRY_US);
+	SharedHeap* s = NULL;
+	if (atomic_load_explicit(&header->magic, memory_order_acquire) == SHARED_HEAP_MAGIC &&
+	    header->version == SHARED_HEAP_VERSION && header->bytes == (uint64_t)status.st_size)
+		s = newView(mapping, status.st_size);
+	if (s == NULL) munmap(mapping, status.st_size);
+	return s;
+}
+
+/* Unmaps view 's' and frees it. The heap lives on in its segment.
+ */
+void closeSharedHeap(SharedHeap* s) {
+	deleteHeap(s->heap);	// unmaps the segment
+	free(s);
+}
+
+/* Removes the segment named 'name'. Returns False if there is no such
+ * segment.
+ */
+bool unlinkSharedHeap(const char* name) {
+	return shm_unlink(name) == 0;
+}
+
+/* Same as insert on the shared heap of 's'. Returns False, changing nothing,
+ * if the lock cannot be taken.
+ */
+bool sharedInsert(SharedHeap* s, int priority, int id) {
+	if (!lockHeap(s, 1)) return false;
+	insert(s->heap, priority, id);
+	unlockHeap(s);
+	return true;
+}
+
+/* Same as decreasePriority on the shared heap of 's'. Returns False, changing
+ * nothing, if the lock cannot be taken.
+ */
+bool sharedDecreasePriority(SharedHeap* s, int id, int newPriority) {
+	if (!lockHeap(s, 0)) return false;
+	bool decreased = decreasePriority(s->heap, id, newPriority);
+	unlockHeap(s);
+	return decreased;
+}
+
+/* Removes the node with minimum priority from the shared heap of 's' into
+ * '*node' and returns True. Returns False if the heap is empty or the lock
+ * cannot be taken.
+ */
+bool sharedExtractMin(SharedHeap* s, HeapNode* node) {
+	if (!lockHeap(s, 0)) return false;
+	bool found = numNodes(s->heap) > 0;
+	if (found) *node = extractMin(s->heap);
+	unlockHeap(s);
+	return found;
+}
+
+/* Same as insertBatch on the shared heap of 's', under one lock. Returns
+ * False if the lock cannot be taken.
+ */
+bool sharedInsertBatch(SharedHeap* s, int* priorities, int* ids, int n) {
+	if (!lockHeap(s, n)) return false;
+	insertBatch(s->heap, priorities, ids, n);
+	unlockHeap(s);
+	return true;
+}
+
+/* Same as extractMinBatch on the shared heap of 's', under one lock. Returns
+ * -1 if the lock cannot be taken.
+ */
+int sharedExtractMinBatch(SharedHeap* s, int k, HeapNode out[]) {
+	if (!lockHeap(s, 0)) return -1;
+	int extracted = extractMinBatch(s->heap, k, out);
+	unlockHeap(s);
+	return extracted;
+}
+
+/* Returns the number of nodes in the shared heap of 's', or -1 if the lock
+ * cannot be taken.
+ */
+int sharedNumNodes(SharedHeap* s) {
+	if (!lockHeap(s, 0)) return -1;
+	int n = numNodes(s->heap);
+	unlockHeap(s);
+	return n;
+}
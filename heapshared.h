@@ -0,0 +1,111 @@
+/*
+ * Header file for our shared Priority Queue: one heap in a POSIX
+ * shared-memory segment, used by several processes at once.
+ *
+ * The segment holds a SharedHeapHeader, then arr and indexMap, each starting
+ * on a page boundary. The header holds the heap's state (size, buffer, ...)
+ * and where arr and indexMap start, as offsets from the start of the
+ * segment, so each process may map it anywhere. Each process works through
+ * its own view: a MinHeap whose arr and indexMap point into its mapping.
+ *
+ * Every operation below takes the header's lock, a process-shared robust
+ * mutex, copies the shared state into the view, runs the usual operation on
+ * the view, and copies the state back before unlocking. The batch
+ * operations take the lock once for the whole batch.
+ *
+ * If a process dies holding the lock, the next one to take it repairs the
+ * heap: it keeps one node per ID among the slots the interrupted operation
+ * could have touched and re-heapifies them. Each swap records the two nodes
+ * it exchanges in the header before writing either, so a swap cut in half
+ * is undone first rather than losing one of them. The node that operation
+ * was inserting or extracting may or may not survive; everything else is
+ * kept.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __HeapShared_header
+#define __HeapShared_header
+
+#define SHARED_HEAP_MAGIC 0x4853484d  // "MHSH", little-endian
+#define SHARED_HEAP_VERSION 2
+
+typedef struct shared_heap_header {
+  _Atomic uint32_t magic;   // SHARED_HEAP_MAGIC, once the segment is ready
+  uint32_t version;         // SHARED_HEAP_VERSION
+  pthread_mutex_t lock;     // robust and process-shared; guards all below
+  int32_t size;             // the MinHeap fields of the same names
+  int32_t capacity;
+  int32_t layout;
+  int32_t prefetchDistance;
+  int32_t bufferSize;
+  int32_t bufferCapacity;
+  int32_t bufferMin;
+  int32_t adding;           // slots past size + bufferSize the operation in
+                            // progress may fill (for repairs)
+  HeapSwap swapping;        // the swap in progress, if any (for repairs)
+  int64_t arrSlots;
+  uint64_t arrOffset;       // where arr and indexMap start in the segment
+  uint64_t indexMapOffset;
+  uint64_t bytes;           // size of the whole segment
+} SharedHeapHeader;
+
+typedef struct shared_heap {
+  MinHeap* heap;              // this process's view; only valid while the
+                              // lock is held, so use the functions below
+  SharedHeapHeader* header;   // the start of the segment
+} SharedHeap;
+
+/* Creates a shared-memory segment named 'name' (as for shm_open: "/name")
+ * holding an empty heap of capacity 'capacity', configured by 'options' (may
+ * be NULL; its allocator and payloadSize are ignored), and returns a view of
+ * it. Returns NULL if the segment exists already or cannot be created.
+ */
+SharedHeap* createSharedHeap(const char* name, int capacity,
+                             HeapOptions* options);
+
+/* Returns a view of the shared heap in the segment named 'name', waiting for
+ * its creator to finish setting it up. Returns NULL if there is no such
+ * segment or it is not a shared heap of this version.
+ */
+SharedHeap* openSharedHeap(const char* name);
+
+/* Unmaps view 's' and frees it. The heap lives on in its segment.
+ */
+void closeSharedHeap(SharedHeap* s);
+
+/* Removes the segment named 'name'; it is freed once every view of it is
+ * closed. Returns False if there is no such segment.
+ */
+bool unlinkSharedHeap(const char* name);
+
+/* Same as insert and decreasePriority on the shared heap of 's', with the
+ * same preconditions. Both return False, changing nothing, if the lock cannot
+ * be taken (say, ENOTRECOVERABLE after a repair that never finished).
+ */
+bool sharedInsert(SharedHeap* s, int priority, int id);
+bool sharedDecreasePriority(SharedHeap* s, int id, int newPriority);
+
+/* Removes the node with minimum priority from the shared heap of 's' into
+ * '*node' and returns True. Returns False if the heap is empty or the lock
+ * cannot be taken.
+ */
+bool sharedExtractMin(SharedHeap* s, HeapNode* node);
+
+/* Same as insertBatch and extractMinBatch on the shared heap of 's', under
+ * one lock. If the lock cannot be taken, sharedInsertBatch returns False and
+ * sharedExtractMinBatch returns -1.
+ */
+bool sharedInsertBatch(SharedHeap* s, int* priorities, int* ids, int n);
+int sharedExtractMinBatch(SharedHeap* s, int k, HeapNode out[]);
+
+/* Returns the number of nodes in the shared heap of 's', or -1 if the lock
+ * cannot be taken.
+ */
+int sharedNumNodes(SharedHeap* s);
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * Our binary operation traces: recording through a ring buffer drained by a
+ * writer thread, and reading back through mmap.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heaptrace.h"
+#include "minheap_internal.h"
+
+#define WRITER_PERIOD_NS 10000000	// the writer flushes at least every 10 ms
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Returns 'value' zigzag-encoded: small magnitudes, of either sign, become
+ * small unsigned numbers.
+ */
+uint64_t zigzag(int64_t value) {
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/* Returns the value whose zigzag encoding is 'encoded'.
+ */
+int64_t unzigzag(uint64_t encoded) {
+	return (int64_t)(encoded >> 1) ^ -(int64_t)(encoded & 1);
+}
+
+/* Writes 'value' as a LEB128 varint at 'out', and returns its length in
+ * bytes (1 to 10).
+ */
+int putVarint(unsigned char* out, uint64_t value) {
+	int length = 0;
+	while (value >= 0x80) {
+		out[length++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[length++] = (unsigned char)value;
+	return length;
+}
+
+/* Reads a LEB128 varint at the current position of 'reader' into '*value',
+ * advancing past it, and returns True. Returns False if the trace ends first.
+ */
+bool getVarint(HeapTraceReader* reader, uint64_t* value) {
+	uint64_t result = 0;
+	for (int shift = 0; reader->pos < reader->bytes && shift < 64; shift += 7) {
+		unsigned char byte = reader->data[reader->pos++];
+		result |= (uint64_t)(byte & 0x7f) << shift;
+		if (byte < 0x80) {
+			*value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Writes the 'bytes' bytes at 'data' to file descriptor 'fd', retrying short
+ * writes. Gives up silently on errors: a trace must never stop the heap.
+ */
+void writeAll(int fd, const unsigned char* data, size_t bytes) {
+	while (bytes > 0) {
+		ssize_t written = write(fd, data, bytes);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return;
+		data += written;
+		bytes -= written;
+	}
+}
+
+/* Writes out every record pending in the ring of 'trace', in at most two
+ * writes (the ring may wrap around), then wakes an operation waiting for
+ * space.
+ */
+void drainRing(HeapTrace* trace) {
+	size_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+	if (head == tail) return;
+
+	size_t start = tail & (HEAP_TRACE_RING_BYTES - 1);
+	size_t bytes = head - tail;
+	size_t first = bytes < HEAP_TRACE_RING_BYTES - start ? bytes : HEAP_TRACE_RING_BYTES - start;
+	writeAll(trace->fd, trace->ring + start, first);
+	writeAll(trace->fd, trace->ring, bytes - first);
+	atomic_store_explicit(&trace->tail, head, memory_order_release);
+
+	pthread_mutex_lock(&trace->lock);
+	pthread_cond_broadcast(&trace->drained);
+	pthread_mutex_unlock(&trace->lock);
+}
+
+/* The writer thread of trace 'arg': drains the ring whenever half of it is
+ * pending, or at least every WRITER_PERIOD_NS, until told to stop.
+ */
+void* traceWriter(void* arg) {
+	HeapTrace* trace = arg;
+
+	pthread_mutex_lock(&trace->lock);
+	while (!trace->stopping) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += WRITER_PERIOD_NS;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&trace->pending, &trace->lock, &deadline);
+
+		pthread_mutex_unlock(&trace->lock);
+		drainRing(trace);
+		pthread_mutex_lock(&trace->lock);
+	}
+	pthread_mutex_unlock(&trace->lock);
+
+	drainRing(trace);
+	return NULL;
+}
+
+/* Starts recording the operations on minheap 'heap' into a new trace file at
+ * 'path', after records of the nodes 'heap' holds now. Returns the new
+ * trace, or NULL if 'path' cannot be created.
+ * Precondition: 'heap' is not being recorded already
+ */
+HeapTrace* startHeapTrace(MinHeap* heap, const char* path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return NULL;
+
+	HeapTraceHeader header = {HEAP_TRACE_MAGIC, HEAP_TRACE_VERSION,
+	                          heap->capacity, numNodes(heap)};
+	writeAll(fd, (unsigned char*)&header, sizeof(header));
+
+	HeapTrace* trace = malloc(sizeof(HeapTrace));
+	trace->fd = fd;
+	trace->ring = malloc(HEAP_TRACE_RING_BYTES);
+	atomic_init(&trace->head, 0);
+	atomic_init(&trace->tail, 0);
+	trace->lastPriority = 0;
+	trace->stopping = false;
+	pthread_mutex_init(&trace->lock, NULL);
+	pthread_cond_init(&trace->pending, NULL);
+	pthread_cond_init(&trace->drained, NULL);
+	pthread_create(&trace->writer, NULL, traceWriter, trace);
+
+	// The heap as it stands, buffered nodes included, as its first records
+	for (int i = ROOT_INDEX; i <= heap->size + heap->bufferSize; i++)
+		traceRecord(trace, TRACE_INSERT, priorityAt(heap, i), idAt(heap, i));
+
+	heap->trace = trace;
+	heap->traceOp = traceRecord;
+	return trace;
+}
+
+/* Stops recording minheap 'heap', writes out every pending record and closes
+ * its trace. Has no effect if 'heap' is not being recorded.
+ */
+void stopHeapTrace(MinHeap* heap) {
+	HeapTrace* trace = heap->trace;
+	if (trace == NULL) return;
+	heap->trace = NULL;
+	heap->traceOp = NULL;
+
+	pthread_mutex_lock(&trace->lock);
+	trace->stopping = true;
+	pthread_cond_signal(&trace->pending);
+	pthread_mutex_unlock(&trace->lock);
+	pthread_join(trace->writer, NULL);
+
+	close(trace->fd);
+	pthread_mutex_destroy(&trace->lock);
+	pthread_cond_destroy(&trace->pending);
+	pthread_cond_destroy(&trace->drained);
+	free(trace->ring);
+	free(trace);
+}
+
+/* Writes the record of operation 'op' with arguments 'arg1' and 'arg2' at
+ * 'out', storing its priority relative to '*lastPriority' and updating that,
+ * and returns its length in bytes.
+ */
+int encodeTraceRecord(unsigned char* out, int* lastPriority, HeapTraceOp op,
+                      int arg1, int arg2) {
+	int length = 0;
+	out[length++] = (unsigned char)op;
+
+	if (op == TRACE_INSERT) {
+		length += putVarint(out + length, zigzag((int64_t)arg1 - *lastPriority));
+		length += putVarint(out + length, (uint32_t)arg2);
+		*lastPriority = arg1;
+	} else if (op == TRACE_DECREASE_PRIORITY) {
+		length += putVarint(out + length, (uint32_t)arg1);
+		length += putVarint(out + length, zigzag((int64_t)arg2 - *lastPriority));
+		*lastPriority = arg2;
+	}
+	return length;
+}
+
+/* Appends the record of operation 'op' with arguments 'arg1' and 'arg2' to
+ * 'trace', waiting for the writer if its ring is full.
+ */
+void traceRecord(HeapTrace* trace, HeapTraceOp op, int arg1, int arg2) {
+	unsigned char record[HEAP_TRACE_MAX_RECORD];
+	int length = encodeTraceRecord(record, &trace->lastPriority, op, arg1, arg2);
+
+	// Only this thread moves head, so only the writer can make more room
+	size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&trace->tail, memory_order_acquire);
+	if (head + length - tail > HEAP_TRACE_RING_BYTES) {
+		pthread_mutex_lock(&trace->lock);
+		while (head + length - atomic_load(&trace->tail) > HEAP_TRACE_RING_BYTES) {
+			pthread_cond_signal(&trace->pending);
+			pthread_cond_wait(&trace->drained, &trace->lock);
+		}
+		pthread_mutex_unlock(&trace->lock);
+	}
+
+	for (int i = 0; i < length; i++)
+		trace->ring[(head + i) & (HEAP_TRACE_RING_BYTES - 1)] = record[i];
+	atomic_store_explicit(&trace->head, head + length, memory_order_release);
+
+	// Wake the writer once, as the pending records reach half the ring
+	size_t half = HEAP_TRACE_RING_BYTES / 2;
+	if (head - tail < half && head + length - tail >= half) {
+		pthread_mutex_lock(&trace->lock);
+		pthread_cond_signal(&trace->pending);
+		pthread_mutex_unlock(&trace->lock);
+	}
+}
+
+/* Maps the trace file at 'path' for reading. Returns NULL if it cannot be
+ * opened or mapped, or is not a trace of this version.
+ */
+HeapTraceReader* openHeapTrace(const char* path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat status;
+	if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(HeapTraceHeader)) {
+		close(fd);
+		return NULL;
+	}
+	void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping outlives the descriptor
+	if (data == MAP_FAILED) return NULL;
+	madvise(data, status.st_size, MADV_SEQUENTIAL);
+
+	HeapTraceReader* reader = malloc(sizeof(HeapTraceReader));
+	memcpy(&reader->header, data, sizeof(HeapTraceHeader));
+	reader->data = data;
+	reader->bytes = status.st_size;
+	reader->pos = sizeof(HeapTraceHeader);
+	reader->lastPriority = 0;
+	if (reader->header.magic != HEAP_TRACE_MAGIC ||
+	    reader->header.version != HEAP_TRACE_VERSION) {
+		closeHeapTrace(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+/* Reads the next record of 'reader' into '*op', '*arg1' and '*arg2', and
+ * returns True. Returns False at the end of the trace (or at a truncated
+ * last record).
+ */
+bool readTraceRecord(HeapTraceReader* reader, HeapTraceOp* op, int* arg1,
+                     int* arg2) {
+	if (reader->pos >= reader->bytes) return false;
+	*op = reader->data[reader->pos++];
+	*arg1 = 0;
+	*arg2 = 0;
+
+	uint64_t first, second;
+	if (*op == TRACE_INSERT) {
+		if (!getVarint(reader, &first) || !getVarint(reader, &second)) return false;
+		*arg1 = (int)(reader->lastPriority + unzigzag(first));
+		*arg2 = (int)second;
+		reader->lastPriority = *arg1;
+	} else if (*op == TRACE_DECREASE_PRIORITY) {
+		if (!getVarint(reader, &first) || !getVarint(reader, &second)) return false;
+		*arg1 = (int)first;
+		*arg2 = (int)(reader->lastPriority + unzigzag(second));
+		reader->lastPriority = *arg2;
+	} else if (*op != TRACE_EXTRACT_MIN && *op != TRACE_GET_MIN) {
+		return false;	// not a record: the trace is corrupt
+	}
+	return true;
+}
+
+/* Unmaps and frees 'reader'.
+ */
+void closeHeapTrace(HeapTraceReader* reader) {
+	munmap((void*)reader->data, reader->bytes);
+	free(reader);
+}
@@ -0,0 +1,107 @@
+/*
+ * Header file for recording the operations on our Priority Queue into a
+ * binary trace file, and for reading such traces back (see minheap_replay.c).
+ *
+ * A trace file is a HeapTraceHeader followed by records, one per operation:
+ * a HeapTraceOp byte, then its arguments as LEB128 varints. Priorities are
+ * stored as the zigzag-encoded difference from the previous priority in the
+ * trace, so that slowly drifting priorities (timers, distances) take one or
+ * two bytes. The first 'numInitial' records are TRACE_INSERTs of the nodes
+ * the heap held when recording started.
+ *
+ * Recording appends each record to a ring buffer in memory; a writer thread
+ * drains it to the file in large writes, so an operation costs no syscall.
+ * If the ring fills up, the operation waits for the writer.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __HeapTrace_header
+#define __HeapTrace_header
+
+#define HEAP_TRACE_MAGIC 0x5254484d  // "MHTR", little-endian
+#define HEAP_TRACE_VERSION 1
+#define HEAP_TRACE_RING_BYTES (1 << 20)  // a power of two
+#define HEAP_TRACE_MAX_RECORD 11         // op byte + two 5-byte varints
+
+typedef struct heap_trace_header {
+  uint32_t magic;       // HEAP_TRACE_MAGIC
+  uint32_t version;     // HEAP_TRACE_VERSION
+  int32_t capacity;     // capacity of the heap traced
+  int32_t numInitial;   // records that re-create the heap's initial nodes
+} HeapTraceHeader;
+
+typedef struct heap_trace {
+  int fd;                   // the trace file
+  unsigned char* ring;      // HEAP_TRACE_RING_BYTES of pending records
+  _Atomic size_t head;      // bytes ever appended to the ring
+  _Atomic size_t tail;      // bytes ever written out from the ring
+  int lastPriority;         // the priority of the last record that had one
+  bool stopping;            // set (under 'lock') to make the writer finish
+  pthread_t writer;         // drains the ring into 'fd'
+  pthread_mutex_t lock;     // guards 'stopping' and the two conditions
+  pthread_cond_t pending;   // signalled when half the ring is pending
+  pthread_cond_t drained;   // signalled when the writer has freed space
+} HeapTrace;
+
+/* Reads a trace file, or (filled in directly, with 'pos' and 'lastPriority'
+ * 0) any run of records in memory.
+ */
+typedef struct heap_trace_reader {
+  HeapTraceHeader header;     // the header of the trace
+  const unsigned char* data;  // the whole trace file, mapped
+  size_t bytes;               // size of the trace file
+  size_t pos;                 // offset of the next record in 'data'
+  int lastPriority;           // as in HeapTrace
+} HeapTraceReader;
+
+/* Starts recording every insert, extractMin, decreasePriority that takes
+ * effect and getMin on minheap 'heap' (including those that insertBatch and
+ * extractMinBatch stand for) into a new trace file at 'path', after records
+ * of the nodes 'heap' holds now. buildHeap is not recorded: start recording
+ * after it. Returns the new trace, or NULL if 'path' cannot be created.
+ * Precondition: 'heap' is not being recorded already
+ */
+HeapTrace* startHeapTrace(MinHeap* heap, const char* path);
+
+/* Stops recording minheap 'heap', writes out every pending record and closes
+ * its trace. Has no effect if 'heap' is not being recorded. Must be called
+ * before deleteHeap.
+ */
+void stopHeapTrace(MinHeap* heap);
+
+/* Appends the record of operation 'op' with arguments 'arg1' and 'arg2' (see
+ * HeapTraceOp) to 'trace'. startHeapTrace installs this as MinHeap.traceOp.
+ */
+void traceRecord(HeapTrace* trace, HeapTraceOp op, int arg1, int arg2);
+
+/* Writes the record of operation 'op' with arguments 'arg1' and 'arg2' at
+ * 'out' (which has room for HEAP_TRACE_MAX_RECORD bytes), storing its
+ * priority relative to '*lastPriority' and updating that, and returns its
+ * length in bytes.
+ */
+int encodeTraceRecord(unsigned char* out, int* lastPriority, HeapTraceOp op,
+                      int arg1, int arg2);
+
+/* Maps the trace file at 'path' for reading. Returns NULL if it cannot be
+ * opened or mapped, or is not a trace of this version.
+ */
+HeapTraceReader* openHeapTrace(const char* path);
+
+/* Reads the next record of 'reader' into '*op', '*arg1' and '*arg2' (0 if the
+ * operation has no such argument), and returns True. Returns False at the end
+ * of the trace (or at a truncated last record).
+ */
+bool readTraceRecord(HeapTraceReader* reader, HeapTraceOp* op, int* arg1,
+                     int* arg2);
+
+/* Unmaps and frees 'reader'.
+ */
+void closeHeapTrace(HeapTraceReader* reader);
+
+#endif
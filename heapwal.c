@@ -0,0 +1,357 @@
+/*
+ * Our write-ahead-logged heap: operations appended to a log in group
+ * commits, compacted into heap image snapshots, and replayed on recovery.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heapio.h"
+#include "heaptrace.h"
+#include "heapwal.h"
+#include "minheap_internal.h"
+
+#define INITIAL_FRAME_BYTES 4096
+#define MAX_FRAME_BYTES (1 << 30)	// a frame is committed before it gets larger
+#define SNAPSHOT_SUFFIX 22	// room for '.', a 64-bit generation and '\0'
+
+/*************************************************************************
+ ** Helper functions
+ *************************************************************************/
+
+/* Returns the time on the monotonic clock, in seconds.
+ */
+double monotonicSeconds(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Writes the path of the snapshot of generation 'generation' of the log at
+ * 'path' to 'out' (of strlen('path') + SNAPSHOT_SUFFIX bytes).
+ */
+void snapshotPath(char* out, const char* path, uint64_t generation) {
+	sprintf(out, "%s.%llu", path, (unsigned long long)generation);
+}
+
+/* Replaces the log at 'path' with an empty log with header 'header'
+ * (written beside it, synced, then renamed over it, then the directory
+ * synced), and returns a file descriptor open on it. Sets '*synced' to
+ * whether the directory sync, and so the rename, went through; if not, the
+ * new log is in place but may not survive a crash. Returns -1, leaving the
+ * log at 'path' as it was, if it cannot be written.
+ */
+int createLog(const char* path, HeapWalHeader* header, bool* synced) {
+	char temporary[strlen(path) + sizeof(".tmp")];
+	sprintf(temporary, "%s.tmp", path);
+	int fd = open(temporary, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return -1;
+
+	if (!writeAllAt(fd, header, sizeof(*header), 0) || fsync(fd) != 0 ||
+	    rename(temporary, path) != 0) {
+		close(fd);
+		unlink(temporary);
+		return -1;
+	}
+	*synced = syncParentDirectory(path);
+	return fd;
+}
+
+/* Returns the heap the log with header 'header' at 'path' applies to: its
+ * snapshot, or a new empty heap for generation 0. Returns NULL if the
+ * snapshot cannot be loaded.
+ */
+MinHeap* loadSnapshot(const char* path, HeapWalHeader* header) {
+	if (header->generation == 0) {
+		HeapOptions options = {
+			.insertBufferCapacity = header->insertBufferCapacity,
+			.layout = header->layout,
+			.prefetchDistance = header->prefetchDistance,
+		};
+		return newHeapWithOptions(header->capacity, &options);
+	}
+
+	char snapshot[strlen(path) + SNAPSHOT_SUFFIX];
+	snapshotPath(snapshot, path, header->generation);
+	return loadHeap(snapshot, HEAP_IMAGE_PRIVATE);
+}
+
+/* Applies operation 'op' with arguments 'arg1' and 'arg2' (see HeapTraceOp)
+ * to minheap 'heap', unless it would break a precondition, as it only could
+ * for a log that does not belong to 'heap'.
+ */
+void applyOperation(MinHeap* heap, HeapTraceOp op, int arg1, int arg2) {
+	switch (op) {
+		case TRACE_INSERT:
+			if (arg2 >= 0 && arg2 < heap->capacity && !holdsId(heap, arg2) &&
+			    numNodes(heap) < heap->capacity)
+				insert(heap, arg1, arg2);
+			break;
+		case TRACE_EXTRACT_MIN:
+			if (numNodes(heap) > 0) extractMin(heap);
+			break;
+		case TRACE_DECREASE_PRIORITY:
+			if (arg1 >= 0 && arg1 < heap->capacity) decreasePriority(heap, arg1, arg2);
+			break;
+		case TRACE_GET_MIN:
+			break;
+	}
+}
+
+/* Replays every intact frame of the 'bytes' bytes of log at 'log' onto
+ * minheap 'heap', and returns where the last of them ends.
+ */
+size_t replayLog(MinHeap* heap, const unsigned char* log, size_t bytes) {
+	size_t pos = sizeof(HeapWalHeader);
+	HeapWalFrame frame;
+	while (bytes - pos >= sizeof(frame)) {
+		memcpy(&frame, log + pos, sizeof(frame));	// frames are not aligned
+		const unsigned char* data = log + pos + sizeof(frame);
+		if (frame.magic != HEAP_WAL_FRAME_MAGIC || frame.bytes > bytes - pos - sizeof(frame) ||
+		    frame.checksum != fnv1a(data, frame.bytes))
+			break;
+
+		HeapTraceReader records = {.data = data, .bytes = frame.bytes};
+		HeapTraceOp op;
+		int arg1, arg2;
+		while (readTraceRecord(&records, &op, &arg1, &arg2))
+			applyOperation(heap, op, arg1, arg2);
+		pos += sizeof(frame) + frame.bytes;
+	}
+	return pos;
+}
+
+/* Empties the frame of 'wal', leaving room for its HeapWalFrame.
+ */
+void startFrame(HeapWal* wal) {
+	wal->frameBytes = sizeof(HeapWalFrame);
+	wal->lastPriority = 0;
+	wal->pending = 0;
+}
+
+/* Appends the record of operation 'op' with arguments 'arg1' and 'arg2' to
+ * the frame of 'wal', and commits if its policy says it is time. Returns
+ * False if that commit failed.
+ */
+bool logOperation(HeapWal* wal, HeapTraceOp op, int arg1, int arg2) {
+	if (wal->frameBytes + HEAP_TRACE_MAX_RECORD > wal->frameCapacity) {
+		wal->frameCapacity *= 2;
+		wal->frame = realloc(wal->frame, wal->frameCapacity);
+	}
+	if (wal->pending == 0 && wal->policy.commitMicros > 0)
+		wal->firstPending = monotonicSeconds();
+	wal->frameBytes += encodeTraceRecord(wal->frame + wal->frameBytes, &wal->lastPriority,
+	                                     op, arg1, arg2);
+	wal->pending++;
+
+	HeapWalPolicy* policy = &wal->policy;
+	if ((policy->commitOps > 0 && wal->pending >= policy->commitOps) ||
+	    (policy->commitMicros > 0 &&
+	     (monotonicSeconds() - wal->firstPending) * 1e6 >= policy->commitMicros) ||
+	    wal->frameBytes >= MAX_FRAME_BYTES)
+		return commitHeapWal(wal);
+	return true;
+}
+
+/* Opens the logged heap at 'path', recovering it from its snapshot and log,
+ * or creates an empty one of capacity 'capacity' if there is no log.
+ * Commits and compacts as 'policy' says (NULL to commit every operation).
+ * Returns NULL if the files cannot be created or read.
+ */
+HeapWal* openHeapWal(const char* path, int capacity, HeapOptions* options,
+                     HeapWalPolicy* policy) {
+	HeapWalHeader header;
+	int fd;
+	if (access(path, F_OK) != 0) {
+		header = (HeapWalHeader){
+			.magic = HEAP_WAL_MAGIC,
+			.version = HEAP_WAL_VERSION,
+			.generation = 0,
+			.capacity = capacity,
+			.layout = options == NULL ? HEAP_LAYOUT_IMPLICIT : options->layout,
+			.prefetchDistance = options == NULL ? 0 : options->prefetchDistance,
+			.insertBufferCapacity = options == NULL ? 0 : options->insertBufferCapacity,
+		};
+		bool synced;
+		fd = createLog(path, &header, &synced);
+		if (fd >= 0 && !synced) {
+			close(fd);
+			fd = -1;
+		}
+	} else {
+		fd = open(path, O_RDWR);
+	}
+
+	struct stat status;
+	if (fd < 0 || fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(header) ||
+	    pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+	    header.magic != HEAP_WAL_MAGIC || header.version != HEAP_WAL_VERSION) {
+		if (fd >= 0) close(fd);
+		return NULL;
+	}
+	MinHeap* heap = loadSnapshot(path, &header);
+	if (heap == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	// Replay, then cut off whatever follows the last intact frame
+	size_t logBytes = sizeof(header);
+	if ((size_t)status.st_size > sizeof(header)) {
+		const unsigned char* log = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (log == MAP_FAILED) {
+			close(fd);
+			deleteHeap(heap);
+			return NULL;
+		}
+		madvise((void*)log, status.st_size, MADV_SEQUENTIAL);
+		logBytes = replayLog(heap, log, status.st_size);
+		munmap((void*)log, status.st_size);
+	}
+	if (logBytes < (size_t)status.st_size &&
+	    (ftruncate(fd, logBytes) != 0 || fsync(fd) != 0)) {
+		close(fd);
+		deleteHeap(heap);
+		return NULL;
+	}
+
+	// A compaction cut short may have left the snapshot before or after
+	char snapshot[strlen(path) + SNAPSHOT_SUFFIX];
+	snapshotPath(snapshot, path, header.generation + 1);
+	unlink(snapshot);
+	if (header.generation > 1) {
+		snapshotPath(snapshot, path, header.generation - 1);
+		unlink(snapshot);
+	}
+
+	HeapWal* wal = malloc(sizeof(HeapWal));
+	wal->heap = heap;
+	wal->path = strdup(path);
+	wal->fd = fd;
+	wal->header = header;
+	wal->policy = policy == NULL ? (HeapWalPolicy){.commitOps = 1} : *policy;
+	if (wal->policy.compactBytes == 0) wal->policy.compactBytes = HEAP_WAL_COMPACT_BYTES;
+	wal->logBytes = logBytes;
+	wal->frameCapacity = INITIAL_FRAME_BYTES;
+	wal->frame = malloc(wal->frameCapacity);
+	wal->commits = 0;
+	wal->compactions = 0;
+	wal->bytesLogged = 0;
+	startFrame(wal);
+	return wal;
+}
+
+/* Makes every operation on the heap of 'wal' so far durable, and returns
+ * True. Returns False if the log cannot be written; they are then kept for
+ * the next commit.
+ */
+bool commitHeapWal(HeapWal* wal) {
+	if (wal->pending == 0) return true;
+
+	HeapWalFrame* frame = (HeapWalFrame*)wal->frame;
+	frame->magic = HEAP_WAL_FRAME_MAGIC;
+	frame->bytes = wal->frameBytes - sizeof(HeapWalFrame);
+	frame->checksum = fnv1a(wal->frame + sizeof(HeapWalFrame), frame->bytes);
+
+	// The commit point: once the log is synced, recovery will replay the frame
+	if (!writeAllAt(wal->fd, wal->frame, wal->frameBytes, wal->logBytes) ||
+	    fdatasync(wal->fd) != 0) {
+		// Drop whatever part made it; the frame is kept for the next try
+		ftruncate(wal->fd, wal->logBytes);
+		return false;
+	}
+	wal->logBytes += wal->frameBytes;
+	wal->bytesLogged += wal->frameBytes;
+	wal->commits++;
+	startFrame(wal);
+
+	if (wal->logBytes >= wal->policy.compactBytes) compactHeapWal(wal);
+	return true;
+}
+
+/* Commits, then saves the heap of 'wal' as a new snapshot and empties its
+ * log, and returns True. Returns False if the snapshot or the new log
+ * cannot be written, or the directory holding the log cannot be synced.
+ */
+bool compactHeapWal(HeapWal* wal) {
+	if (!commitHeapWal(wal)) return false;
+
+	// The new snapshot is unused until the new log names it; saveHeap syncs
+	// its directory entry before the log's rename can reach the disk
+	HeapWalHeader header = wal->header;
+	header.generation++;
+	char snapshot[strlen(wal->path) + SNAPSHOT_SUFFIX];
+	snapshotPath(snapshot, wal->path, header.generation);
+	if (!saveHeap(wal->heap, snapshot)) {
+		unlink(snapshot);
+		return false;
+	}
+	bool synced;
+	int fd = createLog(wal->path, &header, &synced);
+	if (fd < 0) {
+		unlink(snapshot);
+		return false;
+	}
+
+	// The new log is in place either way; but until its rename is durable, a
+	// crash may bring back the old log, which needs the old snapshot (the
+	// next recovery removes whichever of the two is left over)
+	close(wal->fd);
+	wal->fd = fd;
+	uint64_t oldGeneration = wal->header.generation;
+	wal->header = header;
+	wal->logBytes = sizeof(header);
+	if (!synced) return false;
+
+	// From here on the old snapshot is unused (a mapped heap keeps its pages)
+	if (oldGeneration > 0) {
+		snapshotPath(snapshot, wal->path, oldGeneration);
+		unlink(snapshot);
+	}
+	wal->compactions++;
+	return true;
+}
+
+/* Same as insert on the heap of 'wal', logged for its next group commit.
+ * Returns what that commit returned, if it made one, and True otherwise.
+ */
+bool walInsert(HeapWal* wal, int priority, int id) {
+	insert(wal->heap, priority, id);
+	return logOperation(wal, TRACE_INSERT, priority, id);
+}
+
+/* Same as extractMin on the heap of 'wal', storing the node in '*min'.
+ * Returns as walInsert does.
+ */
+bool walExtractMin(HeapWal* wal, HeapNode* min) {
+	*min = extractMin(wal->heap);
+	return logOperation(wal, TRACE_EXTRACT_MIN, 0, 0);
+}
+
+/* Same as decreasePriority on the heap of 'wal', storing whether it took
+ * effect in '*decreased' unless NULL. Returns as walInsert does.
+ */
+bool walDecreasePriority(HeapWal* wal, int id, int newPriority, bool* decreased) {
+	bool changed = decreasePriority(wal->heap, id, newPriority);
+	if (decreased != NULL) *decreased = changed;
+	return !changed || logOperation(wal, TRACE_DECREASE_PRIORITY, id, newPriority);
+}
+
+/* Commits the heap of 'wal', and closes and frees it. Returns False if the
+ * final commit failed.
+ */
+bool closeHeapWal(HeapWal* wal) {
+	bool closed = commitHeapWal(wal);
+	close(wal->fd);
+	deleteHeap(wal->heap);
+	free(wal->path);
+	free(wal->frame);
+	free(wal);
+	return closed;
+}
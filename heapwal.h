@@ -0,0 +1,125 @@
+/*
+ * Header file for our write-ahead-logged Priority Queue: a heap kept in
+ * memory, made durable by logging its operations rather than its memory.
+ *
+ * The log at 'path' is a HeapWalHeader, then frames: a HeapWalFrame, then
+ * the operations of one group commit, encoded as trace records (see
+ * heaptrace.h; priority deltas start over in each frame). A frame is
+ * written and synced in one go, so a group commit costs one fdatasync
+ * however many operations it holds. Commits happen every 'commitOps'
+ * operations, or when told to. With 'commitMicros' set, an operation done
+ * that long or longer after the oldest one still pending commits too: the
+ * age is checked on each operation, not by a timer, so a heap left idle
+ * keeps its pending operations until the next one (or commitHeapWal).
+ *
+ * The log applies to the snapshot its header names: the heap image
+ * 'path'.<generation> (see heapio.h), or an empty heap for generation 0.
+ * Compaction saves the heap as the next generation's snapshot, then
+ * replaces the log with an empty one naming it, so a crash at any point
+ * leaves a log and the snapshot it applies to. Recovery loads that snapshot
+ * with loadHeap and replays every intact frame onto it; a frame torn by the
+ * crash fails its checksum and is dropped.
+ *
+ * Only insert, extractMin and decreasePriority are logged; payloads are not.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __HeapWal_header
+#define __HeapWal_header
+
+#define HEAP_WAL_MAGIC 0x4c57484d    // "MHWL", little-endian
+#define HEAP_WAL_VERSION 1
+#define HEAP_WAL_FRAME_MAGIC 0x5257484d  // "MHWR", little-endian
+#define HEAP_WAL_COMPACT_BYTES (64L << 20)
+
+typedef struct heap_wal_header {
+  uint32_t magic;                 // HEAP_WAL_MAGIC
+  uint32_t version;               // HEAP_WAL_VERSION
+  uint64_t generation;            // of the snapshot the log applies to
+  int32_t capacity;               // the heap to create for generation 0
+  int32_t layout;
+  int32_t prefetchDistance;
+  int32_t insertBufferCapacity;
+} HeapWalHeader;
+
+typedef struct heap_wal_frame {
+  uint32_t magic;     // HEAP_WAL_FRAME_MAGIC
+  uint32_t bytes;     // size of the records that follow
+  uint64_t checksum;  // FNV-1a of those records
+} HeapWalFrame;
+
+typedef struct heap_wal_policy {
+  int commitOps;         // operations per group commit; 0 for no limit
+  long commitMicros;     // age of the oldest pending operation at which the
+                         // next operation commits; 0 for no limit
+  size_t compactBytes;   // log size that triggers a compaction; 0 for
+                         // HEAP_WAL_COMPACT_BYTES
+} HeapWalPolicy;
+
+typedef struct heap_wal {
+  MinHeap* heap;            // the heap itself; read it freely, and change it
+                            // through the functions below
+  char* path;               // the log
+  int fd;                   // open on the log
+  HeapWalHeader header;     // the header of the log
+  HeapWalPolicy policy;     // when to commit and compact
+  size_t logBytes;          // size of the log
+  unsigned char* frame;     // the frame being gathered, header first
+  size_t frameBytes;        // its size so far
+  size_t frameCapacity;     // bytes allocated for it
+  int lastPriority;         // as in HeapTrace, within the frame
+  int pending;              // operations in the frame
+  double firstPending;      // when the first of them was done, in seconds
+  long commits;             // group commits made since opening
+  long compactions;         // compactions made since opening
+  long bytesLogged;         // bytes appended to the log since opening
+} HeapWal;
+
+/* Opens the logged heap at 'path', recovering it from its snapshot and log.
+ * If there is no log at 'path', creates an empty heap of capacity
+ * 'capacity', configured by 'options' (may be NULL; only its layout,
+ * prefetchDistance and insertBufferCapacity are used). Commits and compacts
+ * as 'policy' says (NULL to commit every operation). Returns NULL if the
+ * files cannot be created or read.
+ */
+HeapWal* openHeapWal(const char* path, int capacity, HeapOptions* options,
+                     HeapWalPolicy* policy);
+
+/* Makes every operation on the heap of 'wal' so far durable: after this
+ * returns True, a crash no longer loses them. Returns False if the log
+ * cannot be written; they are then kept for the next commit.
+ */
+bool commitHeapWal(HeapWal* wal);
+
+/* Commits, then saves the heap of 'wal' as a new snapshot and empties its
+ * log, and returns True. Changes made to the heap without going through the
+ * functions below (such as a buildHeap after opening) become durable here.
+ * Returns False, leaving the log as it was, if the snapshot or the new log
+ * cannot be written; or with the new log in use, if the directory holding
+ * it cannot be synced: a crash may then bring back either log, and
+ * recovery works from either.
+ */
+bool compactHeapWal(HeapWal* wal);
+
+/* Same as insert, extractMin (storing the node in '*min') and
+ * decreasePriority (storing whether it took effect in '*decreased', unless
+ * NULL) on the heap of 'wal', with the same preconditions, logged for its
+ * next group commit. Return what that commit returned, if the operation
+ * made one, and True otherwise: the operation takes effect either way, and
+ * a failed commit keeps it for the next.
+ */
+bool walInsert(HeapWal* wal, int priority, int id);
+bool walExtractMin(HeapWal* wal, HeapNode* min);
+bool walDecreasePriority(HeapWal* wal, int id, int newPriority,
+                         bool* decreased);
+
+/* Commits the heap of 'wal', and closes and frees it. Returns False if the
+ * final commit failed.
+ */
+bool closeHeapWal(HeapWal* wal);
+
+#endif
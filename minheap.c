@@ -4,10 +4,11 @@
  * Author (starter code): A. Tafliovich.
  */
 
-#include "minheap.h"
+#include <stdarg.h>
+#include <string.h>
 
-#define ROOT_INDEX 1
-#define NOTHING -1
+#include "heapalloc.h"
+#include "minheap_internal.h"
 
 /*************************************************************************
  ** Suggested helper functions -- to help designing your code
@@ -20,12 +21,57 @@ bool isValidIndex(MinHeap* heap, int maybeIdx) {
 	return (maybeIdx >= ROOT_INDEX && maybeIdx <= heap->size);
 }
 
+/* Returns the position in arr of the node at index 'nodeIndex' under a
+ * blocked layout of 'height' levels per block, for a heap whose bottom block
+ * level is 'lastLevel' and uses 'lastHeight' levels.
+ */
+long blockedSlot(int nodeIndex, int height, int lastLevel, int lastHeight) {
+	// The tree is cut into subtrees of 'height' levels each, stored one per
+	// block in breadth-first order of blocks; within a block, nodes are in
+	// breadth-first order from offset 1 (offset 0 pads the block)
+	int depth = 31 - __builtin_clz(nodeIndex);
+	int blockLevel = depth / height;
+	int depthInBlock = depth % height;
+	long blockRoot = nodeIndex >> depthInBlock;
+	long firstRoot = 1L << (blockLevel * height);
+	long blocksBefore = (firstRoot - 1) / ((1L << height) - 1);
+	long offset = nodeIndex - (blockRoot << depthInBlock) + (1L << depthInBlock);
+	
+	// The bottom block level only needs as many levels as the capacity reaches;
+	// full-height blocks there could be almost all padding
+	if (blockLevel == lastLevel)
+		return (blocksBefore << height) + ((blockRoot - firstRoot) << lastHeight) + offset;
+	return ((blocksBefore + blockRoot - firstRoot) << height) + offset;
+}
+
+/* Returns the position in heap->arr of the node at index 'nodeIndex' in
+ * minheap 'heap'. Indices always follow the implicit layout (children of i at
+ * 2i and 2i + 1); only blocked layouts store nodes anywhere else.
+ */
+long slotOf(MinHeap* heap, int nodeIndex) {
+	if (heap->blockHeight == 0 || nodeIndex <= 0) return nodeIndex;
+	
+	// Constant heights let the compiler turn the divisions into multiplies
+	if (heap->blockHeight == LINE_BLOCK_HEIGHT)
+		return blockedSlot(nodeIndex, LINE_BLOCK_HEIGHT, heap->lastBlockLevel,
+		                   heap->lastBlockHeight);
+	return blockedSlot(nodeIndex, PAGE_BLOCK_HEIGHT, heap->lastBlockLevel,
+	                   heap->lastBlockHeight);
+}
+
+/* Returns a pointer to the node at index 'nodeIndex' in minheap 'heap'.
+ * Precondition: 0 <= 'nodeIndex' <= heap->capacity
+ */
+HeapNode* nodePtr(MinHeap* heap, int nodeIndex) {
+	return &heap->arr[slotOf(heap, nodeIndex)];
+}
+
 /* Returns node at index 'nodeIndex' in minheap 'heap'.
  * Precondition: 'nodeIndex' is a valid index in 'heap'
  *               'heap' is non-empty
  */
 HeapNode nodeAt(MinHeap* heap, int nodeIndex) {
-	return heap->arr[nodeIndex];
+	return *nodePtr(heap, nodeIndex);
 }
 
 /* Returns priority of node at index 'nodeIndex' in minheap 'heap'.
@@ -33,7 +79,7 @@ HeapNode nodeAt(MinHeap* heap, int nodeIndex) {
  *               'heap' is non-empty
  */
 int priorityAt(MinHeap* heap, int nodeIndex) {
-	return heap->arr[nodeIndex].priority;
+	return nodePtr(heap, nodeIndex)->priority;
 }
 
 /* Returns ID of node at index 'nodeIndex' in minheap 'heap'.
@@ -41,7 +87,7 @@ int priorityAt(MinHeap* heap, int nodeIndex) {
  *               'heap' is non-empty
  */
 int idAt(MinHeap* heap, int nodeIndex) {
-	return heap->arr[nodeIndex].id;
+	return nodePtr(heap, nodeIndex)->id;
 }
 
 /* Returns index of node with ID 'id' in minheap 'heap'.
@@ -52,6 +98,69 @@ int indexOf(MinHeap* heap, int id) {
 	return heap->indexMap[id];
 }
 
+/* Adds element 'i' to the dirty set 'set'.
+ */
+void markDirty(HeapDirtySet* set, long i) {
+	uint64_t* word = &set->bits[i / 64];
+	if (*word == 0) set->words[set->numWords++] = i / 64;
+	*word |= 1ULL << (i % 64);
+}
+
+/* Makes 'set' an empty dirty set with room for elements 0 to 'n' - 1.
+ * Returns False if memory runs out; 'set' is then only fit to be freed.
+ */
+bool initDirtySet(HeapDirtySet* set, long n) {
+	set->bits = calloc(n / 64 + 1, sizeof(uint64_t));
+	set->words = malloc(sizeof(long) * (n / 64 + 1));
+	set->numWords = 0;
+	return set->bits != NULL && set->words != NULL;
+}
+
+/* Frees the record of writes 'dirty'. Has no effect if it is NULL.
+ */
+void freeDirty(HeapDirty* dirty) {
+	if (dirty == NULL) return;
+	HeapDirtySet* sets[] = {&dirty->slots, &dirty->ids, &dirty->payloads};
+	for (int i = 0; i < 3; i++) {
+		free(sets[i]->bits);
+		free(sets[i]->words);
+	}
+	free(dirty);
+}
+
+/* Returns a new, empty record of the writes to minheap 'heap', or NULL if
+ * memory runs out.
+ */
+HeapDirty* newDirty(MinHeap* heap) {
+	HeapDirty* dirty = malloc(sizeof(HeapDirty));
+	if (dirty == NULL) return NULL;
+	// Not &&: all three must be set up for freeDirty, whichever fails
+	bool allocated = initDirtySet(&dirty->slots, heap->arrSlots) &
+	                 initDirtySet(&dirty->ids, heap->capacity) &
+	                 initDirtySet(&dirty->payloads, heap->payloadSize > 0 ? heap->capacity : 0);
+	if (allocated) return dirty;
+	freeDirty(dirty);
+	return NULL;
+}
+
+/* Writes 'node' at index 'nodeIndex' of minheap 'heap', recording its slot
+ * as written if 'heap' tracks writes or has been dumped.
+ */
+void setNode(MinHeap* heap, int nodeIndex, HeapNode node) {
+	*nodePtr(heap, nodeIndex) = node;
+	if (heap->dirty != NULL) markDirty(&heap->dirty->slots, slotOf(heap, nodeIndex));
+	if (heap->dumped != NULL) markDirty(&heap->dumped->slots, slotOf(heap, nodeIndex));
+}
+
+/* Sets the index of ID 'id' in minheap 'heap' to 'nodeIndex', recording it
+ * as written if 'heap' tracks writes or has been dumped.
+ */
+void setIndex(MinHeap* heap, int id, int nodeIndex) {
+	heap->indexMap[id] = nodeIndex;
+	if (heap->dirty != NULL) markDirty(&heap->dirty->ids, id);
+	if (heap->dumped != NULL) markDirty(&heap->dumped->ids, id);
+}
+
 /* Returns the index of the left child of a node at index 'nodeIndex' in
  * minheap 'heap', if such exists.  Returns NOTHING if there is no such left
  * child.
@@ -83,20 +192,36 @@ int parentIdx(MinHeap* heap, int nodeIndex) {
 }
 
 /* Swaps contents of heap->arr[index1] and heap->arr[index2] if both 'index1'
- * and 'index2' are valid indices for minheap 'heap'. Has no effect
- * otherwise.
+ * and 'index2' are valid indices for minheap 'heap', recording the exchange
+ * in heap->swapping first if it is set. Has no effect otherwise.
  */
 void swap(MinHeap* heap, int index1, int index2) {
 	if (isValidIndex(heap, index1) && isValidIndex(heap, index2)) {
 		HeapNode temp = nodeAt(heap, index1);
 		
+		// Between the two writes below, 'temp' is nowhere but here. The
+		// fences keep the compiler from moving writes across the record,
+		// which is all a process that dies mid-swap needs
+		HeapSwap* swapping = heap->swapping;
+		if (swapping != NULL) {
+			*swapping = (HeapSwap){0, index1, index2, temp, nodeAt(heap, index2)};
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			swapping->active = 1;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		}
+		
 		// Update indices in indexMap
-		heap->indexMap[idAt(heap, index1)] = index2;
-		heap->indexMap[idAt(heap, index2)] = index1;
+		setIndex(heap, idAt(heap, index1), index2);
+		setIndex(heap, idAt(heap, index2), index1);
 		
 		// Swap nodes in arr
-		heap->arr[index1] = nodeAt(heap, index2);
-		heap->arr[index2] = temp;
+		setNode(heap, index1, nodeAt(heap, index2));
+		setNode(heap, index2, temp);
+		
+		if (swapping != NULL) {
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			swapping->active = 0;
+		}
 	}
 }
 
@@ -117,18 +242,44 @@ void bubbleUp(MinHeap* heap, int nodeIndex) {
 	}
 }
 
-/* Bubbles down the element newly inserted into minheap 'heap' at the root,
- * if it exists. Has no effect otherwise.
+/* Starts loading, without waiting for it, the level of minheap 'heap'
+ * 'distance' levels below the sibling pair whose left node is at index
+ * 'left'. Those descendants occupy indices [left << distance,
+ * ((left + 2) << distance) - 1].
  */
-void bubbleDown(MinHeap* heap) {
-	if (heap != NULL && heap->size > 0) {
-		int id = idAt(heap, ROOT_INDEX);
-		int left = leftIdx(heap, ROOT_INDEX);
-		int right = rightIdx(heap, ROOT_INDEX);
+void prefetchBelow(MinHeap* heap, int left, int distance) {
+	long first = (long)left << distance;
+	long last = (((long)left + 2) << distance) - 1;
+	if (first > heap->size) return;
+	if (last > heap->size) last = heap->size;
+	
+	if (heap->blockHeight == 0) {
+		// Contiguous in arr: touch every cache line they span
+		for (char* p = (char*)&heap->arr[first]; p <= (char*)&heap->arr[last]; p += CACHE_LINE_SIZE)
+			__builtin_prefetch(p, 1);
+		__builtin_prefetch(&heap->arr[last], 1);
+	} else {
+		// Scattered over at most a couple of blocks; the ends are a good guess
+		__builtin_prefetch(nodePtr(heap, (int)first), 1);
+		__builtin_prefetch(nodePtr(heap, (int)last), 1);
+	}
+}
+
+/* Bubbles down the element at index 'nodeIndex' of minheap 'heap' until both
+ * its subtrees satisfy the heap property, if 'nodeIndex' is a valid index
+ * for heap. Has no effect otherwise.
+ * Only touches nodes in the subtree rooted at 'nodeIndex'.
+ */
+void bubbleDownFrom(MinHeap* heap, int nodeIndex) {
+	if (heap != NULL && isValidIndex(heap, nodeIndex)) {
+		int id = idAt(heap, nodeIndex);
+		int left = leftIdx(heap, nodeIndex);
+		int right = rightIdx(heap, nodeIndex);
 		
 		// stop condition: no children or satisfied order of priorities
 		// (left will exist if right exists, by nature of being nearly-complete)
 		while (left != NOTHING) {
+			if (heap->prefetchDistance > 0) prefetchBelow(heap, left, heap->prefetchDistance);
 			int priority = priorityAt(heap, indexOf(heap, id));
 			int priorityLeft = priorityAt(heap, left);
 			
@@ -157,30 +308,224 @@ void bubbleDown(MinHeap* heap) {
 	}
 }
 
+/* Bubbles down the element newly inserted into minheap 'heap' at the root,
+ * if it exists. Has no effect otherwise.
+ */
+void bubbleDown(MinHeap* heap) {
+	bubbleDownFrom(heap, ROOT_INDEX);
+}
+
+/* Returns the number of levels of a minheap holding 'size' nodes.
+ */
+int heapHeight(int size) {
+	int levels = 0;
+	while (size > 0) {
+		levels++;
+		size /= 2;
+	}
+	return levels;
+}
+
+/* Appends the 'n' nodes whose priorities are 'priorities' and whose IDs are
+ * 'ids' (or 0..n-1 if 'ids' is NULL) after the last node of minheap 'heap',
+ * without restoring the heap property.
+ * Precondition: heap->size + n <= heap->capacity
+ */
+void appendNodes(MinHeap* heap, int* priorities, int* ids, int n) {
+	for (int i = 0; i < n; i++) {
+		int nodeIndex = heap->size + 1 + i;
+		HeapNode node = {priorities[i], ids == NULL ? i : ids[i]};
+		setNode(heap, nodeIndex, node);
+		setIndex(heap, node.id, nodeIndex);
+	}
+	heap->size += n;
+}
+
+/* Restores the heap property of minheap 'heap', given that only the nodes at
+ * indices 'first' to 'last' may violate it: bubbles down those nodes, then
+ * their parents, and so on up to the root.
+ */
+void heapifyRange(MinHeap* heap, int first, int last) {
+	while (last >= ROOT_INDEX) {
+		for (int i = last; i >= first; i--) bubbleDownFrom(heap, i);
+		if (first == ROOT_INDEX) break;
+		first /= 2;
+		last /= 2;
+	}
+}
+
+/* Restores the heap property of minheap 'heap' after nodes were appended at
+ * indices 'first' to heap->size: either bubbles each one up, or re-heapifies
+ * their ancestors in bulk, whichever is estimated to be cheaper.
+ */
+void heapifyAppended(MinHeap* heap, int first) {
+	int n = heap->size - first + 1;
+	
+	// Worst cases: n full-height bubbleUps, vs. ~2n bubbleDowns (mostly near
+	// the leaves) plus one range per level up to the root
+	int levels = heapHeight(heap->size);
+	long perNode = (long)n * levels;
+	long bulk = 2L * n + (long)levels * levels;
+	
+	if (perNode <= bulk) {
+		for (int i = first; i <= heap->size; i++) bubbleUp(heap, i);
+	} else {
+		heapifyRange(heap, first, heap->size);
+	}
+}
+
+/* Returns True if 'maybeIdx' is the index of a node in the insertion buffer
+ * of minheap 'heap'. Returns False otherwise.
+ */
+bool isBufferIndex(MinHeap* heap, int maybeIdx) {
+	return maybeIdx > heap->size && maybeIdx <= heap->size + heap->bufferSize;
+}
+
+/* Returns 'a' minus 'b', for sorting word indices of a dirty set.
+ */
+int compareWords(const void* a, const void* b) {
+	long x = *(const long*)a, y = *(const long*)b;
+	return (x > y) - (x < y);
+}
+
+/* Appends the text 'format' and what follows make (as for printf) to the
+ * '*used' bytes of the buffer at '*text', growing it (and '*capacity') as
+ * needed. If memory runs out, frees the buffer and sets '*text' to NULL;
+ * has no effect once it is NULL.
+ */
+void appendText(char** text, size_t* used, size_t* capacity, const char* format, ...) {
+	while (*text != NULL) {
+		va_list args;
+		va_start(args, format);
+		int length = vsnprintf(*text + *used, *capacity - *used, format, args);
+		va_end(args);
+		if (*used + length < *capacity) {
+			*used += length;
+			return;
+		}
+		*capacity = 2 * (*used + length + 1);
+		char* grown = realloc(*text, *capacity);
+		if (grown == NULL) free(*text);
+		*text = grown;
+	}
+}
+
+/* Returns True if the insertion buffer of minheap 'heap' holds a node of
+ * smaller priority than every node in the heap proper.
+ */
+bool bufferHoldsMin(MinHeap* heap) {
+	return heap->bufferSize > 0 &&
+	       (heap->size == 0 || priorityAt(heap, heap->bufferMin) < priorityAt(heap, ROOT_INDEX));
+}
+
+/* Moves the node at index 'from' of minheap 'heap' to index 'to', keeping
+ * indexMap in step. Unlike swap, works on buffered nodes too.
+ */
+void moveNode(MinHeap* heap, int from, int to) {
+	setNode(heap, to, nodeAt(heap, from));
+	setIndex(heap, idAt(heap, to), to);
+}
+
+/* Removes the buffered node at index 'nodeIndex' of minheap 'heap' and
+ * returns it. The last buffered node takes its place.
+ * Precondition: 'nodeIndex' is a buffer index of 'heap'
+ */
+HeapNode removeFromBuffer(MinHeap* heap, int nodeIndex) {
+	HeapNode save = nodeAt(heap, nodeIndex);
+	setIndex(heap, save.id, 0);
+	
+	int last = heap->size + heap->bufferSize;
+	if (nodeIndex != last) moveNode(heap, last, nodeIndex);
+	heap->bufferSize--;
+	
+	// Rescan for the new minimum; the buffer is small by design
+	heap->bufferMin = NOTHING;
+	for (int i = heap->size + 1; i <= heap->size + heap->bufferSize; i++)
+		if (heap->bufferMin == NOTHING || priorityAt(heap, i) < priorityAt(heap, heap->bufferMin))
+			heap->bufferMin = i;
+	
+	return save;
+}
+
+/* Adds the node at index 'nodeIndex' of minheap 'heap' to 'frontier', a
+ * 0-based array heap of 'frontierSize' entries whose IDs are indices into
+ * heap->arr, and returns the new frontier size.
+ */
+int frontierPush(MinHeap* heap, HeapNode* frontier, int frontierSize,
+                 int nodeIndex) {
+	HeapNode entry = {priorityAt(heap, nodeIndex), nodeIndex};
+	int i = frontierSize;
+	while (i > 0 && frontier[(i - 1) / 2].priority > entry.priority) {
+		frontier[i] = frontier[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	frontier[i] = entry;
+	return frontierSize + 1;
+}
+
+/* Removes the entry of minimum priority from 'frontier' (see frontierPush)
+ * and returns it.
+ * Precondition: frontierSize > 0
+ */
+HeapNode frontierPop(HeapNode* frontier, int frontierSize) {
+	HeapNode min = frontier[0];
+	HeapNode last = frontier[--frontierSize];
+	int i = 0;
+	while (2 * i + 1 < frontierSize) {
+		int child = 2 * i + 1;
+		if (child + 1 < frontierSize && frontier[child + 1].priority < frontier[child].priority)
+			child++;
+		if (last.priority <= frontier[child].priority) break;
+		frontier[i] = frontier[child];
+		i = child;
+	}
+	frontier[i] = last;
+	return min;
+}
+
 /*********************************************************************
  * Required functions
  ********************************************************************/
 
+/* Returns the number of nodes in minheap 'heap', including any still in its
+ * insertion buffer.
+ */
+int numNodes(MinHeap* heap) {
+	return heap->size + heap->bufferSize;
+}
+
 /* Returns the node with minimum priority in minheap 'heap'.
  * Precondition: heap is non-empty
  */
 HeapNode getMin(MinHeap* heap) {
-	return heap->arr[ROOT_INDEX];	// since heap non-empty by precond.
+	if (heap->trace != NULL) heap->traceOp(heap->trace, TRACE_GET_MIN, 0, 0);
+	if (bufferHoldsMin(heap)) return nodeAt(heap, heap->bufferMin);
+	return nodeAt(heap, ROOT_INDEX);	// since heap non-empty by precond.
 }
 
 /* Removes and returns the node with minimum priority in minheap 'heap'.
  * Precondition: heap is non-empty
  */
 HeapNode extractMin(MinHeap* heap) {
+	if (heap->trace != NULL) heap->traceOp(heap->trace, TRACE_EXTRACT_MIN, 0, 0);
+	if (bufferHoldsMin(heap)) return removeFromBuffer(heap, heap->bufferMin);
+	
 	// Swap root and bottom rightmost node
 	swap(heap, ROOT_INDEX, heap->size);
 	
 	// Save and remove bottom rightmost node
 	HeapNode save = nodeAt(heap, heap->size);
 	
-	heap->indexMap[idAt(heap, heap->size)] = 0;
+	setIndex(heap, idAt(heap, heap->size), 0);
 	heap->size--;	// TODO: Removed node is still printed, fix
 	
+	// The buffer starts right after the heap; close the gap left behind
+	if (heap->bufferSize > 0) {
+		int last = heap->size + 1 + heap->bufferSize;
+		moveNode(heap, last, heap->size + 1);
+		if (heap->bufferMin == last) heap->bufferMin = heap->size + 1;
+	}
+	
 	// Bubble down newly swapped root node
 	bubbleDown(heap);
 	
@@ -193,21 +538,118 @@ HeapNode extractMin(MinHeap* heap) {
  *               heap->size < heap->capacity
  */
 void insert(MinHeap* heap, int priority, int id) {
+	if (heap->trace != NULL) heap->traceOp(heap->trace, TRACE_INSERT, priority, id);
+	
 	HeapNode newNode;
 	newNode.priority = priority;
 	newNode.id = id;
-	heap->arr[heap->size + 1] = newNode;		// insert into arr
-	heap->indexMap[id] = heap->size + 1;		// insert into indexMap
+	
+	if (heap->bufferCapacity > 0) {
+		if (heap->bufferSize == heap->bufferCapacity) flushInsertBuffer(heap);
+		
+		int nodeIndex = heap->size + heap->bufferSize + 1;
+		setNode(heap, nodeIndex, newNode);
+		setIndex(heap, id, nodeIndex);
+		heap->bufferSize++;
+		if (heap->bufferMin == NOTHING || priority < priorityAt(heap, heap->bufferMin))
+			heap->bufferMin = nodeIndex;
+		return;
+	}
+	
+	setNode(heap, heap->size + 1, newNode);	// insert into arr
+	setIndex(heap, id, heap->size + 1);		// insert into indexMap
 	heap->size++;						// increment heap size
 	
 	// Bubble up newly inserted node
 	bubbleUp(heap, heap->size);
 }
 
+/* Replaces the contents of minheap 'heap' with the 'n' nodes whose
+ * priorities are 'priorities' and whose IDs are 'ids' (or 0..n-1 if 'ids' is
+ * NULL), and restores the heap property bottom-up in O(n).
+ * Precondition: IDs are unique and 0 <= id < heap->capacity
+ *               0 <= n <= heap->capacity
+ */
+void buildHeap(MinHeap* heap, int* priorities, int* ids, int n) {
+	markDumpedIds(heap);
+	heap->size = 0;
+	heap->bufferSize = 0;
+	heap->bufferMin = NOTHING;
+	appendNodes(heap, priorities, ids, n);
+	heapifyRange(heap, ROOT_INDEX, heap->size);
+}
+
+/* Inserts the 'n' nodes whose priorities are 'priorities' and whose IDs are
+ * 'ids' into minheap 'heap', either one by one or by appending them all and
+ * re-heapifying only their ancestors, whichever is estimated to be cheaper.
+ * Precondition: IDs are unique within this minheap
+ *               0 <= id < heap->capacity
+ *               heap->size + n <= heap->capacity
+ */
+void insertBatch(MinHeap* heap, int* priorities, int* ids, int n) {
+	if (n <= 0) return;
+	if (heap->trace != NULL)
+		for (int i = 0; i < n; i++)
+			heap->traceOp(heap->trace, TRACE_INSERT, priorities[i],
+			              ids == NULL ? i : ids[i]);
+	
+	flushInsertBuffer(heap);
+	int first = heap->size + 1;
+	appendNodes(heap, priorities, ids, n);
+	heapifyAppended(heap, first);
+}
+
+/* Same as extractMin, but also sets '*payload' to the payload of the node
+ * removed. Prefetches that payload first, so it loads while the heap is
+ * restored rather than after.
+ * Precondition: heap is non-empty
+ *               heap->payloadSize > 0
+ */
+HeapNode extractMinWithPayload(MinHeap* heap, void** payload) {
+	// Not getMin, which a trace would record as a call of its own
+	int minIndex = bufferHoldsMin(heap) ? heap->bufferMin : ROOT_INDEX;
+	*payload = payloadOf(heap, idAt(heap, minIndex));
+	__builtin_prefetch(*payload, 0, 3);
+	return extractMin(heap);
+}
+
+/* Returns a pointer to the heap->payloadSize bytes of payload of ID 'id' in
+ * minheap 'heap'. The payload stays put, and keeps its contents, whether or
+ * not a node with that ID is in the heap.
+ * Precondition: 0 <= 'id' < heap->capacity
+ *               heap->payloadSize > 0
+ */
+void* payloadOf(MinHeap* heap, int id) {
+	return heap->payload + (size_t)id * heap->payloadSize;
+}
+
+/* Copies heap->payloadSize bytes from 'payload' to the payload of ID 'id' in
+ * minheap 'heap'.
+ * Precondition: 0 <= 'id' < heap->capacity
+ *               heap->payloadSize > 0
+ */
+void setPayload(MinHeap* heap, int id, const void* payload) {
+	memcpy(payloadOf(heap, id), payload, heap->payloadSize);
+	if (heap->dirty != NULL) markDirty(&heap->dirty->payloads, id);
+}
+
+/* Returns True if minheap 'heap' holds a node with ID 'id', in the heap
+ * proper or its insertion buffer. Returns False otherwise.
+ * Precondition: 0 <= 'id' < heap->capacity
+ */
+bool holdsId(MinHeap* heap, int id) {
+	// indexMap is not cleared for absent IDs, so confirm the slot points back
+	int nodeIndex = indexOf(heap, id);
+	return (isValidIndex(heap, nodeIndex) || isBufferIndex(heap, nodeIndex)) &&
+	       idAt(heap, nodeIndex) == id;
+}
+
 /* Returns priority of the node with ID 'id' in 'heap'.
  * Precondition: 'id' is a valid node ID in 'heap'.
  */
-int getPriority(MinHeap* heap, int id);
+int getPriority(MinHeap* heap, int id) {
+	return priorityAt(heap, indexOf(heap, id));
+}
 
 /* Sets priority of node with ID 'id' in minheap 'heap' to 'newPriority', if
  * such a node exists in 'heap' and its priority is larger than
@@ -215,27 +657,267 @@ int getPriority(MinHeap* heap, int id);
  * Note: this function bubbles up the node until the heap property is restored.
  */
 bool decreasePriority(MinHeap* heap, int id, int newPriority) {
-	return false;	//TODO: Complete
+	if (heap == NULL || id < 0 || id >= heap->capacity) return false;
+	
+	// indexMap is not cleared for absent IDs, so confirm the slot points back
+	int nodeIndex = indexOf(heap, id);
+	bool buffered = isBufferIndex(heap, nodeIndex);
+	if (!isValidIndex(heap, nodeIndex) && !buffered) return false;
+	if (idAt(heap, nodeIndex) != id) return false;
+	if (priorityAt(heap, nodeIndex) <= newPriority) return false;
+	
+	// Only decreases that take effect are traced
+	if (heap->trace != NULL)
+		heap->traceOp(heap->trace, TRACE_DECREASE_PRIORITY, id, newPriority);
+	HeapNode node = {newPriority, id};
+	setNode(heap, nodeIndex, node);
+	if (!buffered) bubbleUp(heap, nodeIndex);
+	else if (newPriority < priorityAt(heap, heap->bufferMin)) heap->bufferMin = nodeIndex;
+	return true;
+}
+
+/* Copies the 'k' nodes of minimum priority in minheap 'heap' into 'out', in
+ * increasing order of priority, and returns how many were copied (fewer than
+ * 'k' if 'heap' is smaller). Does not modify 'heap'. Runs in O(k log k).
+ * Precondition: 'out' has room for 'k' nodes
+ */
+int topK(MinHeap* heap, int k, HeapNode out[]) {
+	if (k > numNodes(heap)) k = numNodes(heap);
+	if (k <= 0) return 0;
+	
+	// The next smallest node is always a child of one already taken, or a
+	// buffered node, so the frontier never holds more than k + 1 + bufferSize
+	// candidates
+	HeapNode* frontier = malloc(sizeof(HeapNode) * (k + 1 + heap->bufferSize));
+	int frontierSize = 0;
+	if (heap->size > 0) frontierSize = frontierPush(heap, frontier, 0, ROOT_INDEX);
+	for (int i = heap->size + 1; i <= heap->size + heap->bufferSize; i++)
+		frontierSize = frontierPush(heap, frontier, frontierSize, i);
+	
+	for (int taken = 0; taken < k; taken++) {
+		int nodeIndex = frontierPop(frontier, frontierSize--).id;
+		out[taken] = nodeAt(heap, nodeIndex);
+		
+		int left = leftIdx(heap, nodeIndex);
+		int right = rightIdx(heap, nodeIndex);
+		if (left != NOTHING) frontierSize = frontierPush(heap, frontier, frontierSize, left);
+		if (right != NOTHING) frontierSize = frontierPush(heap, frontier, frontierSize, right);
+	}
+	
+	free(frontier);
+	return k;
+}
+
+/* Removes the 'k' nodes of minimum priority from minheap 'heap' into 'out',
+ * in increasing order of priority, and returns how many were removed (fewer
+ * than 'k' if 'heap' is smaller).
+ * Precondition: 'out' has room for 'k' nodes
+ */
+int extractMinBatch(MinHeap* heap, int k, HeapNode out[]) {
+	flushInsertBuffer(heap);
+	if (k > heap->size) k = heap->size;
+	if (k <= 0) return 0;
+	
+	// Few nodes: k bubbleDowns of the root are cheapest
+	if ((long)k * heapHeight(heap->size) <= heap->size) {
+		for (int i = 0; i < k; i++) out[i] = extractMin(heap);
+		return k;
+	}
+	
+	// Many nodes: read them off without sifting, then compact the rest and
+	// rebuild once in O(size). A trace records the k extractMins this stands for
+	if (heap->trace != NULL)
+		for (int i = 0; i < k; i++) heap->traceOp(heap->trace, TRACE_EXTRACT_MIN, 0, 0);
+	topK(heap, k, out);
+	for (int i = 0; i < k; i++) setIndex(heap, out[i].id, 0);
+	
+	int kept = 0;
+	for (int i = ROOT_INDEX; i <= heap->size; i++) {
+		if (indexOf(heap, idAt(heap, i)) != i) continue;	// one of the k taken
+		setNode(heap, ROOT_INDEX + kept, nodeAt(heap, i));
+		setIndex(heap, idAt(heap, i), ROOT_INDEX + kept);
+		kept++;
+	}
+	heap->size = kept;
+	heapifyRange(heap, ROOT_INDEX, heap->size);
+	
+	return k;
+}
+
+/* Moves every node in the insertion buffer of minheap 'heap' into the heap
+ * proper, with one bulk re-heapify. Has no effect if the buffer is empty.
+ */
+void flushInsertBuffer(MinHeap* heap) {
+	if (heap->bufferSize == 0) return;
+	
+	// Buffered nodes already sit right after the heap, so just take them in
+	int first = heap->size + 1;
+	heap->size += heap->bufferSize;
+	heap->bufferSize = 0;
+	heap->bufferMin = NOTHING;
+	heapifyAppended(heap, first);
+}
+
+/* Sets every field of the empty minheap 'heap' of capacity 'capacity', as
+ * configured by 'options' (or the defaults if NULL), except arr and indexMap.
+ * A prefetch distance outside 0..MAX_PREFETCH_DISTANCE is clamped to it.
+ */
+void initHeap(MinHeap* heap, int capacity, HeapOptions* options) {
+	heap->size = 0;
+	heap->capacity = capacity;
+	heap->layout = options == NULL ? HEAP_LAYOUT_IMPLICIT : options->layout;
+	heap->blockHeight = heap->layout == HEAP_LAYOUT_LINES ? LINE_BLOCK_HEIGHT
+	                  : heap->layout == HEAP_LAYOUT_PAGES ? PAGE_BLOCK_HEIGHT : 0;
+	heap->prefetchDistance = options == NULL ? 0 : options->prefetchDistance;
+	if (heap->prefetchDistance < 0) heap->prefetchDistance = 0;
+	if (heap->prefetchDistance > MAX_PREFETCH_DISTANCE) heap->prefetchDistance = MAX_PREFETCH_DISTANCE;
+	heap->allocator = options == NULL ? HEAP_ALLOC_MALLOC : options->allocator;
+	heap->arena = NULL;
+	heap->mapping = NULL;
+	heap->mappingBytes = 0;
+	heap->payloadSize = options == NULL ? 0 : options->payloadSize;
+	heap->payload = NULL;
+	heap->trace = NULL;
+	heap->traceOp = NULL;
+	heap->dirty = NULL;
+	heap->dumped = NULL;
+	heap->swapping = NULL;
+	
+	// slotOf reads the bottom block level from here rather than work it out
+	// from the capacity on every call
+	int lastDepth = 31 - __builtin_clz(capacity > 0 ? capacity : 1);
+	heap->lastBlockLevel = heap->blockHeight == 0 ? 0 : lastDepth / heap->blockHeight;
+	heap->lastBlockHeight = heap->blockHeight == 0 ? 0 : lastDepth % heap->blockHeight + 1;
+	
+	if (heap->blockHeight == 0) {
+		heap->arrSlots = (long)capacity + 1;	// capacity and empty index 0; no int overflow
+	} else {
+		// Up to the end of the block holding the last root of the bottom block
+		// level
+		long blockSize = 1L << heap->blockHeight;
+		int lastRootDepth = heap->lastBlockLevel * heap->blockHeight;
+		long lastRoot = (2L << lastRootDepth) - 1;
+		if (lastRoot > capacity) lastRoot = capacity > 0 ? capacity : 1;
+		long slots = slotOf(heap, lastRoot) + (1L << (lastDepth - lastRootDepth + 1));
+		heap->arrSlots = (slots + blockSize - 1) / blockSize * blockSize;	// whole blocks
+	}
+	
+	// The buffer lives in the unused tail of arr, so it needs no memory of its own
+	heap->bufferSize = 0;
+	heap->bufferCapacity = options == NULL ? 0 : options->insertBufferCapacity;
+	heap->bufferMin = NOTHING;
 }
 
-/* Returns a newly created empty minheap with initial capacity 'capacity'.
+/* Returns the alignment arr of minheap 'heap' needs so that no block of its
+ * layout straddles a line (or page), or 0 if it needs none.
+ */
+size_t arrAlignment(MinHeap* heap) {
+	return heap->blockHeight == 0 ? 0 : sizeof(HeapNode) << heap->blockHeight;
+}
+
+/* Returns the bytes allocated for the payload of minheap 'heap': whole
+ * cache lines, as aligned_alloc requires a multiple of the alignment.
+ */
+size_t payloadBytes(MinHeap* heap) {
+	size_t bytes = heap->payloadSize * heap->capacity;
+	return (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+/* Returns a newly created empty minheap with initial capacity 'capacity', or
+ * NULL if its memory cannot be allocated.
  * Precondition: capacity >= 0
  */
 MinHeap* newHeap(int capacity) {
+	return newHeapWithOptions(capacity, NULL);
+}
+
+/* Returns a newly created empty minheap with initial capacity 'capacity',
+ * configured by 'options', or NULL if its memory cannot be allocated. A
+ * zero-initialised HeapOptions (or NULL) gives the same heap as newHeap.
+ * Precondition: capacity >= 0
+ */
+MinHeap* newHeapWithOptions(int capacity, HeapOptions* options) {
 	MinHeap *new = malloc(sizeof(MinHeap));
-	new->size = 0;
-	new->capacity = capacity;
-	new->arr = malloc(sizeof(HeapNode) * (capacity + 1));	// allocate for capacity and empty index 0
-	new->indexMap = malloc(sizeof(int) * capacity);
+	if (new == NULL) return NULL;
+	initHeap(new, capacity, options);
 	
+	int numaNode = options != NULL && options->bindNuma ? options->numaNode : NOTHING;
+	new->arr = heapAlloc(new->allocator, sizeof(HeapNode) * new->arrSlots,
+	                     arrAlignment(new), numaNode);
+	new->indexMap = heapAlloc(new->allocator, sizeof(int) * capacity, 0, numaNode);
+	if (new->payloadSize > 0)
+		new->payload = heapAlloc(new->allocator, payloadBytes(new),
+		                         CACHE_LINE_SIZE, numaNode);
+	
+	// An allocator may return NULL for no bytes, which is not a failure
+	if (new->arr == NULL || (new->indexMap == NULL && capacity > 0) ||
+	    (new->payload == NULL && payloadBytes(new) > 0)) {
+		heapFree(new->allocator, new->arr, sizeof(HeapNode) * new->arrSlots);
+		heapFree(new->allocator, new->indexMap, sizeof(int) * capacity);
+		heapFree(new->allocator, new->payload, payloadBytes(new));
+		free(new);
+		return NULL;
+	}
 	return new;
 }
 
+/* Starts recording, in heap->dirty, every write to the arr, indexMap and
+ * payload (through setPayload) of minheap 'heap'. Has no effect if already
+ * recording. buildHeapParallel records its writes once its workers are
+ * done.
+ */
+void startTrackingWrites(MinHeap* heap) {
+	if (heap->dirty == NULL) heap->dirty = newDirty(heap);
+}
+
+/* Stops recording the writes to minheap 'heap', and frees heap->dirty. Has
+ * no effect if not recording.
+ */
+void stopTrackingWrites(MinHeap* heap) {
+	freeDirty(heap->dirty);
+	heap->dirty = NULL;
+}
+
+/* Records every ID minheap 'heap' holds as written in heap->dumped, if it
+ * has been dumped, so that the next dumpHeapChanges reports those that
+ * rebuilding the heap drops. Nothing else writes to the indexMap entry of
+ * an ID it drops.
+ */
+void markDumpedIds(MinHeap* heap) {
+	if (heap->dumped == NULL) return;
+	for (int i = ROOT_INDEX; i <= heap->size + heap->bufferSize; i++)
+		markDirty(&heap->dumped->ids, idAt(heap, i));
+}
+
+/* Empties 'set'.
+ */
+void clearDirtySet(HeapDirtySet* set) {
+	for (long i = 0; i < set->numWords; i++) set->bits[set->words[i]] = 0;
+	set->numWords = 0;
+}
+
 /* Frees all memory allocated for minheap 'heap'.
  */
 void deleteHeap(MinHeap* heap) {
-	free(heap->arr);
-	free(heap->indexMap);
+	stopTrackingWrites(heap);
+	freeDirty(heap->dumped);
+	
+	// Arena heaps are one block, header included
+	if (heap->allocator == HEAP_ALLOC_ARENA) {
+		arenaFree(heap->arena, heap, arenaBlockBytes(heap));
+		return;
+	}
+	
+	// Mapped heaps are views into one mapping, header excluded
+	if (heap->allocator == HEAP_ALLOC_MAPPED) {
+		heapFree(heap->allocator, heap->mapping, heap->mappingBytes);
+		free(heap);
+		return;
+	}
+	
+	heapFree(heap->allocator, heap->arr, sizeof(HeapNode) * heap->arrSlots);
+	heapFree(heap->allocator, heap->indexMap, sizeof(int) * heap->capacity);
+	heapFree(heap->allocator, heap->payload, payloadBytes(heap));
 	free(heap);
 }
 
@@ -253,3 +935,89 @@ void printHeap(MinHeap* heap) {
          idAt(heap, heap->capacity));
   printf("\n\n");
 }
+
+/* Prints the nodes of minheap 'heap' that it holds, without the unused
+ * slots and indexMap entries printHeap goes through, with one fwrite to
+ * 'out'. Starts recording the writes to 'heap' in heap->dumped, from
+ * nothing, so that the next dumpHeapChanges shows what changed since this
+ * dump; heap->dirty, which a PersistentHeap may own, is left alone.
+ */
+void dumpHeap(MinHeap* heap, FILE* out) {
+	size_t used = 0, capacity = DUMP_LINE_BYTES * ((size_t)heap->size + heap->bufferSize + 4);
+	char* text = malloc(capacity);
+	appendText(&text, &used, &capacity, "MinHeap with size: %d\n\tcapacity: %d\n\n",
+	           heap->size, heap->capacity);
+	appendText(&text, &used, &capacity, "index: priority [ID]\n");
+	for (int i = ROOT_INDEX; i <= heap->size + heap->bufferSize; i++) {
+		if (i == heap->size + 1) appendText(&text, &used, &capacity, "buffered:\n");
+		appendText(&text, &used, &capacity, "%d: %d [%d]\n", i, priorityAt(heap, i),
+		           idAt(heap, i));
+	}
+	appendText(&text, &used, &capacity, "\n\n");
+	if (text == NULL) return;
+	fwrite(text, 1, used, out);
+	free(text);
+
+	if (heap->dumped == NULL) {
+		heap->dumped = newDirty(heap);
+		return;
+	}
+	clearDirtySet(&heap->dumped->slots);
+	clearDirtySet(&heap->dumped->ids);
+}
+
+/* Prints, as dumpHeap does, only the nodes of minheap 'heap' written to or
+ * moved since its last dump, in increasing order of ID, and the IDs removed
+ * since. Same as dumpHeap if 'heap' has not been dumped yet.
+ */
+void dumpHeapChanges(MinHeap* heap, FILE* out) {
+	HeapDirty* dirty = heap->dumped;
+	if (dirty == NULL) {
+		dumpHeap(heap, out);
+		return;
+	}
+	
+	// A node written in place (a decreased priority that stays put) leaves
+	// its ID clean, so add the IDs of the nodes in dirty slots; the ID
+	// stored in a slot no longer used may be stale, hence the check
+	for (long w = 0; w < dirty->slots.numWords; w++) {
+		uint64_t bits = dirty->slots.bits[dirty->slots.words[w]];
+		while (bits != 0) {
+			long slot = dirty->slots.words[w] * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			int id = heap->arr[slot].id;
+			if (id >= 0 && id < heap->capacity && holdsId(heap, id) &&
+			    slotOf(heap, indexOf(heap, id)) == slot)
+				markDirty(&dirty->ids, id);
+		}
+	}
+	qsort(dirty->ids.words, dirty->ids.numWords, sizeof(long), compareWords);
+	
+	size_t used = 0, capacity = DUMP_LINE_BYTES * (64 * (size_t)dirty->ids.numWords + 4);
+	char* text = malloc(capacity);
+	appendText(&text, &used, &capacity, "MinHeap with size: %d\n\tcapacity: %d\n\n",
+	           heap->size, heap->capacity);
+	appendText(&text, &used, &capacity, "changed since the last dump:\nindex: priority [ID]\n");
+	for (long w = 0; w < dirty->ids.numWords; w++) {
+		uint64_t bits = dirty->ids.bits[dirty->ids.words[w]];
+		while (bits != 0) {
+			int id = dirty->ids.words[w] * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			if (!holdsId(heap, id)) {
+				appendText(&text, &used, &capacity, "removed [%d]\n", id);
+				continue;
+			}
+			int nodeIndex = indexOf(heap, id);
+			appendText(&text, &used, &capacity, "%d: %d [%d]%s\n", nodeIndex,
+			           priorityAt(heap, nodeIndex), id,
+			           isBufferIndex(heap, nodeIndex) ? " buffered" : "");
+		}
+	}
+	appendText(&text, &used, &capacity, "\n\n");
+	if (text == NULL) return;
+	fwrite(text, 1, used, out);
+	free(text);
+
+	clearDirtySet(&dirty->slots);
+	clearDirtySet(&dirty->ids);
+}
@@ -19,13 +19,107 @@ typedef struct heap_node {
   int id;        // the unique ID of this node; 0 <= id < size
 } HeapNode;
 
+/* The two nodes a swap exchanges, recorded before it writes either, so that
+ * a heap shared between processes can be repaired if its writer dies
+ * halfway through the swap (see heapshared.h).
+ */
+typedef struct heap_swap {
+  int active;      // 1 from before the swap writes anything until it is done
+  int index1;      // the indices exchanged, and the nodes they held before
+  int index2;
+  HeapNode node1;
+  HeapNode node2;
+} HeapSwap;
+
+typedef enum heap_layout {
+  HEAP_LAYOUT_IMPLICIT,  // node i at arr[i]; children of i at 2i and 2i + 1
+  HEAP_LAYOUT_LINES,     // 3-level subtrees packed into 64-byte cache lines
+  HEAP_LAYOUT_PAGES      // 9-level subtrees packed into 4 KiB pages
+} HeapLayout;
+
+typedef enum heap_allocator {
+  HEAP_ALLOC_MALLOC,     // plain malloc (aligned_alloc if a layout needs it)
+  HEAP_ALLOC_ALIGNED,    // posix_memalign to cache lines (or layout blocks)
+  HEAP_ALLOC_HUGEPAGES,  // anonymous mmap, advised MADV_HUGEPAGE
+  HEAP_ALLOC_HUGETLB,    // mmap from the hugetlbfs pool (MAP_HUGETLB); falls
+                         // back to HEAP_ALLOC_HUGEPAGES if the pool is empty
+  HEAP_ALLOC_ARENA,      // one block of a HeapArena (see newHeapInArena)
+  HEAP_ALLOC_MAPPED      // views into one mapping of a heap image file or
+                         // shared segment (see loadHeap, heapshared.h);
+                         // only those create these
+} HeapAllocator;
+
+typedef enum heap_trace_op {
+  TRACE_INSERT = 1,         // insert(priority = arg1, id = arg2)
+  TRACE_EXTRACT_MIN,        // extractMin()
+  TRACE_DECREASE_PRIORITY,  // decreasePriority(id = arg1, newPriority = arg2)
+  TRACE_GET_MIN             // getMin()
+} HeapTraceOp;
+
+struct heap_arena;
+struct heap_trace;
+struct heap_dirty;
+
 typedef struct min_heap {
   int size;       // the number of nodes in this heap; 0 <= size <= capacity
   int capacity;   // the number of nodes that can be stored in this heap
   HeapNode* arr;  // the array that stores the nodes of this heap
-  int* indexMap;  // indexMap[id] is the index of node with ID id in array arr
+  int* indexMap;  // indexMap[id] is the index of node with ID id; under a
+                  // blocked layout, that node lives at arr[slotOf(index)]
+  HeapLayout layout;  // where in arr the node at each index is stored
+  int blockHeight;    // levels per block for blocked layouts; 0 if implicit
+  int lastBlockLevel;   // for blocked layouts, the level of the blocks that
+                        // hold index capacity; 0 if implicit
+  int lastBlockHeight;  // the levels those blocks use, up to blockHeight
+  int prefetchDistance;  // levels below the children that bubbleDown
+                         // prefetches while comparing them; 0 for none,
+                         // and at most 30 (larger ones are clamped)
+  int bufferSize;      // nodes inserted but not yet in the heap; they sit in
+                       // arr[size + 1 .. size + bufferSize], unordered
+  int bufferCapacity;  // max bufferSize before a flush; 0 disables buffering
+  int bufferMin;       // index in arr of the buffered node of min priority
+  HeapAllocator allocator;  // how arr and indexMap were allocated
+  long arrSlots;            // the number of HeapNodes allocated for arr
+  struct heap_arena* arena; // the arena holding this heap, if allocator is
+                            // HEAP_ALLOC_ARENA; NULL otherwise
+  void* mapping;        // the mapping holding arr, indexMap and payload, if
+                        // allocator is HEAP_ALLOC_MAPPED; NULL otherwise
+  size_t mappingBytes;  // the size of that mapping
+  size_t payloadSize;  // bytes of payload per ID; 0 for none
+  char* payload;       // the payload of ID id is at payload + id * payloadSize;
+                       // indexed by ID, so it never moves with the nodes
+  struct heap_trace* trace;  // records the operations on this heap; NULL
+                             // unless recording (see heaptrace.h)
+  void (*traceOp)(struct heap_trace* trace, HeapTraceOp op, int arg1,
+                  int arg2);  // how 'trace' records one operation
+  struct heap_dirty* dirty;  // what was written to arr, indexMap and payload
+                             // since last cleared; NULL unless tracked
+  struct heap_dirty* dumped;  // what was written to arr and indexMap since
+                              // the last dump; NULL until dumped
+  HeapSwap* swapping;  // where swap records each exchange before making it;
+                       // NULL unless the heap is shared (see heapshared.h)
 } MinHeap;
 
+typedef struct heap_options {
+  int insertBufferCapacity;  // see MinHeap.bufferCapacity; 0 for none
+  HeapLayout layout;         // see MinHeap.layout
+  int prefetchDistance;      // see MinHeap.prefetchDistance
+  HeapAllocator allocator;   // see MinHeap.allocator
+  bool bindNuma;             // if True, place arr, indexMap and payload on
+  int numaNode;              // 'numaNode', or fail (mmap-based allocators
+                             // only)
+  size_t payloadSize;        // see MinHeap.payloadSize; 0 for none
+} HeapOptions;
+
+/* The payload of the node with ID 'id' in minheap 'heap', as a 'type'*.
+ */
+#define PAYLOAD_OF(heap, id, type) ((type*)payloadOf(heap, id))
+
+/* Returns the number of nodes in minheap 'heap', including any still in its
+ * insertion buffer.
+ */
+int numNodes(MinHeap* heap);
+
 /* Returns the node with minimum priority in minheap 'heap'.
  * Precondition: heap is non-empty
  */
@@ -39,10 +133,63 @@ HeapNode extractMin(MinHeap* heap);
 /* Inserts a new node with priority 'priority' and ID 'id' into minheap 'heap'.
  * Precondition: 'id' is unique within this minheap
  *               0 <= 'id' < heap->capacity
- *               heap->size < heap->capacity
+ *               numNodes(heap) < heap->capacity
  */
 void insert(MinHeap* heap, int priority, int id);
 
+/* Replaces the contents of minheap 'heap' with the 'n' nodes whose
+ * priorities are 'priorities' and whose IDs are 'ids' (or 0..n-1 if 'ids' is
+ * NULL), and restores the heap property bottom-up in O(n).
+ * Precondition: IDs are unique and 0 <= id < heap->capacity
+ *               0 <= n <= heap->capacity
+ */
+void buildHeap(MinHeap* heap, int* priorities, int* ids, int n);
+
+/* Inserts the 'n' nodes whose priorities are 'priorities' and whose IDs are
+ * 'ids' into minheap 'heap', either one by one or by appending them all and
+ * re-heapifying only their ancestors, whichever is estimated to be cheaper.
+ * Precondition: IDs are unique within this minheap
+ *               0 <= id < heap->capacity
+ *               numNodes(heap) + n <= heap->capacity
+ */
+void insertBatch(MinHeap* heap, int* priorities, int* ids, int n);
+
+/* Removes the 'k' nodes of minimum priority from minheap 'heap' into 'out',
+ * in increasing order of priority, and returns how many were removed (fewer
+ * than 'k' if 'heap' is smaller).
+ * Precondition: 'out' has room for 'k' nodes
+ */
+int extractMinBatch(MinHeap* heap, int k, HeapNode out[]);
+
+/* Same as extractMin, but also sets '*payload' to the payload of the node
+ * removed. Prefetches that payload first, so it loads while the heap is
+ * restored rather than after.
+ * Precondition: heap is non-empty
+ *               heap->payloadSize > 0
+ */
+HeapNode extractMinWithPayload(MinHeap* heap, void** payload);
+
+/* Returns a pointer to the heap->payloadSize bytes of payload of ID 'id' in
+ * minheap 'heap'. The payload stays put, and keeps its contents, whether or
+ * not a node with that ID is in the heap.
+ * Precondition: 0 <= 'id' < heap->capacity
+ *               heap->payloadSize > 0
+ */
+void* payloadOf(MinHeap* heap, int id);
+
+/* Copies heap->payloadSize bytes from 'payload' to the payload of ID 'id' in
+ * minheap 'heap'.
+ * Precondition: 0 <= 'id' < heap->capacity
+ *               heap->payloadSize > 0
+ */
+void setPayload(MinHeap* heap, int id, const void* payload);
+
+/* Returns True if minheap 'heap' holds a node with ID 'id', in the heap
+ * proper or its insertion buffer. Returns False otherwise.
+ * Precondition: 0 <= 'id' < heap->capacity
+ */
+bool holdsId(MinHeap* heap, int id);
+
 /* Returns priority of the node with ID 'id' in 'heap'.
  * Precondition: 'id' is a valid node ID in 'heap'.
  */
@@ -55,16 +202,51 @@ int getPriority(MinHeap* heap, int id);
  */
 bool decreasePriority(MinHeap* heap, int id, int newPriority);
 
+/* Copies the 'k' nodes of minimum priority in minheap 'heap' into 'out', in
+ * increasing order of priority, and returns how many were copied (fewer than
+ * 'k' if 'heap' is smaller). Does not modify 'heap'. Runs in O(k log k).
+ * Precondition: 'out' has room for 'k' nodes
+ */
+int topK(MinHeap* heap, int k, HeapNode out[]);
+
+/* Moves every node in the insertion buffer of minheap 'heap' into the heap
+ * proper, with one bulk re-heapify. Has no effect if the buffer is empty.
+ */
+void flushInsertBuffer(MinHeap* heap);
+
 /* Prints the contents of this heap, including size, capacity, full index
  * map, and, for each non-empty element of the heap array, that node's ID and
  * priority. */
 void printHeap(MinHeap* heap);
 
-/* Returns a newly created empty minheap with initial capacity 'capacity'.
+/* Prints the size and capacity of minheap 'heap', then the index, priority
+ * and ID of each node it holds, buffered nodes last, with one fwrite to
+ * 'out'. Unlike printHeap, skips the slots and IDs not in use. From then on,
+ * 'heap' records its writes for dumpHeapChanges, apart from the record
+ * startTrackingWrites keeps (for a PersistentHeap, say), which dumps leave
+ * alone. Prints nothing if memory runs out.
+ */
+void dumpHeap(MinHeap* heap, FILE* out);
+
+/* Same as dumpHeap, but prints only the nodes written to or moved since the
+ * last dump of 'heap', and the IDs removed since. Same as dumpHeap if 'heap'
+ * was never dumped.
+ */
+void dumpHeapChanges(MinHeap* heap, FILE* out);
+
+/* Returns a newly created empty minheap with initial capacity 'capacity', or
+ * NULL if its memory cannot be allocated.
  * Precondition: capacity >= 0
  */
 MinHeap* newHeap(int capacity);
 
+/* Returns a newly created empty minheap with initial capacity 'capacity',
+ * configured by 'options', or NULL if its memory cannot be allocated. A
+ * zero-initialised HeapOptions (or NULL) gives the same heap as newHeap.
+ * Precondition: capacity >= 0
+ */
+MinHeap* newHeapWithOptions(int capacity, HeapOptions* options);
+
 /* Frees all memory allocated for minheap 'heap'.
  */
 void deleteHeap(MinHeap* heap);
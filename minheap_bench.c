@@ -0,0 +1,1499 @@
+/*
+ * Benchmarks for our Minimum Heap implementation and the structures built on
+ * top of it. Each benchmark is selected by name on the command line:
+ *
+ *   minheap_bench sssp [edges] [threads]
+ *   minheap_bench build [nodes] [maxThreads]
+ *   minheap_bench topk [nodes] [k] [threads]
+ *   minheap_bench batch [nodes] [burst]
+ *   minheap_bench buffer [nodes] [bufferCapacity]
+ *   minheap_bench layout [nodes] [ops]
+ *   minheap_bench prefetch [nodes] [ops] [maxDistance]
+ *   minheap_bench alloc [nodes] [ops]
+ *   minheap_bench arena [heaps] [threads]
+ *   minheap_bench small [runs] [runLength]
+ *   minheap_bench index [nodes] [ops]
+ *   minheap_bench payload [nodes] [ops]
+ *   minheap_bench stable [nodes] [ops]
+ *   minheap_bench compact [nodes] [ops]
+ *   minheap_bench trace [nodes] [ops] [path]
+ *   minheap_bench load [nodes] [dir]
+ *   minheap_bench image [nodes] [ops] [path]
+ *   minheap_bench persist [nodes] [ops] [path]
+ *   minheap_bench wal [nodes] [ops] [path]
+ *   minheap_bench shared [nodes] [ops] [maxProcs]
+ *
+ * Build with:
+ *   gcc -O2 -pthread minheap_bench.c minheap.c minheap_parallel.c \
+ *       heapalloc.c deltaqueue.c minheap_variants.c heaptrace.c \
+ *       heapio.c heappersist.c heapwal.c heapshared.c -o minheap_bench
+ */
+#include <limits.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "deltaqueue.h"
+#include "heapalloc.h"
+#include "heapio.h"
+#include "heappersist.h"
+#include "heapshared.h"
+#include "heaptrace.h"
+#include "heapwal.h"
+#include "minheap_internal.h"
+#include "minheap_parallel.h"
+#include "minheap_variants.h"
+#include "smallheap.h"
+
+#define DEFAULT_EDGES 10000000
+#define DEFAULT_THREADS 4
+#define DEFAULT_NODES 10000000
+#define DEFAULT_MAX_THREADS 64
+#define DEFAULT_K 1000000
+#define DEFAULT_BURST 4096
+#define DEFAULT_BUFFER 64
+#define DEFAULT_OPS 2000000
+#define DEFAULT_PREFETCH_NODES 50000000
+#define DEFAULT_MAX_DISTANCE 3
+#define DEFAULT_HEAPS 1000000
+#define DEFAULT_RUNS SMALL_HEAP_CAPACITY
+#define DEFAULT_RUN_LENGTH 100000
+#define DEFAULT_INDEX_NODES 60000
+#define DEFAULT_PAYLOAD_NODES 1000000
+#define DEFAULT_TRACE_PATH "/tmp/minheap_bench.trace"
+#define DEFAULT_LOAD_DIR "/tmp"
+#define DEFAULT_IMAGE_PATH "/tmp/minheap_bench.img"
+#define DEFAULT_PERSIST_NODES 100000
+#define DEFAULT_PERSIST_OPS 20000
+#define MAX_COMMIT_INTERVAL 4096
+#define DEFAULT_WAL_PATH "/tmp/minheap_bench.wal"
+#define DEFAULT_MAX_PROCS 8
+#define SHARED_HEAP_NAME "/minheap_bench"
+#define SHARED_BATCH 64
+#define INPUT_LINE 64
+#define TIMER_SPREAD (1 << 20)  // timers are re-armed up to this far ahead
+#define CONNECTION_HEAP_CAPACITY 32
+#define LIVE_CONNECTIONS 1024
+#define EDGES_PER_VERTEX 10
+#define MAX_WEIGHT 100
+#define DELTA 10
+#define POP_CHUNK 256
+
+typedef struct graph {
+  int numVertices;
+  int numEdges;
+  int* offsets;  // edges of vertex v are targets[offsets[v] .. offsets[v+1])
+  int* targets;
+  int* weights;
+} Graph;
+
+double now(void);
+unsigned int nextRandom(unsigned int* state);
+Graph* newRandomGraph(int numEdges);
+void deleteGraph(Graph* graph);
+bool isValidHeap(MinHeap* heap);
+void benchSssp(int argc, char* argv[]);
+void benchBuild(int argc, char* argv[]);
+void benchTopK(int argc, char* argv[]);
+void benchBatch(int argc, char* argv[]);
+void benchBuffer(int argc, char* argv[]);
+void benchLayout(int argc, char* argv[]);
+void benchPrefetch(int argc, char* argv[]);
+void benchAlloc(int argc, char* argv[]);
+void benchArena(int argc, char* argv[]);
+void benchSmall(int argc, char* argv[]);
+void benchIndex(int argc, char* argv[]);
+void benchPayload(int argc, char* argv[]);
+void benchStable(int argc, char* argv[]);
+void benchCompact(int argc, char* argv[]);
+void benchTrace(int argc, char* argv[]);
+void benchLoad(int argc, char* argv[]);
+void benchImage(int argc, char* argv[]);
+void benchPersist(int argc, char* argv[]);
+void benchWal(int argc, char* argv[]);
+void benchShared(int argc, char* argv[]);
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && strcmp(argv[1], "sssp") == 0) {
+    benchSssp(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "build") == 0) {
+    benchBuild(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "topk") == 0) {
+    benchTopK(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+    benchBatch(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "buffer") == 0) {
+    benchBuffer(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "layout") == 0) {
+    benchLayout(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "prefetch") == 0) {
+    benchPrefetch(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "alloc") == 0) {
+    benchAlloc(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "arena") == 0) {
+    benchArena(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "small") == 0) {
+    benchSmall(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "index") == 0) {
+    benchIndex(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "payload") == 0) {
+    benchPayload(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "stable") == 0) {
+    benchStable(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "compact") == 0) {
+    benchCompact(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "trace") == 0) {
+    benchTrace(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "load") == 0) {
+    benchLoad(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "image") == 0) {
+    benchImage(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "persist") == 0) {
+    benchPersist(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "wal") == 0) {
+    benchWal(argc - 1, argv + 1);
+  } else if (argc > 1 && strcmp(argv[1], "shared") == 0) {
+    benchShared(argc - 1, argv + 1);
+  } else {
+    fprintf(stderr, "Usage: %s sssp [edges] [threads]\n", argv[0]);
+    fprintf(stderr, "       %s build [nodes] [maxThreads]\n", argv[0]);
+    fprintf(stderr, "       %s topk [nodes] [k] [threads]\n", argv[0]);
+    fprintf(stderr, "       %s batch [nodes] [burst]\n", argv[0]);
+    fprintf(stderr, "       %s buffer [nodes] [bufferCapacity]\n", argv[0]);
+    fprintf(stderr, "       %s layout [nodes] [ops]\n", argv[0]);
+    fprintf(stderr, "       %s prefetch [nodes] [ops] [maxDistance]\n",
+            argv[0]);
+    fprintf(stderr, "       %s alloc [nodes] [ops]\n", argv[0]);
+    fprintf(stderr, "       %s arena [heaps] [threads]\n", argv[0]);
+    fprintf(stderr, "       %s small [runs] [runLength]\n", argv[0]);
+    fprintf(stderr, "       %s index [nodes] [ops]\n", argv[0]);
+    fprintf(stderr, "       %s payload [nodes] [ops]\n", argv[0]);
+    fprintf(stderr, "       %s stable [nodes] [ops]\n", argv[0]);
+    fprintf(stderr, "       %s compact [nodes] [ops]\n", argv[0]);
+    fprintf(stderr, "       %s trace [nodes] [ops] [path]\n", argv[0]);
+    fprintf(stderr, "       %s load [nodes] [dir]\n", argv[0]);
+    fprintf(stderr, "       %s image [nodes] [ops] [path]\n", argv[0]);
+    fprintf(stderr, "       %s persist [nodes] [ops] [path]\n", argv[0]);
+    fprintf(stderr, "       %s wal [nodes] [ops] [path]\n", argv[0]);
+    fprintf(stderr, "       %s shared [nodes] [ops] [maxProcs]\n", argv[0]);
+    exit(1);
+  }
+  return 0;
+}
+
+double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned int nextRandom(unsigned int* state) {
+  // xorshift32: fast, reproducible across runs
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+Graph* newRandomGraph(int numEdges) {
+  Graph* graph = malloc(sizeof(Graph));
+  graph->numVertices = numEdges / EDGES_PER_VERTEX;
+  graph->numEdges = graph->numVertices * EDGES_PER_VERTEX;
+  graph->offsets = malloc(sizeof(int) * (graph->numVertices + 1));
+  graph->targets = malloc(sizeof(int) * graph->numEdges);
+  graph->weights = malloc(sizeof(int) * graph->numEdges);
+
+  unsigned int state = 2463534242u;
+  for (int v = 0; v <= graph->numVertices; v++)
+    graph->offsets[v] = v * EDGES_PER_VERTEX;
+  for (int e = 0; e < graph->numEdges; e++) {
+    graph->targets[e] = nextRandom(&state) % graph->numVertices;
+    graph->weights[e] = 1 + nextRandom(&state) % MAX_WEIGHT;
+  }
+  return graph;
+}
+
+void deleteGraph(Graph* graph) {
+  free(graph->offsets);
+  free(graph->targets);
+  free(graph->weights);
+  free(graph);
+}
+
+/* Opens a hardware counter of 'type' and 'config' for this thread, disabled
+ * until startCounter. Returns -1 if counters are unavailable (e.g. in a VM or
+ * under a restrictive perf_event_paranoid).
+ */
+int openCounter(unsigned int type, unsigned long config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void startCounter(int fd) {
+  if (fd < 0) return;
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/* Stops the counter 'fd' and prints its value, or n/a.
+ */
+void printCounter(int fd) {
+  long long count = 0;
+  if (fd < 0 || (ioctl(fd, PERF_EVENT_IOC_DISABLE, 0),
+                 read(fd, &count, sizeof(count)) != sizeof(count)))
+    printf(" %14s", "n/a");
+  else
+    printf(" %14lld", count);
+}
+
+/* Returns True if 'heap' satisfies the heap property and its indexMap
+ * agrees with arr for every node in it.
+ */
+bool isValidHeap(MinHeap* heap) {
+  for (int i = ROOT_INDEX; i <= heap->size; i++) {
+    if (indexOf(heap, idAt(heap, i)) != i) return false;
+    if (i > ROOT_INDEX && priorityAt(heap, i / 2) > priorityAt(heap, i))
+      return false;
+  }
+  return true;
+}
+
+/*********************************************************************
+ * sssp: serial Dijkstra on MinHeap vs. parallel delta-stepping
+ ********************************************************************/
+
+typedef struct sssp_worker {
+  Graph* graph;
+  DeltaQueue* queue;
+  pthread_barrier_t* barrier;
+  bool* done;
+  bool leader;  // the one worker that advances the queue between phases
+} SsspWorker;
+
+void* ssspWorker(void* arg) {
+  SsspWorker* worker = arg;
+  Graph* graph = worker->graph;
+  DeltaQueue* queue = worker->queue;
+  int ids[POP_CHUNK];
+
+  while (1) {
+    // phase boundary: nobody is popping or relaxing, so advancing is safe
+    pthread_barrier_wait(worker->barrier);
+    if (worker->leader) *worker->done = deltaNextBucket(queue) < 0;
+    pthread_barrier_wait(worker->barrier);
+    if (*worker->done) return NULL;
+
+    int count;
+    while ((count = deltaPopBucket(queue, ids, POP_CHUNK)) > 0) {
+      for (int i = 0; i < count; i++) {
+        int v = ids[i];
+        int dist = deltaGetPriority(queue, v);
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+          deltaDecreasePriority(queue, graph->targets[e],
+                                dist + graph->weights[e]);
+      }
+    }
+  }
+}
+
+int* dijkstra(Graph* graph, int source) {
+  int* dist = malloc(sizeof(int) * graph->numVertices);
+  for (int v = 0; v < graph->numVertices; v++) dist[v] = DELTA_UNREACHED;
+
+  MinHeap* heap = newHeap(graph->numVertices);
+  dist[source] = 0;
+  insert(heap, 0, source);
+  while (heap->size > 0) {
+    HeapNode node = extractMin(heap);
+    for (int e = graph->offsets[node.id]; e < graph->offsets[node.id + 1];
+         e++) {
+      int target = graph->targets[e];
+      int candidate = node.priority + graph->weights[e];
+      if (candidate >= dist[target]) continue;
+      if (dist[target] == DELTA_UNREACHED)
+        insert(heap, candidate, target);
+      else
+        decreasePriority(heap, target, candidate);
+      dist[target] = candidate;
+    }
+  }
+  deleteHeap(heap);
+  return dist;
+}
+
+void benchSssp(int argc, char* argv[]) {
+  int numEdges = argc > 1 ? atoi(argv[1]) : DEFAULT_EDGES;
+  int numThreads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+
+  Graph* graph = newRandomGraph(numEdges);
+  printf("sssp: %d vertices, %d edges, weights 1..%d, delta %d\n",
+         graph->numVertices, graph->numEdges, MAX_WEIGHT, DELTA);
+
+  double start = now();
+  int* dist = dijkstra(graph, 0);
+  printf("dijkstra (MinHeap):        %8.3f s\n", now() - start);
+
+  // every live priority lies within MAX_WEIGHT of the current bucket
+  DeltaQueue* queue =
+      newDeltaQueue(graph->numVertices, DELTA, MAX_WEIGHT / DELTA + 2);
+  pthread_t* threads = malloc(sizeof(pthread_t) * numThreads);
+  SsspWorker* workers = malloc(sizeof(SsspWorker) * numThreads);
+  pthread_barrier_t barrier;
+  bool done = false;
+  pthread_barrier_init(&barrier, NULL, numThreads);
+
+  start = now();
+  deltaDecreasePriority(queue, 0, 0);
+  for (int t = 0; t < numThreads; t++) {
+    workers[t] = (SsspWorker){graph, queue, &barrier, &done, t == 0};
+    pthread_create(&threads[t], NULL, ssspWorker, &workers[t]);
+  }
+  for (int t = 0; t < numThreads; t++) pthread_join(threads[t], NULL);
+  printf("delta-stepping (%2d threads): %6.3f s\n", numThreads, now() - start);
+
+  int mismatches = 0;
+  for (int v = 0; v < graph->numVertices; v++)
+    if (deltaGetPriority(queue, v) != dist[v]) mismatches++;
+  printf("distance mismatches: %d\n", mismatches);
+
+  pthread_barrier_destroy(&barrier);
+  free(workers);
+  free(threads);
+  deleteDeltaQueue(queue);
+  free(dist);
+  deleteGraph(graph);
+}
+
+/*********************************************************************
+ * build: buildHeap vs. buildHeapParallel from 1 to maxThreads threads
+ ********************************************************************/
+
+void benchBuild(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  int maxThreads = argc > 2 ? atoi(argv[2]) : DEFAULT_MAX_THREADS;
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+  MinHeap* heap = newHeap(numNodes);
+  printf("build: %d nodes\n", numNodes);
+
+  buildHeap(heap, priorities, NULL, numNodes);  // first touch: fault pages in
+  double start = now();
+  buildHeap(heap, priorities, NULL, numNodes);
+  double serial = now() - start;
+  printf("buildHeap:                  %8.3f s %s\n", serial,
+         isValidHeap(heap) ? "" : "INVALID");
+
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    start = now();
+    buildHeapParallel(heap, priorities, NULL, numNodes, threads);
+    double elapsed = now() - start;
+    printf("buildHeapParallel (%2d thr): %8.3f s  speedup %5.2fx %s\n", threads,
+           elapsed, serial / elapsed, isValidHeap(heap) ? "" : "INVALID");
+  }
+
+  deleteHeap(heap);
+  free(priorities);
+}
+
+/*********************************************************************
+ * topk: extractMin + reinsert vs. topK vs. topKParallel
+ ********************************************************************/
+
+/* Returns True if the first 'k' priorities of 'a' and 'b' agree.
+ */
+bool samePriorities(HeapNode* a, HeapNode* b, int k) {
+  for (int i = 0; i < k; i++)
+    if (a[i].priority != b[i].priority) return false;
+  return true;
+}
+
+void benchTopK(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  int k = argc > 2 ? atoi(argv[2]) : DEFAULT_K;
+  int numThreads = argc > 3 ? atoi(argv[3]) : DEFAULT_THREADS;
+  if (k > numNodes) k = numNodes;
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, priorities, NULL, numNodes);
+  printf("topk: k = %d of %d nodes\n", k, numNodes);
+
+  HeapNode* expected = malloc(sizeof(HeapNode) * k);
+  HeapNode* out = malloc(sizeof(HeapNode) * k);
+
+  double start = now();
+  for (int i = 0; i < k; i++) expected[i] = extractMin(heap);
+  for (int i = 0; i < k; i++) insert(heap, expected[i].priority, expected[i].id);
+  printf("extractMin + insert:        %8.3f s\n", now() - start);
+
+  start = now();
+  topK(heap, k, out);
+  printf("topK:                       %8.3f s %s\n", now() - start,
+         samePriorities(out, expected, k) ? "" : "WRONG");
+
+  start = now();
+  topKParallel(heap, k, out, numThreads);
+  printf("topKParallel (%2d threads):  %8.3f s %s\n", numThreads, now() - start,
+         samePriorities(out, expected, k) ? "" : "WRONG");
+  printf("heap %s\n", isValidHeap(heap) ? "still valid" : "INVALID");
+
+  free(out);
+  free(expected);
+  deleteHeap(heap);
+  free(priorities);
+}
+
+/*********************************************************************
+ * batch: insert / extractMin one at a time vs. in bursts
+ ********************************************************************/
+
+void benchBatch(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  int burst = argc > 2 ? atoi(argv[2]) : DEFAULT_BURST;
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  int* ids = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) {
+    priorities[i] = nextRandom(&state) >> 1;
+    ids[i] = i;
+  }
+  HeapNode* out = malloc(sizeof(HeapNode) * burst);
+  MinHeap* single = newHeap(numNodes);
+  MinHeap* batched = newHeap(numNodes);
+  printf("batch: %d nodes in bursts of %d\n", numNodes, burst);
+
+  double start = now();
+  for (int i = 0; i < numNodes; i++) insert(single, priorities[i], ids[i]);
+  printf("insert:            %8.3f s\n", now() - start);
+
+  start = now();
+  for (int i = 0; i < numNodes; i += burst) {
+    int n = numNodes - i < burst ? numNodes - i : burst;
+    insertBatch(batched, priorities + i, ids + i, n);
+  }
+  printf("insertBatch:       %8.3f s %s\n", now() - start,
+         isValidHeap(batched) ? "" : "INVALID");
+
+  start = now();
+  while (single->size > 0)
+    for (int i = 0; i < burst && single->size > 0; i++) extractMin(single);
+  printf("extractMin:        %8.3f s\n", now() - start);
+
+  bool sorted = true;
+  int last = -1;
+  start = now();
+  while (batched->size > 0) {
+    int n = extractMinBatch(batched, burst, out);
+    for (int i = 0; i < n; i++) {
+      if (out[i].priority < last) sorted = false;
+      last = out[i].priority;
+    }
+  }
+  printf("extractMinBatch:   %8.3f s %s\n", now() - start,
+         sorted ? "" : "OUT OF ORDER");
+
+  deleteHeap(batched);
+  deleteHeap(single);
+  free(out);
+  free(ids);
+  free(priorities);
+}
+
+/*********************************************************************
+ * buffer: timer-style workload with and without an insertion buffer
+ ********************************************************************/
+
+/* Runs the timer workload on 'heap': fill it halfway, then alternate three
+ * inserts of later deadlines with one extractMin, then drain. Returns the
+ * sum of extracted priorities, so runs can be checked against each other.
+ */
+long timerWorkload(MinHeap* heap, int numTimers) {
+  unsigned int state = 2463534242u;
+  long checksum = 0;
+  int nextId = 0;
+  int clock = 0;
+
+  while (nextId < numTimers / 2)
+    insert(heap, clock + (nextRandom(&state) >> 8), nextId++);
+  while (nextId < numTimers) {
+    for (int i = 0; i < 3 && nextId < numTimers; i++)
+      insert(heap, clock + (nextRandom(&state) >> 8), nextId++);
+    HeapNode node = extractMin(heap);
+    clock = node.priority;
+    checksum += node.priority;
+  }
+  while (numNodes(heap) > 0) checksum += extractMin(heap).priority;
+  return checksum;
+}
+
+void benchBuffer(int argc, char* argv[]) {
+  int numTimers = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  int bufferCapacity = argc > 2 ? atoi(argv[2]) : DEFAULT_BUFFER;
+  printf("buffer: %d timers\n", numTimers);
+
+  MinHeap* heap = newHeap(numTimers);
+  double start = now();
+  long expected = timerWorkload(heap, numTimers);
+  printf("no buffer:             %8.3f s\n", now() - start);
+  deleteHeap(heap);
+
+  HeapOptions options = {.insertBufferCapacity = bufferCapacity};
+  heap = newHeapWithOptions(numTimers, &options);
+  start = now();
+  long checksum = timerWorkload(heap, numTimers);
+  printf("buffer of %4d:        %8.3f s %s\n", bufferCapacity, now() - start,
+         checksum == expected ? "" : "WRONG");
+  deleteHeap(heap);
+}
+
+/*********************************************************************
+ * layout: steady-state extractMin + insert under each HeapLayout
+ ********************************************************************/
+
+/* Runs 'numOps' extractMin + insert pairs on 'heap', re-inserting each
+ * extracted node a random amount later, and returns the time taken.
+ */
+double steadyState(MinHeap* heap, int numOps) {
+  unsigned int state = 88675123u;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode node = extractMin(heap);
+    insert(heap, node.priority + (nextRandom(&state) >> 8), node.id);
+  }
+  return now() - start;
+}
+
+void benchLayout(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  const char* names[] = {"implicit", "lines", "pages"};
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+
+  int cacheMisses = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  int tlbMisses = openCounter(PERF_TYPE_HW_CACHE,
+                              PERF_COUNT_HW_CACHE_DTLB |
+                                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+  printf("layout: %d nodes, %d extractMin + insert pairs\n", numNodes, numOps);
+  printf("%-10s %10s %14s %14s\n", "layout", "seconds", "cache misses",
+         "dTLB misses");
+  for (int layout = HEAP_LAYOUT_IMPLICIT; layout <= HEAP_LAYOUT_PAGES; layout++) {
+    HeapOptions options = {.layout = layout};
+    MinHeap* heap = newHeapWithOptions(numNodes, &options);
+    buildHeap(heap, priorities, NULL, numNodes);
+
+    startCounter(cacheMisses);
+    startCounter(tlbMisses);
+    double elapsed = steadyState(heap, numOps);
+    printf("%-10s %10.3f", names[layout], elapsed);
+    printCounter(cacheMisses);
+    printCounter(tlbMisses);
+    printf(" %s\n", isValidHeap(heap) ? "" : "INVALID");
+    deleteHeap(heap);
+  }
+
+  if (cacheMisses >= 0) close(cacheMisses);
+  if (tlbMisses >= 0) close(tlbMisses);
+  free(priorities);
+}
+
+/*********************************************************************
+ * prefetch: steady-state extractMin + insert at each prefetch distance
+ ********************************************************************/
+
+void benchPrefetch(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PREFETCH_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  int maxDistance = argc > 3 ? atoi(argv[3]) : DEFAULT_MAX_DISTANCE;
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+
+  printf("prefetch: %d nodes (%ld MiB of arr), %d extractMin + insert pairs\n",
+         numNodes, (long)numNodes * sizeof(HeapNode) >> 20, numOps);
+  for (int distance = 0; distance <= maxDistance; distance++) {
+    HeapOptions options = {.prefetchDistance = distance};
+    MinHeap* heap = newHeapWithOptions(numNodes, &options);
+    buildHeap(heap, priorities, NULL, numNodes);
+    double elapsed = steadyState(heap, numOps);
+    printf("distance %d: %8.3f s  %6.1f ns/pair %s\n", distance, elapsed,
+           elapsed * 1e9 / numOps, isValidHeap(heap) ? "" : "INVALID");
+    deleteHeap(heap);
+  }
+  free(priorities);
+}
+
+/*********************************************************************
+ * alloc: steady-state extractMin + insert under each HeapAllocator
+ ********************************************************************/
+
+void benchAlloc(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PREFETCH_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  const char* names[] = {"malloc", "aligned", "hugepages", "hugetlb"};
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+
+  printf("alloc: %d nodes, %d extractMin + insert pairs\n", numNodes, numOps);
+  printf("%-10s %10s %14s %14s\n", "allocator", "seconds", "MiB total",
+         "MiB huge");
+  for (int allocator = HEAP_ALLOC_MALLOC; allocator <= HEAP_ALLOC_HUGETLB;
+       allocator++) {
+    HeapOptions options = {.allocator = allocator};
+    MinHeap* heap = newHeapWithOptions(numNodes, &options);
+    buildHeap(heap, priorities, NULL, numNodes);
+    double elapsed = steadyState(heap, numOps);
+    long total = sizeof(HeapNode) * heap->arrSlots + sizeof(int) * numNodes;
+    printf("%-10s %10.3f %14ld %14zu %s\n", names[allocator], elapsed,
+           total >> 20, heapHugePageBytes(heap) >> 20,
+           isValidHeap(heap) ? "" : "INVALID");
+    deleteHeap(heap);
+  }
+  free(priorities);
+}
+
+/*********************************************************************
+ * arena: per-connection heap churn, newHeap vs. newHeapInArena
+ ********************************************************************/
+
+typedef struct churn_task {
+  int numHeaps;
+  bool useArena;
+} ChurnTask;
+
+/* Opens and closes 'numHeaps' connections, each with a small heap that
+ * sees a few inserts, keeping LIVE_CONNECTIONS open at a time.
+ */
+void* churnWorker(void* arg) {
+  ChurnTask* task = arg;
+  MinHeap* live[LIVE_CONNECTIONS] = {NULL};
+  HeapArena* arena = NULL;
+  if (task->useArena)
+    arena = newHeapArena((size_t)LIVE_CONNECTIONS * 2 * 1024);
+
+  for (int i = 0; i < task->numHeaps; i++) {
+    int slot = i % LIVE_CONNECTIONS;
+    if (live[slot] != NULL) deleteHeap(live[slot]);
+    live[slot] = task->useArena
+                     ? newHeapInArena(arena, CONNECTION_HEAP_CAPACITY, NULL)
+                     : newHeap(CONNECTION_HEAP_CAPACITY);
+    for (int id = 0; id < 4; id++) insert(live[slot], i + id, id);
+  }
+
+  // With an arena, every remaining connection goes with the arena itself
+  if (task->useArena) {
+    deleteHeapArena(arena);
+  } else {
+    for (int slot = 0; slot < LIVE_CONNECTIONS; slot++)
+      if (live[slot] != NULL) deleteHeap(live[slot]);
+  }
+  return NULL;
+}
+
+void benchArena(int argc, char* argv[]) {
+  int numHeaps = argc > 1 ? atoi(argv[1]) : DEFAULT_HEAPS;
+  int numThreads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+  printf("arena: %d heaps of capacity %d on %d threads\n", numHeaps,
+         CONNECTION_HEAP_CAPACITY, numThreads);
+
+  for (int useArena = 0; useArena <= 1; useArena++) {
+    pthread_t threads[numThreads];
+    ChurnTask task = {numHeaps / numThreads, useArena};
+    double start = now();
+    for (int t = 0; t < numThreads; t++)
+      pthread_create(&threads[t], NULL, churnWorker, &task);
+    for (int t = 0; t < numThreads; t++) pthread_join(threads[t], NULL);
+    double elapsed = now() - start;
+    printf("%-15s %8.3f s  %6.1f ns/heap\n",
+           useArena ? "newHeapInArena:" : "newHeap:", elapsed,
+           elapsed * 1e9 / numHeaps);
+  }
+}
+
+/*********************************************************************
+ * small: k-way merge of sorted runs, MinHeap vs. SmallHeap
+ ********************************************************************/
+
+/* Merges the 'numRuns' sorted runs of length 'runLength' laid out one after
+ * the other in 'runs', into 'out', using a MinHeap keyed by run number.
+ */
+void mergeWithMinHeap(int* runs, int numRuns, int runLength, int* out) {
+  MinHeap* heap = newHeap(numRuns);
+  int next[numRuns];
+  for (int r = 0; r < numRuns; r++) {
+    next[r] = 1;
+    insert(heap, runs[r * runLength], r);
+  }
+  for (long i = 0; i < (long)numRuns * runLength; i++) {
+    HeapNode min = extractMin(heap);
+    out[i] = min.priority;
+    if (next[min.id] < runLength)
+      insert(heap, runs[min.id * runLength + next[min.id]++], min.id);
+  }
+  deleteHeap(heap);
+}
+
+/* As mergeWithMinHeap, using a SmallHeap on the stack.
+ */
+void mergeWithSmallHeap(int* runs, int numRuns, int runLength, int* out) {
+  SmallHeap heap;
+  smallHeapInit(&heap);
+  int next[numRuns];
+  for (int r = 0; r < numRuns; r++) {
+    next[r] = 1;
+    smallHeapInsert(&heap, runs[r * runLength], r);
+  }
+  for (long i = 0; i < (long)numRuns * runLength; i++) {
+    HeapNode min = smallHeapExtractMin(&heap);
+    out[i] = min.priority;
+    if (next[min.id] < runLength)
+      smallHeapInsert(&heap, runs[min.id * runLength + next[min.id]++],
+                      min.id);
+  }
+}
+
+int compareInts(const void* a, const void* b) {
+  return (*(int*)a > *(int*)b) - (*(int*)a < *(int*)b);
+}
+
+void benchSmall(int argc, char* argv[]) {
+  int numRuns = argc > 1 ? atoi(argv[1]) : DEFAULT_RUNS;
+  int runLength = argc > 2 ? atoi(argv[2]) : DEFAULT_RUN_LENGTH;
+  if (numRuns < 1 || numRuns > SMALL_HEAP_CAPACITY) {
+    fprintf(stderr, "small: runs must be in [1, %d]\n", SMALL_HEAP_CAPACITY);
+    exit(1);
+  }
+  long total = (long)numRuns * runLength;
+  printf("small: merging %d runs of %d\n", numRuns, runLength);
+
+  int* runs = malloc(sizeof(int) * total);
+  unsigned int state = 1;
+  for (long i = 0; i < total; i++) runs[i] = nextRandom(&state) % 1000000000;
+  for (int r = 0; r < numRuns; r++)
+    qsort(runs + (long)r * runLength, runLength, sizeof(int), compareInts);
+
+  int* expected = malloc(sizeof(int) * total);
+  int* out = malloc(sizeof(int) * total);
+  double start = now();
+  mergeWithMinHeap(runs, numRuns, runLength, expected);
+  double elapsed = now() - start;
+  printf("MinHeap:   %8.3f s  %6.1f ns/element\n", elapsed,
+         elapsed * 1e9 / total);
+
+  start = now();
+  mergeWithSmallHeap(runs, numRuns, runLength, out);
+  elapsed = now() - start;
+  printf("SmallHeap: %8.3f s  %6.1f ns/element  (%s)\n", elapsed,
+         elapsed * 1e9 / total,
+         memcmp(out, expected, sizeof(int) * total) == 0 ? "same output"
+                                                         : "MISMATCH");
+
+  free(runs);
+  free(expected);
+  free(out);
+}
+
+/*********************************************************************
+ * index: steady-state extractMin + insert, MinHeap vs. MinHeap16/64
+ ********************************************************************/
+
+void benchIndex(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_INDEX_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  if (numNodes < 1 || numNodes > UINT16_MAX) {
+    fprintf(stderr, "index: nodes must be in [1, %d]\n", UINT16_MAX);
+    exit(1);
+  }
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+
+  printf("index: %d nodes, %d extractMin + insert pairs\n", numNodes, numOps);
+  printf("%-10s %10s %10s %12s\n", "heap", "seconds", "ns/op", "bytes/node");
+
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, priorities, NULL, numNodes);
+  double elapsed = steadyState(heap, numOps);
+  printf("%-10s %10.3f %10.1f %12zu\n", "MinHeap", elapsed,
+         elapsed * 1e9 / numOps, sizeof(HeapNode) + sizeof(int));
+  deleteHeap(heap);
+
+  MinHeap16* heap16 = newMinHeap16(numNodes);
+  minHeap16Build(heap16, priorities, numNodes);
+  state = 88675123u;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode16 node = minHeap16ExtractMin(heap16);
+    minHeap16Insert(heap16, node.priority + (nextRandom(&state) >> 8), node.id);
+  }
+  elapsed = now() - start;
+  printf("%-10s %10.3f %10.1f %12zu\n", "MinHeap16", elapsed,
+         elapsed * 1e9 / numOps, sizeof(HeapNode16) + sizeof(uint16_t));
+  deleteMinHeap16(heap16);
+
+  MinHeap64* heap64 = newMinHeap64(numNodes);
+  minHeap64Build(heap64, priorities, numNodes);
+  state = 88675123u;
+  start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode64 node = minHeap64ExtractMin(heap64);
+    minHeap64Insert(heap64, node.priority + (nextRandom(&state) >> 8), node.id);
+  }
+  elapsed = now() - start;
+  printf("%-10s %10.3f %10.1f %12zu\n", "MinHeap64", elapsed,
+         elapsed * 1e9 / numOps, sizeof(HeapNode64) + sizeof(int64_t));
+  deleteMinHeap64(heap64);
+
+  free(priorities);
+}
+
+/*********************************************************************
+ * payload: side table keyed by ID vs. extractMinWithPayload
+ ********************************************************************/
+
+typedef struct job {
+  long deadline;
+  long runs;
+  char name[48];
+} Job;
+
+void benchPayload(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PAYLOAD_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+
+  printf("payload: %d nodes with %zu-byte jobs, %d extractMin + insert pairs\n",
+         numNodes, sizeof(Job), numOps);
+
+  // Side table: what callers build today
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, priorities, NULL, numNodes);
+  Job* jobs = calloc(numNodes, sizeof(Job));
+  state = 88675123u;
+  long checksum = 0;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode node = extractMin(heap);
+    Job* job = &jobs[node.id];
+    checksum += job->runs++;
+    insert(heap, node.priority + (nextRandom(&state) >> 8), node.id);
+  }
+  double elapsed = now() - start;
+  printf("%-22s %8.3f s  %6.1f ns/op  (checksum %ld)\n", "side table:", elapsed,
+         elapsed * 1e9 / numOps, checksum);
+  free(jobs);
+  deleteHeap(heap);
+
+  // Payload held by the heap, prefetched during the sift
+  HeapOptions options = {.payloadSize = sizeof(Job)};
+  heap = newHeapWithOptions(numNodes, &options);
+  buildHeap(heap, priorities, NULL, numNodes);
+  memset(heap->payload, 0, sizeof(Job) * numNodes);
+  state = 88675123u;
+  checksum = 0;
+  start = now();
+  for (int i = 0; i < numOps; i++) {
+    void* payload;
+    HeapNode node = extractMinWithPayload(heap, &payload);
+    Job* job = payload;
+    checksum += job->runs++;
+    insert(heap, node.priority + (nextRandom(&state) >> 8), node.id);
+  }
+  elapsed = now() - start;
+  printf("%-22s %8.3f s  %6.1f ns/op  (checksum %ld)\n",
+         "extractMinWithPayload:", elapsed, elapsed * 1e9 / numOps, checksum);
+  deleteHeap(heap);
+
+  free(priorities);
+}
+
+/*********************************************************************
+ * stable: MinHeapInt64 vs. MinHeapStable (both 64-bit keys), on tied
+ *         priorities (fair-share scheduling) and on distinct ones
+ ********************************************************************/
+
+/* Runs 'numOps' extractMin + insert pairs on a MinHeapInt64 and on a
+ * MinHeapStable of 'numNodes' nodes, each re-inserted at its priority plus a
+ * random amount below 'spread', starting from priorities below 'spread'.
+ */
+void stableWorkload(int numNodes, int numOps, int spread) {
+  MinHeapInt64* plain = newMinHeapInt64(numNodes);
+  unsigned int state = 2463534242u;
+  for (int id = 0; id < numNodes; id++)
+    minHeapInt64Insert(plain, nextRandom(&state) % spread, id);
+  state = 88675123u;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNodeInt64 node = minHeapInt64ExtractMin(plain);
+    minHeapInt64Insert(plain, node.priority + nextRandom(&state) % spread,
+                       node.id);
+  }
+  double elapsed = now() - start;
+  printf("  %-14s %8.3f s  %6.1f ns/op\n", "MinHeapInt64:", elapsed,
+         elapsed * 1e9 / numOps);
+  deleteMinHeapInt64(plain);
+
+  MinHeapStable* stable = newMinHeapStable(numNodes);
+  state = 2463534242u;
+  for (int id = 0; id < numNodes; id++)
+    minHeapStableInsert(stable, nextRandom(&state) % spread, id);
+  state = 88675123u;
+  start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNodeStable node = minHeapStableExtractMin(stable);
+    minHeapStableInsert(stable, node.priority + nextRandom(&state) % spread,
+                        node.id);
+  }
+  elapsed = now() - start;
+  printf("  %-14s %8.3f s  %6.1f ns/op\n", "MinHeapStable:", elapsed,
+         elapsed * 1e9 / numOps);
+  deleteMinHeapStable(stable);
+}
+
+void benchStable(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PAYLOAD_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  printf("stable: %d nodes, %d extractMin + insert pairs\n", numNodes, numOps);
+
+  printf("tied priorities (re-inserted 0-1 levels later):\n");
+  stableWorkload(numNodes, numOps, 2);
+  printf("distinct priorities:\n");
+  stableWorkload(numNodes, numOps, 1 << 24);
+}
+
+/*********************************************************************
+ * compact: timer deadlines, MinHeap vs. 24-bit MinHeapCompact(32)
+ ********************************************************************/
+
+
+void benchCompact(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PAYLOAD_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  printf("compact: %d timers, %d expire + re-arm pairs\n", numNodes, numOps);
+  printf("%-17s %10s %10s %12s\n", "heap", "seconds", "ns/op", "bytes/node");
+
+  int* deadlines = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++)
+    deadlines[i] = nextRandom(&state) % TIMER_SPREAD;
+
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, deadlines, NULL, numNodes);
+  state = 88675123u;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode node = extractMin(heap);
+    insert(heap, node.priority + nextRandom(&state) % TIMER_SPREAD, node.id);
+  }
+  double elapsed = now() - start;
+  printf("%-17s %10.3f %10.1f %12zu\n", "MinHeap", elapsed,
+         elapsed * 1e9 / numOps, sizeof(HeapNode) + sizeof(int));
+  deleteHeap(heap);
+
+  MinHeapCompact32* compact32 = newMinHeapCompact32(numNodes);
+  minHeapCompact32Build(compact32, deadlines, numNodes);
+  state = 88675123u;
+  start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNodeCompact32 node = minHeapCompact32ExtractMin(compact32);
+    minHeapCompact32Insert(compact32,
+                           node.priority + nextRandom(&state) % TIMER_SPREAD,
+                           node.id);
+  }
+  elapsed = now() - start;
+  printf("%-17s %10.3f %10.1f %12zu\n", "MinHeapCompact32", elapsed,
+         elapsed * 1e9 / numOps, sizeof(MinHeapCompact32Entry) + sizeof(int32_t));
+  deleteMinHeapCompact32(compact32);
+
+  if (numNodes <= UINT16_MAX) {
+    MinHeapCompact* compact = newMinHeapCompact(numNodes);
+    minHeapCompactBuild(compact, deadlines, numNodes);
+    state = 88675123u;
+    start = now();
+    for (int i = 0; i < numOps; i++) {
+      HeapNodeCompact node = minHeapCompactExtractMin(compact);
+      minHeapCompactInsert(compact,
+                           node.priority + nextRandom(&state) % TIMER_SPREAD,
+                           node.id);
+    }
+    elapsed = now() - start;
+    printf("%-17s %10.3f %10.1f %12zu\n", "MinHeapCompact", elapsed,
+           elapsed * 1e9 / numOps,
+           sizeof(MinHeapCompactEntry) + sizeof(uint16_t));
+    deleteMinHeapCompact(compact);
+  }
+
+  free(deadlines);
+}
+
+/*********************************************************************
+ * trace: steady-state extractMin + insert, with and without recording
+ ********************************************************************/
+
+void benchTrace(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PAYLOAD_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  const char* path = argc > 3 ? argv[3] : DEFAULT_TRACE_PATH;
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++) priorities[i] = nextRandom(&state) >> 1;
+  printf("trace: %d nodes, %d extractMin + insert pairs, into %s\n", numNodes,
+         numOps, path);
+
+  for (int recording = 0; recording <= 1; recording++) {
+    MinHeap* heap = newHeap(numNodes);
+    buildHeap(heap, priorities, NULL, numNodes);
+    if (recording && startHeapTrace(heap, path) == NULL) {
+      fprintf(stderr, "trace: cannot create %s\n", path);
+      exit(1);
+    }
+    double elapsed = steadyState(heap, numOps);
+    double start = now();
+    stopHeapTrace(heap);
+    double stopping = now() - start;
+    printf("%-10s %8.3f s  %6.1f ns/op", recording ? "recorded:" : "plain:",
+           elapsed, elapsed * 1e9 / numOps);
+    if (recording) {
+      FILE* trace = fopen(path, "r");
+      fseek(trace, 0, SEEK_END);
+      long bytes = ftell(trace) - sizeof(HeapTraceHeader);
+      fclose(trace);
+      printf("  (+%.3f s final flush, %.2f bytes/record)", stopping,
+             (double)bytes / (numNodes + 2L * numOps));
+    }
+    printf("\n");
+    deleteHeap(heap);
+  }
+
+  free(priorities);
+}
+
+/*********************************************************************
+ * load: reading an input file line by line, against loadHeapFromFile
+ ********************************************************************/
+
+/* The way minheap_tester used to read an input file: fgets, atoi and insert
+ * for each line.
+ */
+MinHeap* loadByLines(const char* path) {
+  char line[INPUT_LINE];
+  FILE* f = fopen(path, "r");
+  fgets(line, INPUT_LINE, f);
+  MinHeap* heap = newHeap(atoi(line));
+  int id = 0;
+  while (fgets(line, INPUT_LINE, f)) insert(heap, atoi(line), id++);
+  fclose(f);
+  return heap;
+}
+
+void benchLoad(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  const char* dir = argc > 2 ? argv[2] : DEFAULT_LOAD_DIR;
+  char textPath[PATH_MAX], binaryPath[PATH_MAX];
+  snprintf(textPath, PATH_MAX, "%s/minheap_bench_input.txt", dir);
+  snprintf(binaryPath, PATH_MAX, "%s/minheap_bench_input.bin", dir);
+
+  int* priorities = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++)
+    priorities[i] = (int)nextRandom(&state) % 100000000;
+  FILE* f = fopen(textPath, "w");
+  if (f == NULL || !writeHeapInput(binaryPath, numNodes, priorities, numNodes)) {
+    fprintf(stderr, "load: cannot write input files in %s\n", dir);
+    exit(1);
+  }
+  fprintf(f, "%d\n", numNodes);
+  for (int i = 0; i < numNodes; i++) fprintf(f, "%d\n", priorities[i]);
+  fclose(f);
+  printf("load: %d priorities, from %s (page cache warm)\n", numNodes, dir);
+  printf("%-22s %10s %10s %10s\n", "loader", "seconds", "ns/node", "min");
+
+  for (int loader = 0; loader < 3; loader++) {
+    double start = now();
+    MinHeap* heap = loader == 0   ? loadByLines(textPath)
+                    : loader == 1 ? loadHeapFromFile(textPath, NULL)
+                                  : loadHeapFromFile(binaryPath, NULL);
+    double elapsed = now() - start;
+    const char* name = loader == 0   ? "fgets + atoi + insert"
+                       : loader == 1 ? "loadHeapFromFile text"
+                                     : "loadHeapFromFile bin";
+    printf("%-22s %10.3f %10.1f %10d\n", name, elapsed,
+           elapsed * 1e9 / numNodes, getMin(heap).priority);
+    deleteHeap(heap);
+  }
+
+  // The parser alone, over text already in memory
+  f = fopen(textPath, "r");
+  fseek(f, 0, SEEK_END);
+  long bytes = ftell(f);
+  rewind(f);
+  char* text = malloc(bytes);
+  fread(text, 1, bytes, f);
+  fclose(f);
+  int* parsed = malloc(sizeof(int) * (numNodes + 1L));
+  double start = now();
+  long count = parseIntegers(text, bytes, parsed, numNodes + 1L);
+  double elapsed = now() - start;
+  printf("%-22s %10.3f %10.1f %10s  (%.2f GB/s)\n", "parseIntegers only",
+         elapsed, elapsed * 1e9 / count, "-", bytes / elapsed / 1e9);
+
+  remove(textPath);
+  remove(binaryPath);
+  free(text);
+  free(parsed);
+  free(priorities);
+}
+
+/*********************************************************************
+ * image: restarting from a heap image, against rebuilding the heap
+ ********************************************************************/
+
+/* Runs 'numOps' timer expiries and re-arms on 'heap', and returns the time
+ * they took.
+ */
+double expireTimers(MinHeap* heap, int numOps) {
+  unsigned int state = 88675123u;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode node = extractMin(heap);
+    insert(heap, node.priority + nextRandom(&state) % TIMER_SPREAD, node.id);
+  }
+  return now() - start;
+}
+
+void benchImage(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  const char* path = argc > 3 ? argv[3] : DEFAULT_IMAGE_PATH;
+  printf("image: %d timers, %d expire + re-arm pairs after each start\n",
+         numNodes, numOps);
+  printf("%-20s %10s %10s %10s\n", "start", "start s", "ops s", "min");
+
+  int* deadlines = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++)
+    deadlines[i] = nextRandom(&state) % TIMER_SPREAD;
+
+  double start = now();
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, deadlines, NULL, numNodes);
+  double elapsed = now() - start;
+  int min = getMin(heap).priority;
+  printf("%-20s %10.3f %10.3f %10d\n", "buildHeap", elapsed,
+         expireTimers(heap, numOps), min);
+
+  start = now();
+  if (!saveHeap(heap, path)) {
+    fprintf(stderr, "image: cannot write %s\n", path);
+    exit(1);
+  }
+  printf("(saveHeap: %.3f s, %.1f MB)\n", now() - start,
+         (sizeof(HeapNode) * heap->arrSlots + sizeof(int) * heap->capacity) / 1e6);
+  deleteHeap(heap);
+
+  for (int mode = HEAP_IMAGE_PRIVATE; mode <= HEAP_IMAGE_READONLY; mode++) {
+    start = now();
+    heap = loadHeap(path, mode);
+    elapsed = now() - start;
+    min = getMin(heap).priority;
+    double ops = mode == HEAP_IMAGE_PRIVATE ? expireTimers(heap, numOps) : 0;
+    printf("%-20s %10.3f %10.3f %10d\n",
+           mode == HEAP_IMAGE_PRIVATE ? "loadHeap private" : "loadHeap read-only",
+           elapsed, ops, min);
+    deleteHeap(heap);
+  }
+
+  remove(path);
+  free(deadlines);
+}
+
+/*********************************************************************
+ * persist: durable timer expiries, by group commit interval
+ ********************************************************************/
+
+void benchPersist(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PERSIST_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_PERSIST_OPS;
+  const char* path = argc > 3 ? argv[3] : DEFAULT_IMAGE_PATH;
+  char logPath[PATH_MAX];
+  snprintf(logPath, PATH_MAX, "%s.log", path);
+  printf("persist: %d timers, %d expire + re-arm pairs, image %s\n", numNodes,
+         numOps, path);
+  printf("%-10s %10s %12s %10s %12s\n", "interval", "seconds", "pairs/s",
+         "commits", "bytes/pair");
+
+  int* deadlines = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++)
+    deadlines[i] = nextRandom(&state) % TIMER_SPREAD;
+
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, deadlines, NULL, numNodes);
+  double elapsed = expireTimers(heap, numOps);
+  printf("%-10s %10.3f %12.0f %10s %12s\n", "in memory", elapsed,
+         numOps / elapsed, "-", "-");
+  deleteHeap(heap);
+
+  // An interval counts operations, so each pair is two of them
+  for (int interval = 2; interval <= 2 * MAX_COMMIT_INTERVAL; interval *= 8) {
+    remove(path);
+    remove(logPath);
+    PersistentHeap* p = openPersistentHeap(path, numNodes, NULL, interval);
+    if (p == NULL) {
+      fprintf(stderr, "persist: cannot create %s\n", path);
+      exit(1);
+    }
+    buildHeap(p->heap, deadlines, NULL, numNodes);
+    commitPersistentHeap(p);
+    long commits = p->commits, bytesLogged = p->bytesLogged;
+
+    state = 88675123u;
+    double start = now();
+    for (int i = 0; i < numOps; i++) {
+      HeapNode node;
+      bool committed = persistentExtractMin(p, &node);
+      int deadline = node.priority + nextRandom(&state) % TIMER_SPREAD;
+      if (!committed || !persistentInsert(p, deadline, node.id)) {
+        fprintf(stderr, "persist: cannot commit to %s\n", logPath);
+        exit(1);
+      }
+    }
+    commitPersistentHeap(p);
+    elapsed = now() - start;
+    printf("%-10d %10.3f %12.0f %10ld %12.1f\n", interval / 2, elapsed,
+           numOps / elapsed, p->commits - commits,
+           (double)(p->bytesLogged - bytesLogged) / numOps);
+    closePersistentHeap(p);
+  }
+
+  remove(path);
+  remove(logPath);
+  free(deadlines);
+}
+
+/*********************************************************************
+ * wal: durable timer expiries through the operation log, by group commit
+ * policy, then the cost of recovery and compaction
+ ********************************************************************/
+
+/* Runs 'numOps' expire + re-arm pairs on a logged heap of 'numNodes' timers
+ * at 'deadlines', newly created at 'path' with 'policy', and prints a row
+ * labelled 'label'. Closing leaves every pair in the log.
+ */
+void walRun(const char* label, HeapWalPolicy* policy, int* deadlines,
+            int numNodes, int numOps, const char* path) {
+  char snapshot[PATH_MAX];
+  snprintf(snapshot, PATH_MAX, "%s.1", path);
+  remove(path);
+  remove(snapshot);
+  HeapWal* wal = openHeapWal(path, numNodes, NULL, policy);
+  if (wal == NULL) {
+    fprintf(stderr, "wal: cannot create %s\n", path);
+    exit(1);
+  }
+  buildHeap(wal->heap, deadlines, NULL, numNodes);
+  compactHeapWal(wal);  // the timers become snapshot 1
+  long commits = wal->commits, bytesLogged = wal->bytesLogged;
+
+  unsigned int state = 88675123u;
+  double start = now();
+  for (int i = 0; i < numOps; i++) {
+    HeapNode node;
+    bool committed = walExtractMin(wal, &node);
+    int deadline = node.priority + nextRandom(&state) % TIMER_SPREAD;
+    if (!committed || !walInsert(wal, deadline, node.id)) {
+      fprintf(stderr, "wal: cannot commit to %s\n", path);
+      exit(1);
+    }
+  }
+  commitHeapWal(wal);
+  double elapsed = now() - start;
+  printf("%-14s %10.3f %12.0f %10ld %12.2f\n", label, elapsed,
+         numOps / elapsed, wal->commits - commits,
+         (double)(wal->bytesLogged - bytesLogged) / numOps);
+  closeHeapWal(wal);
+}
+
+void benchWal(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PERSIST_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_PERSIST_OPS;
+  const char* path = argc > 3 ? argv[3] : DEFAULT_WAL_PATH;
+  printf("wal: %d timers, %d expire + re-arm pairs, log %s\n", numNodes,
+         numOps, path);
+  printf("%-14s %10s %12s %10s %12s\n", "commit every", "seconds", "pairs/s",
+         "commits", "bytes/pair");
+
+  int* deadlines = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++)
+    deadlines[i] = nextRandom(&state) % TIMER_SPREAD;
+
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, deadlines, NULL, numNodes);
+  double elapsed = expireTimers(heap, numOps);
+  printf("%-14s %10.3f %12.0f %10s %12s\n", "in memory", elapsed,
+         numOps / elapsed, "-", "-");
+  deleteHeap(heap);
+
+  // commitOps counts operations, so each pair is two of them
+  char label[32];
+  for (int pairs = 1; pairs <= MAX_COMMIT_INTERVAL; pairs *= 8) {
+    HeapWalPolicy policy = {.commitOps = 2 * pairs};
+    snprintf(label, sizeof(label), "%d pairs", pairs);
+    walRun(label, &policy, deadlines, numNodes, numOps, path);
+  }
+  for (long micros = 100; micros <= 10000; micros *= 10) {
+    HeapWalPolicy policy = {.commitMicros = micros};
+    snprintf(label, sizeof(label), "%ld us", micros);
+    walRun(label, &policy, deadlines, numNodes, numOps, path);
+  }
+
+  // The last run left snapshot 1 and a log of every pair to replay
+  double start = now();
+  HeapWal* wal = openHeapWal(path, numNodes, NULL, NULL);
+  double recovery = now() - start;
+  int min = getMin(wal->heap).priority;
+  start = now();
+  compactHeapWal(wal);
+  printf("(recovery: %.3f s, min %d; compaction: %.3f s)\n", recovery, min,
+         now() - start);
+  closeHeapWal(wal);
+
+  char snapshot[PATH_MAX];
+  snprintf(snapshot, PATH_MAX, "%s.2", path);
+  remove(path);
+  remove(snapshot);
+  free(deadlines);
+}
+
+/*********************************************************************
+ * shared: one timer heap in shared memory, expired and re-armed by several
+ * processes at once, one pair or SHARED_BATCH pairs per lock
+ ********************************************************************/
+
+/* Runs 'numOps' expire + re-arm pairs on a new view of shared heap 'name',
+ * 'batch' pairs per lock, with random stream 'seed'. Returns False if the
+ * heap cannot be opened or its lock cannot be taken.
+ */
+bool sharedWorker(const char* name, int numOps, int batch, unsigned int seed) {
+  SharedHeap* s = openSharedHeap(name);
+  if (s == NULL) return false;
+  HeapNode nodes[SHARED_BATCH];
+  int priorities[SHARED_BATCH], ids[SHARED_BATCH];
+  bool ok = true;
+  for (int done = 0; ok && done < numOps; done += batch) {
+    if (batch == 1) {
+      HeapNode node;
+      if (sharedExtractMin(s, &node))
+        ok = sharedInsert(s, node.priority + nextRandom(&seed) % TIMER_SPREAD,
+                          node.id);
+      continue;
+    }
+    int n = sharedExtractMinBatch(s, batch, nodes);
+    if (n < 0) {
+      ok = false;
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      priorities[i] = nodes[i].priority + nextRandom(&seed) % TIMER_SPREAD;
+      ids[i] = nodes[i].id;
+    }
+    ok = sharedInsertBatch(s, priorities, ids, n);
+  }
+  closeSharedHeap(s);
+  return ok;
+}
+
+void benchShared(int argc, char* argv[]) {
+  int numNodes = argc > 1 ? atoi(argv[1]) : DEFAULT_PERSIST_NODES;
+  int numOps = argc > 2 ? atoi(argv[2]) : DEFAULT_OPS;
+  int maxProcs = argc > 3 ? atoi(argv[3]) : DEFAULT_MAX_PROCS;
+  printf("shared: %d timers, %d expire + re-arm pairs in all\n", numNodes,
+         numOps);
+  printf("%-10s %6s %10s %12s\n", "per lock", "procs", "seconds", "pairs/s");
+
+  int* deadlines = malloc(sizeof(int) * numNodes);
+  unsigned int state = 2463534242u;
+  for (int i = 0; i < numNodes; i++)
+    deadlines[i] = nextRandom(&state) % TIMER_SPREAD;
+
+  MinHeap* heap = newHeap(numNodes);
+  buildHeap(heap, deadlines, NULL, numNodes);
+  double elapsed = expireTimers(heap, numOps);
+  printf("%-10s %6d %10.3f %12.0f\n", "private", 1, elapsed, numOps / elapsed);
+  deleteHeap(heap);
+
+  for (int batch = 1; batch <= SHARED_BATCH; batch *= SHARED_BATCH) {
+    for (int procs = 1; procs <= maxProcs; procs *= 2) {
+      unlinkSharedHeap(SHARED_HEAP_NAME);
+      SharedHeap* s = createSharedHeap(SHARED_HEAP_NAME, numNodes, NULL);
+      if (s == NULL) {
+        fprintf(stderr, "shared: cannot create %s\n", SHARED_HEAP_NAME);
+        exit(1);
+      }
+      int* ids = malloc(sizeof(int) * numNodes);
+      for (int i = 0; i < numNodes; i++) ids[i] = i;
+      bool filled = sharedInsertBatch(s, deadlines, ids, numNodes);
+      free(ids);
+      if (!filled) {
+        fprintf(stderr, "shared: cannot lock %s\n", SHARED_HEAP_NAME);
+        exit(1);
+      }
+
+      fflush(stdout);  // or each child prints it again
+      double start = now();
+      for (int p = 0; p < procs; p++) {
+        if (fork() == 0) {
+          exit(sharedWorker(SHARED_HEAP_NAME, numOps / procs, batch,
+                            88675123u + p) ? 0 : 1);
+        }
+      }
+      bool failed = false;
+      for (int p = 0; p < procs; p++) {
+        int status;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+          failed = true;
+      }
+      elapsed = now() - start;
+      printf("%-10d %6d %10.3f %12.0f\n", batch, procs, elapsed,
+             numOps / elapsed);
+
+      if (failed) printf("  a worker failed!\n");
+      if (sharedNumNodes(s) != numNodes) printf("  lost nodes!\n");
+      closeSharedHeap(s);
+      unlinkSharedHeap(SHARED_HEAP_NAME);
+    }
+  }
+  free(deadlines);
+}
@@ -0,0 +1,221 @@
+/*
+ * Helper functions of our min-heap implementation that are shared with the
+ * other modules built on top of it (minheap_parallel.c, ...). Not part of
+ * the public MinHeap interface.
+ */
+
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __MinHeap_internal_header
+#define __MinHeap_internal_header
+
+#define ROOT_INDEX 1
+#define NOTHING -1
+
+#define CACHE_LINE_SIZE 64
+#define LINE_BLOCK_HEIGHT 3  // 7 nodes + 1 pad = 64 bytes
+#define PAGE_BLOCK_HEIGHT 9  // 511 nodes + 1 pad = 4096 bytes
+#define MAX_PREFETCH_DISTANCE 30  // prefetchBelow shifts indices by this much
+#define DUMP_LINE_BYTES 32   // a guess at a line of dumpHeap, to size its buffer
+
+/* A set of element numbers (arr slots, IDs, ...) of a heap, as a bitmap
+ * plus a list of its nonzero words, so that it can be walked and cleared in
+ * time proportional to what it holds rather than to the heap.
+ */
+typedef struct heap_dirty_set {
+  uint64_t* bits;  // bit i is set if element i is in the set
+  long* words;     // the indices of the nonzero words of 'bits', unordered
+  long numWords;   // how many of them there are
+} HeapDirtySet;
+
+typedef struct heap_dirty {
+  HeapDirtySet slots;     // arr slots written (positions, not indices)
+  HeapDirtySet ids;       // indexMap entries written
+  HeapDirtySet payloads;  // payloads written through setPayload
+} HeapDirty;
+
+/* Returns True if 'maybeIdx' is a valid index in minheap 'heap', and 'heap'
+ * stores an element at that index. Returns False otherwise.
+ */
+bool isValidIndex(MinHeap* heap, int maybeIdx);
+
+/* Returns the position in heap->arr of the node at index 'nodeIndex' in
+ * minheap 'heap'. Indices always follow the implicit layout (children of i at
+ * 2i and 2i + 1); only blocked layouts store nodes anywhere else.
+ */
+long slotOf(MinHeap* heap, int nodeIndex);
+
+/* Returns a pointer to the node at index 'nodeIndex' in minheap 'heap'.
+ * Precondition: 0 <= 'nodeIndex' <= heap->capacity
+ */
+HeapNode* nodePtr(MinHeap* heap, int nodeIndex);
+
+/* Returns node at index 'nodeIndex' in minheap 'heap'.
+ * Precondition: 'nodeIndex' is a valid index in 'heap'
+ *               'heap' is non-empty
+ */
+HeapNode nodeAt(MinHeap* heap, int nodeIndex);
+
+/* Returns priority of node at index 'nodeIndex' in minheap 'heap'.
+ * Precondition: 'nodeIndex' is a valid index in 'heap'
+ *               'heap' is non-empty
+ */
+int priorityAt(MinHeap* heap, int nodeIndex);
+
+/* Returns ID of node at index 'nodeIndex' in minheap 'heap'.
+ * Precondition: 'nodeIndex' is a valid index in 'heap'
+ *               'heap' is non-empty
+ */
+int idAt(MinHeap* heap, int nodeIndex);
+
+/* Returns index of node with ID 'id' in minheap 'heap'.
+ * Precondition: 'id' is a valid ID in 'heap'
+ *               'heap' is non-empty
+ */
+int indexOf(MinHeap* heap, int id);
+
+/* Returns the index of the left child of a node at index 'nodeIndex' in
+ * minheap 'heap', if such exists.  Returns NOTHING if there is no such left
+ * child.
+ */
+int leftIdx(MinHeap* heap, int nodeIndex);
+
+/* Returns the index of the right child of a node at index 'nodeIndex' in
+ * minheap 'heap', if such exists.  Returns NOTHING if there is no such right
+ * child.
+ */
+int rightIdx(MinHeap* heap, int nodeIndex);
+
+/* Returns the index of the parent of a node at index 'nodeIndex' in minheap
+ * 'heap', if such exists.  Returns NOTHING if there is no such parent.
+ */
+int parentIdx(MinHeap* heap, int nodeIndex);
+
+/* Writes 'node' at index 'nodeIndex' of minheap 'heap', recording its slot
+ * as written if 'heap' tracks writes.
+ */
+void setNode(MinHeap* heap, int nodeIndex, HeapNode node);
+
+/* Sets the index of ID 'id' in minheap 'heap' to 'nodeIndex', recording it
+ * as written if 'heap' tracks writes.
+ */
+void setIndex(MinHeap* heap, int id, int nodeIndex);
+
+/* Starts recording, in heap->dirty, every write to the arr, indexMap and
+ * payload (through setPayload) of minheap 'heap'. Has no effect if already
+ * recording. buildHeapParallel records its writes once its workers are
+ * done.
+ */
+void startTrackingWrites(MinHeap* heap);
+
+/* Stops recording the writes to minheap 'heap', and frees heap->dirty. Has
+ * no effect if not recording.
+ */
+void stopTrackingWrites(MinHeap* heap);
+
+/* Records every ID minheap 'heap' holds as written in heap->dumped, if it
+ * has been dumped, so that the next dumpHeapChanges reports those that
+ * rebuilding the heap drops.
+ */
+void markDumpedIds(MinHeap* heap);
+
+/* Empties 'set'.
+ */
+void clearDirtySet(HeapDirtySet* set);
+
+/* Adds element 'i' to the dirty set 'set'.
+ */
+void markDirty(HeapDirtySet* set, long i);
+
+/* Returns 'a' minus 'b', for sorting word indices of a dirty set.
+ */
+int compareWords(const void* a, const void* b);
+
+/* Swaps contents of heap->arr[index1] and heap->arr[index2] if both 'index1'
+ * and 'index2' are valid indices for minheap 'heap'. Has no effect
+ * otherwise.
+ */
+void swap(MinHeap* heap, int index1, int index2);
+
+/* Bubbles up the element newly inserted into minheap 'heap' at index
+ * 'nodeIndex', if 'nodeIndex' is a valid index for heap. Has no effect
+ * otherwise.
+ */
+void bubbleUp(MinHeap* heap, int nodeIndex);
+
+/* Starts loading, without waiting for it, the level of minheap 'heap'
+ * 'distance' levels below the sibling pair whose left node is at index
+ * 'left'. Those descendants occupy indices [left << distance,
+ * ((left + 2) << distance) - 1].
+ */
+void prefetchBelow(MinHeap* heap, int left, int distance);
+
+/* Bubbles down the element at index 'nodeIndex' of minheap 'heap' until both
+ * its subtrees satisfy the heap property, if 'nodeIndex' is a valid index
+ * for heap. Has no effect otherwise.
+ * Only touches nodes in the subtree rooted at 'nodeIndex'.
+ */
+void bubbleDownFrom(MinHeap* heap, int nodeIndex);
+
+/* Bubbles down the element newly inserted into minheap 'heap' at the root,
+ * if it exists. Has no effect otherwise.
+ */
+void bubbleDown(MinHeap* heap);
+
+/* Returns the number of levels of a minheap holding 'size' nodes.
+ */
+int heapHeight(int size);
+
+/* Appends the 'n' nodes whose priorities are 'priorities' and whose IDs are
+ * 'ids' (or 0..n-1 if 'ids' is NULL) after the last node of minheap 'heap',
+ * without restoring the heap property.
+ * Precondition: heap->size + n <= heap->capacity
+ */
+void appendNodes(MinHeap* heap, int* priorities, int* ids, int n);
+
+/* Restores the heap property of minheap 'heap', given that only the nodes at
+ * indices 'first' to 'last' may violate it: bubbles down those nodes, then
+ * their parents, and so on up to the root.
+ */
+void heapifyRange(MinHeap* heap, int first, int last);
+
+/* Sets every field of the empty minheap 'heap' of capacity 'capacity', as
+ * configured by 'options' (or the defaults if NULL), except arr and indexMap.
+ */
+void initHeap(MinHeap* heap, int capacity, HeapOptions* options);
+
+/* Returns the alignment arr of minheap 'heap' needs so that no block of its
+ * layout straddles a line (or page), or 0 if it needs none.
+ */
+size_t arrAlignment(MinHeap* heap);
+
+/* Restores the heap property of minheap 'heap' after nodes were appended at
+ * indices 'first' to heap->size: either bubbles each one up, or re-heapifies
+ * their ancestors in bulk, whichever is estimated to be cheaper.
+ */
+void heapifyAppended(MinHeap* heap, int first);
+
+/* Returns True if 'maybeIdx' is the index of a node in the insertion buffer
+ * of minheap 'heap'. Returns False otherwise.
+ */
+bool isBufferIndex(MinHeap* heap, int maybeIdx);
+
+/* Returns True if the insertion buffer of minheap 'heap' holds a node of
+ * smaller priority than every node in the heap proper.
+ */
+bool bufferHoldsMin(MinHeap* heap);
+
+/* Moves the node at index 'from' of minheap 'heap' to index 'to', keeping
+ * indexMap in step. Unlike swap, works on buffered nodes too.
+ */
+void moveNode(MinHeap* heap, int from, int to);
+
+/* Removes the buffered node at index 'nodeIndex' of minheap 'heap' and
+ * returns it. The last buffered node takes its place.
+ * Precondition: 'nodeIndex' is a buffer index of 'heap'
+ */
+HeapNode removeFromBuffer(MinHeap* heap, int nodeIndex);
+
+#endif
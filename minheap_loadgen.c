@@ -0,0 +1,317 @@
+/*
+ * A load generator for minheap_server: several client processes share one
+ * queue, each keeping 'depth' request frames in flight, and each frame
+ * inserting or extracting 'batch' nodes. Reports the throughput, the
+ * syscalls per operation on the client side, and percentiles of the time
+ * from sending a frame to reading its response.
+ *
+ * Each client owns the IDs it has inserted until it extracts any node, and
+ * then owns the ID extracted: it re-inserts the IDs it owns with later
+ * priorities, like timers re-armed on expiry, so the queue stays about as
+ * large as it started.
+ *
+ * Usage: minheap_loadgen socket [clients] [ops] [batch] [depth] [nodes]
+ *   depth 1, batch 1 is plain request/response.
+ *
+ * Build with:
+ *   gcc -O2 minheap_loadgen.c -o minheap_loadgen
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heapserver.h"
+
+#define DEFAULT_CLIENTS 4
+#define DEFAULT_OPS 1000000
+#define DEFAULT_BATCH 64
+#define DEFAULT_DEPTH 16
+#define DEFAULT_NODES 100000
+#define PRIORITY_SPREAD (1 << 20)
+#define QUEUE 0
+
+typedef struct reader {
+  int fd;
+  unsigned char* data;  // bytes read from 'fd' but not yet taken
+  size_t start;         // the first of them
+  size_t end;           // just past the last
+  size_t capacity;
+  long reads;           // read syscalls made
+} Reader;
+
+typedef struct client_stats {
+  long operations;
+  long frames;
+  long syscalls;
+} ClientStats;
+
+double now(void);
+unsigned int nextRandom(unsigned int* state);
+int connectTo(const char* path);
+bool writeFully(int fd, const void* data, size_t bytes);
+bool readFully(int fd, void* data, size_t bytes);
+bool readBuffered(Reader* reader, void* data, size_t bytes);
+void runClient(const char* path, int client, int numClients, long numOps,
+               int batch, int depth, int numNodes, double* latencies,
+               ClientStats* stats);
+int compareDoubles(const void* a, const void* b);
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "Usage: %s socket [clients] [ops] [batch] [depth] [nodes]\n",
+            argv[0]);
+    exit(1);
+  }
+  const char* path = argv[1];
+  int numClients = argc > 2 ? atoi(argv[2]) : DEFAULT_CLIENTS;
+  long numOps = argc > 3 ? atol(argv[3]) : DEFAULT_OPS;
+  int batch = argc > 4 ? atoi(argv[4]) : DEFAULT_BATCH;
+  int depth = argc > 5 ? atoi(argv[5]) : DEFAULT_DEPTH;
+  int numNodes = argc > 6 ? atoi(argv[6]) : DEFAULT_NODES;
+  if (numClients < 1 || batch < 1 || batch > HEAP_SERVER_MAX_BATCH ||
+      depth < 1 || numNodes < numClients * batch) {
+    fprintf(stderr, "Invalid arguments\n");
+    exit(1);
+  }
+
+  // Create the queue, and have each client fill in its share of it
+  int fd = connectTo(path);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to connect to the specified socket: %s\n", path);
+    exit(1);
+  }
+  HeapRequest create = {sizeof(HeapRequest), HEAP_OP_CREATE, 0, QUEUE,
+                        numNodes, 0};
+  HeapResponse response;
+  if (!writeFully(fd, &create, sizeof(create)) ||
+      !readFully(fd, &response, sizeof(response)) ||
+      response.status != HEAP_STATUS_OK) {
+    fprintf(stderr, "Unable to create the queue\n");
+    exit(1);
+  }
+
+  // Latencies go to memory the parent shares, one slot per frame
+  long framesPerClient = (numOps / numClients + batch - 1) / batch;
+  size_t latencyBytes = sizeof(double) * framesPerClient * numClients;
+  double* latencies = mmap(NULL, latencyBytes, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ClientStats* stats = mmap(NULL, sizeof(ClientStats) * numClients,
+                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                            -1, 0);
+
+  printf("loadgen: %d clients, %ld ops, batch %d, depth %d, %d nodes\n",
+         numClients, numOps, batch, depth, numNodes);
+  fflush(stdout);  // or each client prints it again
+  double start = now();
+  for (int c = 0; c < numClients; c++) {
+    if (fork() == 0) {
+      runClient(path, c, numClients, numOps / numClients, batch, depth,
+                numNodes, latencies + c * framesPerClient, &stats[c]);
+      exit(0);
+    }
+  }
+  for (int c = 0; c < numClients; c++) wait(NULL);
+  double elapsed = now() - start;
+
+  long operations = 0, frames = 0, syscalls = 0;
+  for (int c = 0; c < numClients; c++) {
+    // Pack each client's latencies together before sorting them all
+    memmove(latencies + frames, latencies + c * framesPerClient,
+            sizeof(double) * stats[c].frames);
+    operations += stats[c].operations;
+    frames += stats[c].frames;
+    syscalls += stats[c].syscalls;
+  }
+  qsort(latencies, frames, sizeof(double), compareDoubles);
+
+  printf("%.3f s, %.0f ops/s, %.3f client syscalls/op\n", elapsed,
+         operations / elapsed, (double)syscalls / operations);
+  double percentiles[] = {50, 90, 99, 99.9};
+  printf("frame latency (us):");
+  for (int p = 0; p < 4; p++) {
+    long i = (long)(percentiles[p] / 100 * (frames - 1));
+    printf("  p%g %.1f", percentiles[p], frames > 0 ? latencies[i] * 1e6 : 0.0);
+  }
+  printf("  max %.1f\n", frames > 0 ? latencies[frames - 1] * 1e6 : 0.0);
+
+  close(fd);
+  return 0;
+}
+
+double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned int nextRandom(unsigned int* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* Returns a socket connected to the server at 'path', or -1 on error.
+ */
+int connectTo(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) return -1;
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Writes the 'bytes' bytes at 'data' to 'fd'. Returns False on error.
+ */
+bool writeFully(int fd, const void* data, size_t bytes) {
+  const char* next = data;
+  while (bytes > 0) {
+    ssize_t n = write(fd, next, bytes);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    next += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/* Reads exactly 'bytes' bytes from 'fd' into 'data'. Returns False on error
+ * or end of file.
+ */
+bool readFully(int fd, void* data, size_t bytes) {
+  char* next = data;
+  while (bytes > 0) {
+    ssize_t n = read(fd, next, bytes);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    next += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/* Takes the next 'bytes' bytes from 'reader' into 'data', reading as much
+ * as the socket has, up to the capacity of 'reader', whenever it runs out.
+ * Returns False on error or end of file.
+ * Precondition: 'bytes' <= reader->capacity
+ */
+bool readBuffered(Reader* reader, void* data, size_t bytes) {
+  while (reader->end - reader->start < bytes) {
+    memmove(reader->data, reader->data + reader->start,
+            reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+    ssize_t n = read(reader->fd, reader->data + reader->end,
+                     reader->capacity - reader->end);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    reader->end += n;
+    reader->reads++;
+  }
+  memcpy(data, reader->data + reader->start, bytes);
+  reader->start += bytes;
+  return true;
+}
+
+/* Runs client number 'client' of 'numClients': 'numOps' operations in frames
+ * of 'batch', 'depth' frames in flight, on a queue of 'numNodes' nodes.
+ * Stores the latency of each frame in 'latencies', and its counters in
+ * '*stats'.
+ */
+void runClient(const char* path, int client, int numClients, long numOps,
+               int batch, int depth, int numNodes, double* latencies,
+               ClientStats* stats) {
+  int fd = connectTo(path);
+  if (fd < 0) exit(1);
+  unsigned int state = 2463534242u + client;
+
+  // The IDs this client owns and has not inserted yet
+  int numIds = numNodes / numClients;
+  int* ids = malloc(sizeof(int) * numNodes);
+  int numFree = 0;
+  for (int i = 0; i < numIds; i++) ids[numFree++] = client * numIds + i;
+  int* priorities = malloc(sizeof(int) * numNodes);
+  for (int i = 0; i < numFree; i++)
+    priorities[i] = nextRandom(&state) % PRIORITY_SPREAD;
+
+  size_t frameBytes = sizeof(HeapRequest) + batch * sizeof(HeapNode);
+  unsigned char* frames = malloc(frameBytes * depth);
+  HeapNode* extracted = malloc(sizeof(HeapNode) * batch);
+  double* sentAt = malloc(sizeof(double) * depth);
+  int* inserted = malloc(sizeof(int) * depth);  // per frame; -1 for extract
+  Reader reader = {.fd = fd};
+  reader.capacity = (sizeof(HeapResponse) + batch * sizeof(HeapNode)) * depth;
+  reader.data = malloc(reader.capacity);
+
+  long sent = 0, received = 0, operations = 0, writes = 0;
+  long numFrames = (numOps + batch - 1) / batch;
+  while (received < numFrames) {
+    // Top up the pipeline with as many frames as fit, then send them at once
+    size_t bytes = 0;
+    while (sent < numFrames && sent - received < depth) {
+      int slot = sent % depth;
+      HeapRequest* request = (HeapRequest*)(frames + bytes);
+      HeapNode* nodes = (HeapNode*)(request + 1);
+      int n = numFree < batch ? numFree : batch;
+      if (n == batch) {  // re-arm: insert what this client owns
+        for (int i = 0; i < n; i++) {
+          numFree--;
+          nodes[i] = (HeapNode){priorities[numFree], ids[numFree]};
+        }
+        *request = (HeapRequest){sizeof(HeapRequest) + n * sizeof(HeapNode),
+                                 HEAP_OP_INSERT, n, QUEUE, 0, slot};
+        inserted[slot] = n;
+      } else {
+        *request = (HeapRequest){sizeof(HeapRequest), HEAP_OP_EXTRACT_MIN, 0,
+                                 QUEUE, batch, slot};
+        inserted[slot] = -1;
+      }
+      sentAt[slot] = now();
+      bytes += request->bytes;
+      sent++;
+    }
+    if (bytes > 0) {
+      if (!writeFully(fd, frames, bytes)) exit(1);
+      writes++;
+    }
+
+    // Then take the oldest response
+    HeapResponse response;
+    if (!readBuffered(&reader, &response, sizeof(response))) exit(1);
+    int slot = response.tag;
+    if (response.count > 0 && inserted[slot] < 0) {
+      if (!readBuffered(&reader, extracted, response.count * sizeof(HeapNode)))
+        exit(1);
+      for (int i = 0; i < response.count; i++) {
+        ids[numFree] = extracted[i].id;
+        priorities[numFree++] =
+            extracted[i].priority + nextRandom(&state) % PRIORITY_SPREAD;
+      }
+    }
+    latencies[received++] = now() - sentAt[slot];
+    operations += inserted[slot] < 0 ? response.count : inserted[slot];
+  }
+
+  stats->operations = operations;
+  stats->frames = received;
+  stats->syscalls = writes + reader.reads;
+  close(fd);
+}
+
+int compareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
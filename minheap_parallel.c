@@ -0,0 +1,235 @@
+/*
+ * Our multi-threaded min-heap operations.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "minheap_internal.h"
+#include "minheap_parallel.h"
+
+#define SUBTREES_PER_THREAD 4	// more subtrees than threads evens out the load
+#define PARALLEL_TOPK_MIN 65536	// below this, topK's O(k log k) frontier wins
+
+typedef struct build_task {
+	MinHeap* heap;
+	int* priorities;
+	int* ids;
+	int n;
+	int numThreads;
+	int thread;		// this task's number, 0 <= thread < numThreads
+	int splitLevel;	// subtrees are rooted at indices [2^splitLevel, 2^(splitLevel+1))
+} BuildTask;
+
+/* Heapifies the subtree of 'heap' rooted at index 'root', bottom-up, one
+ * level at a time. The level 'depth' below 'root' spans the contiguous
+ * indices [root << depth, ((root + 1) << depth) - 1].
+ */
+void heapifySubtree(MinHeap* heap, int root) {
+	int lastInternal = heap->size / 2;
+	int depth = 0;
+	while (((long)root << (depth + 1)) <= lastInternal) depth++;
+	
+	for (; depth >= 0; depth--) {
+		long first = (long)root << depth;
+		long last = (((long)root + 1) << depth) - 1;
+		if (first > lastInternal) continue;
+		if (last > lastInternal) last = lastInternal;
+		for (long i = last; i >= first; i--) bubbleDownFrom(heap, (int)i);
+	}
+}
+
+/* Runs 'worker' on each of the 'numTasks' tasks at 'tasks', 'taskBytes'
+ * apart, one thread per task, and waits for them all. A task that cannot get
+ * a thread runs on the calling thread instead, so none is ever left out.
+ */
+void runTasks(void* (*worker)(void*), void* tasks, size_t taskBytes, int numTasks) {
+	pthread_t threads[numTasks];
+	bool started[numTasks];
+	for (int t = 0; t < numTasks; t++)
+		started[t] = pthread_create(&threads[t], NULL, worker,
+		                            (char*)tasks + t * taskBytes) == 0;
+	for (int t = 0; t < numTasks; t++) {
+		if (started[t]) pthread_join(threads[t], NULL);
+		else worker((char*)tasks + t * taskBytes);
+	}
+}
+
+/* Fills this task's contiguous share of arr and the matching indexMap
+ * entries.
+ */
+void* fillWorker(void* arg) {
+	BuildTask* task = arg;
+	MinHeap* heap = task->heap;
+	long first = (long)task->n * task->thread / task->numThreads;
+	long last = (long)task->n * (task->thread + 1) / task->numThreads;
+	for (long i = first; i < last; i++) {
+		int id = task->ids == NULL ? (int)i : task->ids[i];
+		nodePtr(heap, ROOT_INDEX + i)->priority = task->priorities[i];
+		nodePtr(heap, ROOT_INDEX + i)->id = id;
+		heap->indexMap[id] = ROOT_INDEX + i;
+	}
+	return NULL;
+}
+
+/* Heapifies this task's share of the subtrees, once every task is filled.
+ */
+void* heapifyWorker(void* arg) {
+	BuildTask* task = arg;
+	MinHeap* heap = task->heap;
+	
+	// Interleave subtrees across threads, so each gets a similar mix of sizes
+	int firstRoot = 1 << task->splitLevel;
+	int lastRoot = (firstRoot << 1) - 1;
+	for (int root = firstRoot + task->thread; root <= lastRoot && root <= heap->size;
+	     root += task->numThreads)
+		heapifySubtree(heap, root);
+	
+	return NULL;
+}
+
+/* Same as buildHeap, but heapifies disjoint subtrees near the bottom of
+ * minheap 'heap' on 'numThreads' worker threads, then finishes the levels
+ * above them serially.
+ * Precondition: IDs are unique and 0 <= id < heap->capacity
+ *               0 <= n <= heap->capacity
+ *               numThreads >= 1
+ */
+void buildHeapParallel(MinHeap* heap, int* priorities, int* ids, int n,
+                       int numThreads) {
+	// Pick the shallowest level with enough subtrees to keep every thread busy
+	int splitLevel = 0;
+	while ((1L << splitLevel) < (long)numThreads * SUBTREES_PER_THREAD) splitLevel++;
+	
+	if (numThreads <= 1 || (1L << (splitLevel + 1)) > n) {
+		buildHeap(heap, priorities, ids, n);
+		return;
+	}
+	
+	markDumpedIds(heap);
+	heap->size = n;
+	heap->bufferSize = 0;
+	heap->bufferMin = NOTHING;
+	
+	// The workers must not share the records of writes: they are suspended
+	// while the workers run, and every node and ID placed is recorded after
+	HeapDirty* records[] = {heap->dirty, heap->dumped};
+	heap->dirty = heap->dumped = NULL;
+	
+	// Subtrees are disjoint in both arr and the IDs (indexMap slots) they hold,
+	// so workers never write the same memory
+	BuildTask tasks[numThreads];
+	for (int t = 0; t < numThreads; t++)
+		tasks[t] = (BuildTask){heap, priorities, ids, n, numThreads, t, splitLevel};
+	runTasks(fillWorker, tasks, sizeof(BuildTask), numThreads);
+	runTasks(heapifyWorker, tasks, sizeof(BuildTask), numThreads);
+	
+	heap->dirty = records[0];
+	heap->dumped = records[1];
+	for (int r = 0; r < 2; r++) {
+		if (records[r] == NULL) continue;
+		for (int i = ROOT_INDEX; i <= n; i++) {
+			markDirty(&records[r]->slots, slotOf(heap, i));
+			markDirty(&records[r]->ids, idAt(heap, i));
+		}
+	}
+	
+	// Finish the levels above the subtrees serially
+	for (int i = (1 << splitLevel) - 1; i >= ROOT_INDEX; i--)
+		bubbleDownFrom(heap, i);
+}
+
+typedef struct sort_task {
+	HeapNode* nodes;
+	int count;
+} SortTask;
+
+/* Orders HeapNodes by increasing priority, for qsort.
+ */
+int compareByPriority(const void* a, const void* b) {
+	int pa = ((const HeapNode*)a)->priority;
+	int pb = ((const HeapNode*)b)->priority;
+	return (pa > pb) - (pa < pb);
+}
+
+/* Sorts one run of the selected nodes.
+ */
+void* sortWorker(void* arg) {
+	SortTask* task = arg;
+	qsort(task->nodes, task->count, sizeof(HeapNode), compareByPriority);
+	return NULL;
+}
+
+/* Rearranges the 'n' nodes of 'nodes' so that the 'k' of minimum priority
+ * come first, in no particular order. Expected O(n).
+ * Precondition: 0 < k <= n
+ */
+void selectSmallest(HeapNode* nodes, int n, int k) {
+	int lo = 0, hi = n - 1;
+	while (lo < hi) {
+		// median of three guards against already-ordered heap arrays
+		int mid = lo + (hi - lo) / 2;
+		int a = nodes[lo].priority, b = nodes[mid].priority, c = nodes[hi].priority;
+		int pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+		
+		int i = lo, j = hi;
+		while (i <= j) {
+			while (nodes[i].priority < pivot) i++;
+			while (nodes[j].priority > pivot) j--;
+			if (i <= j) {
+				HeapNode temp = nodes[i];
+				nodes[i++] = nodes[j];
+				nodes[j--] = temp;
+			}
+		}
+		
+		// [lo, j] <= pivot <= [i, hi]; keep narrowing onto position k - 1
+		if (k - 1 <= j) hi = j;
+		else if (k - 1 >= i) lo = i;
+		else return;
+	}
+}
+
+/* Same as topK, but for large 'k' partitions a copy of the heap array and
+ * sorts the k smallest nodes on 'numThreads' worker threads.
+ * Precondition: 'out' has room for 'k' nodes
+ *               numThreads >= 1
+ */
+int topKParallel(MinHeap* heap, int k, HeapNode out[], int numThreads) {
+	if (k > numNodes(heap)) k = numNodes(heap);
+	if (numThreads <= 1 || k < PARALLEL_TOPK_MIN) return topK(heap, k, out);
+	
+	// Buffered nodes follow the heap's indices, so one copy picks them up too
+	HeapNode* nodes = malloc(sizeof(HeapNode) * numNodes(heap));
+	if (heap->blockHeight == 0)
+		memcpy(nodes, &heap->arr[ROOT_INDEX], sizeof(HeapNode) * numNodes(heap));
+	else
+		for (int i = 0; i < numNodes(heap); i++) nodes[i] = nodeAt(heap, ROOT_INDEX + i);
+	selectSmallest(nodes, numNodes(heap), k);
+	
+	// Sort the selected nodes in one run per thread
+	SortTask tasks[numThreads];
+	for (int t = 0; t < numThreads; t++) {
+		long first = (long)k * t / numThreads;
+		long last = (long)k * (t + 1) / numThreads;
+		tasks[t] = (SortTask){nodes + first, (int)(last - first)};
+	}
+	runTasks(sortWorker, tasks, sizeof(SortTask), numThreads);
+	
+	// Merge the runs, with a small MinHeap keyed by run number
+	MinHeap* heads = newHeap(numThreads);
+	int* taken = calloc(numThreads, sizeof(int));
+	for (int t = 0; t < numThreads; t++)
+		if (tasks[t].count > 0) insert(heads, tasks[t].nodes[0].priority, t);
+	for (int i = 0; i < k; i++) {
+		int t = extractMin(heads).id;
+		out[i] = tasks[t].nodes[taken[t]++];
+		if (taken[t] < tasks[t].count)
+			insert(heads, tasks[t].nodes[taken[t]].priority, t);
+	}
+	
+	deleteHeap(heads);
+	free(taken);
+	free(nodes);
+	return k;
+}
@@ -0,0 +1,34 @@
+/*
+ * Header file for the multi-threaded operations on our Priority Queue.
+ * These live apart from minheap.h so that single-threaded users of MinHeap
+ * need not link against pthreads.
+ */
+
+#include "minheap.h"
+
+#ifndef __MinHeap_parallel_header
+#define __MinHeap_parallel_header
+
+/* Same as buildHeap, but uses 'numThreads' worker threads: disjoint subtrees
+ * near the bottom of the heap are heapified concurrently, and the few levels
+ * above them are finished serially. Leaves 'heap' (including its indexMap)
+ * exactly as valid as buildHeap would, and records every node and ID it
+ * placed if 'heap' tracks its writes. A worker that cannot get a thread runs
+ * on the calling thread.
+ * Precondition: IDs are unique and 0 <= id < heap->capacity
+ *               0 <= n <= heap->capacity
+ *               numThreads >= 1
+ */
+void buildHeapParallel(MinHeap* heap, int* priorities, int* ids, int n,
+                       int numThreads);
+
+/* Same as topK, but for large 'k' selects the k smallest nodes of a copy of
+ * the heap array by partitioning, then sorts them on 'numThreads' worker
+ * threads and merges the sorted runs. Falls back to topK for small 'k'.
+ * Does not modify 'heap'.
+ * Precondition: 'out' has room for 'k' nodes
+ *               numThreads >= 1
+ */
+int topKParallel(MinHeap* heap, int k, HeapNode out[], int numThreads);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ * Replays an operation trace recorded with startHeapTrace (see heaptrace.h)
+ * against one or more heap backends, at full speed, and reports the time per
+ * operation of each. The trace is decoded up front, so only the heap is
+ * timed; the nodes the heap held when recording started are inserted before
+ * the clock starts.
+ *
+ * Usage: minheap_replay trace [backend ...]
+ *   backends: implicit lines pages buffered heap16 heap64 (default: all)
+ *
+ * Each report ends with a checksum of the priorities extractMin and getMin
+ * returned, and the number of decreasePriority calls that took effect. All
+ * backends but buffered break ties alike, so their reports match exactly.
+ * The insertion buffer may extract a different one of several tied nodes;
+ * if the trace later inserts that node's ID again while buffered still holds
+ * it, the insert is skipped (it would break the heap) and counted in the
+ * report, and the checksums may then differ.
+ *
+ * Traces are checked up front against an implicit MinHeap: one that inserts
+ * an ID the heap still holds, inserts into a full heap or names an ID out of
+ * range is rejected.
+ *
+ * Build with:
+ *   gcc -O2 -pthread minheap_replay.c minheap.c heapalloc.c heaptrace.c \
+ *       minheap_variants.c -o minheap_replay
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "heaptrace.h"
+#include "minheap.h"
+#include "minheap_variants.h"
+
+#define INITIAL_OPS_CAPACITY 4096
+#define REPLAY_BUFFER 64
+
+typedef struct replay_op {
+  HeapTraceOp op;
+  int arg1;
+  int arg2;
+} ReplayOp;
+
+/* A heap backend, driven through its own MinHeap-like operations.
+ */
+typedef struct backend {
+  const char* name;
+  void* (*create)(int capacity);
+  void (*insert)(void* heap, int priority, int id);
+  int (*extractMin)(void* heap);  // returns the priority extracted
+  int (*getMin)(void* heap);      // returns the minimum priority
+  bool (*decreasePriority)(void* heap, int id, int newPriority);
+  bool (*holdsId)(void* heap, int id);
+  long (*numNodes)(void* heap);
+  void (*destroy)(void* heap);
+  int maxCapacity;
+} Backend;
+
+double now(void);
+ReplayOp* readTrace(HeapTraceReader* reader, int capacity, long* numOps);
+void replay(Backend* backend, ReplayOp* ops, long numOps, int capacity,
+            int numInitial);
+
+/*********************************************************************
+ * Backends
+ ********************************************************************/
+
+void* createImplicit(int capacity) { return newHeap(capacity); }
+void* createLines(int capacity) {
+  HeapOptions options = {.layout = HEAP_LAYOUT_LINES};
+  return newHeapWithOptions(capacity, &options);
+}
+void* createPages(int capacity) {
+  HeapOptions options = {.layout = HEAP_LAYOUT_PAGES};
+  return newHeapWithOptions(capacity, &options);
+}
+void* createBuffered(int capacity) {
+  HeapOptions options = {.insertBufferCapacity = REPLAY_BUFFER};
+  return newHeapWithOptions(capacity, &options);
+}
+void minHeapInsert(void* heap, int priority, int id) {
+  insert(heap, priority, id);
+}
+int minHeapExtractMin(void* heap) { return extractMin(heap).priority; }
+int minHeapGetMin(void* heap) { return getMin(heap).priority; }
+bool minHeapDecreasePriority(void* heap, int id, int newPriority) {
+  return decreasePriority(heap, id, newPriority);
+}
+bool minHeapHoldsId(void* heap, int id) { return holdsId(heap, id); }
+long minHeapNumNodes(void* heap) { return numNodes(heap); }
+void minHeapDestroy(void* heap) { deleteHeap(heap); }
+
+void* create16(int capacity) { return newMinHeap16(capacity); }
+void insert16(void* heap, int priority, int id) {
+  minHeap16Insert(heap, priority, id);
+}
+int extractMin16(void* heap) { return minHeap16ExtractMin(heap).priority; }
+int getMin16(void* heap) { return minHeap16GetMin(heap).priority; }
+bool decreasePriority16(void* heap, int id, int newPriority) {
+  return id >= 0 && id <= UINT16_MAX &&
+         minHeap16DecreasePriority(heap, id, newPriority);
+}
+bool holdsId16(void* heap, int id) {
+  return id >= 0 && id <= UINT16_MAX && minHeap16HoldsId(heap, id);
+}
+long numNodes16(void* heap) { return minHeap16NumNodes(heap); }
+void destroy16(void* heap) { deleteMinHeap16(heap); }
+
+void* create64(int capacity) { return newMinHeap64(capacity); }
+void insert64(void* heap, int priority, int id) {
+  minHeap64Insert(heap, priority, id);
+}
+int extractMin64(void* heap) { return minHeap64ExtractMin(heap).priority; }
+int getMin64(void* heap) { return minHeap64GetMin(heap).priority; }
+bool decreasePriority64(void* heap, int id, int newPriority) {
+  return minHeap64DecreasePriority(heap, id, newPriority);
+}
+bool holdsId64(void* heap, int id) { return minHeap64HoldsId(heap, id); }
+long numNodes64(void* heap) { return minHeap64NumNodes(heap); }
+void destroy64(void* heap) { deleteMinHeap64(heap); }
+
+Backend backends[] = {
+    {"implicit", createImplicit, minHeapInsert, minHeapExtractMin,
+     minHeapGetMin, minHeapDecreasePriority, minHeapHoldsId, minHeapNumNodes,
+     minHeapDestroy, __INT_MAX__},
+    {"lines", createLines, minHeapInsert, minHeapExtractMin, minHeapGetMin,
+     minHeapDecreasePriority, minHeapHoldsId, minHeapNumNodes, minHeapDestroy,
+     __INT_MAX__},
+    {"pages", createPages, minHeapInsert, minHeapExtractMin, minHeapGetMin,
+     minHeapDecreasePriority, minHeapHoldsId, minHeapNumNodes, minHeapDestroy,
+     __INT_MAX__},
+    {"buffered", createBuffered, minHeapInsert, minHeapExtractMin,
+     minHeapGetMin, minHeapDecreasePriority, minHeapHoldsId, minHeapNumNodes,
+     minHeapDestroy, __INT_MAX__},
+    {"heap16", create16, insert16, extractMin16, getMin16, decreasePriority16,
+     holdsId16, numNodes16, destroy16, UINT16_MAX},
+    {"heap64", create64, insert64, extractMin64, getMin64, decreasePriority64,
+     holdsId64, numNodes64, destroy64, __INT_MAX__},
+};
+#define NUM_BACKENDS (int)(sizeof(backends) / sizeof(backends[0]))
+
+/*********************************************************************
+ * Replay
+ ********************************************************************/
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s trace [backend ...]\n", argv[0]);
+    fprintf(stderr, "  backends:");
+    for (int b = 0; b < NUM_BACKENDS; b++)
+      fprintf(stderr, " %s", backends[b].name);
+    fprintf(stderr, " (default: all)\n");
+    exit(1);
+  }
+
+  HeapTraceReader* reader = openHeapTrace(argv[1]);
+  if (reader == NULL) {
+    fprintf(stderr, "Unable to read the specified trace: %s\n", argv[1]);
+    exit(1);
+  }
+  int capacity = reader->header.capacity;
+  int numInitial = reader->header.numInitial;
+  long numOps;
+  ReplayOp* ops = readTrace(reader, capacity, &numOps);
+  closeHeapTrace(reader);
+  if (ops == NULL || numInitial < 0 || numInitial > numOps) {
+    fprintf(stderr, "Trace %s is not valid for a heap of capacity %d\n",
+            argv[1], capacity);
+    exit(1);
+  }
+
+  printf("replay: %ld operations (%d initial nodes), capacity %d\n",
+         numOps - numInitial, numInitial, capacity);
+  for (int b = 0; b < NUM_BACKENDS; b++) {
+    bool chosen = argc == 2;
+    for (int a = 2; a < argc; a++)
+      if (strcmp(argv[a], backends[b].name) == 0) chosen = true;
+    if (!chosen) continue;
+    if (capacity > backends[b].maxCapacity) {
+      printf("%-10s skipped: capacity above %d\n", backends[b].name,
+             backends[b].maxCapacity);
+      continue;
+    }
+    replay(&backends[b], ops, numOps, capacity, numInitial);
+  }
+
+  free(ops);
+  return 0;
+}
+
+double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Returns every record of 'reader' decoded into an array, and stores their
+ * number in '*numOps'. Returns NULL if memory runs out, or if a record would
+ * break a precondition of a heap of capacity 'capacity': an ID out of range,
+ * an insert into a full heap, or an insert of an ID the heap still holds.
+ * The records are run on an implicit MinHeap to know which IDs it holds.
+ */
+ReplayOp* readTrace(HeapTraceReader* reader, int capacity, long* numOps) {
+  long size = INITIAL_OPS_CAPACITY;
+  ReplayOp* ops = malloc(sizeof(ReplayOp) * size);
+  MinHeap* heap = newHeap(capacity);
+  *numOps = 0;
+
+  bool valid = ops != NULL && heap != NULL;
+  ReplayOp op;
+  while (valid && readTraceRecord(reader, &op.op, &op.arg1, &op.arg2)) {
+    switch (op.op) {
+      case TRACE_INSERT:
+        valid = op.arg2 >= 0 && op.arg2 < capacity &&
+                numNodes(heap) < capacity && !holdsId(heap, op.arg2);
+        if (valid) insert(heap, op.arg1, op.arg2);
+        break;
+      case TRACE_EXTRACT_MIN:
+        if (numNodes(heap) > 0) extractMin(heap);
+        break;
+      case TRACE_GET_MIN:
+        break;
+      case TRACE_DECREASE_PRIORITY:
+        valid = op.arg1 >= 0 && op.arg1 < capacity;
+        if (valid) decreasePriority(heap, op.arg1, op.arg2);
+        break;
+    }
+    if (valid && *numOps == size) {
+      size *= 2;
+      ReplayOp* grown = realloc(ops, sizeof(ReplayOp) * size);
+      if (grown != NULL) ops = grown;
+      else valid = false;
+    }
+    if (valid) ops[(*numOps)++] = op;
+  }
+
+  deleteHeap(heap);
+  if (!valid) {
+    free(ops);
+    return NULL;
+  }
+  return ops;
+}
+
+/* Runs the 'numOps' operations 'ops' on a new heap of 'backend' with
+ * capacity 'capacity', timing all but the first 'numInitial', and prints the
+ * time taken and a checksum of the results. Skips, and counts, inserts of IDs
+ * the heap already holds.
+ */
+void replay(Backend* backend, ReplayOp* ops, long numOps, int capacity,
+            int numInitial) {
+  void* heap = backend->create(capacity);
+  for (long i = 0; i < numInitial && i < numOps; i++)
+    backend->insert(heap, ops[i].arg1, ops[i].arg2);
+
+  long checksum = 0, numDecreased = 0, numSkipped = 0;
+  double start = now();
+  for (long i = numInitial; i < numOps; i++) {
+    ReplayOp* op = &ops[i];
+    switch (op->op) {
+      case TRACE_INSERT:
+        if (backend->holdsId(heap, op->arg2)) numSkipped++;
+        else backend->insert(heap, op->arg1, op->arg2);
+        break;
+      case TRACE_EXTRACT_MIN:
+        if (backend->numNodes(heap) > 0) checksum += backend->extractMin(heap);
+        break;
+      case TRACE_GET_MIN:
+        if (backend->numNodes(heap) > 0) checksum += backend->getMin(heap);
+        break;
+      case TRACE_DECREASE_PRIORITY:
+        numDecreased += backend->decreasePriority(heap, op->arg1, op->arg2);
+        break;
+    }
+  }
+  double elapsed = now() - start;
+
+  long timed = numOps - numInitial;
+  printf("%-10s %8.3f s  %7.1f ns/op  checksum %ld/%ld", backend->name,
+         elapsed, timed > 0 ? elapsed * 1e9 / timed : 0.0, checksum,
+         numDecreased);
+  if (numSkipped > 0) printf("  (%ld inserts of held IDs skipped)", numSkipped);
+  printf("\n");
+  backend->destroy(heap);
+}
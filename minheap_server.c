@@ -0,0 +1,311 @@
+/*
+ * A Priority Queue server: owns up to HEAP_SERVER_MAX_QUEUES heaps and
+ * serves them to local processes over a Unix domain socket, speaking the
+ * pipelined, batched protocol of heapserver.h.
+ *
+ * One thread runs an epoll loop over every connection. Each time a
+ * connection is readable, the server reads as much as it can take, handles
+ * the complete request frames in its input, and writes all of their
+ * responses with one write. Output that the socket does not take waits for
+ * EPOLLOUT; while a connection has more than MAX_PENDING_OUTPUT of it, the
+ * server neither reads from that connection nor handles the frames it has
+ * read, and goes on with them once the client takes its output.
+ *
+ * Usage: minheap_server socket
+ *   runs until SIGINT or SIGTERM, then prints its counters.
+ *
+ * Build with:
+ *   gcc -O2 -pthread minheap_server.c minheap.c heapalloc.c -o minheap_server
+ */
+#define _GNU_SOURCE  // for accept4
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "heapserver.h"
+#include "minheap_internal.h"
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 65536
+#define INITIAL_BUFFER 65536
+#define MAX_PENDING_OUTPUT (1 << 20)
+#define LISTEN_BACKLOG 128
+
+typedef struct connection {
+  int fd;
+  unsigned char* in;    // bytes read but not yet handled
+  size_t inBytes;
+  size_t inCapacity;
+  unsigned char* out;   // responses not yet written
+  size_t outBytes;
+  size_t outSent;       // of 'out', already written
+  size_t outCapacity;
+  uint32_t events;      // what epoll watches for
+} Connection;
+
+MinHeap* queues[HEAP_SERVER_MAX_QUEUES];
+volatile sig_atomic_t stopping = 0;
+long numRequests = 0, numOperations = 0, numReads = 0, numWrites = 0;
+
+void stop(int signal);
+int listenOn(const char* path);
+bool reserve(unsigned char** buffer, size_t* capacity, size_t needed);
+bool handleRequest(Connection* c, const HeapRequest* request);
+bool readInput(Connection* c);
+bool handleInput(Connection* c);
+bool flushOutput(Connection* c);
+bool serve(Connection* c);
+void watch(int epoll, Connection* c);
+void closeConnection(int epoll, Connection* c);
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s socket\n", argv[0]);
+    exit(1);
+  }
+  int listener = listenOn(argv[1]);
+  if (listener < 0) {
+    fprintf(stderr, "Unable to listen on the specified socket: %s\n", argv[1]);
+    exit(1);
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  int epoll = epoll_create1(0);
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+  epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+  struct epoll_event events[MAX_EVENTS];
+  while (!stopping) {
+    int n = epoll_wait(epoll, events, MAX_EVENTS, -1);
+    for (int i = 0; i < n; i++) {
+      Connection* c = events[i].data.ptr;
+      if (c == NULL) {  // the listener: a new client
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        c = calloc(1, sizeof(Connection));
+        if (c == NULL) {
+          close(fd);
+          continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        struct epoll_event added = {.events = c->events, .data.ptr = c};
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &added);
+        continue;
+      }
+
+      bool open = !(events[i].events & (EPOLLERR | EPOLLHUP)) ||
+                  (events[i].events & EPOLLIN);
+      if (open && (events[i].events & EPOLLIN)) open = readInput(c);
+      if (open) open = serve(c);  // after EPOLLOUT too, for held frames
+      if (open) watch(epoll, c);
+      else closeConnection(epoll, c);
+    }
+  }
+
+  printf("%ld requests, %ld operations, %ld reads, %ld writes\n", numRequests,
+         numOperations, numReads, numWrites);
+  close(listener);
+  unlink(argv[1]);
+  for (int q = 0; q < HEAP_SERVER_MAX_QUEUES; q++)
+    if (queues[q] != NULL) deleteHeap(queues[q]);
+  return 0;
+}
+
+void stop(int signal) {
+  (void)signal;
+  stopping = 1;
+}
+
+/* Returns a non-blocking socket listening at 'path', replacing any socket
+ * file there. Returns -1 on error.
+ */
+int listenOn(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) return -1;
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+      listen(fd, LISTEN_BACKLOG) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Grows '*buffer' (of '*capacity' bytes) to hold at least 'needed' bytes.
+ * Returns False, leaving both as they were, if memory runs out.
+ */
+bool reserve(unsigned char** buffer, size_t* capacity, size_t needed) {
+  if (needed <= *capacity) return true;
+  size_t grown = *capacity == 0 ? INITIAL_BUFFER : *capacity;
+  while (grown < needed) grown *= 2;
+  unsigned char* larger = realloc(*buffer, grown);
+  if (larger == NULL) return false;
+  *buffer = larger;
+  *capacity = grown;
+  return true;
+}
+
+/* Runs the complete request 'request' (followed by its nodes) and appends
+ * its response to the output of 'c'. Returns False if it is malformed or
+ * there is no memory for its response.
+ */
+bool handleRequest(Connection* c, const HeapRequest* request) {
+  const HeapNode* nodes = (const HeapNode*)(request + 1);
+  bool takesNodes =
+      request->op == HEAP_OP_INSERT || request->op == HEAP_OP_DECREASE;
+  size_t expected =
+      sizeof(HeapRequest) + (takesNodes ? request->count * sizeof(HeapNode) : 0);
+  if (request->bytes != expected || request->op < HEAP_OP_CREATE ||
+      request->op > HEAP_OP_SIZE || request->count > HEAP_SERVER_MAX_BATCH)
+    return false;
+
+  int extracting = request->op == HEAP_OP_EXTRACT_MIN
+                       ? (request->arg < 0 ? 0 : request->arg)
+                       : 0;
+  if (extracting > HEAP_SERVER_MAX_BATCH) extracting = HEAP_SERVER_MAX_BATCH;
+  if (!reserve(&c->out, &c->outCapacity,
+               c->outBytes + sizeof(HeapResponse) +
+                   extracting * sizeof(HeapNode)))
+    return false;
+  HeapResponse* response = (HeapResponse*)(c->out + c->outBytes);
+  *response = (HeapResponse){sizeof(HeapResponse), HEAP_STATUS_OK, 0, 0,
+                             request->tag};
+
+  MinHeap* heap =
+      request->queue < HEAP_SERVER_MAX_QUEUES ? queues[request->queue] : NULL;
+  if (request->op == HEAP_OP_CREATE) {
+    MinHeap* created = NULL;
+    if (request->queue >= HEAP_SERVER_MAX_QUEUES || request->arg < 0)
+      response->status = HEAP_STATUS_NO_QUEUE;
+    else if (request->arg > HEAP_SERVER_MAX_CAPACITY ||
+             (created = newHeap(request->arg)) == NULL)
+      response->status = HEAP_STATUS_NO_MEMORY;
+    else {
+      if (heap != NULL) deleteHeap(heap);
+      heap = queues[request->queue] = created;
+    }
+  } else if (heap == NULL) {
+    response->status = HEAP_STATUS_NO_QUEUE;
+  } else if (request->op == HEAP_OP_INSERT) {
+    // Nodes that would break a precondition are skipped, not inserted
+    for (int i = 0; i < request->count; i++) {
+      int id = nodes[i].id;
+      if (id < 0 || id >= heap->capacity || numNodes(heap) == heap->capacity ||
+          holdsId(heap, id))
+        continue;
+      insert(heap, nodes[i].priority, id);
+      response->count++;
+    }
+  } else if (request->op == HEAP_OP_EXTRACT_MIN) {
+    response->count =
+        extractMinBatch(heap, extracting, (HeapNode*)(response + 1));
+    response->bytes += response->count * sizeof(HeapNode);
+  } else if (request->op == HEAP_OP_DECREASE) {
+    for (int i = 0; i < request->count; i++)
+      response->count +=
+          decreasePriority(heap, nodes[i].id, nodes[i].priority);
+  }
+  if (heap != NULL) response->size = numNodes(heap);
+
+  c->outBytes += response->bytes;
+  numRequests++;
+  numOperations += takesNodes ? request->count : response->count;
+  return true;
+}
+
+/* Reads what it can from 'c' into its input. Returns False if the
+ * connection is closed or there is no memory for the input.
+ */
+bool readInput(Connection* c) {
+  if (!reserve(&c->in, &c->inCapacity, c->inBytes + READ_CHUNK)) return false;
+  ssize_t n = read(c->fd, c->in + c->inBytes, c->inCapacity - c->inBytes);
+  numReads++;
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) return false;
+  if (n > 0) c->inBytes += n;
+  return true;
+}
+
+/* Handles the complete requests in the input of 'c', in order, until more
+ * than MAX_PENDING_OUTPUT of output is pending; the rest stay in its input.
+ * Returns False if it sent a malformed request, or memory runs out.
+ */
+bool handleInput(Connection* c) {
+  // Frames are multiples of 4 bytes, so each starts aligned
+  size_t pos = 0;
+  while (c->inBytes - pos >= sizeof(HeapRequest) &&
+         c->outBytes - c->outSent <= MAX_PENDING_OUTPUT) {
+    const HeapRequest* request = (const HeapRequest*)(c->in + pos);
+    size_t maxBytes = sizeof(HeapRequest) + HEAP_SERVER_MAX_BATCH * sizeof(HeapNode);
+    if (request->bytes < sizeof(HeapRequest) || request->bytes > maxBytes ||
+        request->bytes % 4 != 0)
+      return false;
+    if (c->inBytes - pos < request->bytes) break;
+    if (!handleRequest(c, request)) return false;
+    pos += request->bytes;
+  }
+  memmove(c->in, c->in + pos, c->inBytes - pos);
+  c->inBytes -= pos;
+  return true;
+}
+
+/* Writes what it can of the output of 'c'. Returns False if the connection
+ * is closed.
+ */
+bool flushOutput(Connection* c) {
+  if (c->outSent == c->outBytes) return true;
+  ssize_t n = write(c->fd, c->out + c->outSent, c->outBytes - c->outSent);
+  numWrites++;
+  if (n < 0) return errno == EAGAIN || errno == EINTR;
+  c->outSent += n;
+  if (c->outSent == c->outBytes) c->outBytes = c->outSent = 0;
+  return true;
+}
+
+/* Handles what input of 'c' it can and writes the responses, for as long as
+ * writing them lets it handle more. Returns False if the connection is to be
+ * closed.
+ */
+bool serve(Connection* c) {
+  for (;;) {
+    size_t held = c->inBytes;
+    if (!handleInput(c) || !flushOutput(c)) return false;
+    // Nothing handled: the rest is incomplete, or waits for EPOLLOUT
+    if (c->inBytes == held) return true;
+  }
+}
+
+/* Has epoll watch 'c' for output space while it has output pending, and for
+ * input unless too much output is pending.
+ */
+void watch(int epoll, Connection* c) {
+  size_t pending = c->outBytes - c->outSent;
+  uint32_t events = (pending < MAX_PENDING_OUTPUT ? EPOLLIN : 0) |
+                    (pending > 0 ? EPOLLOUT : 0);
+  if (events == c->events) return;
+  c->events = events;
+  struct epoll_event event = {.events = events, .data.ptr = c};
+  epoll_ctl(epoll, EPOLL_CTL_MOD, c->fd, &event);
+}
+
+/* Stops watching 'c', closes it and frees it.
+ */
+void closeConnection(int epoll, Connection* c) {
+  epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  free(c->in);
+  free(c->out);
+  free(c);
+}
@@ -0,0 +1,534 @@
+/*
+ * Sorts a stream of integer priorities with our Minimum Heap, like sort -n.
+ *
+ * Reads each input in turn (stdin if there are none, or for "-"), in either
+ * of the formats of heapio.h, told apart by their first bytes: binary input
+ * files (a HeapInputHeader, then its 'count' priorities), or text, where
+ * every whitespace-separated integer is a priority (with --header, the first
+ * is a capacity, as in sample_input.txt, and is skipped). Writes the
+ * priorities to stdout in increasing order, one per line.
+ *
+ * The input may be any size. Priorities are gathered into runs of as many as
+ * fit in the memory budget. Each run is heapsorted in segments of
+ * SEGMENT_VALUES, small enough for their heap to stay in cache (one big heap
+ * misses it on almost every level), and its segments are merged through a
+ * heap of one node per segment: to stdout if it is the only run, or else to
+ * a temporary file (in $TMPDIR, or /tmp). Then the runs are merged the same
+ * way, in more than one round if there are too many runs to give each a
+ * worthwhile read buffer.
+ *
+ * With --k N, writes only the N smallest priorities: it keeps them in a heap
+ * of capacity N, with priorities complemented (~p) so that the largest one
+ * kept is at the root, and never spills.
+ *
+ * Usage: minheap_sort [--k N] [--memory MiB] [--header] [--verbose]
+ *                     [file ...]
+ *
+ * Build with:
+ *   gcc -O2 -pthread minheap_sort.c minheap.c heapalloc.c heapio.c \
+ *       -o minheap_sort
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heapio.h"
+#include "minheap.h"
+
+#define DEFAULT_MEMORY_MIB 64
+#define SEGMENT_VALUES (1 << 12)  // values heapsorted at a time
+#define INPUT_CHUNK (1 << 20)  // bytes read from an input at a time
+#define OUTPUT_CHUNK (1 << 20) // bytes written at a time
+#define OUTPUT_BATCH 256       // nodes taken per extractMinBatch
+#define MAX_VALUE_CHARS 12     // "-2147483648\n"
+#define MIN_MERGE_BUFFER (256 << 10)  // bytes of read buffer per merged run
+#define MAX_FAN_IN 1024
+
+typedef struct input {
+  int fd;
+  bool started;    // whether its format is known yet
+  bool binary;
+  bool skipFirst;  // whether the next text integer is a capacity to skip
+  bool atEnd;      // whether 'fd' has nothing more to read
+  long remaining;  // binary: priorities still to come
+  char* data;      // bytes read but not yet parsed: data[consumed .. filled)
+  size_t filled;
+  size_t consumed;
+  int* parsed;     // the priorities of the last chunk
+} Input;
+
+typedef struct output {
+  int fd;
+  bool text;       // one decimal per line, or native ints
+  char* data;
+  size_t used;
+} Output;
+
+typedef struct run {
+  int fd;          // an unlinked temporary file of native ints
+  long count;
+} Run;
+
+typedef struct run_reader {
+  Run run;
+  off_t offset;    // where in the file the next read starts
+  int* data;       // the values read but not yet taken: data[start .. end)
+  long start;
+  long end;
+  long capacity;
+} RunReader;
+
+typedef struct sorter {
+  long k;             // keep only the k smallest; -1 to keep all
+  long budget;        // bytes of memory to sort in
+  int* run;           // the run being gathered
+  long runSize;
+  long runCapacity;
+  long sortedSize;    // of 'run', the prefix already sorted in segments
+  MinHeap* segmentHeap;  // sorts each segment
+  Run* runs;          // the runs spilled so far
+  long numRuns;
+  long runsCapacity;
+  MinHeap* kept;      // for --k: the smallest priorities seen, complemented
+  long numValues;     // read in total
+  int extraMerges;    // merges of spilled runs into more spilled runs
+} Sorter;
+
+double now(void);
+void fail(const char* message, const char* detail);
+bool readFully(int fd, void* data, size_t bytes, off_t offset);
+bool writeFully(int fd, const void* data, size_t bytes);
+int temporaryFile(void);
+long readChunk(Input* in, int** values);
+void flushOutput(Output* out);
+void put(Output* out, int value);
+void sortSegment(MinHeap* heap, int* values, long n);
+bool nextValue(RunReader* reader, int* value);
+long mergeReaders(RunReader* readers, int n, Output* out);
+void mergeSegments(Sorter* sorter, Output* out);
+void spillRun(Sorter* sorter);
+long mergeFiles(Run* group, int n, Output* out, long budget);
+void mergeRuns(Sorter* sorter, Output* out);
+void addValues(Sorter* sorter, const int* values, long n);
+void finish(Sorter* sorter, Output* out);
+
+int main(int argc, char* argv[]) {
+  Sorter sorter = {.k = -1, .budget = (long)DEFAULT_MEMORY_MIB << 20};
+  bool header = false, verbose = false;
+  int first = 1;
+  for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+    if (strcmp(argv[first], "--k") == 0 && first + 1 < argc) {
+      sorter.k = atol(argv[++first]);
+    } else if (strcmp(argv[first], "--memory") == 0 && first + 1 < argc) {
+      sorter.budget = atol(argv[++first]) << 20;
+    } else if (strcmp(argv[first], "--header") == 0) {
+      header = true;
+    } else if (strcmp(argv[first], "--verbose") == 0) {
+      verbose = true;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--k N] [--memory MiB] [--header] [--verbose] "
+              "[file ...]\n",
+              argv[0]);
+      exit(1);
+    }
+  }
+  if (sorter.k > INT_MAX || sorter.budget < (1L << 20)) {
+    fprintf(stderr, "Invalid arguments\n");
+    exit(1);
+  }
+  sorter.runCapacity = sorter.budget / sizeof(int);
+  if (sorter.k >= 0) sorter.kept = newHeap(sorter.k);
+  else sorter.segmentHeap = newHeap(SEGMENT_VALUES);
+
+  double start = now();
+  Input in = {.data = malloc(INPUT_CHUNK),
+              .parsed = malloc(sizeof(int) * (INPUT_CHUNK / 2 + 1))};
+  for (int i = first; i < argc || i == first; i++) {
+    const char* path = i < argc ? argv[i] : "-";
+    in.fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (in.fd < 0) fail("Unable to open the specified file", path);
+    in.started = in.atEnd = false;
+    in.skipFirst = header;
+    in.filled = in.consumed = 0;
+
+    int* values;
+    long n;
+    while ((n = readChunk(&in, &values)) > 0) addValues(&sorter, values, n);
+    if (n < 0) fail("Malformed or unreadable input", path);
+    if (in.fd != STDIN_FILENO) close(in.fd);
+  }
+  free(in.data);
+  free(in.parsed);
+
+  Output out = {.fd = STDOUT_FILENO, .text = true, .data = malloc(OUTPUT_CHUNK)};
+  finish(&sorter, &out);
+  flushOutput(&out);
+  free(out.data);
+
+  if (verbose)
+    fprintf(stderr, "%ld values, %ld runs spilled, %d extra merges, %.3f s\n",
+            sorter.numValues, sorter.numRuns, sorter.extraMerges, now() - start);
+  return 0;
+}
+
+double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Prints 'message' and 'detail' and exits with an error.
+ */
+void fail(const char* message, const char* detail) {
+  fprintf(stderr, "%s: %s\n", message, detail);
+  exit(1);
+}
+
+/* Reads exactly 'bytes' bytes at offset 'offset' of 'fd' into 'data'.
+ * Returns False on error or end of file.
+ */
+bool readFully(int fd, void* data, size_t bytes, off_t offset) {
+  char* next = data;
+  while (bytes > 0) {
+    ssize_t n = pread(fd, next, bytes, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    next += n;
+    offset += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/* Writes the 'bytes' bytes at 'data' to 'fd'. Returns False on error.
+ */
+bool writeFully(int fd, const void* data, size_t bytes) {
+  const char* next = data;
+  while (bytes > 0) {
+    ssize_t n = write(fd, next, bytes);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    next += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/* Returns a new temporary file, already unlinked, so that it disappears
+ * when closed.
+ */
+int temporaryFile(void) {
+  const char* directory = getenv("TMPDIR");
+  if (directory == NULL || directory[0] == '\0') directory = "/tmp";
+  char path[strlen(directory) + sizeof("/minheap_sort.XXXXXX")];
+  sprintf(path, "%s/minheap_sort.XXXXXX", directory);
+  int fd = mkstemp(path);
+  if (fd < 0) fail("Unable to create a temporary file in", directory);
+  unlink(path);
+  return fd;
+}
+
+/* Reads the next chunk of priorities from 'in', points '*values' at them,
+ * and returns how many there are: 0 once 'in' is done, or -1 if it is
+ * malformed or cannot be read.
+ */
+long readChunk(Input* in, int** values) {
+  while (true) {
+    // Keep what is left of the last chunk (a token cut short, say) and top
+    // the buffer up
+    memmove(in->data, in->data + in->consumed, in->filled - in->consumed);
+    in->filled -= in->consumed;
+    in->consumed = 0;
+    while (!in->atEnd && in->filled < INPUT_CHUNK) {
+      ssize_t n = read(in->fd, in->data + in->filled, INPUT_CHUNK - in->filled);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return -1;
+      if (n == 0) in->atEnd = true;
+      in->filled += n;
+    }
+
+    if (!in->started) {
+      HeapInputHeader header;
+      in->started = true;
+      if (in->filled >= sizeof(header)) memcpy(&header, in->data, sizeof(header));
+      in->binary = in->filled >= sizeof(header) && header.magic == HEAP_INPUT_MAGIC;
+      if (in->binary) {
+        if (header.version != HEAP_INPUT_VERSION || header.count < 0) return -1;
+        in->remaining = header.count;
+        in->consumed = sizeof(header);
+      }
+    }
+
+    *values = in->parsed;
+    long n;
+    if (in->binary) {
+      // Whole priorities, up to the count of the header; anything after it
+      // is ignored, as loadHeapFromFile does
+      n = (in->filled - in->consumed) / sizeof(int);
+      if (n > in->remaining) n = in->remaining;
+      if (n == 0) return in->remaining > 0 && in->atEnd ? -1 : 0;
+      memcpy(in->parsed, in->data + in->consumed, n * sizeof(int));
+      in->consumed += n * sizeof(int);
+      in->remaining -= n;
+      return n;
+    }
+
+    // Text: parse up to the last separator, unless there is no more to read
+    size_t cut = in->filled;
+    if (!in->atEnd) {
+      while (cut > 0 && !strchr(" \n\r\t\v\f", in->data[cut - 1])) cut--;
+      if (cut == 0) return -1;  // one token fills the whole buffer
+    }
+    n = parseIntegers(in->data, cut, in->parsed, INPUT_CHUNK / 2 + 1);
+    in->consumed = cut;
+    if (n > 0 && in->skipFirst) {
+      in->skipFirst = false;
+      (*values)++;
+      n--;
+    }
+    if (n != 0 || in->atEnd) return n;
+  }
+}
+
+/* Writes everything 'out' holds.
+ */
+void flushOutput(Output* out) {
+  if (!writeFully(out->fd, out->data, out->used))
+    fail("Unable to write the output", strerror(errno));
+  out->used = 0;
+}
+
+/* Adds 'value' to 'out'.
+ */
+void put(Output* out, int value) {
+  if (out->used + MAX_VALUE_CHARS > OUTPUT_CHUNK) flushOutput(out);
+  char* p = out->data + out->used;
+  if (!out->text) {
+    memcpy(p, &value, sizeof(int));
+    out->used += sizeof(int);
+    return;
+  }
+
+  char digits[MAX_VALUE_CHARS];
+  int length = 0;
+  unsigned int magnitude = value < 0 ? -(unsigned int)value : (unsigned int)value;
+  do {
+    digits[length++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0) *p++ = '-';
+  while (length > 0) *p++ = digits[--length];
+  *p++ = '\n';
+  out->used = p - out->data;
+}
+
+/* Heapsorts the 'n' priorities 'values' in place, through 'heap'.
+ * Precondition: 'n' <= heap->capacity
+ */
+void sortSegment(MinHeap* heap, int* values, long n) {
+  buildHeap(heap, values, NULL, n);
+  HeapNode batch[OUTPUT_BATCH];
+  int taken;
+  while ((taken = extractMinBatch(heap, OUTPUT_BATCH, batch)) > 0)
+    for (int i = 0; i < taken; i++) *values++ = batch[i].priority;
+}
+
+/* Takes the next value of the run of 'reader' into '*value'. Returns False
+ * once the run is done.
+ */
+bool nextValue(RunReader* reader, int* value) {
+  if (reader->start == reader->end) {
+    if (reader->run.fd < 0) return false;  // a segment, all in memory
+    long left = reader->run.count - reader->offset / (off_t)sizeof(int);
+    if (left == 0) return false;
+    long n = left < reader->capacity ? left : reader->capacity;
+    if (!readFully(reader->run.fd, reader->data, sizeof(int) * n, reader->offset))
+      fail("Unable to read a temporary file", strerror(errno));
+    reader->offset += sizeof(int) * n;
+    reader->start = 0;
+    reader->end = n;
+  }
+  *value = reader->data[reader->start++];
+  return true;
+}
+
+/* Merges the 'n' sorted runs of 'readers' into 'out', and returns how many
+ * values there were. The heap holds the next value of each run, with the
+ * run's position in 'readers' as its ID.
+ */
+long mergeReaders(RunReader* readers, int n, Output* out) {
+  MinHeap* heap = newHeap(n);
+  for (int r = 0; r < n; r++) {
+    int value;
+    if (nextValue(&readers[r], &value)) insert(heap, value, r);
+  }
+
+  long merged = 0;
+  while (numNodes(heap) > 0) {
+    HeapNode node = extractMin(heap);
+    put(out, node.priority);
+    merged++;
+    int value;
+    if (nextValue(&readers[node.id], &value)) insert(heap, value, node.id);
+  }
+  deleteHeap(heap);
+  return merged;
+}
+
+/* Sorts what is left of the run 'sorter' is gathering, merges its segments
+ * into 'out', and empties it.
+ */
+void mergeSegments(Sorter* sorter, Output* out) {
+  sortSegment(sorter->segmentHeap, sorter->run + sorter->sortedSize,
+              sorter->runSize - sorter->sortedSize);
+  int n = (sorter->runSize + SEGMENT_VALUES - 1) / SEGMENT_VALUES;
+  RunReader* readers = malloc(sizeof(RunReader) * (n > 0 ? n : 1));
+  for (int r = 0; r < n; r++) {
+    long start = (long)r * SEGMENT_VALUES;
+    long end = start + SEGMENT_VALUES < sorter->runSize ? start + SEGMENT_VALUES
+                                                         : sorter->runSize;
+    readers[r] = (RunReader){.run = {-1, end - start},
+                             .data = sorter->run + start,
+                             .end = end - start};
+  }
+  mergeReaders(readers, n, out);
+  free(readers);
+  sorter->runSize = sorter->sortedSize = 0;
+}
+
+/* Sorts the run 'sorter' is gathering into a new temporary file.
+ */
+void spillRun(Sorter* sorter) {
+  if (sorter->numRuns == sorter->runsCapacity) {
+    sorter->runsCapacity = sorter->runsCapacity == 0 ? 16 : sorter->runsCapacity * 2;
+    sorter->runs = realloc(sorter->runs, sizeof(Run) * sorter->runsCapacity);
+  }
+  Run run = {temporaryFile(), sorter->runSize};
+  Output out = {.fd = run.fd, .text = false, .data = malloc(OUTPUT_CHUNK)};
+  mergeSegments(sorter, &out);
+  flushOutput(&out);
+  free(out.data);
+  sorter->runs[sorter->numRuns++] = run;
+}
+
+/* Merges the 'n' sorted runs 'group' into 'out', splitting 'budget' bytes
+ * among their read buffers, closes them, and returns how many values there
+ * were.
+ */
+long mergeFiles(Run* group, int n, Output* out, long budget) {
+  long bufferValues = budget / n / sizeof(int);
+  RunReader* readers = malloc(sizeof(RunReader) * n);
+  for (int r = 0; r < n; r++) {
+    readers[r] = (RunReader){.run = group[r], .capacity = bufferValues};
+    readers[r].data = malloc(sizeof(int) * bufferValues);
+  }
+  long merged = mergeReaders(readers, n, out);
+  for (int r = 0; r < n; r++) {
+    close(readers[r].run.fd);
+    free(readers[r].data);
+  }
+  free(readers);
+  return merged;
+}
+
+/* Merges the runs 'sorter' spilled into 'out'. While there are more than
+ * fit in one merge, merges the oldest ones into a new run.
+ */
+void mergeRuns(Sorter* sorter, Output* out) {
+  long fanIn = sorter->budget / MIN_MERGE_BUFFER;
+  if (fanIn > MAX_FAN_IN) fanIn = MAX_FAN_IN;
+  if (fanIn < 2) fanIn = 2;
+
+  long first = 0;
+  long total = sorter->numRuns;
+  while (sorter->numRuns - first > fanIn) {
+    Run run = {temporaryFile(), 0};
+    Output merged = {.fd = run.fd, .text = false, .data = malloc(OUTPUT_CHUNK)};
+    run.count = mergeFiles(sorter->runs + first, fanIn, &merged, sorter->budget);
+    flushOutput(&merged);
+    free(merged.data);
+    first += fanIn;
+    sorter->extraMerges++;
+
+    // Appended, so the runs array stays one queue of runs still to merge
+    if (sorter->numRuns == sorter->runsCapacity) {
+      sorter->runsCapacity *= 2;
+      sorter->runs = realloc(sorter->runs, sizeof(Run) * sorter->runsCapacity);
+    }
+    sorter->runs[sorter->numRuns++] = run;
+  }
+  mergeFiles(sorter->runs + first, sorter->numRuns - first, out, sorter->budget);
+  sorter->numRuns = total;
+}
+
+/* Takes the 'n' priorities 'values' into 'sorter'.
+ */
+void addValues(Sorter* sorter, const int* values, long n) {
+  sorter->numValues += n;
+  if (sorter->kept != NULL) {
+    // Keep the k smallest: ~p reverses the order without overflowing, so
+    // the root is the largest priority kept, the first to give way
+    MinHeap* kept = sorter->kept;
+    for (long i = 0; i < n; i++) {
+      int complement = ~values[i];
+      if (kept->size < kept->capacity) {
+        insert(kept, complement, kept->size);
+      } else if (kept->capacity > 0 && complement > getMin(kept).priority) {
+        HeapNode largest = extractMin(kept);
+        insert(kept, complement, largest.id);
+      }
+    }
+    return;
+  }
+
+  // A full run is spilled only once more values come, so input that fits
+  // in one run never touches the disk
+  while (n > 0) {
+    if (sorter->run == NULL)
+      sorter->run = malloc(sizeof(int) * sorter->runCapacity);
+    if (sorter->runSize == sorter->runCapacity) spillRun(sorter);
+    long taken = sorter->runCapacity - sorter->runSize;
+    if (taken > n) taken = n;
+    memcpy(sorter->run + sorter->runSize, values, sizeof(int) * taken);
+    sorter->runSize += taken;
+    values += taken;
+    n -= taken;
+    for (; sorter->runSize - sorter->sortedSize >= SEGMENT_VALUES;
+         sorter->sortedSize += SEGMENT_VALUES)
+      sortSegment(sorter->segmentHeap, sorter->run + sorter->sortedSize,
+                  SEGMENT_VALUES);
+  }
+}
+
+/* Writes all 'sorter' kept, in increasing order, to 'out'.
+ */
+void finish(Sorter* sorter, Output* out) {
+  if (sorter->kept != NULL) {
+    // Extracted largest first, so fill the output order from its end
+    int n = numNodes(sorter->kept);
+    int* smallest = malloc(sizeof(int) * (n > 0 ? n : 1));
+    for (int i = n - 1; i >= 0; i--) smallest[i] = ~extractMin(sorter->kept).priority;
+    for (int i = 0; i < n; i++) put(out, smallest[i]);
+    free(smallest);
+    deleteHeap(sorter->kept);
+    return;
+  }
+
+  if (sorter->numRuns == 0) {
+    mergeSegments(sorter, out);
+  } else {
+    if (sorter->runSize > 0) spillRun(sorter);
+    free(sorter->run);
+    sorter->run = NULL;
+    mergeRuns(sorter, out);
+  }
+  free(sorter->run);
+  free(sorter->runs);
+  deleteHeap(sorter->segmentHeap);
+}
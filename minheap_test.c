@@ -0,0 +1,3386 @@
+/*
+ * Tests our Minimum Heap, and the structures built on it, against reference
+ * models.
+ *
+ * Usage: minheap_test [-s seed] [test ...]
+ *   tests: heap slots build topk alloc small variants
+ *          delta trace input image persist wal shared server sort dump
+ *          (default: all)
+ *
+ * heap: each configuration is filled halfway with buildHeap, then runs a
+ *   random mix of insert, extractMin, decreasePriority (of IDs in and out
+ *   of range), insertBatch, extractMinBatch, topK and flushInsertBuffer.
+ *   After each operation the heap must agree with the model, an array of
+ *   the priority held by each ID: the same IDs at the same priorities, the
+ *   heap property, an indexMap that points back, the buffered minimum,
+ *   the minimum, and the payload last set for each ID. Ties may be broken
+ *   either way, so a node taken out is checked only against the model's
+ *   minimum priority.
+ * slots: under each layout, and for capacities around each block boundary,
+ *   slotOf must put every index in its own slot of arr.
+ * build: buildHeapParallel, with several sizes and thread counts, on a heap
+ *   that tracks its writes, must give a valid heap of the nodes given and
+ *   record every slot and ID it wrote.
+ * topk: topK, and topKParallel on one and several threads, of a heap big
+ *   enough for topKParallel to sort in parallel must give the k smallest
+ *   priorities in order, each node once, and leave the heap as it was.
+ * alloc: full heaps from each mmap-based allocator, and from an arena, must
+ *   not count more bytes as backed by huge pages than they hold; and a heap
+ *   bound to a NUMA node that does not exist must fail to be made. Arenas,
+ *   mapped and over caller memory, are churned with heaps made, run against
+ *   models, and deleted: live blocks must stay inside the arena without
+ *   overlapping. A full arena must refuse a heap until one is deleted, and
+ *   start over from its base once reset.
+ * small: a SmallHeap runs a random mix of insert, extractMin and
+ *   decreasePriority, often while full, and must agree with the model after
+ *   each.
+ * variants: each variant of integer priorities runs a random mix of insert,
+ *   extractMin and decreasePriority (of IDs in and out of range) against
+ *   the model, as MinHeap does. A MinHeap16 of the largest capacity is
+ *   filled and drained, and capacities past each variant's limit must be
+ *   refused. MinHeapInt64 runs over the whole int64_t range, INT64_MIN
+ *   included. Floating-point keys must round-trip bit for bit and follow
+ *   the IEEE 754 totalOrder (-NaN < -inf < ... < -0.0 < +0.0 < ... < +inf
+ *   < +NaN), and MinHeapFloat and MinHeapDouble must sort such values in
+ *   that order. MinHeapStable, with few distinct priorities, must take out
+ *   nodes of equal priority in the order they were inserted or last
+ *   decreased, also across the wrap of its sequence numbers. The compact
+ *   variants run the model with priorities that drift up past their 24-bit
+ *   window, so that they rebase; and priorities pushed out of the window,
+ *   above and below, must rebase or saturate as documented.
+ * delta: threads lower the priorities of a DeltaQueue at once, then its
+ *   buckets are drained in order; and a parallel delta-stepping run must
+ *   find the same distances as Dijkstra on a MinHeap.
+ * trace: records of every kind, with priorities and IDs across the int
+ *   range, must read back as written, and a truncated last record not at
+ *   all. A random mix of operations, with many ties, is recorded from a
+ *   MinHeap and replayed on each layout and on MinHeap16 and MinHeap64:
+ *   every operation must behave as recorded, with no insert of an ID still
+ *   held, and each must end up holding the nodes the recorded heap did.
+ * input: random priorities, extremes included, are written as binary and as
+ *   text input files and loaded into each configuration: the heap must
+ *   hold them, with IDs in file order. Malformed text and binary files, and
+ *   a missing one, must be refused.
+ * image: each configuration, after a random mix of operations, is saved
+ *   as a heap image and loaded back both privately and read-only: both
+ *   must hold what the model does, the private copy must take nodes out in
+ *   the same order as the original, and draining it must leave the image,
+ *   as the read-only heap sees it, unchanged. Images of another version,
+ *   with more nodes than their capacity, or truncated must be refused.
+ * persist: each configuration, tracking its writes, runs the random mix:
+ *   every slot, indexMap entry and payload an operation changed must have
+ *   been recorded. A PersistentHeap of each configuration then runs random
+ *   operations, through its functions and straight on its heap, and is
+ *   closed and reopened several times; then a child process commits more
+ *   and dies without closing, and the log gains a torn record. Every
+ *   reopening must give back the heap, payloads included, as of the last
+ *   commit. An operation whose automatic commit fails, because the log
+ *   refuses writes, must say so, and the next commit must still make it
+ *   durable.
+ * wal: a logged heap of each configuration runs random operations through
+ *   its functions, with a log small enough to compact often, and is closed
+ *   and recovered several times; then a child process commits more and dies
+ *   without closing. Every recovery must give back the heap as of the last
+ *   commit, and a failed commit must be reported as for persist. With a
+ *   commitMicros policy, the first operation after that long must commit.
+ * shared: for each configuration, child processes open a shared heap and
+ *   insert, one at a time and in batches, and decrease the priorities of
+ *   IDs of their own at once; the heap must then hold every node at its
+ *   last priority, and be drained in order. A child that dies holding the
+ *   lock in the middle of a swap must leave a heap that the next operation
+ *   repairs with no node lost.
+ * server: minheap_server is started on a socket. A client pipelines
+ *   batches of inserts, then of extractMins asking for more output than
+ *   the server buffers, before reading any response: every response must
+ *   come back in order, and the extractMins take out every node inserted,
+ *   sorted. Malformed frames must
+ *   get the connection closed, leaving the server up for the next; and the
+ *   server must exit cleanly on SIGTERM.
+ * sort: minheap_sort must sort random priorities read from text and binary
+ *   files and stdin at once; sort, in little memory, enough to spill runs
+ *   and merge them in two rounds; and keep the k smallest. Malformed,
+ *   truncated and missing inputs must make it fail.
+ * dump: each configuration, tracking its writes, runs rounds of the random
+ *   mix, each ending in a dump: mostly dumpHeapChanges, now and then
+ *   dumpHeap, and once after buildHeapParallel on several threads. Every
+ *   node a dump prints must be where the heap has it; a full dump must
+ *   print each node once, in order of index, and a dump of changes every
+ *   ID moved, changed, added or removed since the last dump, in order of
+ *   ID. Dumps must leave the record of writes alone.
+ *
+ * Prints one line per test case, and exits with status 1 if any failed.
+ * Files go in a new directory in $TMPDIR (or /tmp), removed at the end.
+ * The programs the tests run (minheap_server and minheap_sort) must be
+ * built next to minheap_test.
+ *
+ * Build with:
+ *   gcc -O2 -pthread minheap_test.c minheap.c minheap_parallel.c \
+ *       heapalloc.c deltaqueue.c minheap_variants.c heaptrace.c heapio.c \
+ *       heappersist.c heapwal.c heapshared.c -o minheap_test
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "deltaqueue.h"
+#include "heapalloc.h"
+#include "heapio.h"
+#include "heappersist.h"
+#include "heapserver.h"
+#include "heapshared.h"
+#include "heaptrace.h"
+#include "heapwal.h"
+#include "minheap.h"
+#include "minheap_internal.h"
+#include "minheap_parallel.h"
+#include "minheap_variants.h"
+#include "smallheap.h"
+
+#define DEFAULT_SEED 2463534242u
+#define TEST_CAPACITY 1500
+#define TEST_OPS 5000
+#define TEST_BUFFER 16
+#define MAX_BATCH 200  // nodes per insertBatch or extractMinBatch
+#define TOPK_NODES 80000  // more than topKParallel sorts on the calling thread
+#define TOPK_THREADS 4
+#define PRIORITY_RANGE 1000  // small, so that ties are common
+#define MAX_MESSAGE 256
+#define HUGE_CAPACITY 1000000  // a few huge pages' worth
+#define ABSENT_NUMA_NODE 63
+#define ARENA_BYTES (1 << 20)
+#define ARENA_HEAPS 24        // live at once
+#define ARENA_STEPS 4000
+#define ARENA_MAX_CAPACITY 300
+#define SMALL_OPS 200000
+#define VARIANT_CAPACITY 1500
+#define VARIANT_OPS 20000
+#define FLOAT_SAMPLES 100000  // random bit patterns per key check
+#define FLOAT_SORTED 5000     // random values per heap sort
+#define STABLE_PRIORITIES 8   // so that most priorities are tied
+#define COMPACT_DRIFT 1000    // per operation: past 2^24 in VARIANT_OPS
+#define COMPACT_MAX ((1 << 24) - 1)  // the largest compact key
+#define DELTA_THREADS 4
+#define DELTA_PROPOSALS 20000  // decreasePriority calls per thread
+#define DELTA_WIDTH 16         // priorities per bucket
+#define DELTA_BUCKETS 64
+#define GRAPH_VERTICES 4000
+#define GRAPH_DEGREE 6
+#define MAX_WEIGHT 100
+#define POP_CHUNK 64
+#define TRACE_RECORDS 10000
+#define PERSIST_ROUNDS 4  // reopenings after a clean close
+#define ROUND_OPS 1000
+#define CRASH_OPS 500  // committed before the crash
+#define LOST_OPS 200   // done after the last commit, so lost
+#define WAL_COMPACT_BYTES 4096  // small, so that every round compacts
+#define WAL_COMMIT_MICROS 20000
+#define SHARED_CHILDREN 4
+#define SHARED_DECREASE 1000  // how far decreases lower a priority, at most
+#define SERVER_FRAMES 64  // of inserts, then of extractMins, of the largest
+                          // batch: 2 MB of output
+#define SERVER_LAG_US 200000  // before the client reads: output piles up
+#define SERVER_TIMEOUT_S 10   // on the client's reads and writes
+#define SERVER_START_RETRIES 2000
+#define SERVER_START_US 1000
+#define SORT_SPILL_VALUES 1500000  // 6 runs of 1 MiB, merged 4 at a time
+#define SORT_K 1000
+#define DUMP_ROUNDS 400
+#define DUMP_OPS 20         // random operations per round, at most
+#define DUMP_FULL_EVERY 16  // rounds; the others dump only the changes
+#define SHARED_MODEL_BYTES(capacity) \
+  ((2 * sizeof(int) + 2 * sizeof(bool)) * (capacity))
+
+typedef struct model {
+  int capacity;
+  int count;      // the number of IDs held
+  int lastId;     // the ID inserted last, or NOTHING
+  bool* held;     // held[id] is True if the heap holds ID id
+  int* priority;  // priority[id] is its priority, if held
+  int* payload;   // payload[id] is the payload last set for ID id
+  bool* set;      // set[id] is True once a payload is set for ID id
+} Model;
+
+typedef struct snapshot {
+  HeapNode* arr;  // copies of the arr, indexMap and payload of a heap
+  int* indexMap;
+  char* payload;
+} Snapshot;
+
+typedef struct server_writer {
+  int fd;
+  const unsigned char* frames;  // to write to 'fd', all at once
+  size_t bytes;
+  bool written;  // set once all of them are
+} ServerWriter;
+
+typedef struct config {
+  const char* name;
+  HeapOptions options;
+} Config;
+
+typedef struct test {
+  const char* name;
+  int (*run)(unsigned int seed, const char* directory);  // returns failures
+} Test;
+
+typedef struct delta_worker {
+  DeltaQueue* queue;
+  unsigned int seed;  // of the decreasePriority calls to make
+  int* graph;         // for delta-stepping: GRAPH_DEGREE (target, weight)
+                      // pairs per vertex
+  pthread_barrier_t* barrier;
+  bool* done;
+  bool leader;        // the one worker that advances the queue between phases
+} DeltaWorker;
+
+Config configs[] = {
+    {"implicit", {.layout = HEAP_LAYOUT_IMPLICIT}},
+    {"lines", {.layout = HEAP_LAYOUT_LINES}},
+    {"pages", {.layout = HEAP_LAYOUT_PAGES}},
+    {"implicit+buf",
+     {.layout = HEAP_LAYOUT_IMPLICIT, .insertBufferCapacity = TEST_BUFFER}},
+    {"lines+buf",
+     {.layout = HEAP_LAYOUT_LINES, .insertBufferCapacity = TEST_BUFFER}},
+    {"pages+buf",
+     {.layout = HEAP_LAYOUT_PAGES, .insertBufferCapacity = TEST_BUFFER}},
+    {"prefetch", {.prefetchDistance = 2}},
+    {"prefetch past the max", {.prefetchDistance = 99}},  // clamped
+    {"hugepages", {.allocator = HEAP_ALLOC_HUGEPAGES}},
+    {"payload", {.payloadSize = sizeof(int)}},
+    {"payload+buf",
+     {.payloadSize = sizeof(int), .insertBufferCapacity = TEST_BUFFER}},
+};
+#define NUM_CONFIGS (int)(sizeof(configs) / sizeof(configs[0]))
+
+int testHeap(unsigned int seed, const char* directory);
+int testSlots(unsigned int seed, const char* directory);
+int testBuild(unsigned int seed, const char* directory);
+int testTopK(unsigned int seed, const char* directory);
+int testAlloc(unsigned int seed, const char* directory);
+int testSmall(unsigned int seed, const char* directory);
+int testVariants(unsigned int seed, const char* directory);
+int testDelta(unsigned int seed, const char* directory);
+int testTrace(unsigned int seed, const char* directory);
+int testInput(unsigned int seed, const char* directory);
+int testImage(unsigned int seed, const char* directory);
+int testPersist(unsigned int seed, const char* directory);
+int testWal(unsigned int seed, const char* directory);
+int testShared(unsigned int seed, const char* directory);
+int testServer(unsigned int seed, const char* directory);
+int testSort(unsigned int seed, const char* directory);
+int testDump(unsigned int seed, const char* directory);
+
+Test tests[] = {
+    {"heap", testHeap},
+    {"slots", testSlots},
+    {"build", testBuild},
+    {"topk", testTopK},
+    {"alloc", testAlloc},
+    {"small", testSmall},
+    {"variants", testVariants},
+    {"delta", testDelta},
+    {"trace", testTrace},
+    {"input", testInput},
+    {"image", testImage},
+    {"persist", testPersist},
+    {"wal", testWal},
+    {"shared", testShared},
+    {"server", testServer},
+    {"sort", testSort},
+    {"dump", testDump},
+};
+#define NUM_TESTS (int)(sizeof(tests) / sizeof(tests[0]))
+
+char message[MAX_MESSAGE];  // what went wrong, for the case that failed
+char programs[PATH_MAX - NAME_MAX - 1];  // where minheap_test was run from
+
+unsigned int nextRandom(unsigned int* state);
+const char* failure(const char* format, ...);
+const char* during(const char* what, int n, const char* error);
+bool report(const char* test, const char* name, const char* error);
+void emptyDirectory(const char* directory);
+Model* newModel(int capacity);
+void deleteModel(Model* model);
+int modelMin(Model* model);
+void modelInsert(Model* model, int priority, int id);
+const char* modelExtract(Model* model, HeapNode node);
+int absentId(Model* model, unsigned int* seed);
+void modelSetPayload(MinHeap* heap, Model* model, int id, int payload);
+int compareInts(const void* a, const void* b);
+const char* checkHeap(MinHeap* heap, Model* model);
+void fillModel(Model* model, int n, int* priorities, int* ids,
+               unsigned int* seed);
+bool inDirtySet(HeapDirtySet* set, long i);
+const char* randomOperation(MinHeap* heap, Model* model, unsigned int* seed);
+const char* runOperations(HeapOptions* options, unsigned int seed);
+const char* checkSlots(HeapLayout layout, int capacity);
+const char* checkBuild(HeapOptions* options, int n, int numThreads,
+                       unsigned int seed);
+const char* checkTopK(MinHeap* heap, Model* model, int k, int numThreads);
+const char* runTopK(HeapOptions* options, unsigned int seed);
+const char* checkHugePages(MinHeap* heap);
+const char* checkArenaChurn(HeapArena* arena, unsigned int seed);
+const char* checkArenaFull(void);
+const char* checkSmallHeap(SmallHeap* heap, Model* model);
+const char* runSmallHeap(unsigned int seed);
+const char* checkVariantLimits(void);
+const char* checkInt64Extremes(void);
+const char* checkStableOrder(uint32_t firstSequence, unsigned int seed);
+const char* checkCompactWindow(void);
+const char* drainFullMinHeap16(unsigned int seed);
+void* proposeWorker(void* arg);
+const char* checkConcurrentDecreases(unsigned int seed);
+void* steppingWorker(void* arg);
+int* dijkstra(int* graph, int source);
+const char* checkDeltaStepping(unsigned int seed);
+const char* checkTraceRecords(unsigned int seed);
+const char* sameModels(Model* replayed, Model* recorded);
+const char* recordTrace(const char* path, Model* model, unsigned int seed);
+const char* replayMinHeap(const char* path, HeapOptions* options,
+                          Model* recorded);
+const char* checkInput(HeapOptions* options, unsigned int seed,
+                       const char* directory);
+bool writeFile(const char* path, const char* contents);
+const char* checkMalformedInput(const char* directory);
+const char* checkImage(HeapOptions* options, unsigned int seed,
+                       const char* directory);
+const char* checkBadImages(const char* directory);
+void takeSnapshot(MinHeap* heap, Snapshot* snapshot);
+const char* checkWrites(MinHeap* heap, Snapshot* snapshot);
+const char* checkTracking(HeapOptions* options, unsigned int seed);
+void storeModel(Model* model, char* shared);
+void loadModel(Model* model, const char* shared);
+const char* persistentOperation(PersistentHeap* p, Model* model,
+                                unsigned int* seed);
+const char* checkPersistentHeap(HeapOptions* options, unsigned int seed,
+                                const char* directory);
+const char* checkFailedCommit(const char* directory);
+const char* walOperation(HeapWal* wal, Model* model, unsigned int* seed);
+const char* checkWal(HeapOptions* options, unsigned int seed,
+                     const char* directory);
+const char* checkFailedWalCommit(const char* directory);
+const char* checkWalAge(const char* directory);
+int sharedPriority(int id, unsigned int seed);
+void sharedChild(const char* name, int child, unsigned int seed);
+const char* checkSharedHeap(HeapOptions* options, unsigned int seed);
+const char* checkHalfSwap(unsigned int seed);
+bool programPath(const char* name, char* path);
+int connectServer(const char* socketPath);
+bool sendAll(int fd, const void* data, size_t bytes);
+bool receiveAll(int fd, void* data, size_t bytes);
+void* serverWriter(void* arg);
+const char* checkResponse(HeapResponse* response, uint32_t tag, int count,
+                          int size);
+const char* checkServerPipeline(const char* socketPath, unsigned int seed);
+const char* checkServerMalformed(const char* socketPath);
+int runProgram(const char* path, const char* args[], const char* in,
+               const char* out);
+const char* checkLines(const char* path, const int* expected, long n);
+const char* checkSortInputs(const char* sort, const char* directory,
+                            unsigned int seed);
+const char* checkSortSpill(const char* sort, const char* directory,
+                           unsigned int seed);
+const char* checkSortMalformed(const char* sort, const char* directory);
+char* dumpToMemory(MinHeap* heap, bool changes);
+const char* checkDump(MinHeap* heap, char* text, bool changes,
+                      const int* dumpedIndex, const int* dumpedPriority);
+const char* checkDumps(HeapOptions* options, unsigned int seed);
+
+int main(int argc, char* argv[]) {
+  const char* slash = strrchr(argv[0], '/');
+  snprintf(programs, sizeof(programs), "%.*s",
+           slash == NULL ? 1 : (int)(slash - argv[0]),
+           slash == NULL ? "." : argv[0]);
+
+  unsigned int seed = DEFAULT_SEED;
+  if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+    seed = strtoul(argv[2], NULL, 10);
+    if (seed == 0) seed = DEFAULT_SEED;  // xorshift would stay at 0
+    argc -= 2;
+    argv += 2;
+  }
+  for (int a = 1; a < argc; a++) {
+    bool known = false;
+    for (int t = 0; t < NUM_TESTS; t++)
+      if (strcmp(argv[a], tests[t].name) == 0) known = true;
+    if (!known) {
+      fprintf(stderr, "Usage: minheap_test [-s seed] [test ...]\n");
+      fprintf(stderr, "  tests:");
+      for (int t = 0; t < NUM_TESTS; t++) fprintf(stderr, " %s", tests[t].name);
+      fprintf(stderr, " (default: all)\n");
+      exit(1);
+    }
+  }
+
+  const char* tmp = getenv("TMPDIR");
+  if (tmp == NULL || tmp[0] == '\0') tmp = "/tmp";
+  char directory[strlen(tmp) + sizeof("/minheap_test.XXXXXX")];
+  sprintf(directory, "%s/minheap_test.XXXXXX", tmp);
+  if (mkdtemp(directory) == NULL) {
+    fprintf(stderr, "Unable to create a temporary directory in %s\n", tmp);
+    exit(1);
+  }
+
+  printf("minheap_test: seed %u\n", seed);
+  int failures = 0;
+  for (int t = 0; t < NUM_TESTS; t++) {
+    bool chosen = argc == 1;
+    for (int a = 1; a < argc; a++)
+      if (strcmp(argv[a], tests[t].name) == 0) chosen = true;
+    if (!chosen) continue;
+    failures += tests[t].run(seed + t, directory);
+    emptyDirectory(directory);
+  }
+  rmdir(directory);
+
+  printf("%d test case%s failed\n", failures, failures == 1 ? "" : "s");
+  return failures > 0 ? 1 : 0;
+}
+
+unsigned int nextRandom(unsigned int* state) {
+  // xorshift32: fast, reproducible across runs
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* Formats what went wrong into 'message', and returns it.
+ */
+const char* failure(const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  vsnprintf(message, MAX_MESSAGE, format, arguments);
+  va_end(arguments);
+  return message;
+}
+
+/* Returns 'error' prefixed with where it happened, "'what' 'n': ", or NULL
+ * if 'error' is NULL.
+ */
+const char* during(const char* what, int n, const char* error) {
+  if (error == NULL) return NULL;
+  char inner[MAX_MESSAGE];
+  strcpy(inner, error);  // it may be 'message' itself
+  return failure("%s %d: %s", what, n, inner);
+}
+
+/* Prints the outcome of case 'name' of test 'test': 'error', or "ok" if it
+ * is NULL. Returns True if it is NULL.
+ */
+bool report(const char* test, const char* name, const char* error) {
+  printf("%-8s %-22s %s%s\n", test, name, error == NULL ? "ok" : "FAILED: ",
+         error == NULL ? "" : error);
+  fflush(stdout);  // before any child process can copy it
+  return error == NULL;
+}
+
+/* Removes every file in 'directory'.
+ */
+void emptyDirectory(const char* directory) {
+  DIR* dir = opendir(directory);
+  if (dir == NULL) return;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    char path[strlen(directory) + strlen(entry->d_name) + 2];
+    sprintf(path, "%s/%s", directory, entry->d_name);
+    unlink(path);
+  }
+  closedir(dir);
+}
+
+/*********************************************************************
+ * The reference model of a MinHeap
+ ********************************************************************/
+
+/* Returns a new model of an empty heap of capacity 'capacity'.
+ */
+Model* newModel(int capacity) {
+  Model* model = malloc(sizeof(Model));
+  model->capacity = capacity;
+  model->count = 0;
+  model->lastId = NOTHING;
+  model->held = calloc(capacity, sizeof(bool));
+  model->priority = calloc(capacity, sizeof(int));
+  model->payload = calloc(capacity, sizeof(int));
+  model->set = calloc(capacity, sizeof(bool));
+  return model;
+}
+
+void deleteModel(Model* model) {
+  free(model->held);
+  free(model->priority);
+  free(model->payload);
+  free(model->set);
+  free(model);
+}
+
+/* Returns the minimum priority held in 'model', or INT_MAX if none is.
+ */
+int modelMin(Model* model) {
+  int min = INT_MAX;
+  for (int id = 0; id < model->capacity; id++)
+    if (model->held[id] && model->priority[id] < min) min = model->priority[id];
+  return min;
+}
+
+void modelInsert(Model* model, int priority, int id) {
+  model->held[id] = true;
+  model->priority[id] = priority;
+  model->count++;
+  model->lastId = id;
+}
+
+/* Removes 'node', just taken out of the heap as its minimum, from 'model'.
+ * Returns NULL, or what is wrong with 'node' if it was not a minimum node.
+ */
+const char* modelExtract(Model* model, HeapNode node) {
+  if (node.id < 0 || node.id >= model->capacity || !model->held[node.id])
+    return failure("took out ID %d, which the heap does not hold", node.id);
+  if (node.priority != model->priority[node.id])
+    return failure("took out ID %d with priority %d, not %d", node.id,
+                   node.priority, model->priority[node.id]);
+  int min = modelMin(model);
+  if (node.priority != min)
+    return failure("took out priority %d, but the minimum is %d",
+                   node.priority, min);
+  model->held[node.id] = false;
+  model->count--;
+  return NULL;
+}
+
+/* Returns a random ID that 'model' does not hold, or NOTHING if it is full.
+ */
+int absentId(Model* model, unsigned int* seed) {
+  if (model->count == model->capacity) return NOTHING;
+  int id = nextRandom(seed) % model->capacity;
+  while (model->held[id]) id = (id + 1) % model->capacity;
+  return id;
+}
+
+/* Sets the payload of ID 'id' to 'payload' in 'heap' and 'model' alike, if
+ * 'heap' has payloads.
+ */
+void modelSetPayload(MinHeap* heap, Model* model, int id, int payload) {
+  if (heap->payloadSize == 0) return;
+  setPayload(heap, id, &payload);
+  model->payload[id] = payload;
+  model->set[id] = true;
+}
+
+int compareInts(const void* a, const void* b) {
+  int x = *(const int*)a, y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+/* Returns NULL if 'heap' holds what 'model' does and is a valid heap, or
+ * else the first thing wrong with it. Does not change 'heap'.
+ */
+const char* checkHeap(MinHeap* heap, Model* model) {
+  if (numNodes(heap) != model->count)
+    return failure("numNodes is %d, not %d", numNodes(heap), model->count);
+  if (heap->bufferSize < 0 || heap->bufferSize > heap->bufferCapacity)
+    return failure("bufferSize is %d, above %d", heap->bufferSize,
+                   heap->bufferCapacity);
+
+  for (int i = ROOT_INDEX; i <= numNodes(heap); i++) {
+    int id = idAt(heap, i);
+    if (id < 0 || id >= heap->capacity || indexOf(heap, id) != i)
+      return failure("indexMap does not point back to node %d (ID %d)", i, id);
+    if (i > ROOT_INDEX && i <= heap->size &&
+        priorityAt(heap, i / 2) > priorityAt(heap, i))
+      return failure("node %d has priority %d, below its parent's %d", i,
+                     priorityAt(heap, i), priorityAt(heap, i / 2));
+    if (i > heap->size && priorityAt(heap, i) < priorityAt(heap, heap->bufferMin))
+      return failure("bufferMin %d is not the buffered minimum",
+                     heap->bufferMin);
+  }
+
+  for (int id = 0; id < model->capacity; id++) {
+    if (holdsId(heap, id) != model->held[id])
+      return failure("ID %d is %s", id,
+                     model->held[id] ? "missing" : "held, but was removed");
+    if (!model->held[id]) continue;
+    if (getPriority(heap, id) != model->priority[id])
+      return failure("ID %d has priority %d, not %d", id,
+                     getPriority(heap, id), model->priority[id]);
+    if (heap->payloadSize > 0 && model->set[id] &&
+        *PAYLOAD_OF(heap, id, int) != model->payload[id])
+      return failure("ID %d has payload %d, not %d", id,
+                     *PAYLOAD_OF(heap, id, int), model->payload[id]);
+  }
+  if (model->count > 0 && getMin(heap).priority != modelMin(model))
+    return failure("getMin gives priority %d, not %d", getMin(heap).priority,
+                   modelMin(model));
+  return NULL;
+}
+
+/* Adds 'n' random nodes, with IDs it does not hold, to 'model', and stores
+ * them in 'priorities' and 'ids' too.
+ */
+void fillModel(Model* model, int n, int* priorities, int* ids,
+               unsigned int* seed) {
+  for (int j = 0; j < n; j++) {
+    ids[j] = absentId(model, seed);
+    priorities[j] = nextRandom(seed) % PRIORITY_RANGE;
+    modelInsert(model, priorities[j], ids[j]);
+  }
+}
+
+bool inDirtySet(HeapDirtySet* set, long i) {
+  return (set->bits[i / 64] >> (i % 64)) & 1;
+}
+
+/*********************************************************************
+ * heap: random operations on each configuration of MinHeap
+ ********************************************************************/
+
+/* Runs one random operation, with random stream 'seed', on 'heap' and
+ * 'model' alike, and returns NULL if its results agree with the model, or
+ * else how they do not.
+ */
+const char* randomOperation(MinHeap* heap, Model* model, unsigned int* seed) {
+  int choice = nextRandom(seed) % 100;
+  int room = model->capacity - model->count;
+
+  if (choice < 35 && room > 0) {  // insert
+    int id = absentId(model, seed);
+    int priority = nextRandom(seed) % PRIORITY_RANGE;
+    modelSetPayload(heap, model, id, nextRandom(seed));
+    insert(heap, priority, id);
+    modelInsert(model, priority, id);
+  } else if (choice < 60 && model->count > 0) {  // extractMin
+    if (heap->payloadSize == 0 || choice % 2 == 0)
+      return modelExtract(model, extractMin(heap));
+    void* payload;
+    HeapNode node = extractMinWithPayload(heap, &payload);
+    if (payload != payloadOf(heap, node.id))
+      return failure("extractMinWithPayload gave the wrong payload pointer");
+    return modelExtract(model, node);
+  } else if (choice < 80) {  // decreasePriority, of any ID, even out of range
+    // Often of the ID inserted last, which may still be in the buffer
+    int id = (int)(nextRandom(seed) % (model->capacity + 4)) - 2;
+    if (choice % 2 == 0 && model->lastId != NOTHING) id = model->lastId;
+    bool held = id >= 0 && id < model->capacity && model->held[id];
+    int newPriority = held ? model->priority[id] - (int)(nextRandom(seed) % 50)
+                           : (int)(nextRandom(seed) % PRIORITY_RANGE);
+    bool expected = held && newPriority < model->priority[id];
+    bool decreased = decreasePriority(heap, id, newPriority);
+    if (decreased != expected)
+      return failure("decreasePriority of ID %d to %d returned %d", id,
+                     newPriority, decreased);
+    if (decreased) model->priority[id] = newPriority;
+  } else if (choice < 88 && room > 0) {  // insertBatch
+    int n = 1 + nextRandom(seed) % (room < MAX_BATCH ? room : MAX_BATCH);
+    int priorities[MAX_BATCH], ids[MAX_BATCH];
+    fillModel(model, n, priorities, ids, seed);
+    for (int j = 0; j < n; j++)
+      modelSetPayload(heap, model, ids[j], nextRandom(seed));
+    insertBatch(heap, priorities, ids, n);
+  } else if (choice < 94) {  // extractMinBatch, of up to more than it holds
+    HeapNode out[MAX_BATCH];
+    int k = 1 + nextRandom(seed) % MAX_BATCH;
+    int expected = k < model->count ? k : model->count;
+    int extracted = extractMinBatch(heap, k, out);
+    if (extracted != expected)
+      return failure("extractMinBatch of %d took %d, not %d", k, extracted,
+                     expected);
+    for (int j = 0; j < extracted; j++) {
+      const char* error = modelExtract(model, out[j]);
+      if (error != NULL) return error;
+    }
+  } else if (choice < 98) {  // topK
+    return checkTopK(heap, model, nextRandom(seed) % (2 * MAX_BATCH), 1);
+  } else {
+    flushInsertBuffer(heap);
+  }
+  return NULL;
+}
+
+/* Fills a heap configured by 'options' halfway with buildHeap, then runs
+ * TEST_OPS random operations on it, checking it after each. Returns NULL if
+ * all is well, or else what went wrong.
+ */
+const char* runOperations(HeapOptions* options, unsigned int seed) {
+  MinHeap* heap = newHeapWithOptions(TEST_CAPACITY, options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  if (heap->prefetchDistance < 0 ||
+      heap->prefetchDistance > MAX_PREFETCH_DISTANCE) {
+    deleteHeap(heap);
+    return failure("prefetchDistance %d was not clamped",
+                   options->prefetchDistance);
+  }
+  Model* model = newModel(TEST_CAPACITY);
+  int n = TEST_CAPACITY / 2;
+  int* priorities = malloc(sizeof(int) * n);
+  int* ids = malloc(sizeof(int) * n);
+  fillModel(model, n, priorities, ids, &seed);
+  for (int j = 0; j < n; j++)
+    modelSetPayload(heap, model, ids[j], nextRandom(&seed));
+  buildHeap(heap, priorities, ids, n);
+  free(priorities);
+  free(ids);
+
+  const char* error = checkHeap(heap, model);
+  for (int i = 0; error == NULL && i < TEST_OPS; i++) {
+    error = randomOperation(heap, model, &seed);
+    if (error == NULL) error = checkHeap(heap, model);
+    error = during("operation", i, error);
+  }
+
+  deleteModel(model);
+  deleteHeap(heap);
+  return error;
+}
+
+int testHeap(unsigned int seed, const char* directory) {
+  (void)directory;
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++)
+    failures += !report("heap", configs[c].name,
+                        runOperations(&configs[c].options, seed + c));
+  return failures;
+}
+
+/*********************************************************************
+ * slots: slotOf under each layout
+ ********************************************************************/
+
+/* Returns NULL if a heap of 'layout' and 'capacity' puts each index in its
+ * own slot of arr, or else what went wrong.
+ */
+const char* checkSlots(HeapLayout layout, int capacity) {
+  HeapOptions options = {.layout = layout};
+  MinHeap* heap = newHeapWithOptions(capacity, &options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  bool* used = calloc(heap->arrSlots, sizeof(bool));
+  const char* error = NULL;
+  for (int i = ROOT_INDEX; error == NULL && i <= capacity; i++) {
+    long slot = slotOf(heap, i);
+    if (slot < ROOT_INDEX || slot >= heap->arrSlots)
+      error = failure("index %d is in slot %ld, outside arr", i, slot);
+    else if (used[slot])
+      error = failure("index %d is in slot %ld, already used", i, slot);
+    else
+      used[slot] = true;
+  }
+  free(used);
+  deleteHeap(heap);
+  return during("capacity", capacity, error);
+}
+
+int testSlots(unsigned int seed, const char* directory) {
+  (void)seed;
+  (void)directory;
+  HeapLayout layouts[] = {HEAP_LAYOUT_IMPLICIT, HEAP_LAYOUT_LINES,
+                          HEAP_LAYOUT_PAGES};
+  const char* names[] = {"implicit", "lines", "pages"};
+  int failures = 0;
+  for (int l = 0; l < 3; l++) {
+    // Every capacity into the second block level of pages, then
+    // either side of each depth beyond
+    const char* error = NULL;
+    for (int capacity = 1; error == NULL && capacity <= 1100; capacity++)
+      error = checkSlots(layouts[l], capacity);
+    for (int depth = 11; error == NULL && depth <= 20; depth++)
+      for (int d = -1; error == NULL && d <= 1; d++)
+        error = checkSlots(layouts[l], (1 << depth) + d);
+    failures += !report("slots", names[l], error);
+  }
+  return failures;
+}
+
+/*********************************************************************
+ * build: buildHeapParallel
+ ********************************************************************/
+
+/* Builds a heap configured by 'options' from 'n' random nodes with
+ * buildHeapParallel on 'numThreads' threads, while it tracks its writes.
+ * Returns NULL if it holds those nodes, is valid, and recorded every node
+ * and ID placed; or else what went wrong.
+ */
+const char* checkBuild(HeapOptions* options, int n, int numThreads,
+                       unsigned int seed) {
+  MinHeap* heap = newHeapWithOptions(TEST_CAPACITY, options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  Model* model = newModel(TEST_CAPACITY);
+  int* priorities = malloc(sizeof(int) * (n > 0 ? n : 1));
+  int* ids = malloc(sizeof(int) * (n > 0 ? n : 1));
+  fillModel(model, n, priorities, ids, &seed);
+
+  startTrackingWrites(heap);
+  buildHeapParallel(heap, priorities, ids, n, numThreads);
+  const char* error = checkHeap(heap, model);
+  for (int i = ROOT_INDEX; error == NULL && i <= n; i++) {
+    if (!inDirtySet(&heap->dirty->slots, slotOf(heap, i)))
+      error = failure("the slot of node %d was not recorded", i);
+    else if (!inDirtySet(&heap->dirty->ids, idAt(heap, i)))
+      error = failure("ID %d was not recorded", idAt(heap, i));
+  }
+
+  free(priorities);
+  free(ids);
+  deleteModel(model);
+  deleteHeap(heap);
+  return error;
+}
+
+int testBuild(unsigned int seed, const char* directory) {
+  (void)directory;
+  int sizes[] = {0, 1, 3, 100, TEST_CAPACITY};
+  int threads[] = {1, 2, 3, 8};
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++) {
+    const char* error = NULL;
+    for (int s = 0; error == NULL && s < 5; s++)
+      for (int t = 0; error == NULL && t < 4; t++)
+        error = checkBuild(&configs[c].options, sizes[s], threads[t],
+                           seed + s * 4 + t);
+    failures += !report("build", configs[c].name, error);
+  }
+  return failures;
+}
+
+/*********************************************************************
+ * topk: topK and topKParallel
+ ********************************************************************/
+
+/* Takes the 'k' smallest nodes of 'heap' with topKParallel on 'numThreads'
+ * threads (so topK itself for one). Returns NULL if they are the k smallest
+ * priorities of 'model', in order, with each node once; or else what went
+ * wrong.
+ */
+const char* checkTopK(MinHeap* heap, Model* model, int k, int numThreads) {
+  HeapNode* out = malloc(sizeof(HeapNode) * (k > 0 ? k : 1));
+  int* sorted = malloc(sizeof(int) * (model->count > 0 ? model->count : 1));
+  bool* seen = calloc(model->capacity, sizeof(bool));
+  int n = 0;
+  for (int id = 0; id < model->capacity; id++)
+    if (model->held[id]) sorted[n++] = model->priority[id];
+  qsort(sorted, n, sizeof(int), compareInts);
+
+  const char* error = NULL;
+  int copied = topKParallel(heap, k, out, numThreads);
+  if (copied != (k < n ? k : n))
+    error = failure("copied %d nodes out of %d", copied, n);
+  for (int j = 0; error == NULL && j < copied; j++) {
+    int id = out[j].id;
+    if (id < 0 || id >= model->capacity || !model->held[id] || seen[id] ||
+        model->priority[id] != out[j].priority)
+      error = failure("gave node %d [%d] twice or wrongly", out[j].priority, id);
+    else if (out[j].priority != sorted[j])
+      error = failure("gave priority %d in place %d, not %d", out[j].priority,
+                      j, sorted[j]);
+    else
+      seen[id] = true;
+  }
+  free(out);
+  free(sorted);
+  free(seen);
+  return error;
+}
+
+/* Checks topK and topKParallel, for several 'k', on a heap configured by
+ * 'options' holding TOPK_NODES random nodes. Returns NULL if all is well, or
+ * else what went wrong.
+ */
+const char* runTopK(HeapOptions* options, unsigned int seed) {
+  MinHeap* heap = newHeapWithOptions(TOPK_NODES, options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  Model* model = newModel(TOPK_NODES);
+  int* priorities = malloc(sizeof(int) * TOPK_NODES);
+  int* ids = malloc(sizeof(int) * TOPK_NODES);
+  fillModel(model, TOPK_NODES, priorities, ids, &seed);
+  buildHeap(heap, priorities, ids, TOPK_NODES);
+
+  int ks[] = {0, 1, 100, 5000, 70000, TOPK_NODES, TOPK_NODES + 1};
+  const char* error = NULL;
+  for (int j = 0; error == NULL && j < (int)(sizeof(ks) / sizeof(ks[0])); j++) {
+    error = during("topK of", ks[j], checkTopK(heap, model, ks[j], 1));
+    if (error == NULL)
+      error = during("topKParallel of", ks[j],
+                     checkTopK(heap, model, ks[j], TOPK_THREADS));
+  }
+  if (error == NULL) error = checkHeap(heap, model);
+
+  free(priorities);
+  free(ids);
+  deleteModel(model);
+  deleteHeap(heap);
+  return error;
+}
+
+int testTopK(unsigned int seed, const char* directory) {
+  (void)directory;
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++)
+    failures += !report("topk", configs[c].name,
+                        runTopK(&configs[c].options, seed + c));
+  return failures;
+}
+
+/*********************************************************************
+ * alloc: allocators and huge pages
+ ********************************************************************/
+
+/* Fills 'heap' to capacity. Returns NULL if heapHugePageBytes counts no more
+ * than its arr, indexMap and payload hold, or else what went wrong.
+ */
+const char* checkHugePages(MinHeap* heap) {
+  for (int id = 0; id < heap->capacity; id++) insert(heap, id, id);
+  size_t bytes = sizeof(HeapNode) * heap->arrSlots +
+                 sizeof(int) * heap->capacity +
+                 heap->payloadSize * heap->capacity;
+  size_t huge = heapHugePageBytes(heap);
+  if (huge > bytes)
+    return failure("%zu bytes on huge pages, of %zu", huge, bytes);
+  return NULL;
+}
+
+int testAlloc(unsigned int seed, const char* directory) {
+  (void)seed;
+  (void)directory;
+  const char* names[] = {"hugepages", "hugetlb"};
+  HeapAllocator allocators[] = {HEAP_ALLOC_HUGEPAGES, HEAP_ALLOC_HUGETLB};
+  int failures = 0;
+  for (int a = 0; a < 2; a++) {
+    HeapOptions options = {.allocator = allocators[a],
+                           .payloadSize = sizeof(long)};
+    MinHeap* heap = newHeapWithOptions(HUGE_CAPACITY, &options);
+    const char* error = heap == NULL ? failure("newHeapWithOptions failed")
+                                     : checkHugePages(heap);
+    if (heap != NULL) deleteHeap(heap);
+    failures += !report("alloc", names[a], error);
+  }
+
+  // All three in one block of the arena, so in one mapping
+  HeapOptions options = {.payloadSize = sizeof(long)};
+  MinHeap config;
+  initHeap(&config, HUGE_CAPACITY, &options);
+  HeapArena* arena = newHeapArena(arenaBlockBytes(&config) * 2);
+  MinHeap* heap = arena == NULL ? NULL
+                                : newHeapInArena(arena, HUGE_CAPACITY, &options);
+  failures += !report("alloc", "arena",
+                      heap == NULL ? failure("newHeapInArena failed")
+                                   : checkHugePages(heap));
+  if (arena != NULL) deleteHeapArena(arena);
+
+  HeapOptions bound = {.allocator = HEAP_ALLOC_HUGEPAGES,
+                       .bindNuma = true,
+                       .numaNode = ABSENT_NUMA_NODE};
+  heap = newHeapWithOptions(HUGE_CAPACITY, &bound);
+  failures += !report("alloc", "absent NUMA node",
+                      heap == NULL ? NULL : failure("the heap was made"));
+  if (heap != NULL) deleteHeap(heap);
+
+  arena = newHeapArena(ARENA_BYTES);
+  failures += !report("alloc", "mapped arena",
+                      arena == NULL ? failure("newHeapArena failed")
+                                    : checkArenaChurn(arena, seed));
+  if (arena != NULL) deleteHeapArena(arena);
+  void* memory = aligned_alloc(4096, ARENA_BYTES);
+  arena = newHeapArenaOver(memory, ARENA_BYTES);
+  failures += !report("alloc", "arena over memory",
+                      arena == NULL ? failure("newHeapArenaOver failed")
+                                    : checkArenaChurn(arena, seed + 1));
+  if (arena != NULL) deleteHeapArena(arena);
+  free(memory);
+  failures += !report("alloc", "full arena", checkArenaFull());
+  return failures;
+}
+
+/* Makes, runs and deletes heaps of random capacities and layouts in 'arena'
+ * for ARENA_STEPS steps, with up to ARENA_HEAPS live at once. Returns NULL
+ * if each agrees with its model and the live blocks lie inside 'arena'
+ * without overlapping, or else what went wrong.
+ */
+const char* checkArenaChurn(HeapArena* arena, unsigned int seed) {
+  MinHeap* heaps[ARENA_HEAPS] = {NULL};
+  Model* models[ARENA_HEAPS] = {NULL};
+  const char* error = NULL;
+  for (int step = 0; error == NULL && step < ARENA_STEPS; step++) {
+    int h = nextRandom(&seed) % ARENA_HEAPS;
+    if (heaps[h] == NULL) {
+      HeapOptions options = {.layout = nextRandom(&seed) % 3};
+      int capacity = 1 + nextRandom(&seed) % ARENA_MAX_CAPACITY;
+      heaps[h] = newHeapInArena(arena, capacity, &options);
+      if (heaps[h] == NULL) continue;  // full for now
+      models[h] = newModel(capacity);
+    } else if (nextRandom(&seed) % 8 == 0) {
+      deleteHeap(heaps[h]);
+      deleteModel(models[h]);
+      heaps[h] = NULL;
+      continue;
+    }
+    for (int i = 0; error == NULL && i < 20; i++) {
+      error = randomOperation(heaps[h], models[h], &seed);
+      if (error == NULL) error = checkHeap(heaps[h], models[h]);
+    }
+
+    uintptr_t base = (uintptr_t)arena->base;
+    for (int a = 0; error == NULL && a < ARENA_HEAPS; a++) {
+      if (heaps[a] == NULL) continue;
+      uintptr_t start = (uintptr_t)heaps[a];
+      uintptr_t end = start + arenaBlockBytes(heaps[a]);
+      if (start < base || end > base + arena->bytes)
+        error = failure("a block lies outside the arena");
+      for (int b = a + 1; error == NULL && b < ARENA_HEAPS; b++)
+        if (heaps[b] != NULL && (uintptr_t)heaps[b] < end &&
+            (uintptr_t)heaps[b] + arenaBlockBytes(heaps[b]) > start)
+          error = failure("two live blocks overlap");
+    }
+    error = during("step", step, error);
+  }
+  for (int h = 0; h < ARENA_HEAPS; h++) {
+    if (heaps[h] == NULL) continue;
+    deleteHeap(heaps[h]);
+    deleteModel(models[h]);
+  }
+  return error;
+}
+
+/* Returns NULL if a small arena fills up, takes a heap again once one is
+ * deleted, and starts over from its base once reset; or else what went
+ * wrong.
+ */
+const char* checkArenaFull(void) {
+  HeapArena* arena = newHeapArena(HUGE_PAGE_SIZE);
+  if (arena == NULL) return failure("newHeapArena failed");
+  MinHeap* first = newHeapInArena(arena, ARENA_MAX_CAPACITY, NULL);
+  MinHeap* last = first;
+  int made = 0;
+  for (MinHeap* heap = first; heap != NULL; made++) {
+    last = heap;
+    heap = newHeapInArena(arena, ARENA_MAX_CAPACITY, NULL);
+  }
+
+  const char* error = NULL;
+  if (first == NULL || made < 2) {
+    error = failure("only %d heaps fit", made);
+  } else {
+    deleteHeap(last);
+    MinHeap* again = newHeapInArena(arena, ARENA_MAX_CAPACITY, NULL);
+    if (again != last)
+      error = failure("the freed block was not handed out again");
+    resetHeapArena(arena);
+    MinHeap* fresh = newHeapInArena(arena, ARENA_MAX_CAPACITY, NULL);
+    if (error == NULL && fresh != first)
+      error = failure("a reset arena did not start over from its base");
+  }
+  deleteHeapArena(arena);
+  return error;
+}
+
+/*********************************************************************
+ * small: SmallHeap
+ ********************************************************************/
+
+/* Returns NULL if 'heap' holds what 'model' does and is a valid heap, or
+ * else the first thing wrong with it.
+ */
+const char* checkSmallHeap(SmallHeap* heap, Model* model) {
+  if (heap->size != model->count)
+    return failure("size is %d, not %d", heap->size, model->count);
+  for (int i = 1; i <= heap->size; i++) {
+    int id = heap->arr[i].id;
+    if (id < 0 || id >= SMALL_HEAP_CAPACITY || heap->indexMap[id] != i)
+      return failure("indexMap does not point back to node %d (ID %d)", i, id);
+    if (i > 1 && heap->arr[i / 2].priority > heap->arr[i].priority)
+      return failure("node %d has priority %d, below its parent's %d", i,
+                     heap->arr[i].priority, heap->arr[i / 2].priority);
+  }
+  for (int id = 0; id < SMALL_HEAP_CAPACITY; id++) {
+    if ((heap->indexMap[id] != 0) != model->held[id])
+      return failure("ID %d is %s", id,
+                     model->held[id] ? "missing" : "held, but was removed");
+    if (model->held[id] &&
+        smallHeapGetPriority(heap, id) != model->priority[id])
+      return failure("ID %d has priority %d, not %d", id,
+                     smallHeapGetPriority(heap, id), model->priority[id]);
+  }
+  if (model->count > 0 && smallHeapGetMin(heap).priority != modelMin(model))
+    return failure("getMin gives priority %d, not %d",
+                   smallHeapGetMin(heap).priority, modelMin(model));
+  return NULL;
+}
+
+/* Runs SMALL_OPS random operations on a SmallHeap, checking it after each.
+ * Inserts lead, so it is often full. Returns NULL if all is well, or else
+ * what went wrong.
+ */
+const char* runSmallHeap(unsigned int seed) {
+  SmallHeap heap;
+  smallHeapInit(&heap);
+  Model* model = newModel(SMALL_HEAP_CAPACITY);
+  const char* error = NULL;
+  for (int i = 0; error == NULL && i < SMALL_OPS; i++) {
+    int choice = nextRandom(&seed) % 100;
+    if (choice < 45 && model->count < SMALL_HEAP_CAPACITY) {
+      int id = absentId(model, &seed);
+      int priority = nextRandom(&seed) % PRIORITY_RANGE;
+      smallHeapInsert(&heap, priority, id);
+      modelInsert(model, priority, id);
+    } else if (choice < 75 && model->count > 0) {
+      error = modelExtract(model, smallHeapExtractMin(&heap));
+    } else {
+      int id = (int)(nextRandom(&seed) % (SMALL_HEAP_CAPACITY + 4)) - 2;
+      bool held = id >= 0 && id < SMALL_HEAP_CAPACITY && model->held[id];
+      int newPriority = held ? model->priority[id] - (int)(nextRandom(&seed) % 50)
+                             : (int)(nextRandom(&seed) % PRIORITY_RANGE);
+      bool expected = held && newPriority < model->priority[id];
+      bool decreased = smallHeapDecreasePriority(&heap, id, newPriority);
+      if (decreased != expected)
+        error = failure("decreasePriority of ID %d to %d returned %d", id,
+                        newPriority, decreased);
+      else if (decreased)
+        model->priority[id] = newPriority;
+    }
+    if (error == NULL) error = checkSmallHeap(&heap, model);
+    error = during("operation", i, error);
+  }
+  deleteModel(model);
+  return error;
+}
+
+int testSmall(unsigned int seed, const char* directory) {
+  (void)directory;
+  return !report("small", "SmallHeap", runSmallHeap(seed));
+}
+
+/*********************************************************************
+ * variants: the variants of minheap_variants.h
+ ********************************************************************/
+
+// Defines checkType(heap, model), which returns NULL if the Type 'heap'
+// holds what 'model' does and is a valid heap, or else the first thing
+// wrong with it; and runType(capacity, drift, seed), which runs VARIANT_OPS
+// random operations on a Type against a model, checking it after each.
+// Insert priorities rise by 'drift' per operation. The model's int
+// priorities are stored in the heap as TO(priority) and read back with
+// FROM(priority).
+#define DEFINE_RUN_VARIANT(Type, prefix, TO, FROM)                            \
+  const char* check##Type(Type* heap, Model* model) {                         \
+    if (prefix##NumNodes(heap) != model->count)                               \
+      return failure("NumNodes is %lld, not %d",                              \
+                     (long long)prefix##NumNodes(heap), model->count);        \
+    for (int64_t i = 1; i <= heap->size; i++) {                               \
+      int64_t id = heap->arr[i].id;                                           \
+      if (id < 0 || id >= heap->capacity || heap->indexMap[id] != i)          \
+        return failure("indexMap does not point back to node %lld",           \
+                       (long long)i);                                         \
+      if (i > 1 && heap->arr[i / 2].key > heap->arr[i].key)                   \
+        return failure("node %lld has a key below its parent's",              \
+                       (long long)i);                                         \
+    }                                                                         \
+    for (int id = 0; id < model->capacity; id++) {                            \
+      if ((heap->indexMap[id] != 0) != model->held[id])                       \
+        return failure("ID %d is %s", id,                                     \
+                       model->held[id] ? "missing" : "held, but was removed"); \
+      if (model->held[id] &&                                                  \
+          FROM(prefix##GetPriority(heap, id)) != model->priority[id])         \
+        return failure("ID %d has priority %d, not %d", id,                   \
+                       FROM(prefix##GetPriority(heap, id)),                   \
+                       model->priority[id]);                                  \
+    }                                                                         \
+    if (model->count > 0 &&                                                   \
+        FROM(prefix##GetMin(heap).priority) != modelMin(model))               \
+      return failure("GetMin gives priority %d, not %d",                      \
+                     FROM(prefix##GetMin(heap).priority), modelMin(model));   \
+    return NULL;                                                              \
+  }                                                                           \
+                                                                              \
+  const char* run##Type(int64_t capacity, int drift, unsigned int seed) {     \
+    Type* heap = new##Type(capacity);                                         \
+    if (heap == NULL) return failure("new" #Type " failed");                  \
+    Model* model = newModel((int)capacity);                                   \
+    const char* error = NULL;                                                 \
+    for (int i = 0; error == NULL && i < VARIANT_OPS; i++) {                  \
+      int choice = nextRandom(&seed) % 100;                                   \
+      int priority = i * drift + nextRandom(&seed) % PRIORITY_RANGE;          \
+      if (choice < 40 && model->count < model->capacity) {                    \
+        int id = absentId(model, &seed);                                      \
+        prefix##Insert(heap, TO(priority), id);                               \
+        modelInsert(model, priority, id);                                     \
+      } else if (choice < 70 && model->count > 0) {                           \
+        __typeof__(prefix##GetMin(heap)) node = prefix##ExtractMin(heap);     \
+        error = modelExtract(model,                                           \
+                             (HeapNode){FROM(node.priority), (int)node.id});  \
+      } else {                                                                \
+        /* Of any ID, even out of range, as the heap's index type sees it */  \
+        int id = (int)(nextRandom(&seed) % (model->capacity + 4)) - 2;        \
+        if (choice % 2 == 0 && model->lastId != NOTHING) id = model->lastId;  \
+        int64_t seen = (__typeof__(heap->capacity))id;                        \
+        bool held = seen >= 0 && seen < model->capacity && model->held[seen]; \
+        if (held)                                                             \
+          priority = model->priority[seen] - (int)(nextRandom(&seed) % 50);   \
+        if (priority < 0) priority = 0;                                       \
+        bool expected = held && priority < model->priority[seen];             \
+        bool decreased = prefix##DecreasePriority(heap, id, TO(priority));    \
+        if (decreased != expected)                                            \
+          error = failure("DecreasePriority of ID %d to %d returned %d", id,  \
+                          priority, decreased);                               \
+        else if (decreased)                                                   \
+          model->priority[seen] = priority;                                   \
+      }                                                                       \
+      if (error == NULL) error = check##Type(heap, model);                    \
+      error = during("operation", i, error);                                  \
+    }                                                                         \
+    deleteModel(model);                                                       \
+    delete##Type(heap);                                                       \
+    return error;                                                             \
+  }
+
+// Spreads the model's priorities, 0 <= priority < 1024, over all of
+// int64_t, from INT64_MIN up
+#define SPREAD(priority) \
+  ((int64_t)((uint64_t)INT64_MIN + ((uint64_t)(priority) << 54)))
+#define UNSPREAD(priority) \
+  ((int)(((uint64_t)(priority) - (uint64_t)INT64_MIN) >> 54))
+
+#define SAME(priority) (priority)
+DEFINE_RUN_VARIANT(MinHeap16, minHeap16, SAME, SAME)
+DEFINE_RUN_VARIANT(MinHeap64, minHeap64, SAME, SAME)
+DEFINE_RUN_VARIANT(MinHeapInt64, minHeapInt64, SPREAD, UNSPREAD)
+DEFINE_RUN_VARIANT(MinHeapStable, minHeapStable, SAME, SAME)
+DEFINE_RUN_VARIANT(MinHeapCompact, minHeapCompact, SAME, SAME)
+DEFINE_RUN_VARIANT(MinHeapCompact32, minHeapCompact32, SAME, SAME)
+
+// Defines checkTypeKeys(seed), which returns NULL if the keys of Float
+// (with Bits of the same size) round-trip bit for bit and follow
+// totalOrder, for the values of 'specials' (listed in that order) and for
+// random bit patterns; and sortType(seed), which returns NULL if a Type
+// sorts those values in totalOrder, IDs and bits intact.
+#define DEFINE_CHECK_FLOATS(Type, prefix, Float, Bits, toKey, fromKey,        \
+                            specials)                                         \
+  const char* check##Type##Keys(unsigned int seed) {                          \
+    int numSpecials = sizeof(specials) / sizeof(specials[0]);                 \
+    for (int j = 0; j < numSpecials; j++) {                                   \
+      Float value;                                                            \
+      memcpy(&value, &specials[j], sizeof(value));                            \
+      if (j > 0) {                                                            \
+        Float before;                                                         \
+        memcpy(&before, &specials[j - 1], sizeof(before));                    \
+        if (toKey(before) >= toKey(value))                                    \
+          return failure("special %d does not sort before special %d",        \
+                         j - 1, j);                                           \
+      }                                                                       \
+    }                                                                         \
+    Bits last = 0;                                                            \
+    for (int j = 0; j < FLOAT_SAMPLES; j++) {                                 \
+      Bits bits = ((Bits)nextRandom(&seed) << 31 << 1) ^ nextRandom(&seed);   \
+      Float value, back;                                                      \
+      memcpy(&value, &bits, sizeof(value));                                   \
+      Float roundTrip = fromKey(toKey(value));                                \
+      memcpy(&back, &roundTrip, sizeof(back));                                \
+      if (memcmp(&back, &value, sizeof(value)) != 0)                          \
+        return failure("bits %llx do not round-trip", (unsigned long long)bits); \
+      Float previous;                                                         \
+      memcpy(&previous, &last, sizeof(previous));                             \
+      if (value == value && previous == previous &&                           \
+          (previous < value) != (toKey(previous) < toKey(value)) &&           \
+          previous != value)                                                  \
+        return failure("keys of bits %llx and %llx are out of order",         \
+                       (unsigned long long)last, (unsigned long long)bits);   \
+      last = bits;                                                            \
+    }                                                                         \
+    return NULL;                                                              \
+  }                                                                           \
+                                                                              \
+  const char* sort##Type(unsigned int seed) {                                 \
+    int numSpecials = sizeof(specials) / sizeof(specials[0]);                 \
+    int n = numSpecials + FLOAT_SORTED;                                       \
+    Type* heap = new##Type(n);                                                \
+    if (heap == NULL) return failure("new" #Type " failed");                  \
+    Float* values = malloc(sizeof(Float) * n);                                \
+    bool* seen = calloc(n, sizeof(bool));                                     \
+    for (int id = 0; id < n; id++) {                                          \
+      Bits bits = id < numSpecials                                            \
+                      ? specials[id]                                          \
+                      : ((Bits)nextRandom(&seed) << 31 << 1) ^                \
+                            nextRandom(&seed);                                \
+      memcpy(&values[id], &bits, sizeof(Float));                              \
+    }                                                                         \
+    for (int j = 0; j < n; j++) {                                             \
+      int id = (int)((j * 7919L) % n);  /* specials out of order */           \
+      prefix##Insert(heap, values[id], id);                                   \
+    }                                                                         \
+                                                                              \
+    const char* error = NULL;                                                 \
+    for (int j = 0; error == NULL && j < n; j++) {                            \
+      __typeof__(prefix##GetMin(heap)) node = prefix##ExtractMin(heap);       \
+      if (seen[node.id] ||                                                    \
+          memcmp(&node.priority, &values[node.id], sizeof(Float)) != 0)       \
+        error = failure("took out ID %d twice or with other bits",            \
+                        (int)node.id);                                        \
+      else if (prefix##NumNodes(heap) > 0 &&                                  \
+               toKey(prefix##GetMin(heap).priority) < toKey(node.priority))   \
+        error = failure("took out ID %d before a smaller key", (int)node.id); \
+      seen[node.id] = true;                                                   \
+    }                                                                         \
+    free(values);                                                             \
+    free(seen);                                                               \
+    delete##Type(heap);                                                       \
+    return error;                                                             \
+  }
+
+// In totalOrder: -NaN (largest payload, then quiet), -inf, -max, -1, the
+// smallest negative subnormal, -0.0, +0.0, and the same on the positive side
+uint32_t floatSpecials[] = {
+    0xffffffff, 0xffc00000, 0xff800000, 0xff7fffff, 0xbf800000, 0x80000001,
+    0x80000000, 0x00000000, 0x00000001, 0x3f800000, 0x7f7fffff, 0x7f800000,
+    0x7fc00000, 0x7fffffff,
+};
+uint64_t doubleSpecials[] = {
+    0xffffffffffffffff, 0xfff8000000000000, 0xfff0000000000000,
+    0xffefffffffffffff, 0xbff0000000000000, 0x8000000000000001,
+    0x8000000000000000, 0x0000000000000000, 0x0000000000000001,
+    0x3ff0000000000000, 0x7fefffffffffffff, 0x7ff0000000000000,
+    0x7ff8000000000000, 0x7fffffffffffffff,
+};
+DEFINE_CHECK_FLOATS(MinHeapFloat, minHeapFloat, float, uint32_t, floatToKey,
+                    keyToFloat, floatSpecials)
+DEFINE_CHECK_FLOATS(MinHeapDouble, minHeapDouble, double, uint64_t,
+                    doubleToKey, keyToDouble, doubleSpecials)
+
+/* Returns NULL if a MinHeapInt64 orders and returns INT64_MIN, INT64_MAX
+ * and the values next to them and to 0 exactly, or else what went wrong.
+ */
+const char* checkInt64Extremes(void) {
+  int64_t values[] = {INT64_MAX, 0, INT64_MIN + 1, -1, INT64_MAX - 1, 1,
+                      INT64_MIN};
+  int n = sizeof(values) / sizeof(values[0]);
+  MinHeapInt64* heap = newMinHeapInt64(n);
+  if (heap == NULL) return failure("newMinHeapInt64 failed");
+  for (int id = 0; id < n; id++) minHeapInt64Insert(heap, values[id], id);
+
+  const char* error = NULL;
+  int64_t last = INT64_MIN;
+  for (int j = 0; error == NULL && j < n; j++) {
+    HeapNodeInt64 node = minHeapInt64ExtractMin(heap);
+    if (node.priority != values[node.id] || node.priority < last)
+      error = failure("took out ID %d out of order or changed", node.id);
+    last = node.priority;
+  }
+  deleteMinHeapInt64(heap);
+  return error;
+}
+
+/* Returns NULL if each variant refuses a capacity past its limit and a
+ * negative one, or else what went wrong.
+ */
+const char* checkVariantLimits(void) {
+  if (newMinHeap16((int64_t)UINT16_MAX + 1) != NULL)
+    return failure("newMinHeap16 took a capacity past UINT16_MAX");
+  if (newMinHeap16(-1) != NULL || newMinHeap64(-1) != NULL)
+    return failure("a negative capacity was taken");
+  if (newMinHeap64(INT64_MAX) != NULL)
+    return failure("newMinHeap64 took a capacity of INT64_MAX");
+  return NULL;
+}
+
+/* Builds a MinHeap16 of the largest capacity, UINT16_MAX, from random
+ * priorities, and drains it. Returns NULL if every ID comes out once, in
+ * order of priority, or else what went wrong.
+ */
+const char* drainFullMinHeap16(unsigned int seed) {
+  MinHeap16* heap = newMinHeap16(UINT16_MAX);
+  if (heap == NULL) return failure("newMinHeap16 failed");
+  int* priorities = malloc(sizeof(int) * UINT16_MAX);
+  bool* seen = calloc(UINT16_MAX, sizeof(bool));
+  for (int id = 0; id < UINT16_MAX; id++)
+    priorities[id] = nextRandom(&seed) % PRIORITY_RANGE;
+  minHeap16Build(heap, priorities, UINT16_MAX);
+
+  const char* error = NULL;
+  int last = INT_MIN;
+  for (int taken = 0; error == NULL && taken < UINT16_MAX; taken++) {
+    HeapNode16 node = minHeap16ExtractMin(heap);
+    if (seen[node.id] || node.priority != priorities[node.id])
+      error = failure("took out ID %d twice or wrongly", node.id);
+    else if (node.priority < last)
+      error = failure("took out priority %d after %d", node.priority, last);
+    seen[node.id] = true;
+    last = node.priority;
+  }
+  if (error == NULL && minHeap16NumNodes(heap) != 0)
+    error = failure("%d nodes are left", minHeap16NumNodes(heap));
+  free(priorities);
+  free(seen);
+  deleteMinHeap16(heap);
+  return error;
+}
+
+/* Runs VARIANT_OPS random operations, over STABLE_PRIORITIES priorities,
+ * on a MinHeapStable whose sequence numbers start at 'firstSequence'.
+ * Returns NULL if it takes out the node of minimum priority that arrived
+ * (was inserted or last decreased) first, every time, or else what went
+ * wrong.
+ */
+const char* checkStableOrder(uint32_t firstSequence, unsigned int seed) {
+  MinHeapStable* heap = newMinHeapStable(VARIANT_CAPACITY);
+  if (heap == NULL) return failure("newMinHeapStable failed");
+  heap->sequence = firstSequence;
+  Model* model = newModel(VARIANT_CAPACITY);
+  long* arrival = calloc(VARIANT_CAPACITY, sizeof(long));
+  long arrivals = 0;
+
+  const char* error = NULL;
+  for (int i = 0; error == NULL && i < VARIANT_OPS; i++) {
+    int choice = nextRandom(&seed) % 100;
+    int priority = nextRandom(&seed) % STABLE_PRIORITIES;
+    if (choice < 40 && model->count < model->capacity) {
+      int id = absentId(model, &seed);
+      minHeapStableInsert(heap, priority, id);
+      modelInsert(model, priority, id);
+      arrival[id] = arrivals++;
+    } else if (choice < 70 && model->count > 0) {
+      HeapNodeStable node = minHeapStableExtractMin(heap);
+      int min = modelMin(model), first = NOTHING;
+      for (int id = 0; id < model->capacity; id++)
+        if (model->held[id] && model->priority[id] == min &&
+            (first == NOTHING || arrival[id] < arrival[first]))
+          first = id;
+      if (node.id != first)
+        error = failure("took out ID %d, not ID %d, which arrived first",
+                        node.id, first);
+      else
+        error = modelExtract(model, (HeapNode){node.priority, node.id});
+    } else {
+      int id = nextRandom(&seed) % model->capacity;
+      bool expected = model->held[id] && priority < model->priority[id];
+      if (minHeapStableDecreasePriority(heap, id, priority) != expected)
+        error = failure("DecreasePriority of ID %d to %d returned %d", id,
+                        priority, !expected);
+      if (expected) {
+        model->priority[id] = priority;
+        arrival[id] = arrivals++;
+      }
+    }
+    error = during("operation", i, error);
+  }
+  if (error == NULL && heap->sequence >= firstSequence && firstSequence > 0)
+    error = failure("the sequence numbers never wrapped");
+
+  free(arrival);
+  deleteModel(model);
+  deleteMinHeapStable(heap);
+  return error;
+}
+
+/* Pushes priorities out of the window of a MinHeapCompact, above and then
+ * below its base. Returns NULL if each rebases, or saturates once the
+ * priorities span more than the window, as documented, and the nodes come
+ * out in order; or else what went wrong.
+ */
+const char* checkCompactWindow(void) {
+  MinHeapCompact* heap = newMinHeapCompact(4);
+  if (heap == NULL) return failure("newMinHeapCompact failed");
+  const char* error = NULL;
+  minHeapCompactInsert(heap, 0, 0);
+  minHeapCompactInsert(heap, COMPACT_MAX, 1);
+  minHeapCompactInsert(heap, COMPACT_MAX + 10, 2);  // saturates
+  if (minHeapCompactGetPriority(heap, 2) != COMPACT_MAX)
+    error = failure("a priority past the window reads %d, not %d",
+                    minHeapCompactGetPriority(heap, 2), COMPACT_MAX);
+  else if (minHeapCompactExtractMin(heap).id != 0)
+    error = failure("the minimum did not come out first");
+
+  minHeapCompactInsert(heap, COMPACT_MAX + 20, 3);  // rebases up
+  minHeapCompactDecreasePriority(heap, 3, 5);       // rebases down
+  if (error == NULL && (minHeapCompactGetPriority(heap, 3) != 5 ||
+                        minHeapCompactGetPriority(heap, 1) != COMPACT_MAX))
+    error = failure("rebasing changed a priority");
+  minHeapCompactDecreasePriority(heap, 3, -100);  // saturates the others
+  if (error == NULL &&
+      minHeapCompactGetPriority(heap, 1) != -100 + COMPACT_MAX)
+    error = failure("a priority pushed past the window reads %d, not %d",
+                    minHeapCompactGetPriority(heap, 1), -100 + COMPACT_MAX);
+
+  int order[] = {3, 1, 2};
+  for (int j = 0; error == NULL && j < 3; j++) {
+    HeapNodeCompact node = minHeapCompactExtractMin(heap);
+    if (node.id != order[j] && !(j > 0 && node.id == order[3 - j]))
+      error = failure("took out ID %d in place %d", node.id, j);
+  }
+  deleteMinHeapCompact(heap);
+  return error;
+}
+
+int testVariants(unsigned int seed, const char* directory) {
+  (void)directory;
+  int failures = 0;
+  failures += !report("variants", "MinHeap16",
+                      runMinHeap16(VARIANT_CAPACITY, 0, seed));
+  failures += !report("variants", "MinHeap64",
+                      runMinHeap64(VARIANT_CAPACITY, 0, seed + 1));
+  failures += !report("variants", "MinHeapInt64",
+                      runMinHeapInt64(VARIANT_CAPACITY, 0, seed + 2));
+  failures += !report("variants", "MinHeapStable",
+                      runMinHeapStable(VARIANT_CAPACITY, 0, seed + 3));
+  failures += !report("variants", "stable order", checkStableOrder(0, seed));
+  failures += !report("variants", "stable order at wrap",
+                      checkStableOrder(UINT32_MAX - VARIANT_OPS / 2, seed));
+  failures += !report(
+      "variants", "MinHeapCompact",
+      runMinHeapCompact(VARIANT_CAPACITY, COMPACT_DRIFT, seed + 4));
+  failures += !report(
+      "variants", "MinHeapCompact32",
+      runMinHeapCompact32(VARIANT_CAPACITY, COMPACT_DRIFT, seed + 5));
+  failures += !report("variants", "compact window", checkCompactWindow());
+  failures += !report("variants", "full MinHeap16", drainFullMinHeap16(seed));
+  failures += !report("variants", "int64 extremes", checkInt64Extremes());
+  failures += !report("variants", "float keys", checkMinHeapFloatKeys(seed));
+  failures += !report("variants", "double keys", checkMinHeapDoubleKeys(seed));
+  failures += !report("variants", "MinHeapFloat sort", sortMinHeapFloat(seed));
+  failures += !report("variants", "MinHeapDouble sort", sortMinHeapDouble(seed));
+  failures += !report("variants", "capacity limits", checkVariantLimits());
+  return failures;
+}
+
+/*********************************************************************
+ * delta: DeltaQueue under concurrent decreasePriority
+ ********************************************************************/
+
+/* Makes DELTA_PROPOSALS decreasePriority calls of random IDs to random
+ * priorities within the buckets of a queue still at bucket 0, from random
+ * stream worker->seed.
+ */
+void* proposeWorker(void* arg) {
+  DeltaWorker* worker = arg;
+  unsigned int seed = worker->seed;
+  int capacity = worker->queue->capacity;
+  for (int i = 0; i < DELTA_PROPOSALS; i++) {
+    int id = nextRandom(&seed) % capacity;
+    int priority = nextRandom(&seed) % (DELTA_WIDTH * DELTA_BUCKETS);
+    deltaDecreasePriority(worker->queue, id, priority);
+  }
+  return NULL;
+}
+
+/* Has DELTA_THREADS threads lower the priorities of one queue at once, then
+ * drains it. Returns NULL if every ID ends at the least priority proposed
+ * for it, and comes out exactly once, from the bucket of that priority, with
+ * buckets in increasing order; or else what went wrong.
+ */
+const char* checkConcurrentDecreases(unsigned int seed) {
+  int capacity = TEST_CAPACITY;
+  DeltaQueue* queue = newDeltaQueue(capacity, DELTA_WIDTH, DELTA_BUCKETS);
+  pthread_t threads[DELTA_THREADS];
+  DeltaWorker workers[DELTA_THREADS];
+  for (int t = 0; t < DELTA_THREADS; t++) {
+    workers[t] = (DeltaWorker){.queue = queue, .seed = seed + t};
+    pthread_create(&threads[t], NULL, proposeWorker, &workers[t]);
+  }
+  for (int t = 0; t < DELTA_THREADS; t++) pthread_join(threads[t], NULL);
+
+  // The same proposals, one at a time
+  int* expected = malloc(sizeof(int) * capacity);
+  for (int id = 0; id < capacity; id++) expected[id] = DELTA_UNREACHED;
+  for (int t = 0; t < DELTA_THREADS; t++) {
+    unsigned int state = seed + t;
+    for (int i = 0; i < DELTA_PROPOSALS; i++) {
+      int id = nextRandom(&state) % capacity;
+      int priority = nextRandom(&state) % (DELTA_WIDTH * DELTA_BUCKETS);
+      if (priority < expected[id]) expected[id] = priority;
+    }
+  }
+
+  const char* error = NULL;
+  for (int id = 0; error == NULL && id < capacity; id++)
+    if (deltaGetPriority(queue, id) != expected[id])
+      error = failure("ID %d has priority %d, not %d", id,
+                      deltaGetPriority(queue, id), expected[id]);
+
+  bool* popped = calloc(capacity, sizeof(bool));
+  int numPopped = 0, last = -1, bucket, ids[POP_CHUNK];
+  while (error == NULL && (bucket = deltaNextBucket(queue)) >= 0) {
+    if (bucket <= last)
+      error = failure("bucket %d came after bucket %d", bucket, last);
+    last = bucket;
+    int count;
+    while (error == NULL && (count = deltaPopBucket(queue, ids, POP_CHUNK)) > 0) {
+      for (int j = 0; error == NULL && j < count; j++) {
+        int id = ids[j];
+        if (popped[id])
+          error = failure("ID %d came out twice", id);
+        else if (expected[id] / DELTA_WIDTH != bucket)
+          error = failure("ID %d at priority %d came out of bucket %d", id,
+                          expected[id], bucket);
+        popped[id] = true;
+        numPopped++;
+      }
+    }
+  }
+  for (int id = 0; error == NULL && id < capacity; id++)
+    if (expected[id] != DELTA_UNREACHED && !popped[id])
+      error = failure("ID %d never came out", id);
+
+  free(popped);
+  free(expected);
+  deleteDeltaQueue(queue);
+  return error;
+}
+
+/* One of the threads of a delta-stepping run: pops the current bucket and
+ * relaxes the edges of what it pops, until every bucket is empty.
+ */
+void* steppingWorker(void* arg) {
+  DeltaWorker* worker = arg;
+  DeltaQueue* queue = worker->queue;
+  int ids[POP_CHUNK];
+
+  while (1) {
+    // Phase boundary: nobody is popping or relaxing, so advancing is safe
+    pthread_barrier_wait(worker->barrier);
+    if (worker->leader) *worker->done = deltaNextBucket(queue) < 0;
+    pthread_barrier_wait(worker->barrier);
+    if (*worker->done) return NULL;
+
+    int count;
+    while ((count = deltaPopBucket(queue, ids, POP_CHUNK)) > 0) {
+      for (int i = 0; i < count; i++) {
+        int v = ids[i];
+        int dist = deltaGetPriority(queue, v);
+        int* edges = worker->graph + 2 * GRAPH_DEGREE * v;
+        for (int e = 0; e < GRAPH_DEGREE; e++)
+          deltaDecreasePriority(queue, edges[2 * e], dist + edges[2 * e + 1]);
+      }
+    }
+  }
+}
+
+/* Returns the distances from 'source' in 'graph' (GRAPH_DEGREE target,
+ * weight pairs per vertex), found by Dijkstra on a MinHeap.
+ */
+int* dijkstra(int* graph, int source) {
+  int* dist = malloc(sizeof(int) * GRAPH_VERTICES);
+  for (int v = 0; v < GRAPH_VERTICES; v++) dist[v] = DELTA_UNREACHED;
+  MinHeap* heap = newHeap(GRAPH_VERTICES);
+  dist[source] = 0;
+  insert(heap, 0, source);
+  while (numNodes(heap) > 0) {
+    HeapNode node = extractMin(heap);
+    int* edges = graph + 2 * GRAPH_DEGREE * node.id;
+    for (int e = 0; e < GRAPH_DEGREE; e++) {
+      int target = edges[2 * e], candidate = node.priority + edges[2 * e + 1];
+      if (candidate >= dist[target]) continue;
+      if (dist[target] == DELTA_UNREACHED)
+        insert(heap, candidate, target);
+      else
+        decreasePriority(heap, target, candidate);
+      dist[target] = candidate;
+    }
+  }
+  deleteHeap(heap);
+  return dist;
+}
+
+/* Runs delta-stepping with DELTA_THREADS threads on a random graph, so that
+ * pops and decreasePriority calls overlap. Returns NULL if it finds the same
+ * distances as Dijkstra, or else the first that differs.
+ */
+const char* checkDeltaStepping(unsigned int seed) {
+  int* graph = malloc(sizeof(int) * 2 * GRAPH_DEGREE * GRAPH_VERTICES);
+  for (int e = 0; e < GRAPH_DEGREE * GRAPH_VERTICES; e++) {
+    graph[2 * e] = nextRandom(&seed) % GRAPH_VERTICES;
+    graph[2 * e + 1] = 1 + nextRandom(&seed) % MAX_WEIGHT;
+  }
+  int* dist = dijkstra(graph, 0);
+
+  // Every live priority lies within MAX_WEIGHT of the current bucket
+  DeltaQueue* queue =
+      newDeltaQueue(GRAPH_VERTICES, DELTA_WIDTH, MAX_WEIGHT / DELTA_WIDTH + 2);
+  pthread_t threads[DELTA_THREADS];
+  DeltaWorker workers[DELTA_THREADS];
+  pthread_barrier_t barrier;
+  bool done = false;
+  pthread_barrier_init(&barrier, NULL, DELTA_THREADS);
+  deltaDecreasePriority(queue, 0, 0);
+  for (int t = 0; t < DELTA_THREADS; t++) {
+    workers[t] = (DeltaWorker){.queue = queue, .graph = graph,
+                               .barrier = &barrier, .done = &done,
+                               .leader = t == 0};
+    pthread_create(&threads[t], NULL, steppingWorker, &workers[t]);
+  }
+  for (int t = 0; t < DELTA_THREADS; t++) pthread_join(threads[t], NULL);
+  pthread_barrier_destroy(&barrier);
+
+  const char* error = NULL;
+  for (int v = 0; error == NULL && v < GRAPH_VERTICES; v++)
+    if (deltaGetPriority(queue, v) != dist[v])
+      error = failure("vertex %d is at %d, not %d", v,
+                      deltaGetPriority(queue, v), dist[v]);
+  deleteDeltaQueue(queue);
+  free(dist);
+  free(graph);
+  return error;
+}
+
+int testDelta(unsigned int seed, const char* directory) {
+  (void)directory;
+  int failures = 0;
+  failures += !report("delta", "concurrent decreases",
+                      checkConcurrentDecreases(seed));
+  failures += !report("delta", "delta-stepping", checkDeltaStepping(seed));
+  return failures;
+}
+
+/*********************************************************************
+ * trace: recording and replaying operation traces
+ ********************************************************************/
+
+/* Encodes TRACE_RECORDS random records, with priorities and IDs across the
+ * whole int range, into memory and reads them back. Returns NULL if each
+ * comes back as written, and a truncated last record is not read; or else
+ * what went wrong.
+ */
+const char* checkTraceRecords(unsigned int seed) {
+  unsigned char* data = malloc(TRACE_RECORDS * HEAP_TRACE_MAX_RECORD);
+  int* written = malloc(sizeof(int) * 3 * TRACE_RECORDS);
+  size_t bytes = 0;
+  int lastPriority = 0;
+  int extremes[] = {INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX};
+  for (int r = 0; r < TRACE_RECORDS; r++) {
+    int* record = &written[3 * r];
+    record[0] = TRACE_INSERT + nextRandom(&seed) % 4;  // any of the four
+    int priority = r % 3 == 0 ? extremes[nextRandom(&seed) % 7]
+                              : (int)nextRandom(&seed);
+    int id = (int)(nextRandom(&seed) >> 1);
+    record[1] = record[0] == TRACE_INSERT ? priority
+                : record[0] == TRACE_DECREASE_PRIORITY ? id : 0;
+    record[2] = record[0] == TRACE_INSERT ? id
+                : record[0] == TRACE_DECREASE_PRIORITY ? priority : 0;
+    bytes += encodeTraceRecord(data + bytes, &lastPriority, record[0],
+                               record[1], record[2]);
+  }
+
+  const char* error = NULL;
+  HeapTraceReader reader = {.data = data, .bytes = bytes};
+  HeapTraceOp op;
+  int arg1, arg2;
+  for (int r = 0; error == NULL && r < TRACE_RECORDS; r++) {
+    int* record = &written[3 * r];
+    if (!readTraceRecord(&reader, &op, &arg1, &arg2))
+      error = failure("record %d could not be read", r);
+    else if ((int)op != record[0] || arg1 != record[1] || arg2 != record[2])
+      error = failure("record %d reads as %d (%d, %d), not %d (%d, %d)", r,
+                      op, arg1, arg2, record[0], record[1], record[2]);
+  }
+  if (error == NULL && readTraceRecord(&reader, &op, &arg1, &arg2))
+    error = failure("read a record past the end");
+
+  // Without its last byte, the last record must not be read
+  reader = (HeapTraceReader){.data = data, .bytes = bytes - 1};
+  int numRead = 0;
+  while (error == NULL && readTraceRecord(&reader, &op, &arg1, &arg2))
+    numRead++;
+  if (error == NULL && numRead != TRACE_RECORDS - 1)
+    error = failure("read %d records of a truncated trace, not %d", numRead,
+                    TRACE_RECORDS - 1);
+  free(written);
+  free(data);
+  return error;
+}
+
+/* Returns NULL if 'replayed' holds the same IDs at the same priorities as
+ * 'recorded', or else the first ID that differs.
+ */
+const char* sameModels(Model* replayed, Model* recorded) {
+  for (int id = 0; id < recorded->capacity; id++) {
+    if (replayed->held[id] != recorded->held[id])
+      return failure("ID %d is %s", id,
+                     recorded->held[id] ? "missing" : "held, but should not");
+    if (recorded->held[id] && replayed->priority[id] != recorded->priority[id])
+      return failure("ID %d has priority %d, not %d", id,
+                     replayed->priority[id], recorded->priority[id]);
+  }
+  return NULL;
+}
+
+/* Records TEST_OPS random inserts, extractMins, getMins and
+ * decreasePriority calls (of IDs in and out of range), with many tied
+ * priorities, on an implicit MinHeap filled halfway, into a trace at 'path'.
+ * Returns NULL if the heap agrees with 'model' throughout, or else what went
+ * wrong.
+ */
+const char* recordTrace(const char* path, Model* model, unsigned int seed) {
+  MinHeap* heap = newHeap(TEST_CAPACITY);
+  int n = TEST_CAPACITY / 2;
+  int* priorities = malloc(sizeof(int) * n);
+  int* ids = malloc(sizeof(int) * n);
+  fillModel(model, n, priorities, ids, &seed);
+  buildHeap(heap, priorities, ids, n);
+  free(priorities);
+  free(ids);
+
+  const char* error = NULL;
+  if (startHeapTrace(heap, path) == NULL)
+    error = failure("startHeapTrace failed");
+  for (int i = 0; error == NULL && i < TEST_OPS; i++) {
+    int choice = nextRandom(&seed) % 100;
+    if (choice < 40 && model->count < model->capacity) {
+      int id = absentId(model, &seed);
+      int priority = nextRandom(&seed) % PRIORITY_RANGE;
+      insert(heap, priority, id);
+      modelInsert(model, priority, id);
+    } else if (choice < 70 && model->count > 0) {
+      error = modelExtract(model, extractMin(heap));
+    } else if (choice < 80 && model->count > 0) {
+      if (getMin(heap).priority != modelMin(model))
+        error = failure("getMin gives priority %d, not %d",
+                        getMin(heap).priority, modelMin(model));
+    } else {
+      int id = (int)(nextRandom(&seed) % (model->capacity + 4)) - 2;
+      bool held = id >= 0 && id < model->capacity && model->held[id];
+      int newPriority = (int)(nextRandom(&seed) % PRIORITY_RANGE);
+      if (held) newPriority = model->priority[id] - newPriority % 50;
+      if (decreasePriority(heap, id, newPriority))
+        model->priority[id] = newPriority;
+    }
+    error = during("operation", i, error);
+  }
+  stopHeapTrace(heap);
+  if (error == NULL) error = checkHeap(heap, model);
+  deleteHeap(heap);
+  return error;
+}
+
+/* Replays the trace at 'path' on a new MinHeap configured by 'options'.
+ * Returns NULL if every operation behaves as recorded, and the heap ends up
+ * holding what 'recorded' does; or else what went wrong.
+ */
+const char* replayMinHeap(const char* path, HeapOptions* options,
+                          Model* recorded) {
+  HeapTraceReader* reader = openHeapTrace(path);
+  if (reader == NULL) return failure("openHeapTrace failed");
+  MinHeap* heap = newHeapWithOptions(reader->header.capacity, options);
+  Model* model = newModel(reader->header.capacity);
+  const char* error = NULL;
+  HeapTraceOp op;
+  int arg1, arg2;
+  for (int r = 0; error == NULL && readTraceRecord(reader, &op, &arg1, &arg2);
+       r++) {
+    if (op == TRACE_INSERT && holdsId(heap, arg2)) {
+      error = failure("insert of ID %d, which it still holds", arg2);
+    } else if (op == TRACE_INSERT) {
+      insert(heap, arg1, arg2);
+      modelInsert(model, arg1, arg2);
+    } else if (op == TRACE_EXTRACT_MIN) {
+      error = modelExtract(model, extractMin(heap));
+    } else if (op == TRACE_GET_MIN) {
+      if (getMin(heap).priority != modelMin(model))
+        error = failure("getMin gives priority %d, not %d",
+                        getMin(heap).priority, modelMin(model));
+    } else if (!decreasePriority(heap, arg1, arg2)) {
+      error = failure("decrease of ID %d to %d took no effect", arg1, arg2);
+    } else {
+      model->priority[arg1] = arg2;
+    }
+    error = during("record", r, error);
+  }
+  if (error == NULL) error = checkHeap(heap, model);
+  if (error == NULL) error = sameModels(model, recorded);
+  deleteModel(model);
+  deleteHeap(heap);
+  closeHeapTrace(reader);
+  return error;
+}
+
+// Defines replayType(path, recorded), which does what replayMinHeap does on
+// a new Type. Its ties must be broken as MinHeap breaks them
+#define DEFINE_REPLAY_VARIANT(Type, prefix)                                   \
+  const char* replay##Type(const char* path, Model* recorded) {               \
+    HeapTraceReader* reader = openHeapTrace(path);                            \
+    if (reader == NULL) return failure("openHeapTrace failed");               \
+    Type* heap = new##Type(reader->header.capacity);                          \
+    Model* model = newModel(reader->header.capacity);                         \
+    const char* error = NULL;                                                 \
+    HeapTraceOp op;                                                           \
+    int arg1, arg2;                                                           \
+    for (int r = 0;                                                           \
+         error == NULL && readTraceRecord(reader, &op, &arg1, &arg2); r++) {  \
+      if (op == TRACE_INSERT && prefix##HoldsId(heap, arg2)) {                \
+        error = failure("insert of ID %d, which it still holds", arg2);       \
+      } else if (op == TRACE_INSERT) {                                        \
+        prefix##Insert(heap, arg1, arg2);                                     \
+        modelInsert(model, arg1, arg2);                                       \
+      } else if (op == TRACE_EXTRACT_MIN) {                                   \
+        __typeof__(prefix##GetMin(heap)) node = prefix##ExtractMin(heap);     \
+        error = modelExtract(model, (HeapNode){node.priority, (int)node.id}); \
+      } else if (op == TRACE_GET_MIN) {                                       \
+        if (prefix##GetMin(heap).priority != modelMin(model))                 \
+          error = failure("GetMin gives priority %d, not %d",                 \
+                          prefix##GetMin(heap).priority, modelMin(model));    \
+      } else if (!prefix##DecreasePriority(heap, arg1, arg2)) {               \
+        error = failure("decrease of ID %d to %d took no effect", arg1, arg2); \
+      } else {                                                                \
+        model->priority[arg1] = arg2;                                         \
+      }                                                                       \
+      error = during("record", r, error);                                     \
+    }                                                                         \
+    if (error == NULL) error = check##Type(heap, model);                      \
+    if (error == NULL) error = sameModels(model, recorded);                   \
+    deleteModel(model);                                                       \
+    delete##Type(heap);                                                       \
+    closeHeapTrace(reader);                                                   \
+    return error;                                                             \
+  }
+
+DEFINE_REPLAY_VARIANT(MinHeap16, minHeap16)
+DEFINE_REPLAY_VARIANT(MinHeap64, minHeap64)
+
+int testTrace(unsigned int seed, const char* directory) {
+  int failures = 0;
+  failures += !report("trace", "records", checkTraceRecords(seed));
+
+  char path[strlen(directory) + sizeof("/trace")];
+  sprintf(path, "%s/trace", directory);
+  Model* recorded = newModel(TEST_CAPACITY);
+  const char* error = recordTrace(path, recorded, seed);
+  failures += !report("trace", "record", error);
+  if (error == NULL) {
+    for (int c = 0; c < 3; c++)  // implicit, lines and pages
+      failures += !report("trace", configs[c].name,
+                          replayMinHeap(path, &configs[c].options, recorded));
+    failures += !report("trace", "heap16", replayMinHeap16(path, recorded));
+    failures += !report("trace", "heap64", replayMinHeap64(path, recorded));
+  }
+  deleteModel(recorded);
+  return failures;
+}
+
+/*********************************************************************
+ * input: loading input files
+ ********************************************************************/
+
+/* Writes random priorities as a binary and as a text input file in
+ * 'directory', and loads each with loadHeapFromFile and 'options'. Returns
+ * NULL if both heaps hold those priorities, with IDs in file order; or else
+ * what went wrong.
+ */
+const char* checkInput(HeapOptions* options, unsigned int seed,
+                       const char* directory) {
+  char binaryPath[strlen(directory) + sizeof("/input")];
+  char textPath[strlen(directory) + sizeof("/input.txt")];
+  sprintf(binaryPath, "%s/input", directory);
+  sprintf(textPath, "%s/input.txt", directory);
+
+  Model* model = newModel(TEST_CAPACITY);
+  int n = TEST_CAPACITY - nextRandom(&seed) % (TEST_CAPACITY / 4);
+  int* priorities = malloc(sizeof(int) * n);
+  FILE* text = fopen(textPath, "w");
+  if (text != NULL) fprintf(text, "%d\n", TEST_CAPACITY);
+  for (int id = 0; id < n; id++) {
+    // Any int, extremes included
+    priorities[id] = id == 0   ? INT_MIN
+                     : id == 1 ? INT_MAX
+                               : (int)nextRandom(&seed);
+    modelInsert(model, priorities[id], id);
+    if (text != NULL) fprintf(text, "%d\n", priorities[id]);
+  }
+
+  const char* error = NULL;
+  if (text == NULL || fclose(text) != 0)
+    error = failure("cannot write %s", textPath);
+  else if (!writeHeapInput(binaryPath, TEST_CAPACITY, priorities, n))
+    error = failure("cannot write %s", binaryPath);
+  const char* paths[] = {binaryPath, textPath};
+  for (int p = 0; error == NULL && p < 2; p++) {
+    MinHeap* heap = loadHeapFromFile(paths[p], options);
+    if (heap == NULL) {
+      error = failure("loadHeapFromFile of %s failed", paths[p]);
+      break;
+    }
+    error = checkHeap(heap, model);
+    deleteHeap(heap);
+  }
+  free(priorities);
+  deleteModel(model);
+  return error;
+}
+
+/* Writes 'contents' to the file at 'path', and returns True if it could.
+ */
+bool writeFile(const char* path, const char* contents) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  bool written = fputs(contents, file) >= 0;
+  return fclose(file) == 0 && written;
+}
+
+/* Returns NULL if loadHeapFromFile refuses malformed input files in
+ * 'directory' (a token that is not an integer, more priorities than the
+ * capacity, in text or binary, a truncated binary file and a missing file),
+ * or else the first it accepted.
+ */
+const char* checkMalformedInput(const char* directory) {
+  char path[strlen(directory) + sizeof("/input")];
+  sprintf(path, "%s/input", directory);
+  const char* texts[] = {"3\n1\n2x\n", "2\n1\n2\n3\n", "-1\n", "x\n1\n"};
+  for (int t = 0; t < 4; t++) {
+    if (!writeFile(path, texts[t])) return failure("cannot write %s", path);
+    MinHeap* heap = loadHeapFromFile(path, NULL);
+    if (heap != NULL) {
+      deleteHeap(heap);
+      return failure("loaded the text input %d", t);
+    }
+  }
+
+  int priorities[] = {5, 4, 3};
+  if (!writeHeapInput(path, 2, priorities, 3))
+    return failure("cannot write %s", path);
+  MinHeap* heap = loadHeapFromFile(path, NULL);
+  if (heap != NULL) {
+    deleteHeap(heap);
+    return failure("loaded more binary priorities than the capacity");
+  }
+  if (!writeHeapInput(path, 3, priorities, 3) ||
+      truncate(path, sizeof(HeapInputHeader) + sizeof(int) * 2) != 0)
+    return failure("cannot write %s", path);
+  if ((heap = loadHeapFromFile(path, NULL)) != NULL) {
+    deleteHeap(heap);
+    return failure("loaded a truncated binary input");
+  }
+  unlink(path);
+  if ((heap = loadHeapFromFile(path, NULL)) != NULL) {
+    deleteHeap(heap);
+    return failure("loaded a missing file");
+  }
+  return NULL;
+}
+
+int testInput(unsigned int seed, const char* directory) {
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++)
+    failures += !report("input", configs[c].name,
+                        checkInput(&configs[c].options, seed + c, directory));
+  failures += !report("input", "malformed", checkMalformedInput(directory));
+  return failures;
+}
+
+/*********************************************************************
+ * image: saving and restoring heap images
+ ********************************************************************/
+
+/* Saves a heap configured by 'options', after TEST_OPS random operations,
+ * in 'directory' with saveHeap, and restores it with loadHeap in both
+ * modes. Returns NULL if both give back the same heap, and changes to the
+ * private one leave the image as it was; or else what went wrong.
+ */
+const char* checkImage(HeapOptions* options, unsigned int seed,
+                       const char* directory) {
+  char path[strlen(directory) + sizeof("/image")];
+  sprintf(path, "%s/image", directory);
+  MinHeap* heap = newHeapWithOptions(TEST_CAPACITY, options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  Model* model = newModel(TEST_CAPACITY);
+  const char* error = NULL;
+  for (int i = 0; error == NULL && i < TEST_OPS; i++)
+    error = during("operation", i, randomOperation(heap, model, &seed));
+
+  MinHeap* copy = NULL;
+  MinHeap* shared = NULL;
+  if (error == NULL && !saveHeap(heap, path))
+    error = failure("saveHeap failed");
+  if (error == NULL && (copy = loadHeap(path, HEAP_IMAGE_PRIVATE)) == NULL)
+    error = failure("loadHeap (private) failed");
+  if (error == NULL && (shared = loadHeap(path, HEAP_IMAGE_READONLY)) == NULL)
+    error = failure("loadHeap (read-only) failed");
+  if (error == NULL) error = checkHeap(copy, model);
+  if (error == NULL) error = checkHeap(shared, model);
+
+  // The copy is in the same state, so it breaks ties alike
+  while (error == NULL && numNodes(heap) > 0) {
+    HeapNode expected = extractMin(heap), node = extractMin(copy);
+    if (node.priority != expected.priority || node.id != expected.id)
+      error = failure("the loaded heap gave %d [%d], not %d [%d]",
+                      node.priority, node.id, expected.priority, expected.id);
+  }
+  if (error == NULL && numNodes(copy) != 0)
+    error = failure("the loaded heap has %d nodes left", numNodes(copy));
+  if (error == NULL) error = checkHeap(shared, model);
+
+  if (copy != NULL) deleteHeap(copy);
+  if (shared != NULL) deleteHeap(shared);
+  deleteModel(model);
+  deleteHeap(heap);
+  return error;
+}
+
+/* Returns NULL if loadHeap refuses images in 'directory' that are
+ * truncated, of another version, or claim more nodes than their capacity;
+ * or else the first it accepted.
+ */
+const char* checkBadImages(const char* directory) {
+  char path[strlen(directory) + sizeof("/image")];
+  sprintf(path, "%s/image", directory);
+  MinHeap* heap = newHeap(TEST_CAPACITY);
+  for (int id = 0; id < TEST_CAPACITY / 2; id++) insert(heap, id, id);
+  bool saved = saveHeap(heap, path);
+  deleteHeap(heap);
+  if (!saved) return failure("saveHeap failed");
+
+  HeapImageHeader header;
+  FILE* file = fopen(path, "r+");
+  if (file == NULL || fread(&header, sizeof(header), 1, file) != 1) {
+    if (file != NULL) fclose(file);
+    return failure("cannot read %s", path);
+  }
+  HeapImageHeader bad[] = {header, header};
+  bad[0].version++;
+  bad[1].size = header.capacity + 1;
+  const char* error = NULL;
+  for (int b = 0; error == NULL && b < 3; b++) {
+    // The last is the valid header, over an image missing its last byte
+    bool written = fseek(file, 0, SEEK_SET) == 0 &&
+                   fwrite(b < 2 ? &bad[b] : &header, sizeof(header), 1,
+                          file) == 1 &&
+                   fflush(file) == 0 &&
+                   (b < 2 || truncate(path, header.bytes - 1) == 0);
+    if (!written) error = failure("cannot write %s", path);
+    else if ((heap = loadHeap(path, HEAP_IMAGE_PRIVATE)) != NULL) {
+      deleteHeap(heap);
+      error = failure("loaded bad image %d", b);
+    }
+  }
+  fclose(file);
+  return error;
+}
+
+int testImage(unsigned int seed, const char* directory) {
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++)
+    failures += !report("image", configs[c].name,
+                        checkImage(&configs[c].options, seed + c, directory));
+  failures += !report("image", "bad images", checkBadImages(directory));
+  return failures;
+}
+
+/*********************************************************************
+ * persist: write tracking, and the persistent heap built on it
+ ********************************************************************/
+
+/* Copies the arr, indexMap and payload of 'heap' into 'snapshot', and
+ * empties its record of writes, so that checkWrites can compare against
+ * them later.
+ */
+void takeSnapshot(MinHeap* heap, Snapshot* snapshot) {
+  size_t payloadBytes = heap->payloadSize * heap->capacity;
+  memcpy(snapshot->arr, heap->arr, sizeof(HeapNode) * heap->arrSlots);
+  memcpy(snapshot->indexMap, heap->indexMap, sizeof(int) * heap->capacity);
+  if (payloadBytes > 0) memcpy(snapshot->payload, heap->payload, payloadBytes);
+  clearDirtySet(&heap->dirty->slots);
+  clearDirtySet(&heap->dirty->ids);
+  clearDirtySet(&heap->dirty->payloads);
+}
+
+/* Returns NULL if every slot, indexMap entry and payload of 'heap' that
+ * differs from 'snapshot' was recorded as written, or else the first that
+ * was not. Then takes a new snapshot.
+ */
+const char* checkWrites(MinHeap* heap, Snapshot* snapshot) {
+  const char* error = NULL;
+  for (long s = 0; error == NULL && s < heap->arrSlots; s++)
+    if (memcmp(&heap->arr[s], &snapshot->arr[s], sizeof(HeapNode)) != 0 &&
+        !inDirtySet(&heap->dirty->slots, s))
+      error = failure("slot %ld changed, but was not recorded", s);
+  for (int id = 0; error == NULL && id < heap->capacity; id++)
+    if (heap->indexMap[id] != snapshot->indexMap[id] &&
+        !inDirtySet(&heap->dirty->ids, id))
+      error = failure("indexMap[%d] changed, but was not recorded", id);
+  size_t size = heap->payloadSize;
+  for (int id = 0; error == NULL && size > 0 && id < heap->capacity; id++)
+    if (memcmp(heap->payload + id * size, snapshot->payload + id * size,
+               size) != 0 &&
+        !inDirtySet(&heap->dirty->payloads, id))
+      error = failure("payload of ID %d changed, but was not recorded", id);
+  takeSnapshot(heap, snapshot);
+  return error;
+}
+
+/* Runs TEST_OPS random operations on a heap configured by 'options' that
+ * tracks its writes. Returns NULL if every write each one made was
+ * recorded, or else the first that was not.
+ */
+const char* checkTracking(HeapOptions* options, unsigned int seed) {
+  MinHeap* heap = newHeapWithOptions(TEST_CAPACITY, options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  Model* model = newModel(TEST_CAPACITY);
+  Snapshot snapshot = {
+      malloc(sizeof(HeapNode) * heap->arrSlots),
+      malloc(sizeof(int) * heap->capacity),
+      malloc(heap->payloadSize * heap->capacity + 1),
+  };
+  startTrackingWrites(heap);
+  takeSnapshot(heap, &snapshot);
+
+  const char* error = NULL;
+  for (int i = 0; error == NULL && i < TEST_OPS; i++) {
+    error = randomOperation(heap, model, &seed);
+    if (error == NULL) error = checkWrites(heap, &snapshot);
+    error = during("operation", i, error);
+  }
+
+  free(snapshot.arr);
+  free(snapshot.indexMap);
+  free(snapshot.payload);
+  deleteModel(model);
+  deleteHeap(heap);
+  return error;
+}
+
+/* Copies what 'model' holds into 'shared', SHARED_MODEL_BYTES(capacity)
+ * bytes that a crashing child process leaves for its parent.
+ */
+void storeModel(Model* model, char* shared) {
+  int capacity = model->capacity;
+  memcpy(shared, model->priority, sizeof(int) * capacity);
+  memcpy(shared + sizeof(int) * capacity, model->payload,
+         sizeof(int) * capacity);
+  memcpy(shared + 2 * sizeof(int) * capacity, model->held,
+         sizeof(bool) * capacity);
+  memcpy(shared + (2 * sizeof(int) + sizeof(bool)) * capacity, model->set,
+         sizeof(bool) * capacity);
+}
+
+/* Replaces what 'model' holds with what storeModel left in 'shared'.
+ */
+void loadModel(Model* model, const char* shared) {
+  int capacity = model->capacity;
+  memcpy(model->priority, shared, sizeof(int) * capacity);
+  memcpy(model->payload, shared + sizeof(int) * capacity,
+         sizeof(int) * capacity);
+  memcpy(model->held, shared + 2 * sizeof(int) * capacity,
+         sizeof(bool) * capacity);
+  memcpy(model->set, shared + (2 * sizeof(int) + sizeof(bool)) * capacity,
+         sizeof(bool) * capacity);
+  model->count = 0;
+  model->lastId = NOTHING;
+  for (int id = 0; id < capacity; id++) model->count += model->held[id];
+}
+
+/* Runs one random insert, extractMin or decreasePriority (of any ID, even
+ * out of range), with random stream 'seed', through the functions of 'p'
+ * and on 'model' alike. Returns NULL if its results agree with the model
+ * and any commit it made succeeded, or else what went wrong.
+ */
+const char* persistentOperation(PersistentHeap* p, Model* model,
+                                unsigned int* seed) {
+  int choice = nextRandom(seed) % 100;
+  bool committed;
+  const char* error = NULL;
+  if (choice < 40 && model->count < model->capacity) {
+    int id = absentId(model, seed);
+    int priority = nextRandom(seed) % PRIORITY_RANGE;
+    committed = persistentInsert(p, priority, id);
+    modelInsert(model, priority, id);
+  } else if (choice < 70 && model->count > 0) {
+    HeapNode node;
+    committed = persistentExtractMin(p, &node);
+    error = modelExtract(model, node);
+  } else {
+    int id = (int)(nextRandom(seed) % (model->capacity + 4)) - 2;
+    bool held = id >= 0 && id < model->capacity && model->held[id];
+    int newPriority = held ? model->priority[id] - (int)(nextRandom(seed) % 50)
+                           : (int)(nextRandom(seed) % PRIORITY_RANGE);
+    bool expected = held && newPriority < model->priority[id];
+    bool decreased;
+    committed = persistentDecreasePriority(p, id, newPriority, &decreased);
+    if (decreased != expected)
+      error = failure("persistentDecreasePriority of ID %d to %d gave %d", id,
+                      newPriority, decreased);
+    if (decreased) model->priority[id] = newPriority;
+  }
+  if (error == NULL && !committed)
+    error = failure("an automatic commit failed");
+  return error;
+}
+
+/* Runs random operations, half through the functions of PersistentHeap and
+ * half straight on its heap, on a persistent heap configured by 'options'
+ * in 'directory', closing and reopening it PERSIST_ROUNDS times; then has a
+ * child process commit CRASH_OPS more and die LOST_OPS after that, and
+ * tears the last record of the log. Returns NULL if every reopening gives
+ * back the heap as of the last commit, or else what went wrong.
+ */
+const char* checkPersistentHeap(HeapOptions* options, unsigned int seed,
+                                const char* directory) {
+  char path[strlen(directory) + sizeof("/persist")];
+  sprintf(path, "%s/persist", directory);
+  Model* model = newModel(TEST_CAPACITY);
+  int interval = 1 + seed % 8;
+  const char* error = NULL;
+
+  for (int round = 0; error == NULL && round < PERSIST_ROUNDS; round++) {
+    PersistentHeap* p =
+        openPersistentHeap(path, TEST_CAPACITY, options, interval);
+    if (p == NULL) {
+      error = failure("openPersistentHeap failed in round %d", round);
+      break;
+    }
+    error = during("reopening", round, checkHeap(p->heap, model));
+    for (int i = 0; error == NULL && i < ROUND_OPS; i++) {
+      error = i % 2 == 0 ? persistentOperation(p, model, &seed)
+                         : randomOperation(p->heap, model, &seed);
+      if (error == NULL && i % interval == 0 && !commitPersistentHeap(p))
+        error = failure("commitPersistentHeap failed");
+      error = during("operation", i, error);
+    }
+    if (!closePersistentHeap(p) && error == NULL)
+      error = failure("closePersistentHeap failed in round %d", round);
+  }
+  if (error != NULL) {
+    deleteModel(model);
+    return error;
+  }
+
+  // The child leaves the model as of its last commit where the parent can
+  // see it
+  char* committed = mmap(NULL, SHARED_MODEL_BYTES(TEST_CAPACITY),
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                         -1, 0);
+  if (committed == MAP_FAILED) {
+    deleteModel(model);
+    return failure("cannot map memory to share with the child");
+  }
+  pid_t child = fork();
+  if (child == 0) {
+    PersistentHeap* p = openPersistentHeap(path, TEST_CAPACITY, options, 0);
+    if (p == NULL) _exit(2);
+    for (int i = 0; i < CRASH_OPS; i++)
+      if (randomOperation(p->heap, model, &seed) != NULL) _exit(3);
+    if (!commitPersistentHeap(p)) _exit(4);
+    storeModel(model, committed);
+    for (int i = 0; i < LOST_OPS; i++) randomOperation(p->heap, model, &seed);
+    _exit(0);  // without closing, so the last LOST_OPS are never committed
+  }
+
+  int status;
+  if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0)
+    error = failure("the child failed before its crash");
+  PersistentHeap* p = NULL;
+  if (error == NULL) {
+    // Half a record more, as if the next commit had been cut short
+    char logPath[strlen(path) + sizeof(".log")];
+    sprintf(logPath, "%s.log", path);
+    FILE* log = fopen(logPath, "a");
+    HeapLogRecord torn = {.magic = HEAP_LOG_MAGIC, .bytes = 2 * sizeof(torn)};
+    bool written = log != NULL && fwrite(&torn, sizeof(torn), 1, log) == 1;
+    if (log == NULL || fclose(log) != 0 || !written)
+      error = failure("cannot tear the log");
+  }
+  if (error == NULL &&
+      (p = openPersistentHeap(path, TEST_CAPACITY, options, 0)) == NULL)
+    error = failure("openPersistentHeap failed after the crash");
+  if (error == NULL) {
+    loadModel(model, committed);
+    error = during("reopening after the crash", CRASH_OPS,
+                   checkHeap(p->heap, model));
+  }
+  if (p != NULL) closePersistentHeap(p);
+  munmap(committed, SHARED_MODEL_BYTES(TEST_CAPACITY));
+  deleteModel(model);
+  return error;
+}
+
+/* Has the log of a persistent heap in 'directory' refuse writes while an
+ * operation commits. Returns NULL if the operation reports the failed
+ * commit, the next commit makes it durable once the log is back, and
+ * reopening gives it back; or else what went wrong.
+ */
+const char* checkFailedCommit(const char* directory) {
+  char path[strlen(directory) + sizeof("/persist")];
+  sprintf(path, "%s/persist", directory);
+  PersistentHeap* p = openPersistentHeap(path, TEST_CAPACITY, NULL, 1);
+  if (p == NULL) return failure("openPersistentHeap failed");
+  const char* error = NULL;
+  int logFd = p->logFd;
+  p->logFd = open("/dev/full", O_WRONLY);  // every write fails: ENOSPC
+  if (p->logFd < 0) error = failure("cannot open /dev/full");
+  else if (persistentInsert(p, 7, 3))
+    error = failure("persistentInsert hid the failed commit");
+  if (p->logFd >= 0) close(p->logFd);
+  p->logFd = logFd;
+  if (error == NULL && !commitPersistentHeap(p))
+    error = failure("commitPersistentHeap failed once the log was back");
+  if (!closePersistentHeap(p) && error == NULL)
+    error = failure("closePersistentHeap failed");
+  if (error == NULL &&
+      (p = openPersistentHeap(path, TEST_CAPACITY, NULL, 1)) == NULL)
+    error = failure("openPersistentHeap failed on reopening");
+  else if (error == NULL) {
+    if (numNodes(p->heap) != 1 || !holdsId(p->heap, 3) ||
+        getPriority(p->heap, 3) != 7)
+      error = failure("the insert was lost");
+    closePersistentHeap(p);
+  }
+  return error;
+}
+
+int testPersist(unsigned int seed, const char* directory) {
+  int failures = 0;
+  const char* error = NULL;
+  for (int c = 0; error == NULL && c < NUM_CONFIGS; c++)
+    error = during("configuration", c,
+                   checkTracking(&configs[c].options, seed + c));
+  failures += !report("persist", "write tracking", error);
+  for (int c = 0; c < NUM_CONFIGS; c++) {
+    failures += !report("persist", configs[c].name,
+                        checkPersistentHeap(&configs[c].options, seed + c,
+                                            directory));
+    emptyDirectory(directory);
+  }
+  failures += !report("persist", "failed commit", checkFailedCommit(directory));
+  return failures;
+}
+
+/*********************************************************************
+ * wal: the write-ahead-logged heap
+ ********************************************************************/
+
+/* Runs one random insert, extractMin or decreasePriority (of any ID, even
+ * out of range), with random stream 'seed', through the functions of 'wal'
+ * and on 'model' alike. Returns NULL if its results agree with the model
+ * and any commit it made succeeded, or else what went wrong.
+ */
+const char* walOperation(HeapWal* wal, Model* model, unsigned int* seed) {
+  int choice = nextRandom(seed) % 100;
+  bool committed;
+  const char* error = NULL;
+  if (choice < 40 && model->count < model->capacity) {
+    int id = absentId(model, seed);
+    int priority = nextRandom(seed) % PRIORITY_RANGE;
+    committed = walInsert(wal, priority, id);
+    modelInsert(model, priority, id);
+  } else if (choice < 70 && model->count > 0) {
+    HeapNode node;
+    committed = walExtractMin(wal, &node);
+    error = modelExtract(model, node);
+  } else {
+    int id = (int)(nextRandom(seed) % (model->capacity + 4)) - 2;
+    bool held = id >= 0 && id < model->capacity && model->held[id];
+    int newPriority = held ? model->priority[id] - (int)(nextRandom(seed) % 50)
+                           : (int)(nextRandom(seed) % PRIORITY_RANGE);
+    bool expected = held && newPriority < model->priority[id];
+    bool decreased;
+    committed = walDecreasePriority(wal, id, newPriority, &decreased);
+    if (decreased != expected)
+      error = failure("walDecreasePriority of ID %d to %d gave %d", id,
+                      newPriority, decreased);
+    if (decreased) model->priority[id] = newPriority;
+  }
+  if (error == NULL && !committed)
+    error = failure("an automatic commit failed");
+  return error;
+}
+
+/* Runs random logged operations on a heap configured by 'options' through
+ * a write-ahead log in 'directory', that compacts often, closing and
+ * recovering it PERSIST_ROUNDS times; then has a child process commit
+ * CRASH_OPS more and die LOST_OPS after that. Returns NULL if every
+ * recovery gives back the heap as of the last commit, or else what went
+ * wrong.
+ */
+const char* checkWal(HeapOptions* options, unsigned int seed,
+                     const char* directory) {
+  char path[strlen(directory) + sizeof("/wal")];
+  sprintf(path, "%s/wal", directory);
+  Model* model = newModel(TEST_CAPACITY);
+  HeapWalPolicy policy = {.commitOps = 1 + seed % 8,
+                          .compactBytes = WAL_COMPACT_BYTES};
+  const char* error = NULL;
+  long compactions = 0;
+
+  for (int round = 0; error == NULL && round < PERSIST_ROUNDS; round++) {
+    HeapWal* wal = openHeapWal(path, TEST_CAPACITY, options, &policy);
+    if (wal == NULL) {
+      error = failure("openHeapWal failed in round %d", round);
+      break;
+    }
+    error = during("recovery", round, checkHeap(wal->heap, model));
+    for (int i = 0; error == NULL && i < ROUND_OPS; i++)
+      error = during("operation", i, walOperation(wal, model, &seed));
+    compactions += wal->compactions;
+    if (!closeHeapWal(wal) && error == NULL)
+      error = failure("closeHeapWal failed in round %d", round);
+  }
+  if (error == NULL && compactions == 0)
+    error = failure("the log was never compacted");
+  if (error != NULL) {
+    deleteModel(model);
+    return error;
+  }
+
+  // The child leaves the model as of its last commit where the parent can
+  // see it
+  char* committed = mmap(NULL, SHARED_MODEL_BYTES(TEST_CAPACITY),
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                         -1, 0);
+  if (committed == MAP_FAILED) {
+    deleteModel(model);
+    return failure("cannot map memory to share with the child");
+  }
+  pid_t child = fork();
+  if (child == 0) {
+    HeapWalPolicy manual = {0};  // commits only when told to
+    HeapWal* wal = openHeapWal(path, TEST_CAPACITY, options, &manual);
+    if (wal == NULL) _exit(2);
+    for (int i = 0; i < CRASH_OPS; i++)
+      if (walOperation(wal, model, &seed) != NULL) _exit(3);
+    if (!commitHeapWal(wal)) _exit(4);
+    storeModel(model, committed);
+    for (int i = 0; i < LOST_OPS; i++) walOperation(wal, model, &seed);
+    _exit(0);  // without closing, so the last LOST_OPS are never committed
+  }
+
+  int status;
+  HeapWal* wal = NULL;
+  if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0)
+    error = failure("the child failed before its crash");
+  else if ((wal = openHeapWal(path, TEST_CAPACITY, options, &policy)) == NULL)
+    error = failure("openHeapWal failed after the crash");
+  if (error == NULL) {
+    loadModel(model, committed);
+    error = during("recovery after the crash", CRASH_OPS,
+                   checkHeap(wal->heap, model));
+  }
+  if (wal != NULL) closeHeapWal(wal);
+  munmap(committed, SHARED_MODEL_BYTES(TEST_CAPACITY));
+  deleteModel(model);
+  return error;
+}
+
+/* Has the log of a logged heap in 'directory' refuse writes while an
+ * operation commits. Returns NULL if the operation reports the failed
+ * commit, the next commit makes it durable once the log is back, and
+ * recovery gives it back; or else what went wrong.
+ */
+const char* checkFailedWalCommit(const char* directory) {
+  char path[strlen(directory) + sizeof("/wal")];
+  sprintf(path, "%s/wal", directory);
+  HeapWal* wal = openHeapWal(path, TEST_CAPACITY, NULL, NULL);
+  if (wal == NULL) return failure("openHeapWal failed");
+  const char* error = NULL;
+  int fd = wal->fd;
+  wal->fd = open("/dev/full", O_WRONLY);  // every write fails: ENOSPC
+  if (wal->fd < 0) error = failure("cannot open /dev/full");
+  else if (walInsert(wal, 7, 3))
+    error = failure("walInsert hid the failed commit");
+  if (wal->fd >= 0) close(wal->fd);
+  wal->fd = fd;
+  if (error == NULL && !commitHeapWal(wal))
+    error = failure("commitHeapWal failed once the log was back");
+  if (!closeHeapWal(wal) && error == NULL)
+    error = failure("closeHeapWal failed");
+  if (error == NULL &&
+      (wal = openHeapWal(path, TEST_CAPACITY, NULL, NULL)) == NULL)
+    error = failure("openHeapWal failed on recovery");
+  else if (error == NULL) {
+    if (numNodes(wal->heap) != 1 || !holdsId(wal->heap, 3) ||
+        getPriority(wal->heap, 3) != 7)
+      error = failure("the insert was lost");
+    closeHeapWal(wal);
+  }
+  return error;
+}
+
+/* Returns NULL if a logged heap in 'directory' with a commitMicros policy
+ * keeps an operation pending while it is younger than that, and commits it
+ * with the first operation after; or else what went wrong.
+ */
+const char* checkWalAge(const char* directory) {
+  char path[strlen(directory) + sizeof("/wal")];
+  sprintf(path, "%s/wal", directory);
+  HeapWalPolicy policy = {.commitMicros = WAL_COMMIT_MICROS};
+  HeapWal* wal = openHeapWal(path, TEST_CAPACITY, NULL, &policy);
+  if (wal == NULL) return failure("openHeapWal failed");
+  const char* error = NULL;
+  if (!walInsert(wal, 1, 1) || wal->commits != 0 || wal->pending != 1)
+    error = failure("the first operation did not wait for its commit");
+  usleep(2 * WAL_COMMIT_MICROS);
+  if (error == NULL && (!walInsert(wal, 2, 2) || wal->commits != 1))
+    error = failure("an operation after commitMicros did not commit");
+  closeHeapWal(wal);
+  return error;
+}
+
+int testWal(unsigned int seed, const char* directory) {
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++) {
+    failures += !report("wal", configs[c].name,
+                        checkWal(&configs[c].options, seed + c, directory));
+    emptyDirectory(directory);
+  }
+  failures += !report("wal", "failed commit", checkFailedWalCommit(directory));
+  emptyDirectory(directory);
+  failures += !report("wal", "commit by age", checkWalAge(directory));
+  return failures;
+}
+
+/*********************************************************************
+ * Shared heaps
+ ********************************************************************/
+
+/* Returns the priority ID 'id' is inserted with in a shared heap test of
+ * seed 'seed'; IDs that are decreased end up SHARED_DECREASE or less below
+ * it.
+ */
+int sharedPriority(int id, unsigned int seed) {
+  unsigned int state = seed + id;
+  return SHARED_DECREASE + nextRandom(&state) % PRIORITY_RANGE;
+}
+
+/* Run in child process 'child': opens the shared heap named 'name', inserts
+ * the IDs it owns (those equal to 'child' modulo SHARED_CHILDREN) one at a
+ * time and in batches, decreases every third, and exits.
+ */
+void sharedChild(const char* name, int child, unsigned int seed) {
+  SharedHeap* s = openSharedHeap(name);
+  if (s == NULL) _exit(2);
+  int priorities[MAX_BATCH], ids[MAX_BATCH];
+  int n = 0;
+  for (int id = child; id < TEST_CAPACITY; id += SHARED_CHILDREN) {
+    if (id / SHARED_CHILDREN % 2 == 0) {
+      if (!sharedInsert(s, sharedPriority(id, seed), id)) _exit(3);
+      continue;
+    }
+    priorities[n] = sharedPriority(id, seed);
+    ids[n++] = id;
+    if (n == MAX_BATCH || id + 2 * SHARED_CHILDREN >= TEST_CAPACITY) {
+      if (!sharedInsertBatch(s, priorities, ids, n)) _exit(4);
+      n = 0;
+    }
+  }
+  for (int id = child; id < TEST_CAPACITY; id += 3 * SHARED_CHILDREN)
+    if (!sharedDecreasePriority(s, id,
+                                sharedPriority(id, seed) - 1 -
+                                    id % SHARED_DECREASE))
+      _exit(5);
+  closeSharedHeap(s);
+  _exit(0);
+}
+
+/* Has SHARED_CHILDREN processes fill a shared heap configured by 'options'
+ * at once. Returns NULL if it holds every node at its last priority and
+ * drains in order, or else what went wrong.
+ */
+const char* checkSharedHeap(HeapOptions* options, unsigned int seed) {
+  char name[sizeof("/minheap_test.") + 3 * sizeof(pid_t)];
+  sprintf(name, "/minheap_test.%d", (int)getpid());
+  SharedHeap* s = createSharedHeap(name, TEST_CAPACITY, options);
+  if (s == NULL) return failure("createSharedHeap failed");
+
+  const char* error = NULL;
+  pid_t children[SHARED_CHILDREN];
+  for (int c = 0; c < SHARED_CHILDREN; c++)
+    if ((children[c] = fork()) == 0) sharedChild(name, c, seed);
+  for (int c = 0; c < SHARED_CHILDREN; c++) {
+    int status;
+    if ((children[c] < 0 || waitpid(children[c], &status, 0) != children[c] ||
+         !WIFEXITED(status) || WEXITSTATUS(status) != 0) &&
+        error == NULL)
+      error = failure("child %d failed", c);
+  }
+
+  Model* model = newModel(TEST_CAPACITY);
+  for (int id = 0; id < TEST_CAPACITY; id++)
+    modelInsert(model, sharedPriority(id, seed), id);
+  for (int id = 0; id < TEST_CAPACITY; id += 3 * SHARED_CHILDREN)
+    for (int c = 0; c < SHARED_CHILDREN && id + c < TEST_CAPACITY; c++)
+      model->priority[id + c] -= 1 + (id + c) % SHARED_DECREASE;
+
+  // sharedNumNodes brings the view up to date with the children's work
+  if (error == NULL && sharedNumNodes(s) != TEST_CAPACITY)
+    error = failure("sharedNumNodes is %d, not %d", sharedNumNodes(s),
+                    TEST_CAPACITY);
+  if (error == NULL) error = checkHeap(s->heap, model);
+  HeapNode out[MAX_BATCH];
+  while (error == NULL && model->count > 0) {
+    int taken = sharedExtractMinBatch(s, MAX_BATCH / 2, out);
+    if (taken <= 0) error = failure("sharedExtractMinBatch gave %d", taken);
+    for (int j = 0; error == NULL && j < taken; j++)
+      error = modelExtract(model, out[j]);
+    HeapNode node;
+    if (error == NULL && model->count > 0) {
+      if (!sharedExtractMin(s, &node))
+        error = failure("sharedExtractMin found no node");
+      else
+        error = modelExtract(model, node);
+    }
+  }
+  deleteModel(model);
+  closeSharedHeap(s);
+  unlinkSharedHeap(name);
+  return error;
+}
+
+/* Has a child process die holding the lock of a shared heap after writing
+ * the first half of a swap. Returns NULL if the next operation repairs the
+ * heap with no node lost, or else what went wrong.
+ */
+const char* checkHalfSwap(unsigned int seed) {
+  char name[sizeof("/minheap_test.") + 3 * sizeof(pid_t)];
+  sprintf(name, "/minheap_test.%d", (int)getpid());
+  SharedHeap* s = createSharedHeap(name, TEST_CAPACITY, NULL);
+  if (s == NULL) return failure("createSharedHeap failed");
+  Model* model = newModel(TEST_CAPACITY);
+  const char* error = NULL;
+  for (int i = 0; error == NULL && i < TEST_CAPACITY / 2; i++) {
+    int id = absentId(model, &seed);
+    int priority = nextRandom(&seed) % PRIORITY_RANGE;
+    if (!sharedInsert(s, priority, id)) error = failure("sharedInsert failed");
+    modelInsert(model, priority, id);
+  }
+
+  pid_t child = error == NULL ? fork() : -1;
+  if (child == 0) {
+    // As swap would leave the root and a leaf: both hold the leaf's node
+    SharedHeap* view = openSharedHeap(name);
+    if (view == NULL) _exit(2);
+    SharedHeapHeader* header = view->header;
+    if (pthread_mutex_lock(&header->lock) != 0) _exit(3);
+    int leaf = header->size;
+    HeapSwap* swapping = &header->swapping;
+    *swapping = (HeapSwap){0, ROOT_INDEX, leaf,
+                           *nodePtr(view->heap, ROOT_INDEX),
+                           *nodePtr(view->heap, leaf)};
+    swapping->active = 1;
+    *nodePtr(view->heap, ROOT_INDEX) = swapping->node2;
+    _exit(0);  // still holding the lock
+  }
+  int status;
+  if (error == NULL &&
+      (child < 0 || waitpid(child, &status, 0) != child ||
+       !WIFEXITED(status) || WEXITSTATUS(status) != 0))
+    error = failure("the child failed before its crash");
+  if (error == NULL && sharedNumNodes(s) != model->count)
+    error = failure("sharedNumNodes is %d after the repair, not %d",
+                    sharedNumNodes(s), model->count);
+  if (error == NULL) error = checkHeap(s->heap, model);
+  deleteModel(model);
+  closeSharedHeap(s);
+  unlinkSharedHeap(name);
+  return error;
+}
+
+int testShared(unsigned int seed, const char* directory) {
+  (void)directory;
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++)
+    failures += !report("shared", configs[c].name,
+                        checkSharedHeap(&configs[c].options, seed + c));
+  failures += !report("shared", "half swap", checkHalfSwap(seed));
+  return failures;
+}
+
+/*********************************************************************
+ * The server
+ ********************************************************************/
+
+/* Sets 'path', of PATH_MAX bytes, to that of program 'name' built next to
+ * minheap_test. Returns False if it cannot be run.
+ */
+bool programPath(const char* name, char* path) {
+  snprintf(path, PATH_MAX, "%s/%s", programs, name);
+  return access(path, X_OK) == 0;
+}
+
+/* Returns a socket connected to the server at 'socketPath', whose reads and
+ * writes give up after SERVER_TIMEOUT_S, or -1 on error.
+ */
+int connectServer(const char* socketPath) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+  strcpy(address.sun_path, socketPath);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct timeval timeout = {.tv_sec = SERVER_TIMEOUT_S};
+  if (fd >= 0 &&
+      (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+       setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0 ||
+       connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Writes the 'bytes' bytes at 'data' to 'fd'. Returns False on error.
+ */
+bool sendAll(int fd, const void* data, size_t bytes) {
+  const char* next = data;
+  while (bytes > 0) {
+    ssize_t n = write(fd, next, bytes);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    next += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/* Reads exactly 'bytes' bytes from 'fd' into 'data'. Returns False on error,
+ * timeout or end of file.
+ */
+bool receiveAll(int fd, void* data, size_t bytes) {
+  char* next = data;
+  while (bytes > 0) {
+    ssize_t n = read(fd, next, bytes);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    next += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/* Run by a thread: writes the frames of the ServerWriter 'arg'.
+ */
+void* serverWriter(void* arg) {
+  ServerWriter* writer = arg;
+  writer->written = sendAll(writer->fd, writer->frames, writer->bytes);
+  return NULL;
+}
+
+/* Returns NULL if 'response' answers the request tagged 'tag' with status
+ * HEAP_STATUS_OK, 'count' nodes and a queue of 'size', or else what is
+ * wrong with it.
+ */
+const char* checkResponse(HeapResponse* response, uint32_t tag, int count,
+                          int size) {
+  if (response->tag != tag)
+    return failure("response tagged %u, not %u", response->tag, tag);
+  if (response->status != HEAP_STATUS_OK)
+    return failure("response %u has status %d", tag, response->status);
+  if (response->count != count || response->size != size)
+    return failure("response %u has %d nodes and size %d, not %d and %d", tag,
+                   response->count, response->size, count, size);
+  return NULL;
+}
+
+/* Pipelines SERVER_FRAMES insert frames of the largest batch to the server
+ * at 'socketPath', then as many extractMin frames, from a thread, while the
+ * client reads their responses only after SERVER_LAG_US. The extractMins,
+ * a few bytes each, ask for more output than the server buffers. Returns
+ * NULL if every response comes back in order and the extractMins take out
+ * every node inserted, sorted; or else what went wrong.
+ */
+const char* checkServerPipeline(const char* socketPath, unsigned int seed) {
+  int fd = connectServer(socketPath);
+  if (fd < 0) return failure("cannot connect to the server");
+  int capacity = SERVER_FRAMES * HEAP_SERVER_MAX_BATCH;
+  size_t insertBytes =
+      sizeof(HeapRequest) + HEAP_SERVER_MAX_BATCH * sizeof(HeapNode);
+  size_t bytes = sizeof(HeapRequest) +
+                 SERVER_FRAMES * (insertBytes + sizeof(HeapRequest));
+  unsigned char* frames = malloc(bytes);
+  int* priorities = malloc(capacity * sizeof(int));
+  bool* seen = calloc(capacity, sizeof(bool));
+  HeapNode* out = malloc(HEAP_SERVER_MAX_BATCH * sizeof(HeapNode));
+
+  // The queue, then the inserts, then the extractMins, tagged in order
+  unsigned char* next = frames;
+  *(HeapRequest*)next = (HeapRequest){sizeof(HeapRequest), HEAP_OP_CREATE, 0,
+                                      0, capacity, 0};
+  next += sizeof(HeapRequest);
+  for (int f = 0; f < SERVER_FRAMES; f++) {
+    *(HeapRequest*)next = (HeapRequest){insertBytes, HEAP_OP_INSERT,
+                                        HEAP_SERVER_MAX_BATCH, 0, 0, f + 1};
+    HeapNode* nodes = (HeapNode*)(next + sizeof(HeapRequest));
+    for (int j = 0; j < HEAP_SERVER_MAX_BATCH; j++) {
+      int id = f * HEAP_SERVER_MAX_BATCH + j;
+      priorities[id] = nextRandom(&seed) % PRIORITY_RANGE;
+      nodes[j] = (HeapNode){priorities[id], id};
+    }
+    next += insertBytes;
+  }
+  for (int f = 0; f < SERVER_FRAMES; f++) {
+    *(HeapRequest*)next =
+        (HeapRequest){sizeof(HeapRequest), HEAP_OP_EXTRACT_MIN, 0, 0,
+                      HEAP_SERVER_MAX_BATCH, SERVER_FRAMES + f + 1};
+    next += sizeof(HeapRequest);
+  }
+
+  ServerWriter writer = {fd, frames, bytes, false};
+  pthread_t thread;
+  const char* error = NULL;
+  bool started = pthread_create(&thread, NULL, serverWriter, &writer) == 0;
+  if (!started) error = failure("cannot start the writer");
+  usleep(SERVER_LAG_US);
+
+  HeapResponse response;
+  for (uint32_t tag = 0; error == NULL && tag <= SERVER_FRAMES; tag++) {
+    int count = tag == 0 ? 0 : HEAP_SERVER_MAX_BATCH;
+    if (!receiveAll(fd, &response, sizeof(response)))
+      error = failure("no response to frame %u", tag);
+    else
+      error = checkResponse(&response, tag, count, tag * count);
+  }
+  int last = INT_MIN;
+  for (int f = 0; error == NULL && f < SERVER_FRAMES; f++) {
+    uint32_t tag = SERVER_FRAMES + f + 1;
+    if (!receiveAll(fd, &response, sizeof(response)))
+      error = failure("no response to frame %u", tag);
+    if (error == NULL)
+      error = checkResponse(&response, tag, HEAP_SERVER_MAX_BATCH,
+                            capacity - (f + 1) * HEAP_SERVER_MAX_BATCH);
+    if (error == NULL &&
+        (response.bytes !=
+             sizeof(response) + HEAP_SERVER_MAX_BATCH * sizeof(HeapNode) ||
+         !receiveAll(fd, out, HEAP_SERVER_MAX_BATCH * sizeof(HeapNode))))
+      error = failure("cannot read the nodes of frame %u", tag);
+
+    for (int j = 0; error == NULL && j < HEAP_SERVER_MAX_BATCH; j++) {
+      int id = out[j].id;
+      if (id < 0 || id >= capacity || seen[id])
+        error = failure("frame %u took out ID %d twice or out of range", tag,
+                        id);
+      else if (out[j].priority != priorities[id])
+        error = failure("frame %u took out ID %d with priority %d, not %d",
+                        tag, id, out[j].priority, priorities[id]);
+      else if (out[j].priority < last)
+        error = failure("frame %u took out priority %d after %d", tag,
+                        out[j].priority, last);
+      else
+        seen[id] = true;
+      last = out[j].priority;
+    }
+  }
+  // Shutting the socket down first lets a writer stuck on a server gone
+  // wrong give up
+  shutdown(fd, SHUT_RDWR);
+  if (started) pthread_join(thread, NULL);
+  if (error == NULL && !writer.written)
+    error = failure("the server stopped taking frames");
+  close(fd);
+  free(frames);
+  free(priorities);
+  free(seen);
+  free(out);
+  return error;
+}
+
+/* Sends malformed frames to the server at 'socketPath', each on a
+ * connection of its own. Returns NULL if the server closes each such
+ * connection and still answers on a new one, or else what went wrong.
+ */
+const char* checkServerMalformed(const char* socketPath) {
+  HeapRequest malformed[] = {
+      {sizeof(HeapRequest) + 2, HEAP_OP_SIZE, 0, 0, 0, 0},  // not 4-aligned
+      {sizeof(HeapRequest), HEAP_OP_SIZE + 1, 0, 0, 0, 0},  // no such op
+      {sizeof(HeapRequest), HEAP_OP_INSERT, 1, 0, 0, 0},    // its node missing
+  };
+  int numMalformed = sizeof(malformed) / sizeof(malformed[0]);
+  for (int m = 0; m < numMalformed; m++) {
+    int fd = connectServer(socketPath);
+    if (fd < 0) return failure("cannot connect to the server");
+    HeapRequest frame[2] = {malformed[m]};  // room for a misaligned tail
+    char byte;
+    bool closed =
+        sendAll(fd, frame, malformed[m].bytes) && read(fd, &byte, 1) == 0;
+    close(fd);
+    if (!closed) return failure("malformed frame %d was not refused", m);
+  }
+
+  int fd = connectServer(socketPath);
+  if (fd < 0) return failure("cannot connect to the server");
+  HeapRequest size = {sizeof(HeapRequest), HEAP_OP_SIZE, 0, 0, 0, 7};
+  HeapResponse response;
+  const char* error = NULL;
+  if (!sendAll(fd, &size, sizeof(size)) ||
+      !receiveAll(fd, &response, sizeof(response)))
+    error = failure("the server did not answer after malformed frames");
+  else
+    error = checkResponse(&response, 7, 0, 0);
+  close(fd);
+  return error;
+}
+
+int testServer(unsigned int seed, const char* directory) {
+  char server[PATH_MAX];
+  if (!programPath("minheap_server", server))
+    return !report("server", "start", failure("build %s to test it", server));
+  char socketPath[strlen(directory) + sizeof("/server.sock")];
+  sprintf(socketPath, "%s/server.sock", directory);
+
+  fflush(stdout);  // or the server prints it again
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stdout) == NULL) _exit(126);  // counters
+    execl(server, server, socketPath, (char*)NULL);
+    _exit(127);
+  }
+  int fd = -1;
+  for (int r = 0; pid > 0 && fd < 0 && r < SERVER_START_RETRIES; r++)
+    if ((fd = connectServer(socketPath)) < 0) usleep(SERVER_START_US);
+  if (fd < 0) {
+    if (pid > 0) {
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+    }
+    return !report("server", "start", failure("%s did not start", server));
+  }
+  close(fd);
+
+  int failures = 0;
+  failures +=
+      !report("server", "pipeline", checkServerPipeline(socketPath, seed));
+  failures +=
+      !report("server", "malformed", checkServerMalformed(socketPath));
+  int status;
+  const char* error = NULL;
+  if (kill(pid, SIGTERM) != 0 || waitpid(pid, &status, 0) != pid ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    error = failure("the server did not exit cleanly");
+  failures += !report("server", "shutdown", error);
+  return failures;
+}
+
+/*********************************************************************
+ * minheap_sort
+ ********************************************************************/
+
+/* Runs the program at 'path' with the arguments 'args' (NULL-terminated,
+ * after the program's own name), stdin from the file at 'in' (NULL for none)
+ * and stdout to the file at 'out'. Returns its exit status, or -1 if it
+ * could not be run or did not exit.
+ */
+int runProgram(const char* path, const char* args[], const char* in,
+               const char* out) {
+  int numArgs = 0;
+  while (args[numArgs] != NULL) numArgs++;
+  char* argv[numArgs + 2];
+  argv[0] = (char*)path;
+  for (int a = 0; a <= numArgs; a++) argv[a + 1] = (char*)args[a];
+
+  fflush(stdout);  // or the child prints it again
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (freopen(in == NULL ? "/dev/null" : in, "r", stdin) == NULL ||
+        freopen(out, "w", stdout) == NULL ||
+        freopen("/dev/null", "w", stderr) == NULL)
+      _exit(126);
+    execv(path, argv);
+    _exit(127);
+  }
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+    return -1;
+  return WEXITSTATUS(status);
+}
+
+/* Returns NULL if the file at 'path' holds the 'n' integers 'expected', one
+ * per line, and nothing else; or else where it first differs.
+ */
+const char* checkLines(const char* path, const int* expected, long n) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return failure("cannot read %s", path);
+  const char* error = NULL;
+  int value;
+  long i = 0;
+  for (; error == NULL && fscanf(file, "%d", &value) == 1; i++)
+    if (i >= n || value != expected[i])
+      error = failure("line %ld is %d, not %d", i + 1, value,
+                      i < n ? expected[i] : 0);
+  if (error == NULL && (!feof(file) || i != n))
+    error = failure("%ld lines, not %ld", i, n);
+  fclose(file);
+  return error;
+}
+
+/* Has minheap_sort, at 'sort', sort random priorities, extremes included,
+ * from a text file, a binary file and stdin together, with --header.
+ * Returns NULL if it writes them all in order, or else what went wrong.
+ */
+const char* checkSortInputs(const char* sort, const char* directory,
+                            unsigned int seed) {
+  char paths[3][strlen(directory) + sizeof("/sort.in2")];
+  char out[strlen(directory) + sizeof("/sort.out")];
+  for (int p = 0; p < 3; p++) sprintf(paths[p], "%s/sort.in%d", directory, p);
+  sprintf(out, "%s/sort.out", directory);
+
+  int* values = malloc(sizeof(int) * 3 * TEST_CAPACITY);
+  const char* error = NULL;
+  for (int p = 0; error == NULL && p < 3; p++) {
+    int* mine = values + p * TEST_CAPACITY;
+    for (int i = 0; i < TEST_CAPACITY; i++)
+      mine[i] = i == p ? (p == 0 ? INT_MIN : INT_MAX) : (int)nextRandom(&seed);
+    if (p == 1) {
+      if (!writeHeapInput(paths[p], TEST_CAPACITY, mine, TEST_CAPACITY))
+        error = failure("cannot write %s", paths[p]);
+      continue;
+    }
+    // The capacity first, for --header to skip
+    FILE* text = fopen(paths[p], "w");
+    if (text != NULL) fprintf(text, "%d", TEST_CAPACITY);
+    for (int i = 0; text != NULL && i < TEST_CAPACITY; i++)
+      fprintf(text, i % 7 == 0 ? "\n%d" : " %d", mine[i]);
+    if (text == NULL || fclose(text) != 0)
+      error = failure("cannot write %s", paths[p]);
+  }
+  const char* args[] = {"--header", paths[0], paths[1], "-", NULL};
+  if (error == NULL && runProgram(sort, args, paths[2], out) != 0)
+    error = failure("minheap_sort failed");
+  if (error == NULL) {
+    qsort(values, 3 * TEST_CAPACITY, sizeof(int), compareInts);
+    error = checkLines(out, values, 3 * TEST_CAPACITY);
+  }
+  free(values);
+  return error;
+}
+
+/* Has minheap_sort, at 'sort', sort SORT_SPILL_VALUES random priorities
+ * from a binary file in a budget of 1 MiB, so that it spills runs and
+ * merges some of them into another before the last merge; then keep the
+ * SORT_K smallest, and none. Returns NULL if each writes what it should,
+ * or else what went wrong.
+ */
+const char* checkSortSpill(const char* sort, const char* directory,
+                           unsigned int seed) {
+  char in[strlen(directory) + sizeof("/sort.in")];
+  char out[strlen(directory) + sizeof("/sort.out")];
+  sprintf(in, "%s/sort.in", directory);
+  sprintf(out, "%s/sort.out", directory);
+
+  int* values = malloc(sizeof(int) * SORT_SPILL_VALUES);
+  for (int i = 0; i < SORT_SPILL_VALUES; i++)
+    values[i] = (int)nextRandom(&seed) % PRIORITY_RANGE;  // with many ties
+  const char* error = NULL;
+  if (!writeHeapInput(in, SORT_SPILL_VALUES, values, SORT_SPILL_VALUES))
+    error = failure("cannot write %s", in);
+  qsort(values, SORT_SPILL_VALUES, sizeof(int), compareInts);
+
+  char k[16];
+  sprintf(k, "%d", SORT_K);
+  const char* runs[][4] = {
+      {"--memory", "1", in, NULL},
+      {"--k", k, in, NULL},
+      {"--k", "0", in, NULL},
+  };
+  long expected[] = {SORT_SPILL_VALUES, SORT_K, 0};
+  for (int r = 0; error == NULL && r < 3; r++) {
+    if (runProgram(sort, runs[r], NULL, out) != 0)
+      error = failure("minheap_sort %s %s failed", runs[r][0], runs[r][1]);
+    else
+      error = during("run", r, checkLines(out, values, expected[r]));
+  }
+  free(values);
+  return error;
+}
+
+/* Returns NULL if minheap_sort, at 'sort', fails on malformed text, a
+ * truncated binary file and a missing file, or else the first it took.
+ */
+const char* checkSortMalformed(const char* sort, const char* directory) {
+  char in[strlen(directory) + sizeof("/sort.in")];
+  char out[strlen(directory) + sizeof("/sort.out")];
+  sprintf(in, "%s/sort.in", directory);
+  sprintf(out, "%s/sort.out", directory);
+  const char* args[] = {in, NULL};
+
+  if (!writeFile(in, "1 2x 3\n")) return failure("cannot write %s", in);
+  if (runProgram(sort, args, NULL, out) == 0)
+    return failure("malformed text was sorted");
+  int values[] = {3, 1, 2};
+  if (!writeHeapInput(in, 3, values, 3) ||
+      truncate(in, sizeof(HeapInputHeader) + 2 * sizeof(int)) != 0)
+    return failure("cannot write %s", in);
+  if (runProgram(sort, args, NULL, out) == 0)
+    return failure("a truncated binary file was sorted");
+  unlink(in);
+  if (runProgram(sort, args, NULL, out) == 0)
+    return failure("a missing file was sorted");
+  return NULL;
+}
+
+int testSort(unsigned int seed, const char* directory) {
+  char sort[PATH_MAX];
+  if (!programPath("minheap_sort", sort))
+    return !report("sort", "start", failure("build %s to test it", sort));
+  int failures = 0;
+  failures +=
+      !report("sort", "inputs", checkSortInputs(sort, directory, seed));
+  emptyDirectory(directory);
+  failures += !report("sort", "spill and top k",
+                      checkSortSpill(sort, directory, seed));
+  emptyDirectory(directory);
+  failures += !report("sort", "malformed", checkSortMalformed(sort, directory));
+  return failures;
+}
+
+/*********************************************************************
+ * Heap dumps
+ ********************************************************************/
+
+/* Dumps 'heap' into memory, with dumpHeapChanges if 'changes' and dumpHeap
+ * otherwise, and returns the text (to be freed), or NULL on error.
+ */
+char* dumpToMemory(MinHeap* heap, bool changes) {
+  char* text = NULL;
+  size_t bytes = 0;
+  FILE* out = open_memstream(&text, &bytes);
+  if (out == NULL) return NULL;
+  if (changes) dumpHeapChanges(heap, out);
+  else dumpHeap(heap, out);
+  if (fclose(out) != 0) {
+    free(text);
+    return NULL;
+  }
+  return text;
+}
+
+/* Returns NULL if 'text' is a dump of 'heap' (dumpHeapChanges if 'changes')
+ * whose every node is where 'heap' has it, that lists every ID moved,
+ * changed, added or removed since 'dumpedIndex' and 'dumpedPriority' (the
+ * index, or NOTHING, and priority of each ID at the last dump), and whose
+ * changes are in increasing order of ID; or else the first thing wrong.
+ */
+const char* checkDump(MinHeap* heap, char* text, bool changes,
+                      const int* dumpedIndex, const int* dumpedPriority) {
+  int size, capacity;
+  char* line = strtok(text, "\n");
+  if (line == NULL || sscanf(line, "MinHeap with size: %d", &size) != 1 ||
+      size != heap->size || (line = strtok(NULL, "\n")) == NULL ||
+      sscanf(line, "\tcapacity: %d", &capacity) != 1 ||
+      capacity != heap->capacity)
+    return failure("the dump does not start with the size and capacity");
+  if (changes && ((line = strtok(NULL, "\n")) == NULL ||
+                  strcmp(line, "changed since the last dump:") != 0))
+    return failure("the dump does not say it holds changes");
+  if ((line = strtok(NULL, "\n")) == NULL ||
+      strcmp(line, "index: priority [ID]") != 0)
+    return failure("the dump has no column headings");
+
+  bool* listed = calloc(heap->capacity, sizeof(bool));
+  const char* error = NULL;
+  int i = ROOT_INDEX, lastId = NOTHING;
+  while (error == NULL && (line = strtok(NULL, "\n")) != NULL) {
+    int nodeIndex, priority, id, end = 0;
+    if (!changes && i == heap->size + 1 && strcmp(line, "buffered:") == 0)
+      continue;
+    if (changes && sscanf(line, "removed [%d]%n", &id, &end) == 1 &&
+        line[end] == '\0') {
+      if (id <= lastId || id >= heap->capacity || holdsId(heap, id))
+        error = failure("\"%s\" is out of order or still held", line);
+      else
+        listed[lastId = id] = true;
+      continue;
+    }
+    if (sscanf(line, "%d: %d [%d]%n", &nodeIndex, &priority, &id, &end) != 3)
+      error = failure("\"%s\" is not a node", line);
+    else if (!changes && nodeIndex != i++)
+      error = failure("\"%s\" is not node %d", line, i - 1);
+    else if (nodeIndex < ROOT_INDEX || nodeIndex > numNodes(heap) ||
+             idAt(heap, nodeIndex) != id ||
+             priorityAt(heap, nodeIndex) != priority)
+      error = failure("\"%s\" is not where the heap has it", line);
+    else if (changes &&
+             (id <= lastId ||
+              strcmp(line + end, nodeIndex > heap->size ? " buffered" : "")))
+      error = failure("\"%s\" is out of order or misses \"buffered\"", line);
+    else
+      listed[lastId = id] = true;
+  }
+  if (error == NULL && !changes && i != numNodes(heap) + 1)
+    error = failure("the dump has %d nodes, not %d", i - 1, numNodes(heap));
+
+  for (int id = 0; error == NULL && id < heap->capacity; id++) {
+    int nodeIndex = holdsId(heap, id) ? indexOf(heap, id) : NOTHING;
+    bool changed = nodeIndex != dumpedIndex[id] ||
+                   (nodeIndex != NOTHING &&
+                    priorityAt(heap, nodeIndex) != dumpedPriority[id]);
+    if (changes && changed && !listed[id])
+      error = failure("ID %d changed, but is not in the dump", id);
+  }
+  free(listed);
+  return error;
+}
+
+/* Runs DUMP_ROUNDS rounds of random operations on a heap configured by
+ * 'options' that tracks its writes, each ending in a dump: mostly of the
+ * changes, now and then in full, and once after buildHeapParallel.
+ * Returns NULL if every dump is right and leaves the record of writes as
+ * it was, or else what went wrong.
+ */
+const char* checkDumps(HeapOptions* options, unsigned int seed) {
+  MinHeap* heap = newHeapWithOptions(TEST_CAPACITY, options);
+  if (heap == NULL) return failure("newHeapWithOptions failed");
+  Model* model = newModel(TEST_CAPACITY);
+  Snapshot snapshot = {
+      malloc(sizeof(HeapNode) * heap->arrSlots),
+      malloc(sizeof(int) * heap->capacity),
+      malloc(heap->payloadSize * heap->capacity + 1),
+  };
+  int* dumpedIndex = malloc(sizeof(int) * TEST_CAPACITY);
+  int* dumpedPriority = malloc(sizeof(int) * TEST_CAPACITY);
+  for (int id = 0; id < TEST_CAPACITY; id++) dumpedIndex[id] = NOTHING;
+  startTrackingWrites(heap);
+  takeSnapshot(heap, &snapshot);
+
+  const char* error = NULL;
+  for (int round = 0; error == NULL && round < DUMP_ROUNDS; round++) {
+    if (round == DUMP_ROUNDS / 2) {
+      // Everything anew, on several threads
+      int n = TEST_CAPACITY / 2;
+      int priorities[n], ids[n];
+      memset(model->held, 0, sizeof(bool) * TEST_CAPACITY);
+      model->count = 0;
+      model->lastId = NOTHING;
+      fillModel(model, n, priorities, ids, &seed);
+      buildHeapParallel(heap, priorities, ids, n, TOPK_THREADS);
+    }
+    int ops = nextRandom(&seed) % DUMP_OPS;
+    for (int i = 0; error == NULL && i < ops; i++)
+      error = randomOperation(heap, model, &seed);
+
+    // The first dump is always in full
+    bool changes = round % DUMP_FULL_EVERY != 0;
+    char* text = error == NULL ? dumpToMemory(heap, changes) : NULL;
+    if (error == NULL && text == NULL) error = failure("cannot dump");
+    if (error == NULL)
+      error = checkDump(heap, text, changes, dumpedIndex, dumpedPriority);
+    free(text);
+    if (error == NULL) error = checkWrites(heap, &snapshot);
+    if (error == NULL) error = checkHeap(heap, model);
+    error = during("round", round, error);
+
+    for (int id = 0; id < TEST_CAPACITY; id++) {
+      dumpedIndex[id] = holdsId(heap, id) ? indexOf(heap, id) : NOTHING;
+      if (dumpedIndex[id] != NOTHING)
+        dumpedPriority[id] = priorityAt(heap, dumpedIndex[id]);
+    }
+  }
+
+  free(snapshot.arr);
+  free(snapshot.indexMap);
+  free(snapshot.payload);
+  free(dumpedIndex);
+  free(dumpedPriority);
+  deleteModel(model);
+  deleteHeap(heap);
+  return error;
+}
+
+int testDump(unsigned int seed, const char* directory) {
+  (void)directory;
+  int failures = 0;
+  for (int c = 0; c < NUM_CONFIGS; c++)
+    failures += !report("dump", configs[c].name,
+                        checkDumps(&configs[c].options, seed + c));
+  return failures;
+}
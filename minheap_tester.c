@@ -1,60 +1,92 @@
 /*
  * Some light testing of our Minimum Heap implementation.
  *
+ * Usage: minheap_tester [-b script] [inputFile]
+ *
+ * Without -b, reads commands interactively from stdin. With -b, runs the
+ * command script 'script' ("-" for stdin) with no prompts or reports; see
+ * batchHeap. 'inputFile' is a text or binary input file, as read by
+ * loadHeapFromFile (see heapio.h).
+ *
+ * Build with:
+ *   gcc -O2 -pthread minheap_tester.c minheap.c heapalloc.c heapio.c \
+ *       -o minheap_tester
+ *
  * Author: A. Tafliovich. This file heavily borrows from A1 tester file, which
  * was originally developed by F. Estrada.
  */
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "heapio.h"
 #include "minheap.h"
 
 #define MAX_LIMIT 1024
 #define DEFAULT_CAPACITY 50
+#define INITIAL_SCRIPT_CAPACITY 1024
 
-MinHeap* createHeap(FILE* f);
+typedef struct command {
+  char op;  // 'g', 'e', 'i' or 'd'
+  int arg1;  // priority for 'i', ID for 'd'
+  int arg2;  // ID for 'i', new priority for 'd'
+} Command;
+
+MinHeap* createHeap(const char* path, bool verbose);
 void testHeap(MinHeap* heap);
+void batchHeap(MinHeap* heap, FILE* script);
 void printHeapReport(MinHeap* heap);
 
 int main(int argc, char* argv[]) {
   MinHeap* heap = NULL;
+  char* scriptName = NULL;
+
+  if (argc > 2 && strcmp(argv[1], "-b") == 0) {
+    scriptName = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
 
   // If user specified a file for reading, create a heap with priorities from it.
   if (argc > 1) {
-    FILE* f = fopen(argv[1], "r");
-    if (f == NULL) {
-      fprintf(stderr, "Unable to open the specified input file: %s\n", argv[1]);
+    heap = createHeap(argv[1], scriptName == NULL);
+    if (heap == NULL) {
+      fprintf(stderr, "Unable to read the specified input file: %s\n", argv[1]);
       exit(0);
     }
-    heap = createHeap(f);
-    fclose(f);
   } else {
-    printf("You did not specify an input file.");
-    printf(" We will start with an empty heap of default capacity %d.\n",
-           DEFAULT_CAPACITY);
+    if (scriptName == NULL) {
+      printf("You did not specify an input file.");
+      printf(" We will start with an empty heap of default capacity %d.\n",
+             DEFAULT_CAPACITY);
+    }
     heap = newHeap(DEFAULT_CAPACITY);
   }
 
-  testHeap(heap);
+  if (scriptName == NULL) {
+    testHeap(heap);
+    return 0;
+  }
+
+  FILE* script = strcmp(scriptName, "-") == 0 ? stdin : fopen(scriptName, "r");
+  if (script == NULL) {
+    fprintf(stderr, "Unable to open the specified script: %s\n", scriptName);
+    exit(0);
+  }
+  batchHeap(heap, script);
+  if (script != stdin) fclose(script);
   return 0;
 }
 
-MinHeap* createHeap(FILE* f) {
-  char line[MAX_LIMIT];
-
-  // Create a new Heap with given capacity (must be first line in file)
-  fgets(line, MAX_LIMIT, f);
-  int capacity = atoi(line);
-  printf("Creating Heap with capacity %d...\n", capacity);
-  MinHeap* heap = newHeap(capacity);
-
-  int priority = 0;
-  int id = 0;
-  while (fgets(line, MAX_LIMIT, f)) {  // read the next line
-    priority = atoi(line);
-    printf("read %d\n", priority);
-    insert(heap, priority, id++);  // assign IDs sequentially
+MinHeap* createHeap(const char* path, bool verbose) {
+  // The capacity comes first in the file, then the priorities, which get
+  // IDs sequentially and are heapified all at once
+  MinHeap* heap = loadHeapFromFile(path, NULL);
+  if (heap != NULL && verbose) {
+    printf("Created Heap with capacity %d from %d priorities.\n",
+           heap->capacity, numNodes(heap));
     printHeapReport(heap);
   }
   return heap;
@@ -68,16 +100,19 @@ void testHeap(MinHeap* heap) {
 
   while (1) {
     printf("Choose a command: (g)et-min, (e)xtract-min, (i)nsert, ");
-    printf("(d)ecrease-priority, (q)uit\n");
+    printf("(d)ecrease-priority, (p)rint, (q)uit\n");
     fgets(line, MAX_LIMIT, stdin);
     if (line[0] == 'q') {  // quit
       printf("quit selected. Goodbye!\n");
       deleteHeap(heap);
       return;
     }
-    if (line[0] == 'g') {  // get-min
+    if (line[0] == 'p') {  // print
+      printf("print selected.\n");
+      dumpHeap(heap, stdout);
+    } else if (line[0] == 'g') {  // get-min
       printf("get-min selected.\n");
-      if (heap->size == 0) {
+      if (numNodes(heap) == 0) {
         printf("Heap is empty: can't get min. Choose another command.\n");
         continue;
       }
@@ -86,7 +121,7 @@ void testHeap(MinHeap* heap) {
              node.id);
     } else if (line[0] == 'e') {  // extract-min
       printf("extract-min selected.\n");
-      if (heap->size == 0) {
+      if (numNodes(heap) == 0) {
         printf("Heap is empty: can't extract min. Choose another command.\n");
         continue;
       }
@@ -95,7 +130,7 @@ void testHeap(MinHeap* heap) {
              node.id);
       printHeapReport(heap);
     } else if (line[0] == 'i') {  // insert
-      if (heap->size == heap->capacity) {
+      if (numNodes(heap) == heap->capacity) {
 	printf("Heap is full: can't insert. Choose another command.\n");
 	continue;
       }
@@ -105,6 +140,11 @@ void testHeap(MinHeap* heap) {
       printf("Enter ID for this node (must be unique and 0 <= id < capacity): ");
       fgets(line, MAX_LIMIT, stdin);
       id = atoi(line);
+      if (id < 0 || id >= heap->capacity || holdsId(heap, id)) {
+        printf("ID %d is out of range or in use. No change has been made.\n",
+               id);
+        continue;
+      }
       insert(heap, priority, id);
       printHeapReport(heap);
     } else if (line[0] == 'd') {  // decrease-priority
@@ -124,8 +164,99 @@ void testHeap(MinHeap* heap) {
   }
 }
 
+/* Runs the commands of 'script' on 'heap', one per line:
+ *   g          get-min
+ *   e          extract-min
+ *   i p id     insert priority p with ID id
+ *   d id p     decrease priority of ID id to p
+ *   q          quit (as does the end of the script)
+ * Other lines are ignored. The whole script is read before the clock starts,
+ * and nothing is printed until it stops: then one line per get-min and
+ * extract-min ("priority id", or "empty"), one per insert into a full heap
+ * ("full") or with an ID out of range or in use ("bad"; the insert is
+ * skipped), then a summary with the timing on lines starting with '#'.
+ */
+void batchHeap(MinHeap* heap, FILE* script) {
+  char line[MAX_LIMIT];
+  int numCommands = 0;
+  int capacity = INITIAL_SCRIPT_CAPACITY;
+  Command* commands = malloc(sizeof(Command) * capacity);
+
+  while (fgets(line, MAX_LIMIT, script) && line[0] != 'q') {
+    Command command = {line[0], 0, 0};
+    if (command.op != 'g' && command.op != 'e' && command.op != 'i' &&
+        command.op != 'd')
+      continue;
+    char* end;
+    command.arg1 = strtol(line + 1, &end, 10);
+    command.arg2 = strtol(end, NULL, 10);
+    if (numCommands == capacity) {
+      capacity *= 2;
+      commands = realloc(commands, sizeof(Command) * capacity);
+    }
+    commands[numCommands++] = command;
+  }
+
+  // Results go into a buffer as large as the script, so none is printed
+  // while the clock runs
+  HeapNode* results = malloc(sizeof(HeapNode) * (numCommands + 1));
+  int numResults = 0;
+  int numDecreased = 0, numDecreases = 0;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int c = 0; c < numCommands; c++) {
+    Command* command = &commands[c];
+    if (command->op == 'g' || command->op == 'e') {
+      if (numNodes(heap) == 0) {
+        results[numResults++] = (HeapNode){0, -1};  // ID -1 marks "empty"
+      } else {
+        results[numResults++] =
+            command->op == 'g' ? getMin(heap) : extractMin(heap);
+      }
+    } else if (command->op == 'i') {
+      if (numNodes(heap) == heap->capacity) {
+        results[numResults++] = (HeapNode){0, -2};  // ID -2 marks "full"
+      } else if (command->arg2 < 0 || command->arg2 >= heap->capacity ||
+                 holdsId(heap, command->arg2)) {
+        results[numResults++] = (HeapNode){0, -3};  // ID -3 marks "bad"
+      } else {
+        insert(heap, command->arg1, command->arg2);
+      }
+    } else {
+      numDecreases++;
+      numDecreased += decreasePriority(heap, command->arg1, command->arg2);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  for (int r = 0; r < numResults; r++) {
+    if (results[r].id == -1)
+      printf("empty\n");
+    else if (results[r].id == -2)
+      printf("full\n");
+    else if (results[r].id == -3)
+      printf("bad\n");
+    else
+      printf("%d %d\n", results[r].priority, results[r].id);
+  }
+  printf("# %d commands in %.6f s (%.1f ns/command)\n", numCommands, elapsed,
+         numCommands > 0 ? elapsed * 1e9 / numCommands : 0.0);
+  printf("# %d of %d decrease-priority commands applied; %d nodes left\n",
+         numDecreased, numDecreases, numNodes(heap));
+
+  free(results);
+  free(commands);
+  deleteHeap(heap);
+}
+
+/* Prints what changed in 'heap' since the last report (the whole heap, the
+ * first time); (p)rint shows the whole heap again.
+ */
 void printHeapReport(MinHeap* heap) {
   printf("** The heap is now:\n");
-  printHeap(heap);
+  dumpHeapChanges(heap, stdout);
   printf("**\n");
 }
@@ -0,0 +1,436 @@
+/*
+ * Template for variants of our Priority Queue whose index, ID or priority
+ * type differs from MinHeap's int. Include it once per variant, after
+ * defining:
+ *
+ *   HEAP_VARIANT_TYPE      name of the heap type, e.g. MinHeap16
+ *   HEAP_VARIANT_NODE      name of its node type, e.g. HeapNode16
+ *   HEAP_VARIANT_PREFIX    prefix of its functions, e.g. minHeap16 gives
+ *                          minHeap16Insert, ...; newMinHeap16 and
+ *                          deleteMinHeap16 are named after HEAP_VARIANT_TYPE
+ *   HEAP_VARIANT_INDEX     integer type of its sizes, indices and IDs
+ *   HEAP_VARIANT_MAX_CAPACITY  the largest capacity that type can index
+ *
+ * and optionally:
+ *
+ *   HEAP_VARIANT_PRIORITY  type of its priorities; int by default
+ *   HEAP_VARIANT_KEY       integer type priorities are stored and compared
+ *                          as; HEAP_VARIANT_PRIORITY by default
+ *   HEAP_VARIANT_ENCODE(priority), HEAP_VARIANT_DECODE(key)
+ *                          convert between the two; the identity by default.
+ *                          ENCODE must be a bijection that preserves order,
+ *                          so that priorities round-trip exactly
+ *   HEAP_VARIANT_STABLE    if defined, nodes of equal priority leave in the
+ *                          order they were inserted. Keys are then 64-bit
+ *                          and ENCODE must leave their low 32 bits clear:
+ *                          these hold an insertion sequence number, so
+ *                          ordering still takes one compare per pair
+ *   HEAP_VARIANT_KEY_BITS  if defined, keys are stored in this many bits, as
+ *                          offsets of integer priorities from a base that
+ *                          follows the heap's minimum (see Rebase). Priorities
+ *                          in the heap must then span less than 2^KEY_BITS;
+ *                          one that lies further above the minimum saturates
+ *                          to base + 2^KEY_BITS - 1, so it still sorts last
+ *                          but reads back as that. Not combined with ENCODE
+ *                          or STABLE
+ *
+ * This declares the variant. Define HEAP_VARIANT_IMPLEMENTATION as well to
+ * define its functions, in exactly one translation unit. The parameters are
+ * undefined again at the end, ready for the next variant.
+ *
+ * The operations mirror those of MinHeap, with the same preconditions.
+ * Nodes are packed, so a narrow index also narrows every node.
+ */
+
+#include <stdint.h>
+
+#include "minheap.h"
+
+#define HEAP_VARIANT_PASTE_(a, b) a##b
+#define HEAP_VARIANT_PASTE(a, b) HEAP_VARIANT_PASTE_(a, b)
+#define HEAP_VARIANT_FN(name) HEAP_VARIANT_PASTE(HEAP_VARIANT_PREFIX, name)
+#define HEAP_VARIANT_ENTRY HEAP_VARIANT_PASTE(HEAP_VARIANT_TYPE, Entry)
+
+#ifndef HEAP_VARIANT_PRIORITY
+#define HEAP_VARIANT_PRIORITY int
+#endif
+#ifndef HEAP_VARIANT_KEY
+#define HEAP_VARIANT_KEY HEAP_VARIANT_PRIORITY
+#endif
+#ifndef HEAP_VARIANT_ENCODE
+#define HEAP_VARIANT_ENCODE(priority) (priority)
+#define HEAP_VARIANT_DECODE(key) (key)
+#endif
+
+typedef struct __attribute__((packed)) {
+  HEAP_VARIANT_PRIORITY priority;  // priority of this node
+  HEAP_VARIANT_INDEX id;  // the unique ID of this node; 0 <= id < capacity
+} HEAP_VARIANT_NODE;
+
+// A node as stored in arr: its priority encoded as a key
+typedef struct __attribute__((packed)) {
+#ifdef HEAP_VARIANT_KEY_BITS
+  HEAP_VARIANT_KEY key : HEAP_VARIANT_KEY_BITS;
+#else
+  HEAP_VARIANT_KEY key;
+#endif
+  HEAP_VARIANT_INDEX id;
+} HEAP_VARIANT_ENTRY;
+
+typedef struct {
+  HEAP_VARIANT_INDEX size;       // the number of nodes in this heap
+  HEAP_VARIANT_INDEX capacity;   // the number of nodes it can store
+  HEAP_VARIANT_ENTRY* arr;       // the nodes, from arr[1] (the root) on
+  HEAP_VARIANT_INDEX* indexMap;  // indexMap[id] is the index of the node
+                                 // with ID id; 0 if there is none
+#ifdef HEAP_VARIANT_STABLE
+  uint32_t sequence;  // the sequence number of the next key handed out
+#endif
+#ifdef HEAP_VARIANT_KEY_BITS
+  HEAP_VARIANT_PRIORITY base;  // the priority of a node is base + its key
+#endif
+} HEAP_VARIANT_TYPE;
+
+/* Returns the number of nodes in 'heap'.
+ */
+HEAP_VARIANT_INDEX HEAP_VARIANT_FN(NumNodes)(HEAP_VARIANT_TYPE* heap);
+
+/* Returns the node with minimum priority in 'heap'.
+ * Precondition: heap is non-empty
+ */
+HEAP_VARIANT_NODE HEAP_VARIANT_FN(GetMin)(HEAP_VARIANT_TYPE* heap);
+
+/* Removes and returns the node with minimum priority in 'heap'.
+ * Precondition: heap is non-empty
+ */
+HEAP_VARIANT_NODE HEAP_VARIANT_FN(ExtractMin)(HEAP_VARIANT_TYPE* heap);
+
+/* Inserts a new node with priority 'priority' and ID 'id' into 'heap'.
+ * Precondition: 'id' is unique within this heap
+ *               0 <= 'id' < heap->capacity
+ *               heap->size < heap->capacity
+ */
+void HEAP_VARIANT_FN(Insert)(HEAP_VARIANT_TYPE* heap,
+                             HEAP_VARIANT_PRIORITY priority,
+                             HEAP_VARIANT_INDEX id);
+
+/* Replaces the contents of 'heap' with the 'n' nodes whose priorities are
+ * 'priorities' and whose IDs are 0..n-1, in O(n).
+ * Precondition: 0 <= n <= heap->capacity
+ */
+void HEAP_VARIANT_FN(Build)(HEAP_VARIANT_TYPE* heap,
+                            HEAP_VARIANT_PRIORITY* priorities,
+                            HEAP_VARIANT_INDEX n);
+
+/* Returns priority of the node with ID 'id' in 'heap'.
+ * Precondition: 'id' is a valid node ID in 'heap'.
+ */
+HEAP_VARIANT_PRIORITY HEAP_VARIANT_FN(GetPriority)(HEAP_VARIANT_TYPE* heap,
+                                                   HEAP_VARIANT_INDEX id);
+
+/* Returns True if 'heap' holds a node with ID 'id', and False otherwise.
+ */
+bool HEAP_VARIANT_FN(HoldsId)(HEAP_VARIANT_TYPE* heap, HEAP_VARIANT_INDEX id);
+
+/* Sets priority of node with ID 'id' in 'heap' to 'newPriority', if such a
+ * node exists in 'heap' and its priority is larger than 'newPriority', and
+ * returns True. Has no effect and returns False, otherwise.
+ */
+bool HEAP_VARIANT_FN(DecreasePriority)(HEAP_VARIANT_TYPE* heap,
+                                       HEAP_VARIANT_INDEX id,
+                                       HEAP_VARIANT_PRIORITY newPriority);
+
+/* Returns a newly created empty heap with capacity 'capacity', or NULL if
+ * 'capacity' is out of range or memory runs out.
+ * Precondition: 0 <= capacity <= HEAP_VARIANT_MAX_CAPACITY
+ */
+HEAP_VARIANT_TYPE* HEAP_VARIANT_PASTE(new, HEAP_VARIANT_TYPE)(int64_t capacity);
+
+/* Frees all memory allocated for 'heap'.
+ */
+void HEAP_VARIANT_PASTE(delete, HEAP_VARIANT_TYPE)(HEAP_VARIANT_TYPE* heap);
+
+#ifdef HEAP_VARIANT_IMPLEMENTATION
+
+/* Returns the priority that 'key' stands for in 'heap'.
+ */
+static inline HEAP_VARIANT_PRIORITY HEAP_VARIANT_FN(PriorityOf)(
+    HEAP_VARIANT_TYPE* heap, HEAP_VARIANT_KEY key) {
+#ifdef HEAP_VARIANT_KEY_BITS
+  return (HEAP_VARIANT_PRIORITY)(heap->base + (int64_t)key);
+#else
+  (void)heap;
+  return HEAP_VARIANT_DECODE(key);
+#endif
+}
+
+/* Returns 'entry' of 'heap' as a node, with its key decoded back to a
+ * priority.
+ */
+static inline HEAP_VARIANT_NODE HEAP_VARIANT_FN(Decode)(
+    HEAP_VARIANT_TYPE* heap, HEAP_VARIANT_ENTRY entry) {
+  HEAP_VARIANT_NODE node = {HEAP_VARIANT_FN(PriorityOf)(heap, entry.key),
+                            entry.id};
+  return node;
+}
+
+/* Places 'node' at index 'nodeIndex' of 'heap', keeping indexMap in step.
+ */
+static inline void HEAP_VARIANT_FN(Place)(HEAP_VARIANT_TYPE* heap,
+                                          int64_t nodeIndex,
+                                          HEAP_VARIANT_ENTRY node) {
+  heap->arr[nodeIndex] = node;
+  heap->indexMap[node.id] = (HEAP_VARIANT_INDEX)nodeIndex;
+}
+
+#ifdef HEAP_VARIANT_STABLE
+/* Compares the keys of the entries at 'a' and 'b', for qsort.
+ */
+static int HEAP_VARIANT_FN(CompareEntries)(const void* a, const void* b) {
+  HEAP_VARIANT_KEY keyA = ((const HEAP_VARIANT_ENTRY*)a)->key;
+  HEAP_VARIANT_KEY keyB = ((const HEAP_VARIANT_ENTRY*)b)->key;
+  return (keyA > keyB) - (keyA < keyB);
+}
+
+/* Hands out sequence numbers 0 .. size-1 again, to the nodes of 'heap' in
+ * the order of their keys, so the sequence can go on without wrapping around.
+ * The nodes end up sorted, which is a valid heap. Takes O(n log n), once
+ * every 2^32 keys.
+ */
+static void HEAP_VARIANT_FN(Renumber)(HEAP_VARIANT_TYPE* heap) {
+  qsort(heap->arr + 1, heap->size, sizeof(HEAP_VARIANT_ENTRY),
+        HEAP_VARIANT_FN(CompareEntries));
+  for (int64_t i = 1; i <= heap->size; i++) {
+    HEAP_VARIANT_ENTRY node = heap->arr[i];
+    node.key = (node.key & ~(HEAP_VARIANT_KEY)UINT32_MAX) | (uint32_t)(i - 1);
+    HEAP_VARIANT_FN(Place)(heap, i, node);
+  }
+  heap->sequence = (uint32_t)heap->size;
+}
+#endif
+
+#ifdef HEAP_VARIANT_KEY_BITS
+#define HEAP_VARIANT_KEY_MAX (((int64_t)1 << HEAP_VARIANT_KEY_BITS) - 1)
+
+/* Moves the base of 'heap' to the smallest of its priorities and 'priority',
+ * so that 'priority' gets a key. Every key shifts by the same amount, so no
+ * node moves. Takes O(n), once the priorities inserted have drifted by up to
+ * 2^KEY_BITS less the span of the heap. Keys pushed past HEAP_VARIANT_KEY_MAX
+ * (if the priorities span more) saturate there.
+ */
+static void HEAP_VARIANT_FN(Rebase)(HEAP_VARIANT_TYPE* heap,
+                                    HEAP_VARIANT_PRIORITY priority) {
+  // Not just arr[1]: Build rebases before the nodes are in heap order
+  int64_t newBase = priority;
+  for (int64_t i = 1; i <= heap->size; i++)
+    if (heap->base + (int64_t)heap->arr[i].key < newBase)
+      newBase = heap->base + (int64_t)heap->arr[i].key;
+
+  int64_t shift = heap->base - newBase;
+  for (int64_t i = 1; i <= heap->size; i++) {
+    int64_t key = (int64_t)heap->arr[i].key + shift;
+    if (key > HEAP_VARIANT_KEY_MAX) key = HEAP_VARIANT_KEY_MAX;
+    heap->arr[i].key = (HEAP_VARIANT_KEY)key;
+  }
+  heap->base = (HEAP_VARIANT_PRIORITY)newBase;
+}
+#endif
+
+/* Returns the key for a node given priority 'priority' in 'heap' now: the
+ * encoded priority and, for a stable variant, a sequence number that orders it
+ * after every node already in 'heap'. Renumbers the nodes of a stable variant
+ * if its sequence numbers run out. With KEY_BITS, the key is instead the
+ * offset of 'priority' from the base, which is moved first if need be, and
+ * saturates at HEAP_VARIANT_KEY_MAX.
+ */
+static inline HEAP_VARIANT_KEY HEAP_VARIANT_FN(Key)(
+    HEAP_VARIANT_TYPE* heap, HEAP_VARIANT_PRIORITY priority) {
+#ifdef HEAP_VARIANT_STABLE
+  if (heap->sequence == UINT32_MAX) HEAP_VARIANT_FN(Renumber)(heap);
+  return HEAP_VARIANT_ENCODE(priority) | heap->sequence++;
+#elif defined(HEAP_VARIANT_KEY_BITS)
+  int64_t offset = (int64_t)priority - heap->base;
+  if (offset < 0 || offset > HEAP_VARIANT_KEY_MAX) {
+    HEAP_VARIANT_FN(Rebase)(heap, priority);
+    offset = (int64_t)priority - heap->base;
+  }
+  // Still too far above the minimum: rather than wrap around, sort it last
+  if (offset > HEAP_VARIANT_KEY_MAX) offset = HEAP_VARIANT_KEY_MAX;
+  return (HEAP_VARIANT_KEY)offset;
+#else
+  (void)heap;
+  return HEAP_VARIANT_ENCODE(priority);
+#endif
+}
+
+/* Moves 'node' up from the hole at index 'nodeIndex' of 'heap' until its
+ * parent's key is no larger, and places it there.
+ */
+static void HEAP_VARIANT_FN(SiftUp)(HEAP_VARIANT_TYPE* heap, int64_t nodeIndex,
+                                    HEAP_VARIANT_ENTRY node) {
+  while (nodeIndex > 1 && node.key < heap->arr[nodeIndex / 2].key) {
+    HEAP_VARIANT_FN(Place)(heap, nodeIndex, heap->arr[nodeIndex / 2]);
+    nodeIndex /= 2;
+  }
+  HEAP_VARIANT_FN(Place)(heap, nodeIndex, node);
+}
+
+/* Moves 'node' down from the hole at index 'nodeIndex' of 'heap' until no
+ * child has a smaller key, and places it there.
+ */
+static void HEAP_VARIANT_FN(SiftDown)(HEAP_VARIANT_TYPE* heap,
+                                      int64_t nodeIndex,
+                                      HEAP_VARIANT_ENTRY node) {
+  int64_t size = heap->size;
+  for (int64_t child = 2 * nodeIndex; child <= size; child = 2 * nodeIndex) {
+    // The right child on ties, as MinHeap's bubbleDown takes it
+    if (child < size && heap->arr[child + 1].key <= heap->arr[child].key)
+      child++;
+    if (node.key <= heap->arr[child].key) break;
+    HEAP_VARIANT_FN(Place)(heap, nodeIndex, heap->arr[child]);
+    nodeIndex = child;
+  }
+  HEAP_VARIANT_FN(Place)(heap, nodeIndex, node);
+}
+
+/* Returns the number of nodes in 'heap'.
+ */
+HEAP_VARIANT_INDEX HEAP_VARIANT_FN(NumNodes)(HEAP_VARIANT_TYPE* heap) {
+  return heap->size;
+}
+
+/* Returns the node with minimum priority in 'heap'.
+ * Precondition: heap is non-empty
+ */
+HEAP_VARIANT_NODE HEAP_VARIANT_FN(GetMin)(HEAP_VARIANT_TYPE* heap) {
+  return HEAP_VARIANT_FN(Decode)(heap, heap->arr[1]);
+}
+
+/* Removes and returns the node with minimum priority in 'heap'.
+ * Precondition: heap is non-empty
+ */
+HEAP_VARIANT_NODE HEAP_VARIANT_FN(ExtractMin)(HEAP_VARIANT_TYPE* heap) {
+  HEAP_VARIANT_ENTRY min = heap->arr[1];
+  HEAP_VARIANT_ENTRY last = heap->arr[heap->size--];
+  heap->indexMap[min.id] = 0;
+  if (heap->size > 0) HEAP_VARIANT_FN(SiftDown)(heap, 1, last);
+  return HEAP_VARIANT_FN(Decode)(heap, min);
+}
+
+/* Inserts a new node with priority 'priority' and ID 'id' into 'heap'.
+ * Precondition: 'id' is unique within this heap
+ *               0 <= 'id' < heap->capacity
+ *               heap->size < heap->capacity
+ */
+void HEAP_VARIANT_FN(Insert)(HEAP_VARIANT_TYPE* heap,
+                             HEAP_VARIANT_PRIORITY priority,
+                             HEAP_VARIANT_INDEX id) {
+  HEAP_VARIANT_ENTRY node = {HEAP_VARIANT_FN(Key)(heap, priority), id};
+  HEAP_VARIANT_FN(SiftUp)(heap, ++heap->size, node);
+}
+
+/* Replaces the contents of 'heap' with the 'n' nodes whose priorities are
+ * 'priorities' and whose IDs are 0..n-1, heapifying them bottom-up.
+ * Precondition: 0 <= n <= heap->capacity
+ */
+void HEAP_VARIANT_FN(Build)(HEAP_VARIANT_TYPE* heap,
+                            HEAP_VARIANT_PRIORITY* priorities,
+                            HEAP_VARIANT_INDEX n) {
+  for (int64_t i = 1; i <= heap->size; i++) heap->indexMap[heap->arr[i].id] = 0;
+  heap->size = 0;
+  for (int64_t i = 1; i <= n; i++) {
+    HEAP_VARIANT_ENTRY node = {HEAP_VARIANT_FN(Key)(heap, priorities[i - 1]),
+                               (HEAP_VARIANT_INDEX)(i - 1)};
+    HEAP_VARIANT_FN(Place)(heap, i, node);
+    heap->size = (HEAP_VARIANT_INDEX)i;
+  }
+  for (int64_t i = n / 2; i >= 1; i--)
+    HEAP_VARIANT_FN(SiftDown)(heap, i, heap->arr[i]);
+}
+
+/* Returns priority of the node with ID 'id' in 'heap'.
+ * Precondition: 'id' is a valid node ID in 'heap'.
+ */
+HEAP_VARIANT_PRIORITY HEAP_VARIANT_FN(GetPriority)(HEAP_VARIANT_TYPE* heap,
+                                                   HEAP_VARIANT_INDEX id) {
+  return HEAP_VARIANT_FN(PriorityOf)(heap, heap->arr[heap->indexMap[id]].key);
+}
+
+/* Returns True if 'heap' holds a node with ID 'id', and False otherwise.
+ */
+bool HEAP_VARIANT_FN(HoldsId)(HEAP_VARIANT_TYPE* heap,
+                              HEAP_VARIANT_INDEX id) {
+  // as unsigned, a negative 'id' is out of range too
+  return (uint64_t)id < (uint64_t)heap->capacity && heap->indexMap[id] != 0;
+}
+
+/* Sets priority of node with ID 'id' in 'heap' to 'newPriority', if such a
+ * node exists in 'heap' and its priority is larger than 'newPriority', and
+ * returns True. Has no effect and returns False, otherwise.
+ */
+bool HEAP_VARIANT_FN(DecreasePriority)(HEAP_VARIANT_TYPE* heap,
+                                       HEAP_VARIANT_INDEX id,
+                                       HEAP_VARIANT_PRIORITY newPriority) {
+  // as unsigned, a negative 'id' is out of range too
+  if ((uint64_t)id >= (uint64_t)heap->capacity || heap->indexMap[id] == 0)
+    return false;
+  // Key first: renumbering may move nodes. A stable variant's new key sorts
+  // after the old one if the priority is unchanged
+  HEAP_VARIANT_KEY newKey = HEAP_VARIANT_FN(Key)(heap, newPriority);
+  HEAP_VARIANT_ENTRY node = heap->arr[heap->indexMap[id]];
+  if (node.key <= newKey) return false;
+
+  node.key = newKey;
+  HEAP_VARIANT_FN(SiftUp)(heap, heap->indexMap[id], node);
+  return true;
+}
+
+/* Returns a newly created empty heap with capacity 'capacity', or NULL if
+ * 'capacity' is out of range or memory runs out.
+ */
+HEAP_VARIANT_TYPE* HEAP_VARIANT_PASTE(new, HEAP_VARIANT_TYPE)(int64_t capacity) {
+  if (capacity < 0 || capacity > HEAP_VARIANT_MAX_CAPACITY) return NULL;
+
+  HEAP_VARIANT_TYPE* new = malloc(sizeof(HEAP_VARIANT_TYPE));
+  if (new == NULL) return NULL;
+  new->size = 0;
+  new->capacity = (HEAP_VARIANT_INDEX)capacity;
+#ifdef HEAP_VARIANT_STABLE
+  new->sequence = 0;
+#endif
+#ifdef HEAP_VARIANT_KEY_BITS
+  new->base = 0;
+#endif
+  // size_t arithmetic throughout, so capacity + 1 cannot overflow
+  new->arr = malloc(sizeof(HEAP_VARIANT_ENTRY) * ((size_t)capacity + 1));
+  new->indexMap = calloc((size_t)capacity, sizeof(HEAP_VARIANT_INDEX));
+  if (new->arr == NULL || (new->indexMap == NULL && capacity > 0)) {
+    HEAP_VARIANT_PASTE(delete, HEAP_VARIANT_TYPE)(new);
+    return NULL;
+  }
+  return new;
+}
+
+/* Frees all memory allocated for 'heap'.
+ */
+void HEAP_VARIANT_PASTE(delete, HEAP_VARIANT_TYPE)(HEAP_VARIANT_TYPE* heap) {
+  free(heap->arr);
+  free(heap->indexMap);
+  free(heap);
+}
+
+#endif
+
+#undef HEAP_VARIANT_TYPE
+#undef HEAP_VARIANT_NODE
+#undef HEAP_VARIANT_PREFIX
+#undef HEAP_VARIANT_INDEX
+#undef HEAP_VARIANT_MAX_CAPACITY
+#undef HEAP_VARIANT_PRIORITY
+#undef HEAP_VARIANT_KEY
+#undef HEAP_VARIANT_ENCODE
+#undef HEAP_VARIANT_DECODE
+#undef HEAP_VARIANT_STABLE
+#undef HEAP_VARIANT_KEY_BITS
+#undef HEAP_VARIANT_KEY_MAX
+#undef HEAP_VARIANT_ENTRY
@@ -0,0 +1,7 @@
+/*
+ * The variants of our Priority Queue declared in minheap_variants.h, each
+ * defined by instantiating minheap_variant.h.
+ */
+
+#define HEAP_VARIANT_IMPLEMENTATION
+#include "minheap_variants.h"
@@ -0,0 +1,149 @@
+/*
+ * Header file for the variants of our Priority Queue with other index, ID or
+ * priority types than MinHeap's int, chosen when the heap is created:
+ *
+ *   MinHeap16      uint16_t indices: capacity up to 65535, 6-byte nodes and a
+ *                  2-byte index map, so heaps of a few thousand nodes fit in L1
+ *   MinHeap64      int64_t indices: capacity beyond 2^31 nodes
+ *   MinHeapFloat   float priorities
+ *   MinHeapDouble  double priorities
+ *   MinHeapInt64   int64_t priorities
+ *   MinHeapStable  int priorities; nodes of equal priority leave in the order
+ *                  they were inserted (or last had their priority decreased)
+ *   MinHeapCompact    int priorities kept as 24-bit offsets from a moving
+ *                     base, uint16_t IDs: 5-byte nodes, 2-byte index map
+ *   MinHeapCompact32  the same with int32_t IDs: 7-byte nodes, 4-byte index
+ *                     map. Both need the priorities in the heap at any one
+ *                     time to span less than 2^24 (e.g. timer deadlines);
+ *                     one further above the minimum saturates to 2^24 - 1
+ *                     above it
+ *
+ * Floating-point priorities are stored as unsigned integer keys (see
+ * floatToKey), so the sift loops only ever compare integers. Keys follow the
+ * IEEE 754 totalOrder: -NaN < -inf < ... < -0.0 < +0.0 < ... < +inf < +NaN.
+ * So a NaN is never unordered: it sorts by its sign bit, after +inf (like
+ * NAN from math.h) or before -inf (like 0.0 / 0.0 computed on x86). Every
+ * priority, NaN payloads and -0.0 included, round-trips bit for bit.
+ *
+ * See minheap_variant.h for the operations each one provides.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef __MinHeap_variants_header
+#define __MinHeap_variants_header
+
+/* Returns the key of float 'priority': its bits with the sign bit flipped if
+ * positive, or every bit flipped if negative, so that keys compare as
+ * unsigned integers in the order of their priorities.
+ */
+static inline uint32_t floatToKey(float priority) {
+  uint32_t bits;
+  memcpy(&bits, &priority, sizeof(bits));
+  return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+/* Returns the float whose key (see floatToKey) is 'key'.
+ */
+static inline float keyToFloat(uint32_t key) {
+  uint32_t bits = key & 0x80000000u ? key & 0x7fffffffu : ~key;
+  float priority;
+  memcpy(&priority, &bits, sizeof(priority));
+  return priority;
+}
+
+/* Same as floatToKey, for doubles.
+ */
+static inline uint64_t doubleToKey(double priority) {
+  uint64_t bits;
+  memcpy(&bits, &priority, sizeof(bits));
+  return bits >> 63 ? ~bits : bits | (1ULL << 63);
+}
+
+/* Returns the double whose key (see doubleToKey) is 'key'.
+ */
+static inline double keyToDouble(uint64_t key) {
+  uint64_t bits = key >> 63 ? key & ~(1ULL << 63) : ~key;
+  double priority;
+  memcpy(&priority, &bits, sizeof(priority));
+  return priority;
+}
+
+#define HEAP_VARIANT_TYPE MinHeap16
+#define HEAP_VARIANT_NODE HeapNode16
+#define HEAP_VARIANT_PREFIX minHeap16
+#define HEAP_VARIANT_INDEX uint16_t
+#define HEAP_VARIANT_MAX_CAPACITY UINT16_MAX  // index 0 is never used
+#include "minheap_variant.h"
+
+#define HEAP_VARIANT_TYPE MinHeap64
+#define HEAP_VARIANT_NODE HeapNode64
+#define HEAP_VARIANT_PREFIX minHeap64
+#define HEAP_VARIANT_INDEX int64_t
+#define HEAP_VARIANT_MAX_CAPACITY (INT64_MAX / 16)
+#include "minheap_variant.h"
+
+#define HEAP_VARIANT_TYPE MinHeapFloat
+#define HEAP_VARIANT_NODE HeapNodeFloat
+#define HEAP_VARIANT_PREFIX minHeapFloat
+#define HEAP_VARIANT_INDEX int32_t
+#define HEAP_VARIANT_MAX_CAPACITY INT32_MAX
+#define HEAP_VARIANT_PRIORITY float
+#define HEAP_VARIANT_KEY uint32_t
+#define HEAP_VARIANT_ENCODE(priority) floatToKey(priority)
+#define HEAP_VARIANT_DECODE(key) keyToFloat(key)
+#include "minheap_variant.h"
+
+#define HEAP_VARIANT_TYPE MinHeapDouble
+#define HEAP_VARIANT_NODE HeapNodeDouble
+#define HEAP_VARIANT_PREFIX minHeapDouble
+#define HEAP_VARIANT_INDEX int32_t
+#define HEAP_VARIANT_MAX_CAPACITY INT32_MAX
+#define HEAP_VARIANT_PRIORITY double
+#define HEAP_VARIANT_KEY uint64_t
+#define HEAP_VARIANT_ENCODE(priority) doubleToKey(priority)
+#define HEAP_VARIANT_DECODE(key) keyToDouble(key)
+#include "minheap_variant.h"
+
+#define HEAP_VARIANT_TYPE MinHeapInt64
+#define HEAP_VARIANT_NODE HeapNodeInt64
+#define HEAP_VARIANT_PREFIX minHeapInt64
+#define HEAP_VARIANT_INDEX int32_t
+#define HEAP_VARIANT_MAX_CAPACITY INT32_MAX
+#define HEAP_VARIANT_PRIORITY int64_t
+#include "minheap_variant.h"
+
+// The priority, offset to unsigned, in the high half of the key; the
+// template keeps the insertion sequence number in the low half
+#define HEAP_VARIANT_TYPE MinHeapStable
+#define HEAP_VARIANT_NODE HeapNodeStable
+#define HEAP_VARIANT_PREFIX minHeapStable
+#define HEAP_VARIANT_INDEX int32_t
+#define HEAP_VARIANT_MAX_CAPACITY INT32_MAX
+#define HEAP_VARIANT_KEY uint64_t
+#define HEAP_VARIANT_ENCODE(priority) \
+  ((uint64_t)((uint32_t)(priority) ^ 0x80000000u) << 32)
+#define HEAP_VARIANT_DECODE(key) ((int)((uint32_t)((key) >> 32) ^ 0x80000000u))
+#define HEAP_VARIANT_STABLE
+#include "minheap_variant.h"
+
+#define HEAP_VARIANT_TYPE MinHeapCompact
+#define HEAP_VARIANT_NODE HeapNodeCompact
+#define HEAP_VARIANT_PREFIX minHeapCompact
+#define HEAP_VARIANT_INDEX uint16_t
+#define HEAP_VARIANT_MAX_CAPACITY UINT16_MAX
+#define HEAP_VARIANT_KEY uint32_t
+#define HEAP_VARIANT_KEY_BITS 24
+#include "minheap_variant.h"
+
+#define HEAP_VARIANT_TYPE MinHeapCompact32
+#define HEAP_VARIANT_NODE HeapNodeCompact32
+#define HEAP_VARIANT_PREFIX minHeapCompact32
+#define HEAP_VARIANT_INDEX int32_t
+#define HEAP_VARIANT_MAX_CAPACITY INT32_MAX
+#define HEAP_VARIANT_KEY uint32_t
+#define HEAP_VARIANT_KEY_BITS 24
+#include "minheap_variant.h"
+
+#endif
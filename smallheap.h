@@ -0,0 +1,146 @@
+/*
+ * Header file for our fixed-capacity Priority Queue, for small heaps in inner
+ * loops (k-nearest-neighbours, k-way merges, ...).
+ *
+ * A SmallHeap stores its nodes and index map inline, so it can live on the
+ * stack or inside another struct, and never calls malloc. Its capacity is
+ * fixed at compile time by SMALL_HEAP_CAPACITY (default 64, at most 64),
+ * which bounds the depth of the heap so the compiler can fully unroll the
+ * sift loops. Define SMALL_HEAP_CAPACITY before including this file to change
+ * it; every function is static inline, so translation units may differ.
+ *
+ * The operations mirror those of MinHeap, with the same preconditions.
+ */
+
+#include <stdint.h>
+
+#include "minheap.h"
+
+#ifndef __SmallHeap_header
+#define __SmallHeap_header
+
+#ifndef SMALL_HEAP_CAPACITY
+#define SMALL_HEAP_CAPACITY 64
+#endif
+
+_Static_assert(SMALL_HEAP_CAPACITY > 0 && SMALL_HEAP_CAPACITY <= 64,
+               "SmallHeap indices must fit its uint8_t index map");
+
+// The number of levels of a full SmallHeap: no sift moves more than this
+#define SMALL_HEAP_LEVELS                   \
+  (SMALL_HEAP_CAPACITY >= 64   ? 7          \
+   : SMALL_HEAP_CAPACITY >= 32 ? 6          \
+   : SMALL_HEAP_CAPACITY >= 16 ? 5          \
+   : SMALL_HEAP_CAPACITY >= 8  ? 4          \
+   : SMALL_HEAP_CAPACITY >= 4  ? 3          \
+   : SMALL_HEAP_CAPACITY >= 2  ? 2 : 1)
+
+typedef struct small_heap {
+  int size;                               // 0 <= size <= SMALL_HEAP_CAPACITY
+  HeapNode arr[SMALL_HEAP_CAPACITY + 1];  // 1-based, like MinHeap.arr
+  uint8_t indexMap[SMALL_HEAP_CAPACITY];  // indexMap[id] is the index of the
+                                          // node with ID id; 0 if absent
+} SmallHeap;
+
+/* Places 'node' at index 'nodeIndex' of 'heap', keeping indexMap in step.
+ */
+static inline void smallHeapPlace(SmallHeap* heap, int nodeIndex,
+                                  HeapNode node) {
+  heap->arr[nodeIndex] = node;
+  heap->indexMap[node.id] = (uint8_t)nodeIndex;
+}
+
+/* Moves 'node' up from the hole at index 'nodeIndex' of 'heap' until its
+ * parent's priority is no larger, and places it there.
+ */
+static inline void smallHeapSiftUp(SmallHeap* heap, int nodeIndex,
+                                   HeapNode node) {
+#pragma GCC unroll 8
+  for (int level = 1; level < SMALL_HEAP_LEVELS; level++) {
+    if (nodeIndex == 1 || heap->arr[nodeIndex / 2].priority <= node.priority)
+      break;
+    smallHeapPlace(heap, nodeIndex, heap->arr[nodeIndex / 2]);
+    nodeIndex /= 2;
+  }
+  smallHeapPlace(heap, nodeIndex, node);
+}
+
+/* Moves 'node' down from the hole at index 'nodeIndex' of 'heap' until no
+ * child has a smaller priority, and places it there.
+ */
+static inline void smallHeapSiftDown(SmallHeap* heap, int nodeIndex,
+                                     HeapNode node) {
+#pragma GCC unroll 8
+  for (int level = 1; level < SMALL_HEAP_LEVELS; level++) {
+    int child = 2 * nodeIndex;
+    if (child > heap->size) break;
+    // child < SMALL_HEAP_CAPACITY always holds; it lets the compiler see that
+    if (child < heap->size && child < SMALL_HEAP_CAPACITY &&
+        heap->arr[child + 1].priority < heap->arr[child].priority)
+      child++;
+    if (node.priority <= heap->arr[child].priority) break;
+    smallHeapPlace(heap, nodeIndex, heap->arr[child]);
+    nodeIndex = child;
+  }
+  smallHeapPlace(heap, nodeIndex, node);
+}
+
+/* Makes 'heap' an empty SmallHeap.
+ */
+static inline void smallHeapInit(SmallHeap* heap) {
+  heap->size = 0;
+  for (int id = 0; id < SMALL_HEAP_CAPACITY; id++) heap->indexMap[id] = 0;
+}
+
+/* Returns the node with minimum priority in 'heap'.
+ * Precondition: heap is non-empty
+ */
+static inline HeapNode smallHeapGetMin(SmallHeap* heap) {
+  return heap->arr[1];
+}
+
+/* Removes and returns the node with minimum priority in 'heap'.
+ * Precondition: heap is non-empty
+ */
+static inline HeapNode smallHeapExtractMin(SmallHeap* heap) {
+  HeapNode min = heap->arr[1];
+  HeapNode last = heap->arr[heap->size--];
+  heap->indexMap[min.id] = 0;
+  if (heap->size > 0) smallHeapSiftDown(heap, 1, last);
+  return min;
+}
+
+/* Inserts a new node with priority 'priority' and ID 'id' into 'heap'.
+ * Precondition: 'id' is unique within this heap
+ *               0 <= 'id' < SMALL_HEAP_CAPACITY
+ *               heap->size < SMALL_HEAP_CAPACITY
+ */
+static inline void smallHeapInsert(SmallHeap* heap, int priority, int id) {
+  HeapNode node = {priority, id};
+  smallHeapSiftUp(heap, ++heap->size, node);
+}
+
+/* Returns priority of the node with ID 'id' in 'heap'.
+ * Precondition: 'id' is a valid node ID in 'heap'.
+ */
+static inline int smallHeapGetPriority(SmallHeap* heap, int id) {
+  return heap->arr[heap->indexMap[id]].priority;
+}
+
+/* Sets priority of node with ID 'id' in 'heap' to 'newPriority', if such a
+ * node exists in 'heap' and its priority is larger than 'newPriority', and
+ * returns True. Has no effect and returns False, otherwise.
+ */
+static inline bool smallHeapDecreasePriority(SmallHeap* heap, int id,
+                                             int newPriority) {
+  if (id < 0 || id >= SMALL_HEAP_CAPACITY || heap->indexMap[id] == 0)
+    return false;
+  HeapNode node = heap->arr[heap->indexMap[id]];
+  if (node.priority <= newPriority) return false;
+
+  node.priority = newPriority;
+  smallHeapSiftUp(heap, heap->indexMap[id], node);
+  return true;
+}
+
+#endif